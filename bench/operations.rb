@@ -0,0 +1,105 @@
+# frozen_string_literal: true
+
+# Iterations per second of every DBCFile operation on the spec resources,
+# printed as JSON so runs from different versions can be compared.
+#
+#   rake bench
+#   BENCH_TIME=3 BENCH_OUT=bench.json ruby -Ilib bench/operations.rb
+#
+# Each operation warms up, then runs in batches on the monotonic clock
+# until BENCH_TIME seconds (default 1) have passed. Mutating operations get
+# a fresh table per operation; delete_record removes rows from the middle.
+
+require 'fileutils'
+require 'json'
+require 'tmpdir'
+require 'wow_dbc'
+
+RESOURCES = File.expand_path('../spec/resources', __dir__)
+TIME = Float(ENV.fetch('BENCH_TIME', '1'))
+WARMUP = TIME / 5
+
+def now
+  Process.clock_gettime(Process::CLOCK_MONOTONIC)
+end
+
+# Runs the block with increasing iteration numbers until `seconds` pass, or
+# `limit` iterations. Returns [iterations, elapsed seconds].
+def run(seconds, limit)
+  iterations = 0
+  elapsed = 0.0
+  batch = 1
+  while elapsed < seconds && iterations < limit
+    batch = [batch, limit - iterations].min
+    start = now
+    batch.times { |k| yield iterations + k }
+    elapsed += now - start
+    iterations += batch
+    batch *= 2 if batch < 1 << 16
+  end
+  [iterations, elapsed]
+end
+
+def measure(file, operation, limit: Float::INFINITY, setup: nil, &block)
+  setup&.call
+  run(WARMUP, limit / 2, &block)
+  setup&.call
+  iterations, seconds = run(TIME, limit, &block)
+  { file: file, operation: operation, iterations: iterations, seconds: seconds.round(6),
+    ips: (iterations / seconds).round(1), ns_per_op: (seconds * 1e9 / iterations).round(1) }
+end
+
+results = []
+Dir.mktmpdir do |dir|
+  Dir[File.join(RESOURCES, '*.dbc')].sort.each do |path|
+    name = File.basename(path)
+    fields = WowDBC::Schema.infer(path)
+    key = fields.keys.first
+    number = fields.find { |field, type| type == :uint32 && field != key }&.first
+    string = fields.find { |_, type| type == :string }&.first
+    copy = File.join(dir, name)
+    FileUtils.cp(path, copy)
+
+    dbc = WowDBC::DBCFile.new(copy, fields).tap(&:read)
+    count = dbc.header[:record_count]
+    ids = Array.new(count) { |i| dbc.get_record(i)[key] }
+    names = string ? Array.new(count) { |i| dbc.get_record(i)[string] } : []
+    fresh = -> { dbc = WowDBC::DBCFile.new(copy, fields).tap(&:read) }
+    row = ->(i) { (i * 7919) % count }
+
+    results << measure(name, 'read') { WowDBC::DBCFile.new(path, fields).read }
+    results << measure(name, 'write', setup: fresh) { dbc.write }
+    results << measure(name, 'write_to', setup: fresh) { dbc.write_to(File.join(dir, 'out.dbc')) }
+    results << measure(name, 'get_record', setup: fresh) { |i| dbc.get_record(row.call(i)) }
+    results << measure(name, 'find_by_int', setup: fresh) { |i| dbc.find_by(key, ids[row.call(i)]) }
+    if string
+      results << measure(name, 'find_by_string', setup: fresh) { |i| dbc.find_by(string, names[row.call(i)]) }
+    end
+    results << measure(name, 'update_record_int', setup: fresh) { |i| dbc.update_record(row.call(i), number, i) }
+    if string
+      results << measure(name, 'update_record_string', setup: fresh) do |i|
+        dbc.update_record(row.call(i), string, "Bench #{i}")
+      end
+    end
+    results << measure(name, 'update_record_multi', setup: fresh) do |i|
+      dbc.update_record_multi(row.call(i), { number => i, key => ids[row.call(i)] })
+    end
+    results << measure(name, 'create_record', setup: fresh) { dbc.create_record }
+    results << measure(name, 'create_record_with_values', setup: fresh) do |i|
+      dbc.create_record_with_values(key => 10_000_000 + i, number => i)
+    end
+    results << measure(name, 'delete_record', limit: count / 2, setup: fresh) do
+      dbc.delete_record(dbc.header[:record_count] / 2)
+    end
+  end
+end
+
+report = JSON.pretty_generate(
+  version: WowDBC::VERSION, ruby: RUBY_VERSION, platform: RUBY_PLATFORM,
+  time: TIME, results: results
+)
+if ENV['BENCH_OUT']
+  File.write(ENV['BENCH_OUT'], report)
+else
+  puts report
+end
@@ -0,0 +1,59 @@
+# frozen_string_literal: true
+
+# Patch size and apply speed for typical edits to the spec resources.
+#
+#   rake bench:patch
+#   ruby -Ilib bench/patch.rb
+
+require 'benchmark'
+require 'tmpdir'
+require 'wow_dbc'
+
+RESOURCES = File.expand_path('../spec/resources', __dir__)
+RUNS = 10
+
+def edit(dbc, fields, fraction)
+  count = dbc.header[:record_count]
+  number = fields.find { |field, type| type == :uint32 && field != fields.keys.first }&.first
+  string = fields.find { |_, type| type == :string }&.first
+  edits = [(count * fraction).ceil, 1].max
+
+  edits.times do |k|
+    index = (k * 7919) % dbc.header[:record_count]
+    dbc.update_record(index, number, k) if number
+    dbc.update_record(index, string, "Edited #{k}") if string && k.even?
+  end
+  (edits / 4).times { |k| dbc.delete_record((k * 104_729) % dbc.header[:record_count]) }
+  (edits / 4).times { |k| dbc.create_record_with_values(fields.keys.first => 10_000_000 + k) }
+  edits
+end
+
+def measure
+  best = Float::INFINITY
+  RUNS.times { best = [best, Benchmark.realtime { yield }].min }
+  best
+end
+
+Dir.mktmpdir do |dir|
+  Dir[File.join(RESOURCES, '*.dbc')].sort.each do |base_path|
+    fields = WowDBC::Schema.infer(base_path)
+    name = File.basename(base_path)
+
+    [0.001, 0.01, 0.1].each do |fraction|
+      target_path = File.join(dir, name)
+      target = WowDBC::DBCFile.new(base_path, fields).tap(&:read)
+      edits = edit(target, fields, fraction)
+      target.write_to(target_path)
+
+      patch = nil
+      make = measure { patch = WowDBC.make_patch(base_path, target_path, fields: fields) }
+      read = measure { WowDBC::DBCFile.new(base_path, fields).read }
+      bases = Array.new(RUNS) { WowDBC::DBCFile.new(base_path, fields).tap(&:read) }
+      apply = measure { bases.pop.apply_patch!(patch) }
+
+      puts format('%-22s %6d edits  patch %9d bytes (%6.3f%% of %d)  make %7.2f ms  apply %6.2f ms  read %6.2f ms',
+                  name, edits, patch.bytesize, 100.0 * patch.bytesize / File.size(target_path),
+                  File.size(target_path), make * 1000, apply * 1000, read * 1000)
+    end
+  end
+end
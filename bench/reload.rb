@@ -0,0 +1,75 @@
+# frozen_string_literal: true
+
+# Load and free cycles of the hot-reload path on tables from
+# WowDBC::Synth, printed as JSON. Catalog#reload reads a fresh table and
+# drops the old one, so what matters is the cost of a read plus the cost of
+# freeing what the previous read loaded.
+#
+#   rake bench:reload
+#   BENCH_ROWS=10000,1000000 BENCH_OUT=reload.json ruby -Ilib bench/reload.rb
+#
+# `reload` reads into the same table again, which frees the previous load
+# at once. `load` and `free` split a cycle: tables are read with GC off,
+# then dropped and collected, less the time of an empty collection.
+
+require 'benchmark'
+require 'json'
+require 'tmpdir'
+require 'wow_dbc'
+
+ROWS = ENV.fetch('BENCH_ROWS', '10000,100000,1000000').split(',').map { |rows| Integer(rows) }
+RUNS = 5
+TABLES = 4
+SCHEMA = {
+  id: :uint32, model_name: :string, model_texture: :string, inventory_icon: :string,
+  geoset_group_1: :uint32, geoset_group_2: :uint32, flags: :uint32, spell_visual_id: :uint32,
+  item_visual: :int32, particle_scale: :float
+}.freeze
+
+def best
+  Array.new(RUNS) { Benchmark.realtime { yield } }.min
+end
+
+# Seconds to collect `tables` once nothing else refers to them
+def collect(tables)
+  tables.clear
+  GC.enable
+  Benchmark.realtime { GC.start }
+end
+
+results = []
+Dir.mktmpdir do |dir|
+  ROWS.each do |rows|
+    path = File.join(dir, "synth_#{rows}.dbc")
+    WowDBC::Synth.generate(path, rows: rows, schema: SCHEMA)
+    result = lambda do |operation, seconds|
+      results << { rows: rows, operation: operation, ns_per_op: (seconds * 1e9).round(1),
+                   ns_per_row: (seconds * 1e9 / rows).round(2) }
+    end
+
+    table = WowDBC::DBCFile.new(path, SCHEMA).tap(&:read)
+    result.call('reload', best { table.read })
+
+    GC.start
+    baseline = best { GC.start }
+    loads = []
+    frees = []
+    RUNS.times do
+      GC.start
+      GC.disable
+      tables = Array.new(TABLES) { WowDBC::DBCFile.new(path, SCHEMA) }
+      loads << Benchmark.realtime { tables.each(&:read) } / tables.size
+      frees << ([collect(tables) - baseline, 0].max / TABLES)
+    end
+    result.call('load', loads.min)
+    result.call('free', frees.min)
+    File.delete(path)
+  end
+end
+
+report = JSON.pretty_generate(version: WowDBC::VERSION, ruby: RUBY_VERSION, platform: RUBY_PLATFORM, results: results)
+if ENV['BENCH_OUT']
+  File.write(ENV['BENCH_OUT'], report)
+else
+  puts report
+end
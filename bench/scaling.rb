@@ -0,0 +1,64 @@
+# frozen_string_literal: true
+
+# How DBCFile operations scale with table size, on tables from
+# WowDBC::Synth. Prints JSON with the time per operation at each row
+# count, for charting complexity.
+#
+#   rake bench:scaling
+#   BENCH_ROWS=10000,1000000,10000000 BENCH_OUT=scaling.json ruby -Ilib bench/scaling.rb
+#
+# Single operations (read, write_to, find_by scans) report the best of
+# RUNS; per-row operations average over OPS calls on one table.
+
+require 'benchmark'
+require 'json'
+require 'tmpdir'
+require 'wow_dbc'
+
+ROWS = ENV.fetch('BENCH_ROWS', '10000,100000,1000000').split(',').map { |rows| Integer(rows) }
+RUNS = 3
+OPS = 200
+SCHEMA = {
+  id: :uint32, model_name: :string, model_texture: :string, inventory_icon: :string,
+  geoset_group_1: :uint32, geoset_group_2: :uint32, flags: :uint32, spell_visual_id: :uint32,
+  item_visual: :int32, particle_scale: :float
+}.freeze
+
+def best
+  Array.new(RUNS) { Benchmark.realtime { yield } }.min
+end
+
+results = []
+Dir.mktmpdir do |dir|
+  ROWS.each do |rows|
+    path = File.join(dir, "synth_#{rows}.dbc")
+    result = ->(operation, seconds, count = 1) do
+      results << { rows: rows, operation: operation, ns_per_op: (seconds * 1e9 / count).round(1) }
+    end
+
+    result.call('generate', Benchmark.realtime { WowDBC::Synth.generate(path, rows: rows, schema: SCHEMA) })
+    result.call('read', best { WowDBC::DBCFile.new(path, SCHEMA).read })
+    dbc = WowDBC::DBCFile.new(path, SCHEMA).tap(&:read)
+    result.call('write_to', best { dbc.write_to(File.join(dir, 'out.dbc')) })
+    last_id = dbc.get_record(rows - 1)[:id]
+    result.call('find_by_scan', best { dbc.find_by(:id, last_id) })
+    result.call('build_index', Benchmark.realtime { dbc.build_index(:id) })
+    result.call('find_by_indexed', Benchmark.realtime { OPS.times { |i| dbc.find_by(:id, last_id - i) } }, OPS)
+    result.call('get_record', Benchmark.realtime { OPS.times { |i| dbc.get_record((i * 7919) % rows) } }, OPS)
+    result.call('update_record', Benchmark.realtime { OPS.times { |i| dbc.update_record(i, :flags, i) } }, OPS)
+    result.call('create_record', Benchmark.realtime { OPS.times { dbc.create_record } }, OPS)
+    result.call('create_record_with_values',
+                Benchmark.realtime { OPS.times { |i| dbc.create_record_with_values(id: 1 << 31 | i, flags: i) } }, OPS)
+    ops = [OPS, rows / 2].min
+    result.call('delete_record',
+                Benchmark.realtime { ops.times { dbc.delete_record(dbc.header[:record_count] / 2) } }, ops)
+    File.delete(path)
+  end
+end
+
+report = JSON.pretty_generate(version: WowDBC::VERSION, ruby: RUBY_VERSION, platform: RUBY_PLATFORM, results: results)
+if ENV['BENCH_OUT']
+  File.write(ENV['BENCH_OUT'], report)
+else
+  puts report
+end
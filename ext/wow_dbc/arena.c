@@ -0,0 +1,145 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+#include <sys/mman.h>
+
+// Per-table arena for the memory DBCFile#read loads in bulk: the records
+// array, every row and the string block. The load knows its size up
+// front, so it is a single chunk and freeing the table is O(chunks) rather
+// than a free per row. Chunks of 2 MiB and up are mapped on a 2 MiB
+// boundary and marked for transparent huge pages, smaller ones come from
+// malloc.
+//
+// Nothing in an arena is freed on its own. Rows deleted or replaced stay
+// until the arena goes, which bounds the waste by the size of the load;
+// rows created later come from the heap as before, so churn doesn't grow
+// the arena. Snapshot bases and undo logs holding rows from the arena keep
+// a reference to it, counted atomically like the bases themselves.
+
+#define ARENA_ALIGN 16
+#define ARENA_MIN_CHUNK ((size_t)64 << 10)
+#define ARENA_HUGE_PAGE ((size_t)2 << 20)
+#define CHUNK_HEADER ((sizeof(DBCArenaChunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct DBCArenaChunk {
+    DBCArenaChunk *next;
+    size_t size;  // bytes allocated or mapped, header included
+    size_t used;  // offset of the free space, header included
+    int mapped;
+};
+
+// Maps `size` bytes, a multiple of ARENA_HUGE_PAGE, on a huge page boundary
+static void *arena_map(size_t size) {
+    size_t padded = size + ARENA_HUGE_PAGE;
+    char *addr = mmap(NULL, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) return NULL;
+    char *aligned = (char *)(((uintptr_t)addr + ARENA_HUGE_PAGE - 1) & ~(uintptr_t)(ARENA_HUGE_PAGE - 1));
+    if (aligned > addr) munmap(addr, (size_t)(aligned - addr));
+    munmap(aligned + size, (size_t)(addr + padded - (aligned + size)));
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+    return aligned;
+}
+
+static DBCArenaChunk *arena_chunk_new(size_t size) {
+    if (size > SIZE_MAX - CHUNK_HEADER - ARENA_HUGE_PAGE) return NULL;
+    size += CHUNK_HEADER;
+    if (size < ARENA_MIN_CHUNK) size = ARENA_MIN_CHUNK;
+
+    DBCArenaChunk *chunk = NULL;
+    int mapped = 0;
+    if (size >= ARENA_HUGE_PAGE) {
+        size = (size + ARENA_HUGE_PAGE - 1) & ~(ARENA_HUGE_PAGE - 1);
+        chunk = arena_map(size);
+        mapped = chunk != NULL;
+    }
+    if (!chunk) chunk = malloc(size);
+    if (!chunk) return NULL;
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = CHUNK_HEADER;
+    chunk->mapped = mapped;
+    return chunk;
+}
+
+static void arena_chunk_free(DBCArenaChunk *chunk) {
+    if (chunk->mapped) {
+        munmap(chunk, chunk->size);
+    } else {
+        free(chunk);
+    }
+}
+
+// An arena with room for `size` bytes in its first chunk, holding one
+// reference. NULL when out of memory. Doesn't need the GVL.
+DBCArena *dbc_arena_new(size_t size) {
+    DBCArena *arena = malloc(sizeof(DBCArena));
+    if (!arena) return NULL;
+    arena->chunks = arena_chunk_new(size);
+    if (!arena->chunks) {
+        free(arena);
+        return NULL;
+    }
+    arena->refs = 1;
+    arena->size = arena->chunks->size;
+    return arena;
+}
+
+// `size` bytes aligned for any field type, or NULL when out of memory.
+// Doesn't need the GVL.
+void *dbc_arena_alloc(DBCArena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    DBCArenaChunk *chunk = arena->chunks;
+    if (chunk->size - chunk->used < size) {
+        // Chunks double so a growing arena stays at a few of them
+        size_t want = arena->size > size ? arena->size : size;
+        chunk = arena_chunk_new(want);
+        if (!chunk) return NULL;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->size += chunk->size;
+    }
+    void *ptr = (char *)chunk + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+int dbc_arena_owns(const DBCArena *arena, const void *ptr) {
+    if (!arena) return 0;
+    for (const DBCArenaChunk *chunk = arena->chunks; chunk; chunk = chunk->next) {
+        const char *start = (const char *)chunk + CHUNK_HEADER;
+        if ((const char *)ptr >= start && (const char *)ptr < (const char *)chunk + chunk->used) return 1;
+    }
+    return 0;
+}
+
+DBCArena *dbc_arena_retain(DBCArena *arena) {
+    if (arena) __atomic_add_fetch(&arena->refs, 1, __ATOMIC_ACQ_REL);
+    return arena;
+}
+
+void dbc_arena_release(DBCArena *arena) {
+    if (!arena || __atomic_sub_fetch(&arena->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+    DBCArenaChunk *chunk = arena->chunks;
+    while (chunk) {
+        DBCArenaChunk *next = chunk->next;
+        arena_chunk_free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+// dbc_retire for memory that may be in `arena`, which frees it with the rest
+void dbc_arena_retire(const DBCArena *arena, void *ptr) {
+    if (!dbc_arena_owns(arena, ptr)) dbc_retire(ptr, NULL);
+}
+
+// dbc_grow for memory that may be in `arena`, which is copied to the heap
+void *dbc_arena_grow(const DBCArena *arena, void *ptr, size_t used, size_t size) {
+    if (!dbc_arena_owns(arena, ptr)) return dbc_grow(ptr, used, size);
+    void *copy = malloc(size ? size : 1);
+    if (!copy) rb_raise(rb_eNoMemError, "Could not grow table storage to %zu bytes", size);
+    memcpy(copy, ptr, used);
+    return copy;
+}
@@ -0,0 +1,1045 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// Arrow IPC file format (https://arrow.apache.org/docs/format/Columnar.html).
+// Integer and float columns are written as Int32/UInt32/Float32 arrays,
+// string columns as Int32-indexed dictionaries of Utf8 values. The flatbuffer
+// metadata is produced and parsed by the small helpers below so the
+// extension doesn't need the Arrow or flatbuffers libraries.
+
+#define ARROW_MAGIC "ARROW1"
+#define ARROW_MAGIC_SIZE 6
+#define ARROW_CONTINUATION 0xFFFFFFFFu
+#define ARROW_BATCH_ROWS 65536
+#define ARROW_METADATA_V5 4
+
+// flatbuffer union tags from Schema.fbs / Message.fbs
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOATING_POINT 3
+#define ARROW_TYPE_UTF8 5
+#define ARROW_PRECISION_HALF 0
+#define ARROW_PRECISION_SINGLE 1
+#define ARROW_PRECISION_DOUBLE 2
+#define ARROW_HEADER_SCHEMA 1
+#define ARROW_HEADER_DICTIONARY_BATCH 2
+#define ARROW_HEADER_RECORD_BATCH 3
+
+#define FB_MAX_FIELDS 8
+
+typedef struct {
+    int64_t offset;
+    int32_t metadata_length;
+    int32_t padding;
+    int64_t body_length;
+} ArrowBlock;
+
+typedef struct {
+    int64_t length;
+    int64_t null_count;
+} ArrowFieldNode;
+
+typedef struct {
+    int64_t offset;
+    int64_t length;
+} ArrowBuffer;
+
+// Minimal back-to-front flatbuffer builder, following the layout rules of
+// the reference implementation. Offsets are measured from the buffer end.
+typedef struct {
+    uint8_t *buf;
+    size_t capacity;
+    size_t size;
+    size_t minalign;
+    size_t vtable[FB_MAX_FIELDS];
+    int field_count;
+    size_t object_start;
+} FlatBuilder;
+
+// realloc, or malloc for NULL, raising NoMemoryError rather than
+// returning NULL. The block is left as it was when that happens.
+static void *arrow_realloc(void *ptr, size_t size) {
+    void *grown = realloc(ptr, size ? size : 1);
+    if (!grown) rb_raise(rb_eNoMemError, "Could not allocate %zu bytes for Arrow data", size);
+    return grown;
+}
+
+static void *arrow_calloc(size_t count, size_t size) {
+    void *ptr = arrow_realloc(NULL, count * size);
+    memset(ptr, 0, count * size);
+    return ptr;
+}
+
+static void fb_init(FlatBuilder *fb) {
+    memset(fb, 0, sizeof(FlatBuilder));
+    fb->buf = arrow_realloc(NULL, 1024);
+    fb->capacity = 1024;
+    fb->minalign = 1;
+}
+
+static void fb_free(FlatBuilder *fb) {
+    free(fb->buf);
+    fb->buf = NULL;
+}
+
+static void fb_reserve(FlatBuilder *fb, size_t len) {
+    if (fb->size + len <= fb->capacity) return;
+
+    size_t capacity = fb->capacity;
+    while (fb->size + len > capacity) capacity *= 2;
+    uint8_t *buf = arrow_realloc(NULL, capacity);
+    memcpy(buf + capacity - fb->size, fb->buf + fb->capacity - fb->size, fb->size);
+    free(fb->buf);
+    fb->buf = buf;
+    fb->capacity = capacity;
+}
+
+static void fb_push(FlatBuilder *fb, const void *data, size_t len) {
+    fb_reserve(fb, len);
+    fb->size += len;
+    memcpy(fb->buf + fb->capacity - fb->size, data, len);
+}
+
+static void fb_prep(FlatBuilder *fb, size_t align, size_t additional) {
+    if (align > fb->minalign) fb->minalign = align;
+    size_t pad = (~(fb->size + additional) + 1) & (align - 1);
+    static const uint8_t zeros[8] = {0};
+    fb_push(fb, zeros, pad);
+}
+
+static void fb_push_u32(FlatBuilder *fb, uint32_t v) {
+    fb_prep(fb, 4, 0);
+    fb_push(fb, &v, 4);
+}
+
+static void fb_add_u8(FlatBuilder *fb, int slot, uint8_t v) {
+    fb_push(fb, &v, 1);
+    fb->vtable[slot] = fb->size;
+}
+
+static void fb_add_i16(FlatBuilder *fb, int slot, int16_t v) {
+    fb_prep(fb, 2, 0);
+    fb_push(fb, &v, 2);
+    fb->vtable[slot] = fb->size;
+}
+
+static void fb_add_i32(FlatBuilder *fb, int slot, int32_t v) {
+    fb_prep(fb, 4, 0);
+    fb_push(fb, &v, 4);
+    fb->vtable[slot] = fb->size;
+}
+
+static void fb_add_i64(FlatBuilder *fb, int slot, int64_t v) {
+    fb_prep(fb, 8, 0);
+    fb_push(fb, &v, 8);
+    fb->vtable[slot] = fb->size;
+}
+
+static void fb_add_offset(FlatBuilder *fb, int slot, size_t off) {
+    fb_prep(fb, 4, 0);
+    fb_push_u32(fb, (uint32_t)(fb->size + 4 - off));
+    fb->vtable[slot] = fb->size;
+}
+
+static void fb_start_table(FlatBuilder *fb, int field_count) {
+    memset(fb->vtable, 0, sizeof(fb->vtable));
+    fb->field_count = field_count;
+    fb->object_start = fb->size;
+}
+
+static size_t fb_end_table(FlatBuilder *fb) {
+    fb_push_u32(fb, 0);
+    size_t object_offset = fb->size;
+
+    for (int i = fb->field_count - 1; i >= 0; i--) {
+        uint16_t off = fb->vtable[i] ? (uint16_t)(object_offset - fb->vtable[i]) : 0;
+        fb_push(fb, &off, 2);
+    }
+    uint16_t object_size = (uint16_t)(object_offset - fb->object_start);
+    uint16_t vtable_size = (uint16_t)((fb->field_count + 2) * 2);
+    fb_push(fb, &object_size, 2);
+    fb_push(fb, &vtable_size, 2);
+
+    int32_t soffset = (int32_t)(fb->size - object_offset);
+    memcpy(fb->buf + fb->capacity - object_offset, &soffset, 4);
+    return object_offset;
+}
+
+static size_t fb_create_string(FlatBuilder *fb, const char *s, size_t len) {
+    static const uint8_t nul = 0;
+    fb_prep(fb, 4, len + 1);
+    fb_push(fb, &nul, 1);
+    fb_push(fb, s, len);
+    fb_push_u32(fb, (uint32_t)len);
+    return fb->size;
+}
+
+static size_t fb_create_offset_vector(FlatBuilder *fb, const size_t *offsets, size_t count) {
+    fb_prep(fb, 4, count * 4);
+    for (size_t i = count; i > 0; i--) {
+        fb_push_u32(fb, (uint32_t)(fb->size + 4 - offsets[i - 1]));
+    }
+    fb_push_u32(fb, (uint32_t)count);
+    return fb->size;
+}
+
+static size_t fb_create_struct_vector(FlatBuilder *fb, const void *structs, size_t struct_size, size_t count) {
+    fb_prep(fb, 4, struct_size * count);
+    fb_prep(fb, 8, struct_size * count);
+    fb_push(fb, structs, struct_size * count);
+    fb_push_u32(fb, (uint32_t)count);
+    return fb->size;
+}
+
+static void fb_finish(FlatBuilder *fb, size_t root) {
+    fb_prep(fb, fb->minalign > 8 ? fb->minalign : 8, 4);
+    fb_push_u32(fb, (uint32_t)(fb->size + 4 - root));
+}
+
+static const uint8_t *fb_data(const FlatBuilder *fb) {
+    return fb->buf + fb->capacity - fb->size;
+}
+
+// Bounds-checked flatbuffer reader over the loaded file.
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+} FlatReader;
+
+static void fr_check(const FlatReader *fr, size_t pos, size_t n) {
+    if (pos > fr->len || n > fr->len - pos) {
+        rb_raise(rb_eIOError, "Malformed Arrow file");
+    }
+}
+
+static uint8_t fr_u8(const FlatReader *fr, size_t pos) {
+    fr_check(fr, pos, 1);
+    return fr->buf[pos];
+}
+
+static uint16_t fr_u16(const FlatReader *fr, size_t pos) {
+    uint16_t v;
+    fr_check(fr, pos, 2);
+    memcpy(&v, fr->buf + pos, 2);
+    return v;
+}
+
+static uint32_t fr_u32(const FlatReader *fr, size_t pos) {
+    uint32_t v;
+    fr_check(fr, pos, 4);
+    memcpy(&v, fr->buf + pos, 4);
+    return v;
+}
+
+static int64_t fr_i64(const FlatReader *fr, size_t pos) {
+    int64_t v;
+    fr_check(fr, pos, 8);
+    memcpy(&v, fr->buf + pos, 8);
+    return v;
+}
+
+// Position of a table field, or 0 when it is absent.
+static size_t fr_field(const FlatReader *fr, size_t table, int slot) {
+    size_t vtable = table - (size_t)(int32_t)fr_u32(fr, table);
+    uint16_t vtable_size = fr_u16(fr, vtable);
+    size_t entry = 4 + 2 * (size_t)slot;
+    if (entry + 2 > vtable_size) return 0;
+    uint16_t off = fr_u16(fr, vtable + entry);
+    return off ? table + off : 0;
+}
+
+static size_t fr_indirect(const FlatReader *fr, size_t pos) {
+    return pos + fr_u32(fr, pos);
+}
+
+static size_t fr_table(const FlatReader *fr, size_t table, int slot) {
+    size_t pos = fr_field(fr, table, slot);
+    return pos ? fr_indirect(fr, pos) : 0;
+}
+
+static int64_t fr_scalar(const FlatReader *fr, size_t table, int slot, int size, int64_t default_value) {
+    size_t pos = fr_field(fr, table, slot);
+    if (!pos) return default_value;
+    switch (size) {
+        case 1:
+            return (int8_t)fr_u8(fr, pos);
+        case 2:
+            return (int16_t)fr_u16(fr, pos);
+        case 4:
+            return (int32_t)fr_u32(fr, pos);
+        default:
+            return fr_i64(fr, pos);
+    }
+}
+
+// Returns the position of the first element and stores the length, or 0.
+static size_t fr_vector(const FlatReader *fr, size_t table, int slot, uint32_t *length) {
+    size_t pos = fr_table(fr, table, slot);
+    *length = 0;
+    if (!pos) return 0;
+    *length = fr_u32(fr, pos);
+    return pos + 4;
+}
+
+static size_t arrow_pad8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+/* Export */
+
+typedef struct {
+    FILE *file;
+    int64_t position;
+} ArrowWriter;
+
+static int arrow_write(ArrowWriter *w, const void *data, size_t len) {
+    static const uint8_t zeros[8] = {0};
+    size_t padded = arrow_pad8(len);
+    if (len && fwrite(data, 1, len, w->file) != len) return 0;
+    if (padded > len && fwrite(zeros, 1, padded - len, w->file) != padded - len) return 0;
+    w->position += (int64_t)padded;
+    DBC_COUNT(DBC_BYTES_WRITTEN, padded);
+    return 1;
+}
+
+static int arrow_write_message(ArrowWriter *w, FlatBuilder *fb, int64_t body_length, ArrowBlock *block) {
+    uint32_t prefix[2] = {ARROW_CONTINUATION, (uint32_t)arrow_pad8(fb->size)};
+    block->offset = w->position;
+    block->metadata_length = (int32_t)(8 + prefix[1]);
+    block->padding = 0;
+    block->body_length = body_length;
+    return arrow_write(w, prefix, 8) && arrow_write(w, fb_data(fb), fb->size);
+}
+
+static size_t arrow_build_int_type(FlatBuilder *fb, int bit_width, int is_signed) {
+    fb_start_table(fb, 2);
+    fb_add_i32(fb, 0, bit_width);
+    fb_add_u8(fb, 1, (uint8_t)is_signed);
+    return fb_end_table(fb);
+}
+
+static size_t arrow_build_schema(FlatBuilder *fb, VALUE field_names, const FieldType *types, uint32_t field_count) {
+    size_t *fields = arrow_realloc(NULL, (field_count ? field_count : 1) * sizeof(size_t));
+
+    for (uint32_t j = 0; j < field_count; j++) {
+        VALUE name = rb_ary_entry(field_names, j);
+        name = NIL_P(name) ? rb_sprintf("field_%u", j) : rb_obj_as_string(name);
+        size_t name_offset = fb_create_string(fb, RSTRING_PTR(name), RSTRING_LEN(name));
+
+        uint8_t type_type;
+        size_t type_offset;
+        size_t dictionary_offset = 0;
+        switch (types[j]) {
+            case TYPE_UINT32:
+            case TYPE_INT32:
+                type_type = ARROW_TYPE_INT;
+                type_offset = arrow_build_int_type(fb, 32, types[j] == TYPE_INT32);
+                break;
+            case TYPE_FLOAT:
+                type_type = ARROW_TYPE_FLOATING_POINT;
+                fb_start_table(fb, 1);
+                fb_add_i16(fb, 0, ARROW_PRECISION_SINGLE);
+                type_offset = fb_end_table(fb);
+                break;
+            case TYPE_STRING:
+            default: {
+                type_type = ARROW_TYPE_UTF8;
+                fb_start_table(fb, 0);
+                type_offset = fb_end_table(fb);
+
+                size_t index_type = arrow_build_int_type(fb, 32, 1);
+                fb_start_table(fb, 4);
+                fb_add_i64(fb, 0, j);
+                fb_add_offset(fb, 1, index_type);
+                fb_add_u8(fb, 2, 0);
+                fb_add_i16(fb, 3, 0);
+                dictionary_offset = fb_end_table(fb);
+                break;
+            }
+        }
+        size_t children = fb_create_offset_vector(fb, NULL, 0);
+
+        fb_start_table(fb, 7);
+        fb_add_offset(fb, 0, name_offset);
+        fb_add_u8(fb, 1, 0);
+        fb_add_u8(fb, 2, type_type);
+        fb_add_offset(fb, 3, type_offset);
+        if (dictionary_offset) fb_add_offset(fb, 4, dictionary_offset);
+        fb_add_offset(fb, 5, children);
+        fields[j] = fb_end_table(fb);
+    }
+
+    size_t fields_vector = fb_create_offset_vector(fb, fields, field_count);
+    free(fields);
+
+    fb_start_table(fb, 4);
+    fb_add_i16(fb, 0, 0);
+    fb_add_offset(fb, 1, fields_vector);
+    return fb_end_table(fb);
+}
+
+static size_t arrow_build_record_batch(FlatBuilder *fb, int64_t length, const ArrowFieldNode *nodes, size_t node_count,
+                                       const ArrowBuffer *buffers, size_t buffer_count) {
+    size_t nodes_vector = fb_create_struct_vector(fb, nodes, sizeof(ArrowFieldNode), node_count);
+    size_t buffers_vector = fb_create_struct_vector(fb, buffers, sizeof(ArrowBuffer), buffer_count);
+    fb_start_table(fb, 4);
+    fb_add_i64(fb, 0, length);
+    fb_add_offset(fb, 1, nodes_vector);
+    fb_add_offset(fb, 2, buffers_vector);
+    return fb_end_table(fb);
+}
+
+static void arrow_finish_message(FlatBuilder *fb, uint8_t header_type, size_t header, int64_t body_length) {
+    fb_start_table(fb, 5);
+    fb_add_i16(fb, 0, ARROW_METADATA_V5);
+    fb_add_u8(fb, 1, header_type);
+    fb_add_offset(fb, 2, header);
+    fb_add_i64(fb, 3, body_length);
+    fb_finish(fb, fb_end_table(fb));
+}
+
+typedef struct {
+    DBCFile *dbc;
+    VALUE field_names;
+    FieldType *types;
+    DBCStringTable *dictionaries;  // one per column, only used for strings
+    int32_t **indices;             // dictionary index of each row, per string column
+    uint32_t *scratch;
+    char *dictionary_body;
+    ArrowBlock *dictionary_blocks;
+    ArrowBlock *batch_blocks;
+    FlatBuilder fb;
+    ArrowWriter writer;
+    const char *path;
+} ArrowExport;
+
+static const char *arrow_string_at(const DBCFile *dbc, uint32_t offset) {
+    return offset < dbc->header.string_block_size ? &dbc->string_block[offset] : "";
+}
+
+static VALUE arrow_export_body(VALUE arg) {
+    ArrowExport *ex = (ArrowExport *)arg;
+    DBCFile *dbc = ex->dbc;
+    uint32_t field_count = dbc->header.field_count;
+    uint32_t record_count = dbc->header.record_count;
+
+    uint32_t string_columns = 0;
+    for (uint32_t j = 0; j < field_count; j++) {
+        if (ex->types[j] != TYPE_STRING) continue;
+        string_columns++;
+        dbc_strtab_init(&ex->dictionaries[j]);
+        ex->indices[j] = arrow_realloc(NULL, (record_count ? record_count : 1) * sizeof(int32_t));
+        for (uint32_t i = 0; i < record_count; i++) {
+            const char *s = arrow_string_at(dbc, dbc->records[i][j].value.string_offset);
+            ex->indices[j][i] = (int32_t)dbc_strtab_intern(&ex->dictionaries[j], s, (uint32_t)strlen(s));
+        }
+    }
+
+    ex->writer.file = fopen(ex->path, "wb");
+    if (!ex->writer.file) {
+        rb_raise(rb_eIOError, "Could not open file for writing: %s", ex->path);
+    }
+
+    static const char magic[8] = ARROW_MAGIC;
+    if (!arrow_write(&ex->writer, magic, sizeof(magic))) {
+        rb_raise(rb_eIOError, "Failed to write Arrow file");
+    }
+
+    // Schema
+    ArrowBlock schema_block;
+    fb_init(&ex->fb);
+    arrow_finish_message(&ex->fb, ARROW_HEADER_SCHEMA, arrow_build_schema(&ex->fb, ex->field_names, ex->types, field_count), 0);
+    if (!arrow_write_message(&ex->writer, &ex->fb, 0, &schema_block)) {
+        rb_raise(rb_eIOError, "Failed to write Arrow schema");
+    }
+    fb_free(&ex->fb);
+
+    // One dictionary batch per string column
+    ex->dictionary_blocks = arrow_realloc(NULL, (string_columns ? string_columns : 1) * sizeof(ArrowBlock));
+    uint32_t dictionary_count = 0;
+    for (uint32_t j = 0; j < field_count; j++) {
+        if (ex->types[j] != TYPE_STRING) continue;
+        DBCStringTable *dict = &ex->dictionaries[j];
+
+        size_t offsets_size = arrow_pad8(((size_t)dict->count + 1) * sizeof(int32_t));
+        size_t data_size = dict->data_size - dict->count;
+        ex->dictionary_body = arrow_calloc(offsets_size + arrow_pad8(data_size) + 8, 1);
+        int32_t *offsets = (int32_t *)ex->dictionary_body;
+        char *data = ex->dictionary_body + offsets_size;
+        int32_t position = 0;
+        for (uint32_t k = 0; k < dict->count; k++) {
+            offsets[k] = position;
+            memcpy(data + position, dict->data + dict->offsets[k], dict->lengths[k]);
+            position += (int32_t)dict->lengths[k];
+        }
+        offsets[dict->count] = position;
+
+        int64_t body_length = (int64_t)(offsets_size + arrow_pad8(data_size));
+        ArrowFieldNode node = {dict->count, 0};
+        ArrowBuffer buffers[3] = {{0, 0}, {0, (int64_t)(dict->count + 1) * 4}, {(int64_t)offsets_size, (int64_t)data_size}};
+
+        fb_init(&ex->fb);
+        size_t data_batch = arrow_build_record_batch(&ex->fb, dict->count, &node, 1, buffers, 3);
+        fb_start_table(&ex->fb, 3);
+        fb_add_i64(&ex->fb, 0, j);
+        fb_add_offset(&ex->fb, 1, data_batch);
+        fb_add_u8(&ex->fb, 2, 0);
+        arrow_finish_message(&ex->fb, ARROW_HEADER_DICTIONARY_BATCH, fb_end_table(&ex->fb), body_length);
+
+        if (!arrow_write_message(&ex->writer, &ex->fb, body_length, &ex->dictionary_blocks[dictionary_count++]) ||
+            !arrow_write(&ex->writer, ex->dictionary_body, (size_t)body_length)) {
+            rb_raise(rb_eIOError, "Failed to write Arrow dictionary batch");
+        }
+        fb_free(&ex->fb);
+        free(ex->dictionary_body);
+        ex->dictionary_body = NULL;
+    }
+
+    // Record batches, gathered column by column straight from the records
+    uint32_t batch_count = (record_count + ARROW_BATCH_ROWS - 1) / ARROW_BATCH_ROWS;
+    ex->batch_blocks = arrow_realloc(NULL, (batch_count ? batch_count : 1) * sizeof(ArrowBlock));
+    ex->scratch = arrow_realloc(NULL, ARROW_BATCH_ROWS * sizeof(uint32_t));
+    VALUE nodes_buf, buffers_buf;
+    ArrowFieldNode *nodes = ALLOCV_N(ArrowFieldNode, nodes_buf, field_count ? field_count : 1);
+    ArrowBuffer *buffers = ALLOCV_N(ArrowBuffer, buffers_buf, field_count ? (size_t)field_count * 2 : 1);
+
+    for (uint32_t b = 0; b < batch_count; b++) {
+        uint32_t start = b * ARROW_BATCH_ROWS;
+        uint32_t rows = record_count - start < ARROW_BATCH_ROWS ? record_count - start : ARROW_BATCH_ROWS;
+        size_t column_size = arrow_pad8((size_t)rows * sizeof(uint32_t));
+
+        for (uint32_t j = 0; j < field_count; j++) {
+            nodes[j].length = rows;
+            nodes[j].null_count = 0;
+            buffers[j * 2].offset = (int64_t)(column_size * j);
+            buffers[j * 2].length = 0;
+            buffers[j * 2 + 1].offset = (int64_t)(column_size * j);
+            buffers[j * 2 + 1].length = (int64_t)rows * 4;
+        }
+        int64_t body_length = (int64_t)(column_size * field_count);
+
+        fb_init(&ex->fb);
+        size_t batch = arrow_build_record_batch(&ex->fb, rows, nodes, field_count, buffers, field_count * 2);
+        arrow_finish_message(&ex->fb, ARROW_HEADER_RECORD_BATCH, batch, body_length);
+        if (!arrow_write_message(&ex->writer, &ex->fb, body_length, &ex->batch_blocks[b])) {
+            rb_raise(rb_eIOError, "Failed to write Arrow record batch");
+        }
+        fb_free(&ex->fb);
+
+        for (uint32_t j = 0; j < field_count; j++) {
+            const void *column;
+            if (ex->types[j] == TYPE_STRING) {
+                column = ex->indices[j] + start;
+            } else {
+                for (uint32_t i = 0; i < rows; i++) {
+                    ex->scratch[i] = dbc->records[start + i][j].value.uint32_value;
+                }
+                column = ex->scratch;
+            }
+            if (!arrow_write(&ex->writer, column, (size_t)rows * sizeof(uint32_t))) {
+                rb_raise(rb_eIOError, "Failed to write Arrow record batch");
+            }
+        }
+    }
+    ALLOCV_END(buffers_buf);
+    ALLOCV_END(nodes_buf);
+
+    // End-of-stream marker, then the footer
+    uint32_t eos[2] = {ARROW_CONTINUATION, 0};
+    if (!arrow_write(&ex->writer, eos, sizeof(eos))) {
+        rb_raise(rb_eIOError, "Failed to write Arrow file");
+    }
+
+    fb_init(&ex->fb);
+    size_t schema = arrow_build_schema(&ex->fb, ex->field_names, ex->types, field_count);
+    size_t dictionaries = fb_create_struct_vector(&ex->fb, ex->dictionary_blocks, sizeof(ArrowBlock), dictionary_count);
+    size_t batches = fb_create_struct_vector(&ex->fb, ex->batch_blocks, sizeof(ArrowBlock), batch_count);
+    fb_start_table(&ex->fb, 4);
+    fb_add_i16(&ex->fb, 0, ARROW_METADATA_V5);
+    fb_add_offset(&ex->fb, 1, schema);
+    fb_add_offset(&ex->fb, 2, dictionaries);
+    fb_add_offset(&ex->fb, 3, batches);
+    fb_finish(&ex->fb, fb_end_table(&ex->fb));
+
+    int32_t footer_length = (int32_t)ex->fb.size;
+    if (fwrite(fb_data(&ex->fb), 1, ex->fb.size, ex->writer.file) != ex->fb.size ||
+        fwrite(&footer_length, 4, 1, ex->writer.file) != 1 ||
+        fwrite(ARROW_MAGIC, 1, ARROW_MAGIC_SIZE, ex->writer.file) != ARROW_MAGIC_SIZE) {
+        rb_raise(rb_eIOError, "Failed to write Arrow footer");
+    }
+
+    return Qnil;
+}
+
+static VALUE arrow_export_cleanup(VALUE arg) {
+    ArrowExport *ex = (ArrowExport *)arg;
+    uint32_t field_count = ex->dbc->header.field_count;
+
+    if (ex->writer.file) fclose(ex->writer.file);
+    for (uint32_t j = 0; j < field_count; j++) {
+        if (ex->types[j] != TYPE_STRING) continue;
+        if (ex->dictionaries[j].data) dbc_strtab_free(&ex->dictionaries[j]);
+        free(ex->indices[j]);
+    }
+    free(ex->types);
+    free(ex->dictionaries);
+    free(ex->indices);
+    free(ex->scratch);
+    free(ex->dictionary_body);
+    free(ex->dictionary_blocks);
+    free(ex->batch_blocks);
+    fb_free(&ex->fb);
+
+    return Qnil;
+}
+
+static VALUE dbc_to_arrow(VALUE self, VALUE filepath) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_to_arrow, 1, &filepath, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    ArrowExport ex;
+    memset(&ex, 0, sizeof(ArrowExport));
+    ex.dbc = dbc;
+    ex.path = StringValueCStr(filepath);
+    ex.field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+
+    uint32_t field_count = dbc->header.field_count ? dbc->header.field_count : 1;
+    ex.types = calloc(field_count, sizeof(FieldType));
+    ex.dictionaries = calloc(field_count, sizeof(DBCStringTable));
+    ex.indices = calloc(field_count, sizeof(int32_t *));
+    if (!ex.types || !ex.dictionaries || !ex.indices) {
+        free(ex.types);
+        free(ex.dictionaries);
+        free(ex.indices);
+        rb_raise(rb_eNoMemError, "Could not allocate the Arrow export");
+    }
+    dbc_column_types(dbc, ex.types);
+
+    rb_ensure(arrow_export_body, (VALUE)&ex, arrow_export_cleanup, (VALUE)&ex);
+    return self;
+}
+
+/* Import */
+
+typedef enum {
+    COLUMN_INT,
+    COLUMN_FLOAT,
+    COLUMN_UTF8,
+    COLUMN_DICTIONARY
+} ArrowColumnKind;
+
+typedef struct {
+    ArrowColumnKind kind;
+    int bit_width;       // of the values, or of the indices for dictionaries
+    int precision;
+    int64_t dictionary_id;
+    FieldType type;
+} ArrowColumn;
+
+typedef struct {
+    int64_t id;
+    uint32_t *offsets;  // string block offset of each dictionary entry
+    uint32_t count;
+} ArrowDictionary;
+
+typedef struct {
+    VALUE data;
+    FlatReader fr;
+    ArrowColumn *columns;
+    uint32_t column_count;
+    ArrowDictionary *dictionaries;
+    uint32_t dictionary_count;
+    DBCStringTable strings;
+    FieldValue **records;
+    uint32_t record_count;
+    uint32_t record_capacity;
+    uint32_t *strings_scratch;
+} ArrowImport;
+
+static int arrow_valid(const uint8_t *validity, int64_t row) {
+    return !validity || (validity[row >> 3] >> (row & 7)) & 1;
+}
+
+static ArrowDictionary *arrow_find_dictionary(ArrowImport *im, int64_t id) {
+    for (uint32_t i = 0; i < im->dictionary_count; i++) {
+        if (im->dictionaries[i].id == id) return &im->dictionaries[i];
+    }
+    return NULL;
+}
+
+// Locates the message of a footer block and returns its flatbuffer root and body.
+static size_t arrow_read_message(ArrowImport *im, size_t block_pos, int expected_header, size_t *body) {
+    const FlatReader *fr = &im->fr;
+    int64_t offset = fr_i64(fr, block_pos);
+    int32_t metadata_length = (int32_t)fr_u32(fr, block_pos + 8);
+    if (offset < 0 || metadata_length < 8) rb_raise(rb_eIOError, "Malformed Arrow file");
+
+    size_t message = (size_t)offset;
+    size_t flatbuffer = fr_u32(fr, message) == ARROW_CONTINUATION ? message + 8 : message + 4;
+    fr_check(fr, message, (size_t)metadata_length);
+    *body = message + (size_t)metadata_length;
+
+    size_t root = flatbuffer + fr_u32(fr, flatbuffer);
+    if (fr_scalar(fr, root, 1, 1, 0) != expected_header) {
+        rb_raise(rb_eIOError, "Unexpected Arrow message type");
+    }
+    return fr_table(fr, root, 2);
+}
+
+typedef struct {
+    const FlatReader *fr;
+    size_t body;
+    size_t nodes;
+    uint32_t node_count;
+    uint32_t node_index;
+    size_t buffers;
+    uint32_t buffer_count;
+    uint32_t buffer_index;
+} ArrowBatchCursor;
+
+static void arrow_batch_cursor(ArrowBatchCursor *cursor, const FlatReader *fr, size_t batch, size_t body) {
+    memset(cursor, 0, sizeof(ArrowBatchCursor));
+    cursor->fr = fr;
+    cursor->body = body;
+    if (!batch) rb_raise(rb_eIOError, "Malformed Arrow record batch");
+    if (fr_table(fr, batch, 3)) rb_raise(rb_eIOError, "Compressed Arrow files are not supported");
+    cursor->nodes = fr_vector(fr, batch, 1, &cursor->node_count);
+    cursor->buffers = fr_vector(fr, batch, 2, &cursor->buffer_count);
+}
+
+static int64_t arrow_next_node(ArrowBatchCursor *cursor, int64_t *null_count) {
+    if (cursor->node_index >= cursor->node_count) rb_raise(rb_eIOError, "Malformed Arrow record batch");
+    size_t pos = cursor->nodes + (size_t)cursor->node_index++ * sizeof(ArrowFieldNode);
+    *null_count = fr_i64(cursor->fr, pos + 8);
+    return fr_i64(cursor->fr, pos);
+}
+
+// Returns a pointer to the next buffer of the batch, or NULL when it is
+// empty, after checking it holds at least min_length bytes.
+static const uint8_t *arrow_next_buffer(ArrowBatchCursor *cursor, size_t min_length, size_t *length) {
+    if (cursor->buffer_index >= cursor->buffer_count) rb_raise(rb_eIOError, "Malformed Arrow record batch");
+    size_t pos = cursor->buffers + (size_t)cursor->buffer_index++ * sizeof(ArrowBuffer);
+    int64_t offset = fr_i64(cursor->fr, pos);
+    int64_t size = fr_i64(cursor->fr, pos + 8);
+    if (offset < 0 || size < 0 || (size_t)size < min_length) rb_raise(rb_eIOError, "Malformed Arrow record batch");
+    if (length) *length = (size_t)size;
+    if (size == 0) return NULL;
+    fr_check(cursor->fr, cursor->body + (size_t)offset, (size_t)size);
+    return cursor->fr->buf + cursor->body + offset;
+}
+
+// Returns the validity bitmap of an array of `length` values, or NULL when
+// it has no nulls. A bitmap that is there must cover every value.
+static const uint8_t *arrow_next_validity(ArrowBatchCursor *cursor, int64_t length, int64_t null_count) {
+    const uint8_t *validity = arrow_next_buffer(cursor, null_count ? (size_t)(length + 7) / 8 : 0, NULL);
+    return null_count ? validity : NULL;
+}
+
+// Reads a Utf8 array and interns every value into the string block.
+static void arrow_read_utf8(ArrowImport *im, ArrowBatchCursor *cursor, int64_t length, uint32_t *out) {
+    int64_t null_count;
+    if (arrow_next_node(cursor, &null_count) != length) rb_raise(rb_eIOError, "Malformed Arrow record batch");
+    const uint8_t *validity = arrow_next_validity(cursor, length, null_count);
+    const int32_t *offsets = (const int32_t *)arrow_next_buffer(cursor, length ? (size_t)(length + 1) * 4 : 0, NULL);
+    size_t data_length;
+    const char *data = (const char *)arrow_next_buffer(cursor, 0, &data_length);
+
+    for (int64_t i = 0; i < length; i++) {
+        int32_t start = offsets[i];
+        int32_t end = offsets[i + 1];
+        if (start < 0 || end < start || (size_t)end > data_length) rb_raise(rb_eIOError, "Malformed Arrow string array");
+        if (!arrow_valid(validity, i) || end == start) {
+            out[i] = 0;
+            continue;
+        }
+        uint32_t entry = dbc_strtab_intern(&im->strings, data + start, (uint32_t)(end - start));
+        out[i] = im->strings.offsets[entry];
+    }
+}
+
+static uint32_t arrow_read_word(const uint8_t *values, int bit_width, int64_t i) {
+    switch (bit_width) {
+        case 8:
+            return (uint32_t)(int32_t)((const int8_t *)values)[i];
+        case 16:
+            return (uint32_t)(int32_t)((const int16_t *)values)[i];
+        case 64:
+            return (uint32_t)((const int64_t *)values)[i];
+        default:
+            return ((const uint32_t *)values)[i];
+    }
+}
+
+static void arrow_parse_schema(ArrowImport *im, size_t schema, VALUE field_definitions) {
+    const FlatReader *fr = &im->fr;
+    uint32_t field_count;
+    size_t fields = fr_vector(fr, schema, 1, &field_count);
+    if (!fields || field_count == 0) rb_raise(rb_eIOError, "Arrow schema has no fields");
+
+    im->columns = arrow_calloc(field_count, sizeof(ArrowColumn));
+    im->column_count = field_count;
+
+    for (uint32_t j = 0; j < field_count; j++) {
+        size_t field = fr_indirect(fr, fields + (size_t)j * 4);
+        size_t name_pos = fr_table(fr, field, 0);
+        VALUE name;
+        if (name_pos) {
+            uint32_t name_length = fr_u32(fr, name_pos);
+            fr_check(fr, name_pos + 4, name_length);
+            name = rb_str_new((const char *)fr->buf + name_pos + 4, name_length);
+        } else {
+            name = rb_sprintf("field_%u", j);
+        }
+
+        ArrowColumn *column = &im->columns[j];
+        int64_t type_type = fr_scalar(fr, field, 2, 1, 0);
+        size_t type = fr_table(fr, field, 3);
+        size_t dictionary = fr_table(fr, field, 4);
+
+        uint32_t child_count;
+        fr_vector(fr, field, 5, &child_count);
+        if (child_count) rb_raise(rb_eArgError, "Unsupported nested Arrow field: %"PRIsVALUE, name);
+
+        if (type_type == ARROW_TYPE_INT && type && !dictionary) {
+            column->kind = COLUMN_INT;
+            column->bit_width = (int)fr_scalar(fr, type, 0, 4, 0);
+            column->type = fr_scalar(fr, type, 1, 1, 0) ? TYPE_INT32 : TYPE_UINT32;
+            if (column->bit_width != 8 && column->bit_width != 16 && column->bit_width != 32 && column->bit_width != 64) {
+                rb_raise(rb_eArgError, "Unsupported Arrow integer width for field %"PRIsVALUE, name);
+            }
+        } else if (type_type == ARROW_TYPE_FLOATING_POINT && type && !dictionary) {
+            column->kind = COLUMN_FLOAT;
+            column->precision = (int)fr_scalar(fr, type, 0, 2, ARROW_PRECISION_HALF);
+            column->type = TYPE_FLOAT;
+            if (column->precision == ARROW_PRECISION_HALF) {
+                rb_raise(rb_eArgError, "Unsupported Arrow half float field %"PRIsVALUE, name);
+            }
+        } else if (type_type == ARROW_TYPE_UTF8) {
+            column->type = TYPE_STRING;
+            if (dictionary) {
+                column->kind = COLUMN_DICTIONARY;
+                column->dictionary_id = fr_scalar(fr, dictionary, 0, 8, 0);
+                size_t index_type = fr_table(fr, dictionary, 1);
+                column->bit_width = index_type ? (int)fr_scalar(fr, index_type, 0, 4, 32) : 32;
+                if (column->bit_width != 8 && column->bit_width != 16 && column->bit_width != 32 && column->bit_width != 64) {
+                    rb_raise(rb_eArgError, "Unsupported Arrow dictionary index width for field %"PRIsVALUE, name);
+                }
+            } else {
+                column->kind = COLUMN_UTF8;
+            }
+        } else {
+            rb_raise(rb_eArgError, "Unsupported Arrow type for field %"PRIsVALUE, name);
+        }
+
+        rb_hash_aset(field_definitions, rb_str_intern(name), field_type_to_symbol(column->type));
+    }
+}
+
+static void arrow_read_dictionaries(ArrowImport *im, size_t footer) {
+    const FlatReader *fr = &im->fr;
+    uint32_t block_count;
+    size_t blocks = fr_vector(fr, footer, 2, &block_count);
+
+    im->dictionaries = arrow_calloc(block_count ? block_count : 1, sizeof(ArrowDictionary));
+    for (uint32_t b = 0; b < block_count; b++) {
+        size_t body;
+        size_t batch = arrow_read_message(im, blocks + (size_t)b * sizeof(ArrowBlock), ARROW_HEADER_DICTIONARY_BATCH, &body);
+        if (!batch) rb_raise(rb_eIOError, "Malformed Arrow dictionary batch");
+
+        int64_t id = fr_scalar(fr, batch, 0, 8, 0);
+        int is_delta = (int)fr_scalar(fr, batch, 2, 1, 0);
+        size_t data = fr_table(fr, batch, 1);
+        int64_t length = data ? fr_scalar(fr, data, 0, 8, 0) : 0;
+        if (length < 0 || length > UINT32_MAX) rb_raise(rb_eIOError, "Malformed Arrow dictionary batch");
+
+        ArrowDictionary *dictionary = arrow_find_dictionary(im, id);
+        if (!dictionary) {
+            dictionary = &im->dictionaries[im->dictionary_count++];
+            dictionary->id = id;
+        } else if (!is_delta) {
+            dictionary->count = 0;
+        }
+        dictionary->offsets = arrow_realloc(dictionary->offsets, ((size_t)dictionary->count + (size_t)length + 1) * sizeof(uint32_t));
+
+        ArrowBatchCursor cursor;
+        arrow_batch_cursor(&cursor, fr, data, body);
+        arrow_read_utf8(im, &cursor, length, dictionary->offsets + dictionary->count);
+        dictionary->count += (uint32_t)length;
+    }
+}
+
+static void arrow_read_batches(ArrowImport *im, size_t footer) {
+    const FlatReader *fr = &im->fr;
+    uint32_t block_count;
+    size_t blocks = fr_vector(fr, footer, 3, &block_count);
+
+    for (uint32_t b = 0; b < block_count; b++) {
+        size_t body;
+        size_t batch = arrow_read_message(im, blocks + (size_t)b * sizeof(ArrowBlock), ARROW_HEADER_RECORD_BATCH, &body);
+        ArrowBatchCursor cursor;
+        arrow_batch_cursor(&cursor, fr, batch, body);
+
+        int64_t length = fr_scalar(fr, batch, 0, 8, 0);
+        if (length < 0 || (uint64_t)im->record_count + (uint64_t)length > UINT32_MAX) {
+            rb_raise(rb_eIOError, "Malformed Arrow record batch");
+        }
+
+        uint32_t base = im->record_count;
+        if (base + (uint32_t)length > im->record_capacity) {
+            uint32_t capacity = im->record_capacity ? im->record_capacity : 1024;
+            while (capacity < base + (uint32_t)length) capacity *= 2;
+            im->records = arrow_realloc(im->records, capacity * sizeof(FieldValue *));
+            im->record_capacity = capacity;
+        }
+        for (int64_t i = 0; i < length; i++) {
+            im->records[base + i] = arrow_calloc(im->column_count, sizeof(FieldValue));
+            im->record_count++;
+        }
+
+        for (uint32_t j = 0; j < im->column_count; j++) {
+            ArrowColumn *column = &im->columns[j];
+
+            if (column->kind == COLUMN_UTF8) {
+                im->strings_scratch = arrow_realloc(im->strings_scratch, (size_t)(length ? length : 1) * sizeof(uint32_t));
+                arrow_read_utf8(im, &cursor, length, im->strings_scratch);
+                for (int64_t i = 0; i < length; i++) {
+                    im->records[base + i][j].type = TYPE_STRING;
+                    im->records[base + i][j].value.string_offset = im->strings_scratch[i];
+                }
+                continue;
+            }
+
+            int64_t null_count;
+            if (arrow_next_node(&cursor, &null_count) != length) {
+                rb_raise(rb_eIOError, "Malformed Arrow record batch");
+            }
+            const uint8_t *validity = arrow_next_validity(&cursor, length, null_count);
+            int width = column->kind == COLUMN_FLOAT ? (column->precision == ARROW_PRECISION_DOUBLE ? 64 : 32) : column->bit_width;
+            const uint8_t *values = arrow_next_buffer(&cursor, (size_t)length * (size_t)width / 8, NULL);
+
+            ArrowDictionary *dictionary = NULL;
+            if (column->kind == COLUMN_DICTIONARY) {
+                dictionary = arrow_find_dictionary(im, column->dictionary_id);
+                if (!dictionary) rb_raise(rb_eIOError, "Missing Arrow dictionary %ld", (long)column->dictionary_id);
+            }
+
+            for (int64_t i = 0; i < length; i++) {
+                FieldValue *value = &im->records[base + i][j];
+                value->type = column->type;
+                if (!values || !arrow_valid(validity, i)) continue;
+
+                if (column->kind == COLUMN_FLOAT) {
+                    value->value.float_value = column->precision == ARROW_PRECISION_DOUBLE
+                        ? (float)((const double *)values)[i]
+                        : ((const float *)values)[i];
+                } else if (column->kind == COLUMN_DICTIONARY) {
+                    uint32_t index = arrow_read_word(values, width, i);
+                    if (index >= dictionary->count) {
+                        rb_raise(rb_eIOError, "Arrow dictionary index out of range");
+                    }
+                    value->value.string_offset = dictionary->offsets[index];
+                } else {
+                    value->value.uint32_value = arrow_read_word(values, width, i);
+                }
+            }
+        }
+    }
+}
+
+typedef struct {
+    ArrowImport *im;
+    VALUE klass;
+    VALUE filepath;
+    VALUE dbc_filepath;
+} ArrowImportArgs;
+
+static VALUE arrow_import_body(VALUE arg) {
+    ArrowImportArgs *args = (ArrowImportArgs *)arg;
+    ArrowImport *im = args->im;
+
+    im->data = rb_funcall(rb_cFile, rb_intern("binread"), 1, args->filepath);
+    im->fr.buf = (const uint8_t *)RSTRING_PTR(im->data);
+    im->fr.len = (size_t)RSTRING_LEN(im->data);
+    const FlatReader *fr = &im->fr;
+
+    if (fr->len < 8 + 4 + ARROW_MAGIC_SIZE ||
+        memcmp(fr->buf, ARROW_MAGIC, ARROW_MAGIC_SIZE) != 0 ||
+        memcmp(fr->buf + fr->len - ARROW_MAGIC_SIZE, ARROW_MAGIC, ARROW_MAGIC_SIZE) != 0) {
+        rb_raise(rb_eIOError, "Not an Arrow IPC file");
+    }
+
+    uint32_t footer_length = fr_u32(fr, fr->len - ARROW_MAGIC_SIZE - 4);
+    if (footer_length > fr->len - ARROW_MAGIC_SIZE - 4) rb_raise(rb_eIOError, "Malformed Arrow file");
+    size_t footer_start = fr->len - ARROW_MAGIC_SIZE - 4 - footer_length;
+    size_t footer = footer_start + fr_u32(fr, footer_start);
+
+    VALUE field_definitions = rb_hash_new();
+    size_t schema = fr_table(fr, footer, 1);
+    if (!schema) rb_raise(rb_eIOError, "Arrow file has no schema");
+    arrow_parse_schema(im, schema, field_definitions);
+
+    dbc_strtab_init(&im->strings);
+    arrow_read_dictionaries(im, footer);
+    arrow_read_batches(im, footer);
+
+    VALUE argv[2] = {args->dbc_filepath, field_definitions};
+    VALUE obj = rb_class_new_instance(2, argv, args->klass);
+    DBCFile *dbc;
+    TypedData_Get_Struct(obj, DBCFile, &dbc_data_type, dbc);
+
+    DBCHeader header;
+    memcpy(header.magic, "WDBC", 4);
+    header.record_count = im->record_count;
+    header.field_count = im->column_count;
+    header.record_size = im->column_count * sizeof(uint32_t);
+    header.string_block_size = (uint32_t)im->strings.data_size;
+
+    dbc_install(dbc, &header, im->records, im->strings.data);
+    im->records = NULL;
+    im->record_count = 0;
+    im->strings.data = NULL;
+
+    return obj;
+}
+
+static VALUE arrow_import_cleanup(VALUE arg) {
+    ArrowImport *im = ((ArrowImportArgs *)arg)->im;
+
+    for (uint32_t i = 0; i < im->record_count; i++) {
+        free(im->records[i]);
+    }
+    free(im->records);
+    for (uint32_t i = 0; i < im->dictionary_count; i++) {
+        free(im->dictionaries[i].offsets);
+    }
+    free(im->dictionaries);
+    free(im->columns);
+    free(im->strings_scratch);
+    dbc_strtab_free(&im->strings);
+
+    return Qnil;
+}
+
+// DBCFile.from_arrow(arrow_path, filepath = nil) -> DBCFile
+//
+// `filepath` becomes the path used by #write.
+static VALUE dbc_from_arrow(int argc, VALUE *argv, VALUE klass) {
+    VALUE filepath, dbc_filepath;
+    rb_scan_args(argc, argv, "11", &filepath, &dbc_filepath);
+    FilePathValue(filepath);
+
+    ArrowImport im;
+    memset(&im, 0, sizeof(ArrowImport));
+    ArrowImportArgs args = {&im, klass, filepath, dbc_filepath};
+
+    VALUE result = rb_ensure(arrow_import_body, (VALUE)&args, arrow_import_cleanup, (VALUE)&args);
+    RB_GC_GUARD(im.data);
+    return result;
+}
+
+void Init_wow_dbc_arrow(void) {
+    rb_define_method(rb_cDBCFile, "to_arrow", dbc_to_arrow, 1);
+    rb_define_singleton_method(rb_cDBCFile, "from_arrow", dbc_from_arrow, -1);
+}
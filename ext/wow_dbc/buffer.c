@@ -0,0 +1,71 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// Growable byte buffer shared by the exporters.
+
+// Doesn't need the GVL. When out of memory the buffer starts empty and
+// the first reserve fails instead.
+void dbc_buf_init(DBCBuffer *buf, size_t capacity) {
+    buf->data = malloc(capacity ? capacity : 64);
+    buf->size = 0;
+    buf->capacity = buf->data ? (capacity ? capacity : 64) : 0;
+}
+
+// Makes room for `len` more bytes. Returns 0, leaving the buffer as it
+// was, when out of memory. Doesn't need the GVL.
+int dbc_buf_try_reserve(DBCBuffer *buf, size_t len) {
+    if (buf->size + len <= buf->capacity) return 1;
+
+    size_t capacity = buf->capacity ? buf->capacity : 64;
+    while (buf->size + len > capacity) capacity *= 2;
+    char *data = realloc(buf->data, capacity);
+    if (!data) return 0;
+    buf->data = data;
+    buf->capacity = capacity;
+    return 1;
+}
+
+void dbc_buf_reserve(DBCBuffer *buf, size_t len) {
+    if (!dbc_buf_try_reserve(buf, len)) {
+        rb_raise(rb_eNoMemError, "Could not grow a buffer to %zu bytes", buf->size + len);
+    }
+}
+
+void dbc_buf_append(DBCBuffer *buf, const void *data, size_t len) {
+    dbc_buf_reserve(buf, len);
+    memcpy(buf->data + buf->size, data, len);
+    buf->size += len;
+}
+
+void dbc_buf_free(DBCBuffer *buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->size = 0;
+    buf->capacity = 0;
+}
+
+// Buffered writer over any Ruby object responding to #write.
+
+void dbc_out_init(DBCOutput *out, VALUE io) {
+    dbc_buf_init(&out->buf, DBC_OUTPUT_CHUNK + DBC_NUMBER_MAX);
+    out->io = io;
+    out->bytes_written = 0;
+}
+
+void dbc_out_flush(DBCOutput *out) {
+    if (out->buf.size == 0) return;
+    rb_io_write(out->io, rb_utf8_str_new(out->buf.data, (long)out->buf.size));
+    out->bytes_written += out->buf.size;
+    DBC_COUNT(DBC_BYTES_WRITTEN, out->buf.size);
+    out->buf.size = 0;
+}
+
+void dbc_out_write(DBCOutput *out, const void *data, size_t len) {
+    dbc_buf_append(&out->buf, data, len);
+    if (out->buf.size >= DBC_OUTPUT_CHUNK) dbc_out_flush(out);
+}
+
+void dbc_out_free(DBCOutput *out) {
+    dbc_buf_free(&out->buf);
+}
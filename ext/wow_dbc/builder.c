@@ -0,0 +1,66 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// Accumulates records and an interned string block for the importers, then
+// hands both to a new DBCFile.
+
+void dbc_builder_init(DBCBuilder *builder, uint32_t field_count) {
+    memset(builder, 0, sizeof(DBCBuilder));
+    builder->field_count = field_count;
+    dbc_strtab_init(&builder->strings);
+}
+
+FieldValue *dbc_builder_add_record(DBCBuilder *builder) {
+    if (builder->record_count == builder->record_capacity) {
+        uint32_t capacity = builder->record_capacity ? builder->record_capacity * 2 : 1024;
+        FieldValue **records = realloc(builder->records, capacity * sizeof(FieldValue *));
+        if (!records) {
+            rb_raise(rb_eNoMemError, "Could not grow the records");
+        }
+        builder->records = records;
+        builder->record_capacity = capacity;
+    }
+    FieldValue *record = calloc(builder->field_count ? builder->field_count : 1, sizeof(FieldValue));
+    if (!record) {
+        rb_raise(rb_eNoMemError, "Could not allocate a record");
+    }
+    builder->records[builder->record_count++] = record;
+    return record;
+}
+
+uint32_t dbc_builder_add_string(DBCBuilder *builder, const char *s, uint32_t len) {
+    uint32_t entry = dbc_strtab_intern(&builder->strings, s, len);
+    return builder->strings.offsets[entry];
+}
+
+VALUE dbc_builder_finish(DBCBuilder *builder, VALUE klass, VALUE filepath, VALUE field_definitions) {
+    VALUE argv[2] = {filepath, field_definitions};
+    VALUE obj = rb_class_new_instance(2, argv, klass);
+    DBCFile *dbc;
+    TypedData_Get_Struct(obj, DBCFile, &dbc_data_type, dbc);
+
+    DBCHeader header;
+    memcpy(header.magic, "WDBC", 4);
+    header.record_count = builder->record_count;
+    header.field_count = builder->field_count;
+    header.record_size = builder->field_count * sizeof(uint32_t);
+    header.string_block_size = (uint32_t)builder->strings.data_size;
+
+    dbc_install(dbc, &header, builder->records, builder->strings.data);
+    builder->records = NULL;
+    builder->record_count = 0;
+    builder->strings.data = NULL;
+
+    return obj;
+}
+
+void dbc_builder_free(DBCBuilder *builder) {
+    for (uint32_t i = 0; i < builder->record_count; i++) {
+        free(builder->records[i]);
+    }
+    free(builder->records);
+    builder->records = NULL;
+    builder->record_count = 0;
+    dbc_strtab_free(&builder->strings);
+}
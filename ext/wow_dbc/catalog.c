@@ -0,0 +1,340 @@
+#include "wow_dbc.h"
+
+#include <ruby/io.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+// Native parts of WowDBC::Catalog (lib/wow_dbc/catalog.rb): an inotify
+// watcher for the data directory, and the keyed comparison of a reloaded
+// table with the one it replaces. Without inotify, Watcher.new raises
+// NotImplementedError.
+
+static VALUE rb_cCatalog;
+static VALUE rb_cWatcher;
+static VALUE sym_added;
+static VALUE sym_removed;
+static VALUE sym_changed;
+
+typedef struct {
+    int fd;
+} Watcher;
+
+static void watcher_free(void *ptr) {
+    Watcher *watcher = (Watcher *)ptr;
+    if (watcher->fd >= 0) close(watcher->fd);
+    xfree(watcher);
+}
+
+static size_t watcher_memsize(const void *ptr) {
+    return sizeof(Watcher);
+}
+
+static const rb_data_type_t watcher_data_type = {
+    "WowDBC::Catalog::Watcher",
+    {NULL, watcher_free, watcher_memsize},
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static VALUE watcher_alloc(VALUE klass) {
+    Watcher *watcher;
+    VALUE obj = TypedData_Make_Struct(klass, Watcher, &watcher_data_type, watcher);
+    watcher->fd = -1;
+    return obj;
+}
+
+static Watcher *watcher_get(VALUE self) {
+    Watcher *watcher;
+    TypedData_Get_Struct(self, Watcher, &watcher_data_type, watcher);
+    if (watcher->fd < 0) rb_raise(rb_eIOError, "Watcher is closed");
+    return watcher;
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+// Watcher.new(dir)
+//
+// Watches `dir` for files that were written and closed, or moved in.
+static VALUE watcher_initialize(VALUE self, VALUE dir) {
+    Watcher *watcher;
+    TypedData_Get_Struct(self, Watcher, &watcher_data_type, watcher);
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) rb_sys_fail("inotify_init1");
+    if (inotify_add_watch(fd, StringValueCStr(dir), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        int e = errno;
+        close(fd);
+        rb_syserr_fail_str(e, dir);
+    }
+    watcher->fd = fd;
+    return self;
+}
+
+static uint64_t watcher_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static int watcher_dbc_name(const char *name) {
+    size_t len = strlen(name);
+    return len > 4 && strcasecmp(name + len - 4, ".dbc") == 0;
+}
+
+// Watcher#wait(timeout = nil) -> [name, ...]
+//
+// Blocks, with the GVL released, until DBC files in the directory change
+// or `timeout` seconds pass. Returns the changed file names, each once.
+static VALUE watcher_wait(int argc, VALUE *argv, VALUE self) {
+    VALUE timeout;
+    rb_scan_args(argc, argv, "01", &timeout);
+    Watcher *watcher = watcher_get(self);
+
+    struct timeval tv, *tvp = NULL;
+    uint64_t deadline = 0;
+    if (!NIL_P(timeout)) {
+        tv = rb_time_interval(timeout);
+        deadline = watcher_now_us() + (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec;
+        tvp = &tv;
+    }
+
+    VALUE names = rb_ary_new();
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        // Events for other files don't restart the timeout
+        if (tvp) {
+            uint64_t now = watcher_now_us();
+            uint64_t left = deadline > now ? deadline - now : 0;
+            tv.tv_sec = (time_t)(left / 1000000);
+            tv.tv_usec = (suseconds_t)(left % 1000000);
+        }
+        int ready = rb_wait_for_single_fd(watcher->fd, RB_WAITFD_IN, tvp);
+        if (ready < 0) rb_sys_fail("inotify wait");
+        if (ready == 0) return names;
+
+        for (;;) {
+            ssize_t len = read(watcher->fd, buf, sizeof(buf));
+            if (len < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+                rb_sys_fail("inotify read");
+            }
+            for (char *p = buf; p < buf + len;) {
+                const struct inotify_event *event = (const struct inotify_event *)p;
+                if (event->len && watcher_dbc_name(event->name)) {
+                    VALUE name = rb_str_new_cstr(event->name);
+                    if (!RTEST(rb_ary_includes(names, name))) rb_ary_push(names, name);
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        if (RARRAY_LEN(names) > 0) return names;
+    }
+}
+
+#else
+
+static VALUE watcher_initialize(VALUE self, VALUE dir) {
+    rb_raise(rb_eNotImpError, "wow_dbc was built without inotify support");
+    return Qnil;
+}
+
+static VALUE watcher_wait(int argc, VALUE *argv, VALUE self) {
+    watcher_get(self);
+    return Qnil;
+}
+
+#endif
+
+// Watcher#close -> nil
+static VALUE watcher_close(VALUE self) {
+    Watcher *watcher;
+    TypedData_Get_Struct(self, Watcher, &watcher_data_type, watcher);
+    if (watcher->fd >= 0) close(watcher->fd);
+    watcher->fd = -1;
+    return Qnil;
+}
+
+static const char *catalog_string(const DBCFile *dbc, uint32_t offset) {
+    return offset < dbc->header.string_block_size ? &dbc->string_block[offset] : "";
+}
+
+static uint64_t catalog_key_hash(const DBCFile *dbc, uint32_t row, uint32_t key, FieldType type) {
+    const FieldValue *value = &dbc->records[row][key];
+    if (type == TYPE_STRING) {
+        const char *s = catalog_string(dbc, value->value.string_offset);
+        return dbc_hash64(s, strlen(s), 0);
+    }
+    return dbc_hash64(&value->value.uint32_value, sizeof(uint32_t), 0);
+}
+
+static int catalog_key_equal(const DBCFile *a, uint32_t a_row, const DBCFile *b, uint32_t b_row,
+                             uint32_t key, FieldType type) {
+    const FieldValue *x = &a->records[a_row][key];
+    const FieldValue *y = &b->records[b_row][key];
+    if (type == TYPE_STRING) {
+        return strcmp(catalog_string(a, x->value.string_offset), catalog_string(b, y->value.string_offset)) == 0;
+    }
+    return x->value.uint32_value == y->value.uint32_value;
+}
+
+static VALUE catalog_key_value(const DBCFile *dbc, uint32_t row, uint32_t key, FieldType type) {
+    const FieldValue *value = &dbc->records[row][key];
+    switch (type) {
+        case TYPE_INT32:
+            return INT2NUM(value->value.int32_value);
+        case TYPE_FLOAT:
+            return DBL2NUM(value->value.float_value);
+        case TYPE_STRING:
+            return rb_str_new_cstr(catalog_string(dbc, value->value.string_offset));
+        default:
+            return UINT2NUM(value->value.uint32_value);
+    }
+}
+
+typedef struct {
+    uint32_t *slots;     // old row + 1, 0 for empty
+    uint8_t *matched;    // old rows already paired
+    FieldType *old_types;
+    FieldType *new_types;
+} CatalogChanges;
+
+static VALUE catalog_changes_free(VALUE arg) {
+    CatalogChanges *changes = (CatalogChanges *)arg;
+    free(changes->slots);
+    free(changes->matched);
+    free(changes->old_types);
+    free(changes->new_types);
+    return Qnil;
+}
+
+typedef struct {
+    DBCFile *old_dbc;
+    DBCFile *new_dbc;
+    uint32_t key;
+    CatalogChanges *changes;
+} CatalogCompare;
+
+static VALUE catalog_compare(VALUE arg) {
+    CatalogCompare *compare = (CatalogCompare *)arg;
+    DBCFile *old_dbc = compare->old_dbc;
+    DBCFile *new_dbc = compare->new_dbc;
+    CatalogChanges *changes = compare->changes;
+    uint32_t key = compare->key;
+    FieldType type = changes->new_types[key];
+    // Row hashes only compare when both tables have the same layout
+    int comparable = old_dbc->header.field_count == new_dbc->header.field_count &&
+                     memcmp(changes->old_types, changes->new_types, new_dbc->header.field_count * sizeof(FieldType)) == 0;
+
+    uint32_t old_count = old_dbc->header.record_count;
+    size_t slot_count = 1;
+    while (slot_count < (uint64_t)old_count * 2) slot_count <<= 1;
+    size_t mask = slot_count - 1;
+    changes->slots = calloc(slot_count, sizeof(uint32_t));
+    changes->matched = calloc(old_count ? old_count : 1, 1);
+    if (!changes->slots || !changes->matched) rb_raise(rb_eNoMemError, "Could not allocate the key table");
+
+    // Only the first row with each key goes in the table
+    for (uint32_t i = 0; i < old_count; i++) {
+        size_t slot = (size_t)catalog_key_hash(old_dbc, i, key, type) & mask;
+        while (changes->slots[slot]) {
+            if (catalog_key_equal(old_dbc, changes->slots[slot] - 1, old_dbc, i, key, type)) break;
+            slot = (slot + 1) & mask;
+        }
+        if (!changes->slots[slot]) changes->slots[slot] = i + 1;
+    }
+
+    VALUE added = rb_ary_new();
+    VALUE removed = rb_ary_new();
+    VALUE changed = rb_ary_new();
+    for (uint32_t i = 0; i < new_dbc->header.record_count; i++) {
+        size_t slot = (size_t)catalog_key_hash(new_dbc, i, key, type) & mask;
+        int64_t match = -1;
+        for (; changes->slots[slot]; slot = (slot + 1) & mask) {
+            uint32_t row = changes->slots[slot] - 1;
+            if (catalog_key_equal(old_dbc, row, new_dbc, i, key, type)) {
+                if (!changes->matched[row]) match = row;
+                break;
+            }
+        }
+        if (match < 0) {
+            rb_ary_push(added, catalog_key_value(new_dbc, i, key, type));
+            continue;
+        }
+        changes->matched[match] = 1;
+        if (!comparable || dbc_record_hash(old_dbc, (uint32_t)match, changes->old_types) !=
+                               dbc_record_hash(new_dbc, i, changes->new_types)) {
+            rb_ary_push(changed, catalog_key_value(new_dbc, i, key, type));
+        }
+    }
+    for (uint32_t i = 0; i < old_count; i++) {
+        if (!changes->matched[i]) rb_ary_push(removed, catalog_key_value(old_dbc, i, key, type));
+    }
+
+    VALUE result = rb_hash_new();
+    rb_hash_aset(result, sym_added, added);
+    rb_hash_aset(result, sym_removed, removed);
+    rb_hash_aset(result, sym_changed, changed);
+    return result;
+}
+
+// Catalog.changes(old_table, new_table, key) -> {added:, removed:, changed:}
+//
+// Pairs the rows of two versions of a table by the `key` field and lists
+// the keys of rows only in the new table, only in the old one, and in both
+// with different values. Only the first row with a key is paired, so
+// later rows repeating it count as added or removed.
+static VALUE catalog_changes(VALUE klass, VALUE old_table, VALUE new_table, VALUE key) {
+    DBCFile *old_dbc = rb_check_typeddata(old_table, &dbc_data_type);
+    DBCFile *new_dbc = rb_check_typeddata(new_table, &dbc_data_type);
+
+    VALUE old_names = rb_funcall(old_dbc->field_definitions, rb_intern("keys"), 0);
+    VALUE new_names = rb_funcall(new_dbc->field_definitions, rb_intern("keys"), 0);
+    long old_key = dbc_field_index(old_dbc, old_names, key);
+    long new_key = dbc_field_index(new_dbc, new_names, key);
+    if (old_key < 0 || new_key < 0 || old_key != new_key) {
+        rb_raise(rb_eArgError, "Unknown key field: %" PRIsVALUE, key);
+    }
+
+    CatalogChanges changes = {NULL, NULL, NULL, NULL};
+    changes.old_types = malloc((old_dbc->header.field_count ? old_dbc->header.field_count : 1) * sizeof(FieldType));
+    changes.new_types = malloc((new_dbc->header.field_count ? new_dbc->header.field_count : 1) * sizeof(FieldType));
+    if (!changes.old_types || !changes.new_types) {
+        catalog_changes_free((VALUE)&changes);
+        rb_raise(rb_eNoMemError, "Could not allocate column types");
+    }
+    dbc_column_types(old_dbc, changes.old_types);
+    dbc_column_types(new_dbc, changes.new_types);
+    if (changes.old_types[old_key] != changes.new_types[new_key]) {
+        catalog_changes_free((VALUE)&changes);
+        rb_raise(rb_eArgError, "Key field %" PRIsVALUE " changed type", key);
+    }
+
+    CatalogCompare compare = {old_dbc, new_dbc, (uint32_t)new_key, &changes};
+    VALUE result = rb_ensure(catalog_compare, (VALUE)&compare, catalog_changes_free, (VALUE)&changes);
+    RB_GC_GUARD(old_table);
+    RB_GC_GUARD(new_table);
+    return result;
+}
+
+void Init_wow_dbc_catalog(void) {
+    sym_added = ID2SYM(rb_intern("added"));
+    sym_removed = ID2SYM(rb_intern("removed"));
+    sym_changed = ID2SYM(rb_intern("changed"));
+
+    rb_cCatalog = rb_define_class_under(rb_mWowDBC, "Catalog", rb_cObject);
+    rb_define_singleton_method(rb_cCatalog, "changes", catalog_changes, 3);
+
+    rb_cWatcher = rb_define_class_under(rb_cCatalog, "Watcher", rb_cObject);
+    rb_define_alloc_func(rb_cWatcher, watcher_alloc);
+    rb_define_method(rb_cWatcher, "initialize", watcher_initialize, 1);
+    rb_define_method(rb_cWatcher, "wait", watcher_wait, -1);
+    rb_define_method(rb_cWatcher, "close", watcher_close, 0);
+}
@@ -0,0 +1,139 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// Change log for caches built on a table. Once tracking starts, every
+// mutation appends (op, row, field) to a fixed ring, which costs a store
+// per change and never allocates. Consumers keep a cursor, the sequence
+// number of the next entry they haven't seen, and read the entries after
+// it in batches. Wholesale replacements such as #read, #apply_patch! and a
+// rolled back transaction log a single :reset, since the rows no longer
+// correspond one to one.
+
+static VALUE sym_update;
+static VALUE sym_create;
+static VALUE sym_delete;
+static VALUE sym_reset;
+
+#define CHANGELOG_DEFAULT_CAPACITY 4096
+#define CHANGELOG_MAX_CAPACITY (1u << 30)
+
+void dbc_change(DBCFile *dbc, DBCChangeOp op, uint32_t row, uint32_t field) {
+    DBCChangeLog *log = dbc->changes;
+    if (!log) return;
+    DBCChange *entry = &log->entries[log->next & log->mask];
+    entry->op = op;
+    entry->row = row;
+    entry->field = field;
+    log->next++;
+}
+
+static VALUE change_op_to_symbol(uint32_t op) {
+    switch (op) {
+        case DBC_CHANGE_UPDATE:
+            return sym_update;
+        case DBC_CHANGE_CREATE:
+            return sym_create;
+        case DBC_CHANGE_DELETE:
+            return sym_delete;
+        default:
+            return sym_reset;
+    }
+}
+
+// DBCFile#track_changes(capacity = 4096) -> cursor
+//
+// Starts logging changes, keeping the latest `capacity` (rounded up to a
+// power of two). Returns the current cursor. Calling it again while
+// tracking changes nothing.
+static VALUE dbc_track_changes(int argc, VALUE *argv, VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_track_changes, -1 - argc, argv, &guarded)) return guarded;
+    VALUE capacity_value;
+    rb_scan_args(argc, argv, "01", &capacity_value);
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    if (dbc->changes) return ULL2NUM(dbc->changes->next);
+
+    rb_check_frozen(self);
+    long requested = NIL_P(capacity_value) ? CHANGELOG_DEFAULT_CAPACITY : NUM2LONG(capacity_value);
+    if (requested < 1 || requested > CHANGELOG_MAX_CAPACITY) {
+        rb_raise(rb_eArgError, "Capacity must be between 1 and %u", CHANGELOG_MAX_CAPACITY);
+    }
+    uint32_t capacity = 1;
+    while (capacity < (uint32_t)requested) capacity <<= 1;
+
+    DBCChangeLog *log = malloc(sizeof(DBCChangeLog));
+    DBCChange *entries = malloc(capacity * sizeof(DBCChange));
+    if (!log || !entries) {
+        free(log);
+        free(entries);
+        rb_raise(rb_eNoMemError, "Could not allocate the change log");
+    }
+    log->entries = entries;
+    log->mask = capacity - 1;
+    log->next = 0;
+    dbc->changes = log;
+    return ULL2NUM(0);
+}
+
+// DBCFile#change_cursor -> Integer or nil
+//
+// Cursor past the newest change, or nil when changes aren't tracked.
+static VALUE dbc_change_cursor(VALUE self) {
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    return dbc->changes ? ULL2NUM(dbc->changes->next) : Qnil;
+}
+
+// DBCFile#changes_since(cursor, limit = nil) -> [[op, row, field], ...] or nil
+//
+// Changes from `cursor` on, oldest first and at most `limit` of them. The
+// cursor for the next batch is `cursor` plus the number returned. `op` is
+// :update, :create, :delete or :reset. `field` is the field name for
+// :update and nil otherwise, and `row` is nil for :reset. Rows after a
+// deleted row move up by one. Returns nil when the ring has overwritten
+// changes after `cursor`; callers rebuild from the table and continue
+// from #change_cursor.
+static VALUE dbc_changes_since(int argc, VALUE *argv, VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_changes_since, -1 - argc, argv, &guarded)) return guarded;
+    VALUE cursor_value, limit_value;
+    rb_scan_args(argc, argv, "11", &cursor_value, &limit_value);
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    DBCChangeLog *log = dbc->changes;
+    if (!log) rb_raise(rb_eRuntimeError, "Changes are not tracked, call track_changes first");
+    uint64_t cursor = NUM2ULL(cursor_value);
+    if (cursor > log->next) rb_raise(rb_eArgError, "Cursor is past the newest change");
+    uint64_t capacity = (uint64_t)log->mask + 1;
+    if (log->next - cursor > capacity) return Qnil;
+
+    uint64_t count = log->next - cursor;
+    if (!NIL_P(limit_value)) {
+        long limit = NUM2LONG(limit_value);
+        if (limit < 0) rb_raise(rb_eArgError, "Limit must not be negative");
+        if ((uint64_t)limit < count) count = (uint64_t)limit;
+    }
+
+    VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+    VALUE result = rb_ary_new_capa((long)count);
+    for (uint64_t n = cursor; n < cursor + count; n++) {
+        const DBCChange *entry = &log->entries[n & log->mask];
+        VALUE row = entry->row == DBC_CHANGE_NONE ? Qnil : UINT2NUM(entry->row);
+        VALUE field = entry->field == DBC_CHANGE_NONE ? Qnil : rb_ary_entry(field_names, entry->field);
+        rb_ary_push(result, rb_ary_new_from_args(3, change_op_to_symbol(entry->op), row, field));
+    }
+    return result;
+}
+
+void Init_wow_dbc_changelog(void) {
+    sym_update = ID2SYM(rb_intern("update"));
+    sym_create = ID2SYM(rb_intern("create"));
+    sym_delete = ID2SYM(rb_intern("delete"));
+    sym_reset = ID2SYM(rb_intern("reset"));
+    rb_define_method(rb_cDBCFile, "track_changes", dbc_track_changes, -1);
+    rb_define_method(rb_cDBCFile, "change_cursor", dbc_change_cursor, 0);
+    rb_define_method(rb_cDBCFile, "changes_since", dbc_changes_since, -1);
+}
@@ -0,0 +1,169 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// Copy-on-write snapshots. Taking a snapshot hands the live table's
+// records array and string block to a shared base in O(1). The live table
+// keeps reading them and copies lazily: the records array (pointers only)
+// and a flag per row on its first write, then each row the first time it
+// is written, and the string block on its first append.
+
+// References are counted atomically: frozen views may be shared between
+// Ractors and collected by any of them.
+void dbc_cow_base_release(DBCCowBase *base) {
+    while (base && __atomic_sub_fetch(&base->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        DBCCowBase *parent = base->parent;
+        DBCArena *arena = base->arena;
+        for (uint32_t i = 0; i < base->record_count && !base->mapping; i++) {
+            if ((!base->borrowed || !base->borrowed[i]) && !dbc_arena_owns(arena, base->records[i])) {
+                free(base->records[i]);
+            }
+        }
+        if (!dbc_arena_owns(arena, base->records)) free(base->records);
+        free(base->borrowed);
+        if (base->owns_strings && !dbc_arena_owns(arena, base->string_block)) free(base->string_block);
+        if (base->mapping) dbc_mapping_release(base->mapping);
+        dbc_arena_release(arena);
+        free(base);
+        base = parent;
+    }
+}
+
+// Called before the records array changes: gives the live table its own
+// copy of the array, with every row still marked shared
+void dbc_cow_prepare(DBCFile *dbc) {
+    if (!dbc->records_shared) return;
+    uint32_t count = dbc->header.record_count;
+
+    FieldValue **records = ALLOC_N(FieldValue *, count ? count : 1);
+    uint8_t *cow = ALLOC_N(uint8_t, count ? count : 1);
+    memcpy(records, dbc->records, count * sizeof(FieldValue *));
+    memset(cow, 1, count);
+
+    dbc->records = records;
+    dbc->cow = cow;
+    dbc->records_shared = 0;
+    dbc->record_capacity = count ? count : 1;
+    dbc->cow_capacity = dbc->record_capacity;
+}
+
+// Called before a field of `row` is written in place
+void dbc_cow_row(DBCFile *dbc, uint32_t row) {
+    dbc_cow_prepare(dbc);
+    if (!dbc->cow || !dbc->cow[row]) return;
+
+    size_t size = (size_t)dbc->header.field_count * sizeof(FieldValue);
+    FieldValue *copy = ALLOC_N(FieldValue, dbc->header.field_count ? dbc->header.field_count : 1);
+    memcpy(copy, dbc->records[row], size);
+    dbc->records[row] = copy;
+    dbc->cow[row] = 0;
+    dbc->rows_in_arena = 0;
+}
+
+// Called after a record is appended, which is never shared. The flags
+// follow the records array and never shrink: rolling back deletes moves
+// them back up to the count the table had before.
+void dbc_cow_grow(DBCFile *dbc, uint32_t record_count) {
+    if (!dbc->cow) return;
+    if (dbc->cow_capacity < dbc->record_capacity) {
+        REALLOC_N(dbc->cow, uint8_t, dbc->record_capacity);
+        dbc->cow_capacity = dbc->record_capacity;
+    }
+    dbc->cow[record_count - 1] = 0;
+}
+
+// Makes room for `extra` more bytes at the end of the string block. Also
+// unshares the records array, so a live table sharing its records with a
+// base always shares its strings too.
+void dbc_strings_reserve(DBCFile *dbc, uint32_t extra) {
+    dbc_cow_prepare(dbc);
+    size_t used = dbc->header.string_block_size;
+    size_t size = used + extra;
+    if (!dbc->strings_shared && size <= dbc->string_capacity) return;
+
+    size_t capacity = used + used / 4;
+    if (capacity < size) capacity = size;
+    if (capacity > UINT32_MAX) capacity = size;
+    if (dbc->strings_shared) {
+        char *block = malloc(capacity ? capacity : 1);
+        if (!block) {
+            rb_raise(rb_eNoMemError, "Could not allocate the string block");
+        }
+        memcpy(block, dbc->string_block, used);
+        dbc->string_block = block;
+        dbc->strings_shared = 0;
+    } else {
+        dbc->string_block = dbc_arena_grow(dbc->arena, dbc->string_block, used, capacity);
+    }
+    dbc->string_capacity = (uint32_t)capacity;
+}
+
+// Freezes the live table's current data into a base, or returns the base
+// it still shares untouched
+static DBCCowBase *cow_base_take(DBCFile *dbc) {
+    if (dbc->records_shared && dbc->strings_shared) return dbc->cow_base;
+
+    DBCCowBase *base = calloc(1, sizeof(DBCCowBase));
+    if (!base) {
+        rb_raise(rb_eNoMemError, "Could not allocate snapshot");
+    }
+    base->refs = 1;
+    base->parent = dbc->cow_base;
+    base->records = dbc->records;
+    base->record_count = dbc->header.record_count;
+    base->borrowed = dbc->cow;
+    base->string_block = dbc->string_block;
+    base->owns_strings = !dbc->strings_shared;
+    base->arena = dbc_arena_retain(dbc->arena);
+
+    dbc->cow_base = base;  // the parent's reference moves to the new base
+    dbc->records = base->records;
+    dbc->cow = NULL;
+    dbc->cow_capacity = 0;
+    dbc->records_shared = 1;
+    dbc->strings_shared = 1;
+    dbc->record_capacity = 0;
+    dbc->string_capacity = 0;
+    return base;
+}
+
+// DBCFile#snapshot -> DBCFile
+//
+// Frozen view of the table as it is now, sharing its records and strings
+// with the live table. Taking one costs O(1); writes to the live table
+// afterwards copy what they touch. Not available inside a transaction.
+// Frozen tables are their own snapshot.
+static VALUE dbc_snapshot(VALUE self) {
+    if (OBJ_FROZEN(self)) return self;
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_snapshot, 0, NULL, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    if (dbc->undo) {
+        rb_raise(rb_eRuntimeError, "Cannot take a snapshot inside a transaction");
+    }
+
+    VALUE filepath = rb_iv_get(self, "@filepath");
+    VALUE argv[2] = {RB_TYPE_P(filepath, T_STRING) ? rb_str_new_frozen(filepath) : filepath, dbc->field_definitions};
+    VALUE view = rb_class_new_instance(2, argv, rb_obj_class(self));
+    DBCFile *snapshot;
+    TypedData_Get_Struct(view, DBCFile, &dbc_data_type, snapshot);
+
+    DBCCowBase *base = cow_base_take(dbc);
+    __atomic_add_fetch(&base->refs, 1, __ATOMIC_ACQ_REL);
+    snapshot->cow_base = base;
+    snapshot->records = base->records;
+    snapshot->string_block = base->string_block;
+    snapshot->records_shared = 1;
+    snapshot->strings_shared = 1;
+    snapshot->header = dbc->header;
+    snapshot->indexes_stale = 0;  // a view starts without indexes
+    snapshot->modified = dbc->modified;
+    snapshot->stamp = dbc->stamp;
+
+    return rb_obj_freeze(view);
+}
+
+void Init_wow_dbc_cow(void) {
+    rb_define_method(rb_cDBCFile, "snapshot", dbc_snapshot, 0);
+}
@@ -0,0 +1,328 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// RFC 4180 CSV with a header row of field names. Strings are quoted only
+// when they contain a separator, quote or line break.
+
+static void csv_write_string(DBCBuffer *buf, const char *s) {
+    size_t plain = strcspn(s, ",\"\r\n");
+    if (s[plain] == '\0') {
+        dbc_buf_append(buf, s, plain);
+        return;
+    }
+
+    dbc_buf_append(buf, "\"", 1);
+    for (;;) {
+        size_t run = strcspn(s, "\"");
+        dbc_buf_append(buf, s, run);
+        if (s[run] == '\0') break;
+        dbc_buf_append(buf, "\"\"", 2);
+        s += run + 1;
+    }
+    dbc_buf_append(buf, "\"", 1);
+}
+
+typedef struct {
+    DBCFile *dbc;
+    FieldType *types;
+    DBCOutput out;
+} CSVExport;
+
+static VALUE csv_export_body(VALUE arg) {
+    CSVExport *ex = (CSVExport *)arg;
+    DBCFile *dbc = ex->dbc;
+    DBCBuffer *buf = &ex->out.buf;
+    uint32_t field_count = dbc->header.field_count;
+
+    VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+    for (uint32_t j = 0; j < field_count; j++) {
+        VALUE name = rb_ary_entry(field_names, j);
+        name = NIL_P(name) ? rb_sprintf("field_%u", j) : rb_obj_as_string(name);
+        if (j) dbc_buf_append(buf, ",", 1);
+        csv_write_string(buf, StringValueCStr(name));
+    }
+    dbc_buf_append(buf, "\n", 1);
+
+    for (uint32_t i = 0; i < dbc->header.record_count; i++) {
+        FieldValue *record = dbc->records[i];
+        dbc_buf_reserve(buf, (size_t)field_count * (DBC_NUMBER_MAX + 1) + 1);
+
+        for (uint32_t j = 0; j < field_count; j++) {
+            if (j) buf->data[buf->size++] = ',';
+            switch (ex->types[j]) {
+                case TYPE_UINT32:
+                    buf->size += dbc_format_uint32(buf->data + buf->size, record[j].value.uint32_value);
+                    break;
+                case TYPE_INT32:
+                    buf->size += dbc_format_int32(buf->data + buf->size, record[j].value.int32_value);
+                    break;
+                case TYPE_FLOAT:
+                    buf->size += dbc_format_float(buf->data + buf->size, record[j].value.float_value);
+                    break;
+                case TYPE_STRING: {
+                    uint32_t offset = record[j].value.string_offset;
+                    csv_write_string(buf, offset < dbc->header.string_block_size ? &dbc->string_block[offset] : "");
+                    // strings may have grown the buffer past the reservation
+                    dbc_buf_reserve(buf, (size_t)(field_count - j) * (DBC_NUMBER_MAX + 1) + 1);
+                    break;
+                }
+            }
+        }
+        buf->data[buf->size++] = '\n';
+
+        if (buf->size >= DBC_OUTPUT_CHUNK) dbc_out_flush(&ex->out);
+    }
+    dbc_out_flush(&ex->out);
+
+    return Qnil;
+}
+
+static VALUE csv_export_cleanup(VALUE arg) {
+    CSVExport *ex = (CSVExport *)arg;
+    dbc_out_free(&ex->out);
+    return Qnil;
+}
+
+// DBCFile#to_csv(io) -> self
+static VALUE dbc_to_csv(VALUE self, VALUE io) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_to_csv, 1, &io, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    CSVExport ex;
+    VALUE types_buf;
+    ex.dbc = dbc;
+    ex.types = ALLOCV_N(FieldType, types_buf, dbc->header.field_count ? dbc->header.field_count : 1);
+    dbc_column_types(dbc, ex.types);
+    dbc_out_init(&ex.out, io);
+
+    rb_ensure(csv_export_body, (VALUE)&ex, csv_export_cleanup, (VALUE)&ex);
+    ALLOCV_END(types_buf);
+    return self;
+}
+
+/* Import */
+
+typedef struct {
+    const char *pos;
+    const char *end;
+    long line;
+    DBCBuffer unquoted;
+} CSVReader;
+
+// Reads the next field. Returns 1 when more fields follow on the same
+// record, 0 at the end of the record.
+static int csv_next_field(CSVReader *reader, const char **field, size_t *len) {
+    const char *p = reader->pos;
+    const char *end = reader->end;
+
+    if (p < end && *p == '"') {
+        long start_line = reader->line;
+        reader->unquoted.size = 0;
+        p++;
+        for (;;) {
+            const char *quote = memchr(p, '"', (size_t)(end - p));
+            if (!quote) rb_raise(rb_eArgError, "Unterminated quoted CSV field at line %ld", start_line);
+            for (const char *c = p; c < quote; c++) {
+                if (*c == '\n') reader->line++;
+            }
+            dbc_buf_append(&reader->unquoted, p, (size_t)(quote - p));
+            p = quote + 1;
+            if (p < end && *p == '"') {
+                dbc_buf_append(&reader->unquoted, "\"", 1);
+                p++;
+                continue;
+            }
+            break;
+        }
+        *field = reader->unquoted.data;
+        *len = reader->unquoted.size;
+    } else {
+        const char *start = p;
+        while (p < end && *p != ',' && *p != '\n' && *p != '\r') p++;
+        *field = start;
+        *len = (size_t)(p - start);
+    }
+
+    if (p < end && *p == ',') {
+        reader->pos = p + 1;
+        return 1;
+    }
+    if (p < end) {
+        if (*p == '\r') p++;
+        if (p < end && *p == '\n') {
+            p++;
+        } else if (p[-1] != '\r') {
+            rb_raise(rb_eArgError, "Unexpected character after quoted CSV field at line %ld", reader->line);
+        }
+    }
+    reader->line++;
+    reader->pos = p;
+    return 0;
+}
+
+typedef struct {
+    VALUE io;
+    VALUE schema;
+    VALUE filepath;
+    VALUE klass;
+    CSVReader reader;
+    DBCBuilder builder;
+    int32_t *column_fields;  // CSV column -> field index
+    FieldType *types;
+} CSVImport;
+
+static void csv_parse_value(CSVImport *im, FieldValue *value, FieldType type, const char *field, size_t len, VALUE name, long line) {
+    int64_t n;
+    value->type = type;
+
+    if (len == 0) {
+        value->value.uint32_value = 0;
+        return;
+    }
+
+    switch (type) {
+        case TYPE_UINT32:
+            // Negative values wrap like NUM2UINT does for update_record
+            if (!dbc_parse_int64(field, len, INT32_MIN, UINT32_MAX, &n)) {
+                rb_raise(rb_eArgError, "Invalid uint32 value for %"PRIsVALUE" at line %ld", name, line);
+            }
+            value->value.uint32_value = (uint32_t)n;
+            break;
+        case TYPE_INT32:
+            if (!dbc_parse_int64(field, len, INT32_MIN, INT32_MAX, &n)) {
+                rb_raise(rb_eArgError, "Invalid int32 value for %"PRIsVALUE" at line %ld", name, line);
+            }
+            value->value.int32_value = (int32_t)n;
+            break;
+        case TYPE_FLOAT:
+            if (!dbc_parse_float(field, len, &value->value.float_value)) {
+                rb_raise(rb_eArgError, "Invalid float value for %"PRIsVALUE" at line %ld", name, line);
+            }
+            break;
+        case TYPE_STRING:
+            value->value.string_offset = dbc_builder_add_string(&im->builder, field, (uint32_t)len);
+            break;
+    }
+}
+
+static VALUE csv_import_body(VALUE arg) {
+    CSVImport *im = (CSVImport *)arg;
+    CSVReader *reader = &im->reader;
+
+    Check_Type(im->schema, T_HASH);
+    VALUE field_names = rb_funcall(im->schema, rb_intern("keys"), 0);
+    uint32_t field_count = (uint32_t)RARRAY_LEN(field_names);
+    if (field_count == 0) rb_raise(rb_eArgError, "Schema has no fields");
+
+    im->types = malloc(field_count * sizeof(FieldType));
+    if (!im->types) rb_raise(rb_eNoMemError, "Could not allocate the column types");
+    for (uint32_t j = 0; j < field_count; j++) {
+        VALUE field_type = rb_hash_aref(im->schema, rb_ary_entry(field_names, j));
+        im->types[j] = NIL_P(field_type) ? TYPE_UINT32 : ruby_to_field_type(field_type);
+    }
+
+    VALUE data = rb_funcall(im->io, rb_intern("read"), 0);
+    StringValue(data);
+    reader->pos = RSTRING_PTR(data);
+    reader->end = reader->pos + RSTRING_LEN(data);
+    reader->line = 1;
+    dbc_buf_init(&reader->unquoted, 256);
+    dbc_builder_init(&im->builder, field_count);
+
+    if (reader->end - reader->pos >= 3 && memcmp(reader->pos, "\xEF\xBB\xBF", 3) == 0) {
+        reader->pos += 3;
+    }
+    if (reader->pos == reader->end) rb_raise(rb_eArgError, "CSV has no header row");
+
+    // Header row
+    uint32_t column_count = 0;
+    uint32_t column_capacity = field_count;
+    im->column_fields = malloc(column_capacity * sizeof(int32_t));
+    if (!im->column_fields) rb_raise(rb_eNoMemError, "Could not allocate the CSV columns");
+    int more;
+    do {
+        const char *field;
+        size_t len;
+        more = csv_next_field(reader, &field, &len);
+
+        int32_t field_idx = -1;
+        for (uint32_t j = 0; j < field_count; j++) {
+            VALUE name = rb_obj_as_string(rb_ary_entry(field_names, j));
+            if ((size_t)RSTRING_LEN(name) == len && memcmp(RSTRING_PTR(name), field, len) == 0) {
+                field_idx = (int32_t)j;
+                break;
+            }
+        }
+        if (field_idx < 0) {
+            rb_raise(rb_eArgError, "Unknown CSV column: %"PRIsVALUE, rb_str_new(field, (long)len));
+        }
+        if (column_count == column_capacity) {
+            int32_t *column_fields = realloc(im->column_fields, (size_t)column_capacity * 2 * sizeof(int32_t));
+            if (!column_fields) rb_raise(rb_eNoMemError, "Could not grow the CSV columns");
+            im->column_fields = column_fields;
+            column_capacity *= 2;
+        }
+        im->column_fields[column_count++] = field_idx;
+    } while (more);
+
+    // Records
+    while (reader->pos < reader->end) {
+        if (*reader->pos == '\n' || *reader->pos == '\r') {
+            const char *field;
+            size_t len;
+            csv_next_field(reader, &field, &len);
+            continue;
+        }
+
+        FieldValue *record = dbc_builder_add_record(&im->builder);
+        for (uint32_t j = 0; j < field_count; j++) {
+            record[j].type = im->types[j];
+        }
+
+        uint32_t column = 0;
+        long line = reader->line;
+        do {
+            const char *field;
+            size_t len;
+            more = csv_next_field(reader, &field, &len);
+            if (column >= column_count) {
+                rb_raise(rb_eArgError, "Too many CSV fields at line %ld", line);
+            }
+            int32_t field_idx = im->column_fields[column++];
+            csv_parse_value(im, &record[field_idx], im->types[field_idx], field, len, rb_ary_entry(field_names, field_idx), line);
+        } while (more);
+    }
+
+    RB_GC_GUARD(data);
+    return dbc_builder_finish(&im->builder, im->klass, im->filepath, im->schema);
+}
+
+static VALUE csv_import_cleanup(VALUE arg) {
+    CSVImport *im = (CSVImport *)arg;
+    dbc_buf_free(&im->reader.unquoted);
+    dbc_builder_free(&im->builder);
+    free(im->column_fields);
+    free(im->types);
+    return Qnil;
+}
+
+// DBCFile.from_csv(io, schema, filepath = nil) -> DBCFile
+//
+// `schema` is a field definitions hash; CSV columns are matched to it by
+// header name and may come in any order. Missing columns are left zero.
+static VALUE dbc_from_csv(int argc, VALUE *argv, VALUE klass) {
+    CSVImport im;
+    memset(&im, 0, sizeof(CSVImport));
+    rb_scan_args(argc, argv, "21", &im.io, &im.schema, &im.filepath);
+    im.klass = klass;
+
+    return rb_ensure(csv_import_body, (VALUE)&im, csv_import_cleanup, (VALUE)&im);
+}
+
+void Init_wow_dbc_csv(void) {
+    rb_define_method(rb_cDBCFile, "to_csv", dbc_to_csv, 1);
+    rb_define_singleton_method(rb_cDBCFile, "from_csv", dbc_from_csv, -1);
+}
@@ -0,0 +1,282 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// Record-level diff of two DBC files with the same column layout. Records
+// are paired by key with a hash join over the raw rows of the old file.
+// Paired rows are compared a whole row at a time, and string offsets are
+// only resolved to their text when the rows differ or the two string
+// blocks are not identical.
+
+typedef struct {
+    DBCDiff diff;
+    VALUE added;
+    VALUE removed;
+    VALUE changed;
+} DiffReport;
+
+const char *dbc_diff_string(const DBCRaw *raw, uint32_t offset, size_t *len) {
+    if (offset >= raw->header.string_block_size) {
+        *len = 0;
+        return "";
+    }
+    const char *s = raw->string_block + offset;
+    const char *end = memchr(s, '\0', raw->header.string_block_size - offset);
+    *len = end ? (size_t)(end - s) : raw->header.string_block_size - offset;
+    return s;
+}
+
+static int diff_string_equal(const DBCDiff *diff, uint32_t old_offset, uint32_t new_offset) {
+    size_t old_len, new_len;
+    const char *old_s = dbc_diff_string(&diff->old_raw, old_offset, &old_len);
+    const char *new_s = dbc_diff_string(&diff->new_raw, new_offset, &new_len);
+    return old_len == new_len && memcmp(old_s, new_s, old_len) == 0;
+}
+
+static uint64_t diff_key_hash(const DBCDiff *diff, const DBCRaw *raw, const uint32_t *row) {
+    uint32_t word = row[diff->key];
+    if (diff->types[diff->key] == TYPE_STRING) {
+        size_t len;
+        const char *s = dbc_diff_string(raw, word, &len);
+        return dbc_hash64(s, len, 0);
+    }
+    return dbc_hash64(&word, sizeof(uint32_t), 0);
+}
+
+int dbc_diff_field_equal(const DBCDiff *diff, const uint32_t *old_row, const uint32_t *new_row, uint32_t j) {
+    if (diff->types[j] != TYPE_STRING) return old_row[j] == new_row[j];
+    if (old_row[j] == new_row[j] && diff->same_strings) return 1;
+    return diff_string_equal(diff, old_row[j], new_row[j]);
+}
+
+VALUE dbc_diff_value(const DBCRaw *raw, const uint32_t *row, uint32_t j, FieldType type) {
+    switch (type) {
+        case TYPE_UINT32:
+            return UINT2NUM(row[j]);
+        case TYPE_INT32:
+            return INT2NUM((int32_t)row[j]);
+        case TYPE_FLOAT: {
+            float f;
+            memcpy(&f, &row[j], sizeof(float));
+            return DBL2NUM(f);
+        }
+        case TYPE_STRING: {
+            size_t len;
+            const char *s = dbc_diff_string(raw, row[j], &len);
+            return rb_str_new(s, (long)len);
+        }
+    }
+    return Qnil;
+}
+
+static VALUE diff_record(const DBCDiff *diff, const DBCRaw *raw, const uint32_t *row) {
+    VALUE record = rb_hash_new();
+    for (uint32_t j = 0; j < raw->columns; j++) {
+        rb_hash_aset(record, rb_ary_entry(diff->field_names, j), dbc_diff_value(raw, row, j, diff->types[j]));
+    }
+    return record;
+}
+
+static void diff_build_table(DBCDiff *diff) {
+    const DBCRaw *raw = &diff->old_raw;
+    uint32_t record_count = raw->header.record_count;
+
+    size_t slot_count = 16;
+    while (slot_count < (uint64_t)record_count * 2) slot_count <<= 1;
+    diff->slots = calloc(slot_count, sizeof(uint32_t));
+    diff->matched = calloc(record_count ? record_count : 1, 1);
+    if (!diff->slots || !diff->matched) {
+        rb_raise(rb_eNoMemError, "Could not allocate diff table");
+    }
+    diff->slot_mask = slot_count - 1;
+
+    for (uint32_t i = 0; i < record_count; i++) {
+        size_t slot = diff_key_hash(diff, raw, raw->records + (size_t)i * raw->columns) & diff->slot_mask;
+        while (diff->slots[slot]) slot = (slot + 1) & diff->slot_mask;
+        diff->slots[slot] = i + 1;
+    }
+}
+
+// The first old row with the same key that is not paired yet, or -1.
+// Duplicate keys pair up in row order.
+int64_t dbc_diff_match(DBCDiff *diff, const uint32_t *new_row) {
+    const DBCRaw *old_raw = &diff->old_raw;
+    uint32_t key = diff->key;
+    size_t slot = diff_key_hash(diff, &diff->new_raw, new_row) & diff->slot_mask;
+
+    for (; diff->slots[slot]; slot = (slot + 1) & diff->slot_mask) {
+        uint32_t row = diff->slots[slot] - 1;
+        if (diff->matched[row]) continue;
+        const uint32_t *old_row = old_raw->records + (size_t)row * old_raw->columns;
+        if (dbc_diff_field_equal(diff, old_row, new_row, key)) return row;
+    }
+    return -1;
+}
+
+static VALUE diff_report_body(VALUE arg) {
+    DiffReport *report = (DiffReport *)arg;
+    DBCDiff *diff = &report->diff;
+    dbc_diff_load(diff);
+
+    const DBCRaw *old_raw = &diff->old_raw;
+    const DBCRaw *new_raw = &diff->new_raw;
+    uint32_t columns = new_raw->columns;
+    size_t row_bytes = (size_t)columns * sizeof(uint32_t);
+
+    VALUE sym_key = ID2SYM(rb_intern("key"));
+    VALUE sym_fields = ID2SYM(rb_intern("fields"));
+    VALUE sym_old = ID2SYM(rb_intern("old"));
+    VALUE sym_new = ID2SYM(rb_intern("new"));
+
+    for (uint32_t i = 0; i < new_raw->header.record_count; i++) {
+        const uint32_t *new_row = new_raw->records + (size_t)i * columns;
+        int64_t match = dbc_diff_match(diff, new_row);
+        if (match < 0) {
+            rb_ary_push(report->added, diff_record(diff, new_raw, new_row));
+            continue;
+        }
+        diff->matched[match] = 1;
+
+        const uint32_t *old_row = old_raw->records + (size_t)match * columns;
+        if (diff->same_strings && memcmp(old_row, new_row, row_bytes) == 0) continue;
+
+        VALUE fields = Qnil;
+        for (uint32_t j = 0; j < columns; j++) {
+            if (dbc_diff_field_equal(diff, old_row, new_row, j)) continue;
+            if (NIL_P(fields)) fields = rb_ary_new();
+            rb_ary_push(fields, rb_ary_entry(diff->field_names, j));
+        }
+        if (NIL_P(fields)) continue;
+
+        VALUE change = rb_hash_new();
+        rb_hash_aset(change, sym_key, dbc_diff_value(new_raw, new_row, diff->key, diff->types[diff->key]));
+        rb_hash_aset(change, sym_fields, fields);
+        rb_hash_aset(change, sym_old, diff_record(diff, old_raw, old_row));
+        rb_hash_aset(change, sym_new, diff_record(diff, new_raw, new_row));
+        rb_ary_push(report->changed, change);
+    }
+
+    for (uint32_t i = 0; i < old_raw->header.record_count; i++) {
+        if (!diff->matched[i]) {
+            rb_ary_push(report->removed, diff_record(diff, old_raw, old_raw->records + (size_t)i * columns));
+        }
+    }
+
+    return Qnil;
+}
+
+VALUE dbc_diff_cleanup(VALUE arg) {
+    DBCDiff *diff = (DBCDiff *)arg;
+    dbc_raw_release(&diff->old_raw);
+    dbc_raw_release(&diff->new_raw);
+    free(diff->types);
+    free(diff->slots);
+    free(diff->matched);
+    return Qnil;
+}
+
+// Loads both files and builds the join table. Runs under rb_ensure with
+// dbc_diff_cleanup.
+void dbc_diff_load(DBCDiff *diff) {
+    dbc_raw_load(diff->old_path, &diff->old_raw);
+    dbc_raw_load(diff->new_path, &diff->new_raw);
+    dbc_diff_prepare(diff);
+}
+
+// Checks the layouts of the two loaded files and builds the join table.
+// The raws may be shared with other diffs, in which case the caller
+// releases them and frees only `types`, `slots` and `matched` of each diff.
+void dbc_diff_prepare(DBCDiff *diff) {
+    diff->types = malloc((diff->field_count ? diff->field_count : 1) * sizeof(FieldType));
+    if (!diff->types) {
+        rb_raise(rb_eNoMemError, "Could not allocate diff column types");
+    }
+    for (uint32_t j = 0; j < diff->field_count; j++) {
+        diff->types[j] = ruby_to_field_type(rb_hash_aref(diff->fields, rb_ary_entry(diff->field_names, j)));
+    }
+
+    if (diff->old_raw.columns != diff->new_raw.columns) {
+        rb_raise(rb_eArgError, "Files have different record layouts: %u and %u columns",
+                 diff->old_raw.columns, diff->new_raw.columns);
+    }
+    if (diff->field_count != diff->new_raw.columns) {
+        rb_raise(rb_eArgError, "Field definitions cover %u of %u columns", diff->field_count, diff->new_raw.columns);
+    }
+
+    const DBCRaw *old_raw = &diff->old_raw;
+    const DBCRaw *new_raw = &diff->new_raw;
+    diff->same_strings = old_raw->header.string_block_size == new_raw->header.string_block_size &&
+                         memcmp(old_raw->string_block, new_raw->string_block, old_raw->header.string_block_size) == 0;
+    diff_build_table(diff);
+}
+
+// Resolves the paths, field definitions and key of a diff between two
+// files from `key:` and `fields:` options. `fields` are field definitions
+// covering every column, inferred with Schema.infer from the new file by
+// default. A `key` of :id names the first column when the definitions have
+// no :id field.
+void dbc_diff_init(DBCDiff *diff, VALUE old_path, VALUE new_path, VALUE options) {
+    ID keywords[2] = {rb_intern("key"), rb_intern("fields")};
+    VALUE values[2] = {Qundef, Qundef};
+    if (!NIL_P(options)) rb_get_kwargs(options, keywords, 0, 2, values);
+    VALUE key = values[0] == Qundef ? ID2SYM(rb_intern("id")) : values[0];
+    VALUE fields = values[1] == Qundef ? Qnil : values[1];
+
+    memset(diff, 0, sizeof(DBCDiff));
+    diff->old_path = StringValueCStr(old_path);
+    diff->new_path = StringValueCStr(new_path);
+
+    if (NIL_P(fields)) {
+        VALUE schema = rb_const_get(rb_mWowDBC, rb_intern("Schema"));
+        fields = rb_funcall(schema, rb_intern("infer"), 1, new_path);
+    }
+    Check_Type(fields, T_HASH);
+    diff->fields = fields;
+    diff->field_names = rb_funcall(fields, rb_intern("keys"), 0);
+    long field_count = RARRAY_LEN(diff->field_names);
+    diff->field_count = (uint32_t)field_count;
+
+    long key_idx = -1;
+    for (long j = 0; j < field_count; j++) {
+        if (rb_eql(rb_ary_entry(diff->field_names, j), key)) {
+            key_idx = j;
+            break;
+        }
+    }
+    if (key_idx < 0 && key == ID2SYM(rb_intern("id")) && field_count > 0) key_idx = 0;
+    if (key_idx < 0) {
+        rb_raise(rb_eArgError, "Invalid field name: %"PRIsVALUE, key);
+    }
+    diff->key = (uint32_t)key_idx;
+}
+
+// WowDBC.diff(old_path, new_path, key: :id, fields: nil)
+//   -> { added: [record, ...], removed: [record, ...],
+//        changed: [{ key:, fields:, old:, new: }, ...] }
+//
+// Pairs the records of two DBC files by `key` and reports what changed.
+// See dbc_diff_init for the options.
+static VALUE wow_dbc_diff(int argc, VALUE *argv, VALUE self) {
+    VALUE old_path, new_path, options;
+    rb_scan_args(argc, argv, "2:", &old_path, &new_path, &options);
+
+    DiffReport report;
+    dbc_diff_init(&report.diff, old_path, new_path, options);
+    report.added = rb_ary_new();
+    report.removed = rb_ary_new();
+    report.changed = rb_ary_new();
+
+    rb_ensure(diff_report_body, (VALUE)&report, dbc_diff_cleanup, (VALUE)&report.diff);
+
+    VALUE result = rb_hash_new();
+    rb_hash_aset(result, ID2SYM(rb_intern("added")), report.added);
+    rb_hash_aset(result, ID2SYM(rb_intern("removed")), report.removed);
+    rb_hash_aset(result, ID2SYM(rb_intern("changed")), report.changed);
+    RB_GC_GUARD(report.diff.fields);
+    RB_GC_GUARD(report.diff.field_names);
+    return result;
+}
+
+void Init_wow_dbc_diff(void) {
+    rb_define_module_function(rb_mWowDBC, "diff", wow_dbc_diff, -1);
+}
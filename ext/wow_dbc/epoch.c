@@ -0,0 +1,248 @@
+#include "wow_dbc.h"
+
+#include <ruby/thread_native.h>
+#include <stdlib.h>
+
+// Epoch-based reclamation for tables in concurrent mode. Readers take no
+// lock: they join the current epoch and leave it when done. Anything a
+// writer unlinks while readers may still hold it (records, record arrays,
+// string blocks, index words) is retired instead of freed, and released
+// once every reader that could have seen it has left. The domain is shared
+// by all tables, so with no readers anywhere retiring frees at once and
+// tables outside concurrent mode behave as before.
+//
+// Under the GVL readers and writers of one table only interleave where
+// the C code calls back into Ruby (blocks, IO, conversions), which is
+// exactly where a reader can be left holding pointers a writer replaces.
+
+typedef struct {
+    void *ptr;
+    void (*release)(void *);
+} Retired;
+
+typedef struct {
+    Retired *items;
+    size_t count;
+    size_t capacity;
+} RetireList;
+
+static rb_nativethread_lock_t epoch_lock;
+static uint64_t epoch_current;
+static uint32_t epoch_readers[2];  // readers by epoch parity
+static RetireList epoch_retired[3];  // by epoch modulo 3
+static __thread int guard_passthrough;
+static ID id_write_lock;
+static ID id_owned_p;
+
+static void retire_release(Retired *item) {
+    if (item->release) {
+        item->release(item->ptr);
+    } else {
+        free(item->ptr);
+    }
+}
+
+static void retire_list_drain(RetireList *list) {
+    for (size_t k = 0; k < list->count; k++) retire_release(&list->items[k]);
+    list->count = 0;
+}
+
+static uint32_t epoch_reader_count(void) {
+    return __atomic_load_n(&epoch_readers[0], __ATOMIC_SEQ_CST) + __atomic_load_n(&epoch_readers[1], __ATOMIC_SEQ_CST);
+}
+
+// Called with epoch_lock held. Items retired in epoch e - 1 are released
+// when moving from e to e + 1, which waits for the readers of e - 1.
+static void epoch_reclaim(void) {
+    if (epoch_reader_count() == 0) {
+        for (int k = 0; k < 3; k++) retire_list_drain(&epoch_retired[k]);
+        return;
+    }
+    uint64_t e = __atomic_load_n(&epoch_current, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&epoch_readers[(e + 1) & 1], __ATOMIC_SEQ_CST) == 0) {
+        __atomic_store_n(&epoch_current, e + 1, __ATOMIC_SEQ_CST);
+        retire_list_drain(&epoch_retired[(e + 2) % 3]);
+    }
+}
+
+uint64_t dbc_epoch_enter(void) {
+    for (;;) {
+        uint64_t e = __atomic_load_n(&epoch_current, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&epoch_readers[e & 1], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&epoch_current, __ATOMIC_SEQ_CST) == e) return e;
+        __atomic_sub_fetch(&epoch_readers[e & 1], 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+void dbc_epoch_exit(uint64_t e) {
+    __atomic_sub_fetch(&epoch_readers[e & 1], 1, __ATOMIC_SEQ_CST);
+    rb_nativethread_lock_lock(&epoch_lock);
+    epoch_reclaim();
+    rb_nativethread_lock_unlock(&epoch_lock);
+}
+
+// Whether a reader anywhere might be holding pointers into a table
+int dbc_epoch_active(void) {
+    return epoch_reader_count() != 0;
+}
+
+// Frees `ptr` with `release` (free when NULL) once no reader can hold it
+void dbc_retire(void *ptr, void (*release)(void *)) {
+    if (!ptr) return;
+    Retired item = {ptr, release};
+    if (!dbc_epoch_active()) {
+        retire_release(&item);
+        return;
+    }
+
+    rb_nativethread_lock_lock(&epoch_lock);
+    RetireList *list = &epoch_retired[__atomic_load_n(&epoch_current, __ATOMIC_SEQ_CST) % 3];
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        Retired *items = realloc(list->items, capacity * sizeof(Retired));
+        if (!items) {
+            // Leaking beats freeing memory a reader may still use
+            rb_nativethread_lock_unlock(&epoch_lock);
+            return;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = item;
+    epoch_reclaim();
+    rb_nativethread_lock_unlock(&epoch_lock);
+}
+
+// realloc for memory readers may be using: the old block is retired
+// rather than freed when readers are active
+void *dbc_grow(void *ptr, size_t used, size_t size) {
+    if (!dbc_epoch_active()) {
+        void *grown = realloc(ptr, size ? size : 1);
+        if (!grown) rb_raise(rb_eNoMemError, "Could not grow table storage to %zu bytes", size);
+        return grown;
+    }
+    void *copy = malloc(size ? size : 1);
+    if (!copy) rb_raise(rb_eNoMemError, "Could not grow table storage to %zu bytes", size);
+    if (used) memcpy(copy, ptr, used);
+    dbc_retire(ptr, NULL);
+    return copy;
+}
+
+typedef struct {
+    VALUE self;
+    DBCFile *dbc;
+    DBCAccess access;
+    DBCMethod fn;
+    int arity;
+    const VALUE *argv;
+    uint64_t epoch;
+} Guard;
+
+static VALUE guard_call(VALUE arg) {
+    Guard *guard = (Guard *)arg;
+    const VALUE *argv = guard->argv;
+    guard_passthrough = 1;
+    switch (guard->arity) {
+        case 0:
+            return ((VALUE (*)(VALUE))guard->fn)(guard->self);
+        case 1:
+            return ((VALUE (*)(VALUE, VALUE))guard->fn)(guard->self, argv[0]);
+        case 2:
+            return ((VALUE (*)(VALUE, VALUE, VALUE))guard->fn)(guard->self, argv[0], argv[1]);
+        case 3:
+            return ((VALUE (*)(VALUE, VALUE, VALUE, VALUE))guard->fn)(guard->self, argv[0], argv[1], argv[2]);
+        default:
+            return ((VALUE (*)(int, const VALUE *, VALUE))guard->fn)(-guard->arity - 1, argv, guard->self);
+    }
+}
+
+static VALUE guard_exit(VALUE arg) {
+    dbc_epoch_exit(((Guard *)arg)->epoch);
+    return Qnil;
+}
+
+static VALUE guard_write_end(VALUE arg) {
+    DBCFile *dbc = ((Guard *)arg)->dbc;
+    if (dbc->writing == 2) dbc->indexes_stale = 1;
+    dbc->writing = 0;
+    return Qnil;
+}
+
+static VALUE guard_write(VALUE arg) {
+    ((Guard *)arg)->dbc->writing = 1;
+    return rb_ensure(guard_call, arg, guard_write_end, arg);
+}
+
+// Calls the method as a reader or writer in concurrent mode, directly
+// otherwise
+static VALUE guard_run(VALUE arg) {
+    Guard *guard = (Guard *)arg;
+    if (!guard->dbc->concurrent) return guard_call(arg);
+    if (guard->access == DBC_WRITER) {
+        VALUE lock = rb_ivar_get(guard->self, id_write_lock);
+        if (RTEST(rb_funcall(lock, id_owned_p, 0))) return guard_call(arg);
+        return rb_mutex_synchronize(lock, guard_write, arg);
+    }
+    guard->epoch = dbc_epoch_enter();
+    return rb_ensure(guard_call, arg, guard_exit, arg);
+}
+
+// Runs a DBCFile method as a reader or writer when the table is in
+// concurrent mode, and times it while instrumentation is on. Methods
+// start with
+//
+//   VALUE guarded;
+//   if (dbc_guard(self, DBC_WRITER, (DBCMethod)this_method, arity, argv, &guarded)) return guarded;
+//
+// which calls the method again inside the guard and returns its result.
+// `arity` is the method's fixed argument count, or -1 - argc for methods
+// taking (argc, argv, self). Returns 0, running nothing, when neither
+// applies and on the guarded call itself.
+int dbc_guard(VALUE self, DBCAccess access, DBCMethod fn, int arity, const VALUE *argv, VALUE *result) {
+    if (guard_passthrough) {
+        guard_passthrough = 0;
+        return 0;
+    }
+    DBCFile *dbc = rb_check_typeddata(self, &dbc_data_type);
+    if (!(dbc->concurrent | dbc_instrumenting)) return 0;
+
+    Guard guard = {self, dbc, access, fn, arity, argv, 0};
+    if (dbc_instrumenting) {
+        *result = dbc_instrument(rb_frame_this_func(), guard_run, (VALUE)&guard);
+    } else {
+        *result = guard_run((VALUE)&guard);
+    }
+    return 1;
+}
+
+// DBCFile#concurrent! -> self
+//
+// Lets several threads use the table at once. Readers run without locking
+// while writers take turns on a mutex, and memory a writer replaces is
+// kept until the readers that might be using it are done. Re-entrant, so a
+// transaction holds off other writers until it ends.
+static VALUE dbc_concurrent_bang(VALUE self) {
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    if (dbc->concurrent) return self;
+
+    rb_check_frozen(self);
+    rb_ivar_set(self, id_write_lock, rb_mutex_new());
+    dbc->concurrent = 1;
+    return self;
+}
+
+// DBCFile#concurrent? -> true or false
+static VALUE dbc_concurrent_p(VALUE self) {
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    return dbc->concurrent ? Qtrue : Qfalse;
+}
+
+void Init_wow_dbc_epoch(void) {
+    rb_nativethread_lock_initialize(&epoch_lock);
+    id_write_lock = rb_intern("@write_lock");
+    id_owned_p = rb_intern("owned?");
+    rb_define_method(rb_cDBCFile, "concurrent!", dbc_concurrent_bang, 0);
+    rb_define_method(rb_cDBCFile, "concurrent?", dbc_concurrent_p, 0);
+}
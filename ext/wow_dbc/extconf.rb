@@ -2,4 +2,16 @@
 
 require 'mkmf'
 
+# Optional: DBCFile#to_sqlite
+$defs << '-DHAVE_SQLITE3' if have_header('sqlite3.h') && have_library('sqlite3', 'sqlite3_open_v2', 'sqlite3.h')
+
+# Optional: WowDBC::Catalog::Watcher
+have_header('sys/inotify.h')
+
+# shm_open lives in librt before glibc 2.34
+have_library('rt', 'shm_open')
+
+# Exact heap sizes for ObjectSpace.memsize_of and DBCFile#memory_report
+have_func('malloc_usable_size', 'malloc.h')
+
 create_makefile('wow_dbc/wow_dbc')
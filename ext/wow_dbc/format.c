@@ -0,0 +1,161 @@
+#include "wow_dbc.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// Number formatting and parsing for the text exporters and importers.
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+#define FLOAT_MAX_DECIMALS 6
+
+static size_t format_uint64(char *dst, uint64_t v) {
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+
+    while (v >= 100) {
+        uint64_t q = v / 100;
+        p -= 2;
+        memcpy(p, &digit_pairs[(v - q * 100) * 2], 2);
+        v = q;
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, &digit_pairs[v * 2], 2);
+    } else {
+        *--p = (char)('0' + v);
+    }
+
+    size_t len = (size_t)(tmp + sizeof(tmp) - p);
+    memcpy(dst, p, len);
+    return len;
+}
+
+size_t dbc_format_uint32(char *dst, uint32_t v) {
+    return format_uint64(dst, v);
+}
+
+size_t dbc_format_int32(char *dst, int32_t v) {
+    if (v < 0) {
+        *dst = '-';
+        return 1 + format_uint64(dst + 1, (uint64_t)(-(int64_t)v));
+    }
+    return format_uint64(dst, (uint64_t)v);
+}
+
+// Shortest fixed-point form with up to FLOAT_MAX_DECIMALS decimals that
+// reads back as the same float, which covers nearly all values in game
+// data; anything else falls back to %.9g.
+size_t dbc_format_float(char *dst, float f) {
+    double d = f;
+
+    if (isfinite(d) && fabs(d) < 1e9) {
+        for (int decimals = 0; decimals <= FLOAT_MAX_DECIMALS; decimals++) {
+            double scaled = nearbyint(d * powers_of_ten[decimals]);
+            if ((float)(scaled / powers_of_ten[decimals]) != f) continue;
+
+            char *p = dst;
+            if (scaled < 0) {
+                *p++ = '-';
+                scaled = -scaled;
+            }
+            uint64_t digits = (uint64_t)scaled;
+            uint64_t divisor = (uint64_t)powers_of_ten[decimals];
+            p += format_uint64(p, digits / divisor);
+            if (decimals) {
+                char fraction[FLOAT_MAX_DECIMALS];
+                uint64_t rest = digits % divisor;
+                for (int k = decimals - 1; k >= 0; k--) {
+                    fraction[k] = (char)('0' + rest % 10);
+                    rest /= 10;
+                }
+                *p++ = '.';
+                memcpy(p, fraction, decimals);
+                p += decimals;
+            }
+            return (size_t)(p - dst);
+        }
+    }
+
+    return (size_t)snprintf(dst, DBC_NUMBER_MAX, "%.9g", d);
+}
+
+// Parses a whole decimal integer in [min, max]. Returns 0 on garbage or
+// overflow.
+int dbc_parse_int64(const char *s, size_t len, int64_t min, int64_t max, int64_t *out) {
+    size_t i = 0;
+    int negative = 0;
+
+    if (i < len && (s[i] == '-' || s[i] == '+')) negative = s[i++] == '-';
+    if (i == len) return 0;
+
+    uint64_t v = 0;
+    for (; i < len; i++) {
+        unsigned digit = (unsigned)(s[i] - '0');
+        if (digit > 9) return 0;
+        v = v * 10 + digit;
+        if (v > (uint64_t)1 << 33) return 0;
+    }
+
+    int64_t result = negative ? -(int64_t)v : (int64_t)v;
+    if (result < min || result > max) return 0;
+    *out = result;
+    return 1;
+}
+
+// Plain decimals with up to 15 significant digits are converted exactly
+// with one division; exponents and longer inputs go through strtod.
+int dbc_parse_float(const char *s, size_t len, float *out) {
+    size_t i = 0;
+    int negative = 0;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int decimals = 0;
+    int seen_point = 0;
+
+    if (i < len && (s[i] == '-' || s[i] == '+')) negative = s[i++] == '-';
+    for (; i < len; i++) {
+        char c = s[i];
+        if (c >= '0' && c <= '9') {
+            if (digits == 15) break;
+            mantissa = mantissa * 10 + (uint64_t)(c - '0');
+            if (mantissa) digits++;
+            if (seen_point) decimals++;
+        } else if (c == '.' && !seen_point) {
+            seen_point = 1;
+        } else {
+            break;
+        }
+    }
+
+    if (i == len && (digits || i > (size_t)negative + (size_t)seen_point) && decimals <= 22) {
+        double d = (double)mantissa / powers_of_ten[decimals];
+        *out = (float)(negative ? -d : d);
+        return 1;
+    }
+
+    char buf[64];
+    if (len == 0 || len >= sizeof(buf)) return 0;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    char *end;
+    double d = strtod(buf, &end);
+    if (end != buf + len) return 0;
+    *out = (float)d;
+    return 1;
+}
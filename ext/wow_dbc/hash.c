@@ -0,0 +1,245 @@
+#include "wow_dbc.h"
+
+// 64-bit content hash for whole files and records. Stripes of 48 bytes go
+// through three independent lanes of 64x64->128 bit multiplies, in the
+// style of wyhash and XXH3, so the CPU can overlap them.
+// The output is stable across platforms and releases since it is stored
+// in sidecar files.
+
+#define HASH_P0 0xa0761d6478bd642fULL
+#define HASH_P1 0xe7037ed1a0b428dbULL
+#define HASH_P2 0x8ebc6af09c88c6e3ULL
+#define HASH_P3 0x589965cc75374cc3ULL
+
+static inline uint64_t hash_fold(uint64_t a, uint64_t b) {
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t hash_read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t hash_read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline void hash_stripe(DBCHashState *state, const uint8_t *p) {
+    state->seed = hash_fold(hash_read64(p) ^ HASH_P1, hash_read64(p + 8) ^ state->seed);
+    state->lane1 = hash_fold(hash_read64(p + 16) ^ HASH_P2, hash_read64(p + 24) ^ state->lane1);
+    state->lane2 = hash_fold(hash_read64(p + 32) ^ HASH_P3, hash_read64(p + 40) ^ state->lane2);
+}
+
+// Hashes the last 1 to 48 bytes of input longer than 48 bytes. `p` may be
+// read up to 16 bytes backwards.
+static uint64_t hash_finish(uint64_t seed, const uint8_t *p, size_t i, uint64_t len) {
+    while (i > 16) {
+        seed = hash_fold(hash_read64(p) ^ HASH_P1, hash_read64(p + 8) ^ seed);
+        p += 16;
+        i -= 16;
+    }
+    uint64_t a = hash_read64(p + i - 16) ^ HASH_P1;
+    uint64_t b = hash_read64(p + i - 8) ^ seed;
+    __uint128_t r = (__uint128_t)a * b;
+    return hash_fold((uint64_t)r ^ HASH_P0 ^ len, (uint64_t)(r >> 64) ^ HASH_P1);
+}
+
+uint64_t dbc_hash64(const void *data, size_t len, uint64_t seed) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t a, b;
+
+    seed ^= hash_fold(seed ^ HASH_P0, HASH_P1);
+    if (len > 16) {
+        size_t i = len;
+        if (i > 48) {
+            DBCHashState state = {.seed = seed, .lane1 = seed, .lane2 = seed};
+            do {
+                hash_stripe(&state, p);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed = state.seed ^ state.lane1 ^ state.lane2;
+        }
+        return hash_finish(seed, p, i, len);
+    }
+
+    if (len >= 4) {
+        size_t mid = (len >> 3) << 2;
+        a = (hash_read32(p) << 32) | hash_read32(p + mid);
+        b = (hash_read32(p + len - 4) << 32) | hash_read32(p + len - 4 - mid);
+    } else if (len > 0) {
+        a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+        b = 0;
+    } else {
+        a = b = 0;
+    }
+    __uint128_t r = (__uint128_t)(a ^ HASH_P1) * (b ^ seed);
+    return hash_fold((uint64_t)r ^ HASH_P0 ^ len, (uint64_t)(r >> 64) ^ HASH_P1);
+}
+
+// Streaming form of dbc_hash64: any split of the same bytes across updates
+// gives the same hash as a single call.
+void dbc_hash_init(DBCHashState *state, uint64_t seed) {
+    memset(state, 0, sizeof(DBCHashState));
+    state->seed0 = seed;
+    state->seed = seed ^ hash_fold(seed ^ HASH_P0, HASH_P1);
+    state->lane1 = state->seed;
+    state->lane2 = state->seed;
+}
+
+void dbc_hash_update(DBCHashState *state, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint8_t *pending = state->buf + 16;
+
+    state->total += len;
+    if (state->pending + len <= 48) {
+        memcpy(pending + state->pending, p, len);
+        state->pending += len;
+        return;
+    }
+
+    // A stripe is only consumed once more input is known to follow it, so
+    // the final 1 to 48 bytes are always left for dbc_hash_final
+    if (state->pending) {
+        size_t fill = 48 - state->pending;
+        memcpy(pending + state->pending, p, fill);
+        p += fill;
+        len -= fill;
+        hash_stripe(state, pending);
+        memcpy(state->buf, pending + 32, 16);
+        state->pending = 0;
+        state->striped = 1;
+    }
+    if (len > 48) {
+        do {
+            hash_stripe(state, p);
+            p += 48;
+            len -= 48;
+        } while (len > 48);
+        memcpy(state->buf, p - 16, 16);
+        state->striped = 1;
+    }
+    memcpy(pending, p, len);
+    state->pending = len;
+}
+
+uint64_t dbc_hash_final(const DBCHashState *state) {
+    if (!state->striped) return dbc_hash64(state->buf + 16, state->pending, state->seed0);
+    return hash_finish(state->seed ^ state->lane1 ^ state->lane2, state->buf + 16, state->pending, state->total);
+}
+
+// Hash of one record with string fields resolved to their text, so equal
+// records hash the same whatever their string offsets
+uint64_t dbc_record_hash(const DBCFile *dbc, uint32_t index, const FieldType *types) {
+    const FieldValue *record = dbc->records[index];
+    DBCHashState state;
+    dbc_hash_init(&state, 0);
+
+    for (uint32_t j = 0; j < dbc->header.field_count; j++) {
+        if (types[j] == TYPE_STRING) {
+            uint32_t offset = record[j].value.string_offset;
+            const char *s = offset < dbc->header.string_block_size ? &dbc->string_block[offset] : "";
+            uint32_t len = (uint32_t)strlen(s);
+            dbc_hash_update(&state, &len, sizeof(uint32_t));
+            dbc_hash_update(&state, s, len);
+        } else {
+            dbc_hash_update(&state, &record[j].value.uint32_value, sizeof(uint32_t));
+        }
+    }
+    return dbc_hash_final(&state);
+}
+
+// WowDBC.file_hash(path) -> Integer
+//
+// 64-bit hash of the whole file.
+static VALUE wow_dbc_file_hash(VALUE self, VALUE path) {
+    DBCMapping *mapping = dbc_mapping_open(StringValueCStr(path));
+    uint64_t hash = dbc_hash64(mapping->addr, mapping->size, 0);
+    dbc_mapping_release(mapping);
+    return ULL2NUM(hash);
+}
+
+// Hash of the header, records and string block as #write would produce
+// them, equal to WowDBC.file_hash of the written file
+uint64_t dbc_content_hash(const DBCFile *dbc) {
+    uint32_t field_count = dbc->header.field_count;
+    // Record words are staged in a fixed chunk rather than a row, since
+    // any split of the stream hashes the same
+    uint32_t chunk[256];
+    size_t used = 0;
+    DBCHashState state;
+    dbc_hash_init(&state, 0);
+
+    dbc_hash_update(&state, &dbc->header, sizeof(DBCHeader));
+    for (uint32_t i = 0; i < dbc->header.record_count; i++) {
+        for (uint32_t j = 0; j < field_count; j++) {
+            chunk[used++] = dbc->records[i][j].value.uint32_value;
+            if (used == sizeof(chunk) / sizeof(chunk[0])) {
+                dbc_hash_update(&state, chunk, sizeof(chunk));
+                used = 0;
+            }
+        }
+    }
+    dbc_hash_update(&state, chunk, used * sizeof(uint32_t));
+    dbc_hash_update(&state, dbc->string_block, dbc->header.string_block_size);
+
+    return dbc_hash_final(&state);
+}
+
+// DBCFile#content_hash -> Integer
+static VALUE dbc_content_hash_method(VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_content_hash_method, 0, NULL, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    return ULL2NUM(dbc_content_hash(dbc));
+}
+
+// DBCFile#record_hash(index) -> Integer
+static VALUE dbc_record_hash_method(VALUE self, VALUE index) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_record_hash_method, 1, &index, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    long idx = NUM2LONG(index);
+    if (idx < 0 || (uint32_t)idx >= dbc->header.record_count) {
+        rb_raise(rb_eArgError, "Invalid record index");
+    }
+
+    VALUE types_buf;
+    FieldType *types = ALLOCV_N(FieldType, types_buf, dbc->header.field_count ? dbc->header.field_count : 1);
+    dbc_column_types(dbc, types);
+    uint64_t hash = dbc_record_hash(dbc, (uint32_t)idx, types);
+    ALLOCV_END(types_buf);
+    return ULL2NUM(hash);
+}
+
+// DBCFile#record_hashes -> [Integer, ...]
+static VALUE dbc_record_hashes(VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_record_hashes, 0, NULL, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    VALUE types_buf;
+    FieldType *types = ALLOCV_N(FieldType, types_buf, dbc->header.field_count ? dbc->header.field_count : 1);
+    dbc_column_types(dbc, types);
+    VALUE result = rb_ary_new_capa(dbc->header.record_count);
+    for (uint32_t i = 0; i < dbc->header.record_count; i++) {
+        rb_ary_push(result, ULL2NUM(dbc_record_hash(dbc, i, types)));
+    }
+    ALLOCV_END(types_buf);
+    return result;
+}
+
+void Init_wow_dbc_hash(void) {
+    rb_define_module_function(rb_mWowDBC, "file_hash", wow_dbc_file_hash, 1);
+    rb_define_method(rb_cDBCFile, "content_hash", dbc_content_hash_method, 0);
+    rb_define_method(rb_cDBCFile, "record_hash", dbc_record_hash_method, 1);
+    rb_define_method(rb_cDBCFile, "record_hashes", dbc_record_hashes, 0);
+}
@@ -0,0 +1,975 @@
+#include "wow_dbc.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Secondary indexes over one field. They are declared per table and kept
+// up to date as records are created, updated and deleted, or rebuilt on
+// the next lookup when that is not possible in place.
+
+// Direct indexes are refused when the key range is much wider than the
+// table, where a hash index is the better fit anyway.
+#define DIRECT_MAX_RANGE(record_count) ((uint64_t)(record_count) * 4 + 1024)
+
+static const char *index_string(const DBCFile *dbc, uint32_t offset) {
+    return offset < dbc->header.string_block_size ? &dbc->string_block[offset] : "";
+}
+
+// Raw key bits with -0.0 folded into 0.0 so equal floats share a key
+static uint32_t index_key(const DBCFile *dbc, uint32_t row, uint32_t field, FieldType type) {
+    uint32_t key = dbc->records[row][field].value.uint32_value;
+    if (type == TYPE_FLOAT && key == 0x80000000u) key = 0;
+    return key;
+}
+
+static uint32_t index_mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static uint32_t index_hash_bytes(const char *s, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)s[i];
+        hash *= 16777619u;
+    }
+    return index_mix(hash);
+}
+
+static uint32_t index_hash_key(const DBCFile *dbc, uint32_t key, FieldType type) {
+    if (type == TYPE_STRING) {
+        const char *s = index_string(dbc, key);
+        return index_hash_bytes(s, strlen(s));
+    }
+    return index_mix(key);
+}
+
+// Maps key bits to an unsigned value with the same ordering
+static uint32_t index_sortable(uint32_t key, FieldType type) {
+    switch (type) {
+        case TYPE_INT32:
+            return key ^ 0x80000000u;
+        case TYPE_FLOAT:
+            return (key & 0x80000000u) ? ~key : key | 0x80000000u;
+        default:
+            return key;
+    }
+}
+
+size_t dbc_index_word_count(const DBCIndex *index) {
+    if (index->type == DBC_INDEX_SORTED) return index->entry_count;
+    return (size_t)index->bucket_count + index->record_count;
+}
+
+static void index_build_chains(DBCFile *dbc, DBCIndex *index, FieldType type) {
+    uint32_t *heads = index->words;
+    uint32_t *next = index->words + index->bucket_count;
+
+    // Walking backwards leaves every chain in ascending row order
+    for (uint32_t row = index->record_count; row-- > 0;) {
+        uint32_t key = index_key(dbc, row, index->field, type);
+        uint32_t bucket;
+        if (index->type == DBC_INDEX_DIRECT) {
+            bucket = type == TYPE_INT32 ? (uint32_t)((int32_t)key - (int64_t)(int32_t)index->min) : key - index->min;
+        } else {
+            bucket = index_hash_key(dbc, key, type) & (index->bucket_count - 1);
+        }
+        next[row] = heads[bucket];
+        heads[bucket] = row + 1;
+    }
+}
+
+typedef struct {
+    const char *s;
+    uint32_t row;
+} IndexStringEntry;
+
+static int index_compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int index_compare_strings(const void *a, const void *b) {
+    const IndexStringEntry *x = a;
+    const IndexStringEntry *y = b;
+    int cmp = strcmp(x->s, y->s);
+    if (cmp) return cmp;
+    return x->row < y->row ? -1 : x->row > y->row;
+}
+
+// calloc that raises NoMemoryError, freeing `scratch` first
+static void *index_alloc(size_t count, size_t size, void *scratch) {
+    void *ptr = calloc(count ? count : 1, size);
+    if (!ptr) {
+        free(scratch);
+        rb_raise(rb_eNoMemError, "Could not allocate an index of %zu entries", count);
+    }
+    return ptr;
+}
+
+static void index_build_sorted(DBCFile *dbc, DBCIndex *index, FieldType type) {
+    uint32_t n = index->record_count;
+
+    if (type == TYPE_STRING) {
+        IndexStringEntry *entries = index_alloc(n, sizeof(IndexStringEntry), NULL);
+        for (uint32_t row = 0; row < n; row++) {
+            entries[row].s = index_string(dbc, index_key(dbc, row, index->field, type));
+            entries[row].row = row;
+        }
+        qsort(entries, n, sizeof(IndexStringEntry), index_compare_strings);
+        index->entry_count = n;
+        index->words = index_alloc(n, sizeof(uint32_t), entries);
+        for (uint32_t k = 0; k < n; k++) index->words[k] = entries[k].row;
+        free(entries);
+        return;
+    }
+
+    // Sortable key in the high half and row in the low half sorts by key,
+    // then row
+    uint64_t *entries = index_alloc(n, sizeof(uint64_t), NULL);
+    uint32_t count = 0;
+    for (uint32_t row = 0; row < n; row++) {
+        uint32_t key = index_key(dbc, row, index->field, type);
+        if (type == TYPE_FLOAT && isnan(dbc->records[row][index->field].value.float_value)) continue;
+        entries[count++] = ((uint64_t)index_sortable(key, type) << 32) | row;
+    }
+    qsort(entries, count, sizeof(uint64_t), index_compare_u64);
+    index->entry_count = count;
+    index->words = index_alloc(count, sizeof(uint32_t), entries);
+    for (uint32_t k = 0; k < count; k++) index->words[k] = (uint32_t)entries[k];
+    free(entries);
+}
+
+static int index_build_words(DBCFile *dbc, DBCIndex *index, const FieldType *types) {
+    FieldType type = types[index->field];
+    uint32_t n = dbc->header.record_count;
+
+    index->record_count = n;
+    index->entry_count = n;
+    index->mapping = NULL;
+
+    switch (index->type) {
+        case DBC_INDEX_DIRECT: {
+            if (type != TYPE_UINT32 && type != TYPE_INT32) return 0;
+            int64_t min = 0, max = -1;
+            for (uint32_t row = 0; row < n; row++) {
+                uint32_t key = index_key(dbc, row, index->field, type);
+                int64_t v = type == TYPE_INT32 ? (int64_t)(int32_t)key : (int64_t)key;
+                if (row == 0 || v < min) min = v;
+                if (row == 0 || v > max) max = v;
+            }
+            uint64_t range = (uint64_t)(max - min + 1);
+            if (range > DIRECT_MAX_RANGE(n)) return 0;
+            index->min = (uint32_t)min;
+            index->bucket_count = (uint32_t)range;
+            index->words = index_alloc(range + n, sizeof(uint32_t), NULL);
+            index_build_chains(dbc, index, type);
+            return 1;
+        }
+        case DBC_INDEX_HASH: {
+            uint32_t buckets = 16;
+            while (buckets < n) buckets *= 2;
+            index->min = 0;
+            index->bucket_count = buckets;
+            index->words = index_alloc((size_t)buckets + n, sizeof(uint32_t), NULL);
+            index_build_chains(dbc, index, type);
+            return 1;
+        }
+        case DBC_INDEX_SORTED:
+            index->min = 0;
+            index->bucket_count = 0;
+            index_build_sorted(dbc, index, type);
+            return 1;
+    }
+    return 0;
+}
+
+// Builds `index` for the current records. Returns 0 without allocating
+// when a direct index is not possible for this field.
+static int index_build(DBCFile *dbc, DBCIndex *index, const FieldType *types) {
+    if (!index_build_words(dbc, index, types)) return 0;
+    index->capacity = dbc_index_word_count(index);
+    index->stale = 0;
+    return 1;
+}
+
+void dbc_index_build(DBCFile *dbc, DBCIndex *index, const FieldType *types) {
+    index->type = index->requested;
+    if (!index_build(dbc, index, types)) {
+        // Too sparse or not an integer field any more
+        index->type = DBC_INDEX_HASH;
+        index_build(dbc, index, types);
+    }
+}
+
+// Checks that an index read from disk cannot send lookups out of bounds.
+// Chains must be strictly ascending, which also rules out cycles.
+int dbc_index_valid(const DBCIndex *index, uint32_t record_count) {
+    if (index->record_count != record_count) return 0;
+
+    if (index->type == DBC_INDEX_SORTED) {
+        if (index->entry_count > record_count) return 0;
+        for (uint32_t k = 0; k < index->entry_count; k++) {
+            if (index->words[k] >= record_count) return 0;
+        }
+        return 1;
+    }
+
+    if (index->type == DBC_INDEX_HASH && (index->bucket_count == 0 || (index->bucket_count & (index->bucket_count - 1)))) return 0;
+    if (index->type != DBC_INDEX_DIRECT && index->type != DBC_INDEX_HASH) return 0;
+    for (uint32_t b = 0; b < index->bucket_count; b++) {
+        if (index->words[b] > record_count) return 0;
+    }
+    const uint32_t *next = index->words + index->bucket_count;
+    for (uint32_t row = 0; row < record_count; row++) {
+        if (next[row] && (next[row] <= row + 1 || next[row] > record_count)) return 0;
+    }
+    return 1;
+}
+
+// Directory entry for an index stored in a file, shared by snapshots and
+// sidecars: [field, requested type, built type, min, bucket_count,
+// record_count, entry_count, offset of the words]
+void dbc_index_write_meta(DBCBuffer *meta, const DBCIndex *index, uint64_t offset) {
+    dbc_mp_write_array(meta, 8);
+    dbc_mp_write_uint(meta, index->field);
+    dbc_mp_write_uint(meta, index->requested);
+    dbc_mp_write_uint(meta, index->type);
+    dbc_mp_write_uint(meta, index->min);
+    dbc_mp_write_uint(meta, index->bucket_count);
+    dbc_mp_write_uint(meta, index->record_count);
+    dbc_mp_write_uint(meta, index->entry_count);
+    dbc_mp_write_uint(meta, offset);
+}
+
+// Reads an entry written by dbc_index_write_meta, returning 0 if it is out
+// of range. The words are attached separately.
+int dbc_index_read_meta(DBCMsgReader *reader, DBCIndex *index, uint64_t *offset) {
+    uint64_t values[8];
+    if (dbc_mp_read_array(reader) != 8) return 0;
+    for (int v = 0; v < 8; v++) {
+        values[v] = dbc_mp_read_uint(reader);
+        if (v < 7 && values[v] > UINT32_MAX) return 0;
+    }
+    if (values[1] > DBC_INDEX_SORTED || values[2] > DBC_INDEX_SORTED) return 0;
+
+    memset(index, 0, sizeof(DBCIndex));
+    index->field = (uint32_t)values[0];
+    index->requested = (DBCIndexType)values[1];
+    index->type = (DBCIndexType)values[2];
+    index->min = (uint32_t)values[3];
+    index->bucket_count = (uint32_t)values[4];
+    index->record_count = (uint32_t)values[5];
+    index->entry_count = (uint32_t)values[6];
+    *offset = values[7];
+    return 1;
+}
+
+// Points the index at its words inside a mapping, returning 0 unless they
+// are in bounds and safe to use for a table with these columns. Does not
+// take a reference on the mapping.
+int dbc_index_attach(DBCIndex *index, DBCMapping *mapping, uint64_t offset,
+                     const FieldType *types, uint32_t field_count, uint32_t record_count) {
+    if (index->field >= field_count) return 0;
+    if (index->type == DBC_INDEX_DIRECT && types[index->field] != TYPE_UINT32 &&
+        types[index->field] != TYPE_INT32) {
+        return 0;
+    }
+
+    uint64_t size = (uint64_t)dbc_index_word_count(index) * sizeof(uint32_t);
+    if (offset % 4 != 0 || offset > mapping->size || size > mapping->size - offset) return 0;
+    index->words = (uint32_t *)((uint8_t *)mapping->addr + offset);
+    if (!dbc_index_valid(index, record_count)) {
+        index->words = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+// Maps a whole file read-only. The caller holds the only reference.
+DBCMapping *dbc_mapping_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        rb_raise(rb_eIOError, "Could not open file: %s", path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        rb_raise(rb_eIOError, "Could not map empty or unreadable file: %s", path);
+    }
+
+    void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        rb_raise(rb_eIOError, "Could not map file: %s", path);
+    }
+
+    DBCMapping *mapping = malloc(sizeof(DBCMapping));
+    if (!mapping) {
+        munmap(addr, (size_t)st.st_size);
+        rb_raise(rb_eNoMemError, "Could not map file: %s", path);
+    }
+    mapping->addr = addr;
+    mapping->size = (size_t)st.st_size;
+    DBC_COUNT(DBC_BYTES_READ, mapping->size);
+    mapping->refs = 1;
+    return mapping;
+}
+
+// Counted atomically like DBCCowBase, since a mapped cow base may be
+// released by any Ractor
+void dbc_mapping_release(DBCMapping *mapping) {
+    if (__atomic_sub_fetch(&mapping->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        munmap(mapping->addr, mapping->size);
+        free(mapping);
+    }
+}
+
+void dbc_index_release(DBCIndex *index) {
+    if (index->mapping) {
+        dbc_retire(index->mapping, (void (*)(void *))dbc_mapping_release);
+    } else {
+        dbc_retire(index->words, NULL);
+    }
+    index->words = NULL;
+    index->mapping = NULL;
+}
+
+DBCIndex *dbc_index_find(DBCFile *dbc, uint32_t field, DBCIndexType type) {
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        if (dbc->indexes[k].field == field && dbc->indexes[k].requested == type) return &dbc->indexes[k];
+    }
+    return NULL;
+}
+
+// Appends an empty index slot, or returns the existing one
+DBCIndex *dbc_index_add(DBCFile *dbc, uint32_t field, DBCIndexType type) {
+    DBCIndex *index = dbc_index_find(dbc, field, type);
+    if (index) {
+        dbc_index_release(index);
+        return index;
+    }
+
+    dbc->indexes = dbc_grow(dbc->indexes, dbc->index_count * sizeof(DBCIndex), (dbc->index_count + 1) * sizeof(DBCIndex));
+    index = &dbc->indexes[dbc->index_count++];
+    memset(index, 0, sizeof(DBCIndex));
+    index->field = field;
+    index->requested = type;
+    index->type = type;
+    return index;
+}
+
+void dbc_indexes_clear(DBCFile *dbc) {
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        dbc_index_release(&dbc->indexes[k]);
+    }
+    dbc_retire(dbc->indexes, NULL);
+    dbc->indexes = NULL;
+    dbc->index_count = 0;
+}
+
+// Rebuilds every index when the whole table changed, or the stale ones
+void dbc_indexes_refresh(DBCFile *dbc) {
+    int all = dbc->indexes_stale;
+    int any = all;
+    for (uint32_t k = 0; k < dbc->index_count; k++) any |= dbc->indexes[k].stale;
+    if (!any) return;
+    dbc->indexes_stale = 0;
+    // A writer paused mid-change may touch rows after this, so it marks the
+    // indexes stale again when it finishes
+    if (dbc->writing) dbc->writing = 2;
+    if (dbc->index_count == 0) return;
+
+    VALUE types_buf;
+    FieldType *types = ALLOCV_N(FieldType, types_buf, dbc->header.field_count ? dbc->header.field_count : 1);
+    dbc_column_types(dbc, types);
+    uint32_t kept = 0;
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        DBCIndex index = dbc->indexes[k];
+        if (all || index.stale) {
+            dbc_index_release(&index);
+            index.stale = 1;
+        }
+        // A file with fewer fields may have been read since
+        if (index.field >= dbc->header.field_count) continue;
+        dbc->indexes[kept++] = index;
+    }
+    dbc->index_count = kept;
+
+    // Every stale slot is empty but valid, so running out of memory part
+    // way leaves the rest to be built on the next lookup
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        if (dbc->indexes[k].stale) dbc_index_build(dbc, &dbc->indexes[k], types);
+    }
+    ALLOCV_END(types_buf);
+}
+
+static FieldType index_field_type(DBCFile *dbc, VALUE field_names, uint32_t field) {
+    VALUE field_type = rb_hash_aref(dbc->field_definitions, rb_ary_entry(field_names, field));
+    return NIL_P(field_type) ? TYPE_UINT32 : ruby_to_field_type(field_type);
+}
+
+// Keeping indexes up to date in place. Each step either applies the
+// change or marks the index stale for a rebuild: when readers may be
+// walking the words, when memory runs out, and when a key falls outside a
+// direct index or a hash index is twice as full as it was built.
+
+static uint32_t index_fold(uint32_t key, FieldType type) {
+    return type == TYPE_FLOAT && key == 0x80000000u ? 0 : key;
+}
+
+static int index_is_nan(uint32_t key, FieldType type) {
+    float f;
+    memcpy(&f, &key, sizeof(float));
+    return type == TYPE_FLOAT && isnan(f);
+}
+
+// Whether the index can be changed in place, copying mapped words to the
+// heap with room for `words`
+static int index_writable(DBCIndex *index, size_t words) {
+    if (index->stale || !index->words) return 0;
+    if (dbc_epoch_active()) {
+        index->stale = 1;
+        return 0;
+    }
+    if (words <= index->capacity && !index->mapping) return 1;
+
+    size_t capacity = words + words / 2 + 16;
+    uint32_t *grown;
+    if (index->mapping) {
+        grown = malloc(capacity * sizeof(uint32_t));
+        if (grown) memcpy(grown, index->words, dbc_index_word_count(index) * sizeof(uint32_t));
+    } else {
+        grown = realloc(index->words, capacity * sizeof(uint32_t));
+    }
+    if (!grown) {
+        index->stale = 1;
+        return 0;
+    }
+    if (index->mapping) dbc_retire(index->mapping, (void (*)(void *))dbc_mapping_release);
+    index->mapping = NULL;
+    index->words = grown;
+    index->capacity = capacity;
+    return 1;
+}
+
+// Chain head for `key`, or NULL when it is outside a direct index
+static uint32_t *index_head(DBCFile *dbc, DBCIndex *index, uint32_t key, FieldType type) {
+    uint32_t bucket;
+    if (index->type == DBC_INDEX_DIRECT) {
+        int64_t offset = type == TYPE_INT32 ? (int64_t)(int32_t)key - (int32_t)index->min : (int64_t)key - index->min;
+        if (offset < 0 || offset >= index->bucket_count) return NULL;
+        bucket = (uint32_t)offset;
+    } else {
+        bucket = index_hash_key(dbc, key, type) & (index->bucket_count - 1);
+    }
+    return &index->words[bucket];
+}
+
+static void index_chain_unlink(DBCFile *dbc, DBCIndex *index, uint32_t row, uint32_t key, FieldType type) {
+    uint32_t *next = index->words + index->bucket_count;
+    uint32_t *link = index_head(dbc, index, key, type);
+    if (!link) return;
+    while (*link && *link != row + 1) link = &next[*link - 1];
+    if (*link) *link = next[row];
+    next[row] = 0;
+}
+
+// Links `row` into its chain, keeping the chain in ascending row order
+static void index_chain_link(DBCFile *dbc, DBCIndex *index, uint32_t row, uint32_t key, FieldType type) {
+    uint32_t *next = index->words + index->bucket_count;
+    uint32_t *link = index_head(dbc, index, key, type);
+    if (!link) {
+        index->stale = 1;
+        return;
+    }
+    while (*link && *link < row + 1) link = &next[*link - 1];
+    next[row] = *link;
+    *link = row + 1;
+}
+
+// Sorted order of (key, row) pairs, as index_build_sorted sorts them
+static int index_order(DBCFile *dbc, FieldType type, uint32_t a, uint32_t row_a, uint32_t b, uint32_t row_b) {
+    if (type == TYPE_STRING) {
+        int cmp = strcmp(index_string(dbc, a), index_string(dbc, b));
+        if (cmp) return cmp;
+    } else {
+        uint32_t x = index_sortable(index_fold(a, type), type);
+        uint32_t y = index_sortable(index_fold(b, type), type);
+        if (x != y) return x < y ? -1 : 1;
+    }
+    return row_a < row_b ? -1 : row_a > row_b;
+}
+
+// Position of (key, row) in a sorted index. `row` itself compares equal
+// whatever its current value, so it can be found by its old key.
+static uint32_t index_sorted_position(DBCFile *dbc, DBCIndex *index, uint32_t row, uint32_t key, FieldType type) {
+    uint32_t lo = 0, hi = index->entry_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t entry = index->words[mid];
+        int cmp = entry == row ? 0 : index_order(dbc, type, index_key(dbc, entry, index->field, type), entry, key, row);
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void index_sorted_remove(DBCFile *dbc, DBCIndex *index, uint32_t row, uint32_t key, FieldType type) {
+    if (index_is_nan(key, type)) return;
+    uint32_t pos = index_sorted_position(dbc, index, row, key, type);
+    if (pos == index->entry_count || index->words[pos] != row) return;
+    memmove(&index->words[pos], &index->words[pos + 1], (index->entry_count - pos - 1) * sizeof(uint32_t));
+    index->entry_count--;
+}
+
+// Needs room for one more entry
+static void index_sorted_insert(DBCFile *dbc, DBCIndex *index, uint32_t row, uint32_t key, FieldType type) {
+    if (index_is_nan(key, type)) return;
+    uint32_t pos = index_sorted_position(dbc, index, row, key, type);
+    memmove(&index->words[pos + 1], &index->words[pos], (index->entry_count - pos) * sizeof(uint32_t));
+    index->words[pos] = row;
+    index->entry_count++;
+}
+
+static void index_insert(DBCFile *dbc, DBCIndex *index, uint32_t row, FieldType type) {
+    if (!index_writable(index, dbc_index_word_count(index) + 1)) return;
+    uint32_t key = dbc->records[row][index->field].value.uint32_value;
+    index->record_count++;
+    if (index->type == DBC_INDEX_SORTED) {
+        index_sorted_insert(dbc, index, row, key, type);
+    } else {
+        index->entry_count++;
+        index_chain_link(dbc, index, row, key, type);
+        if (index->type == DBC_INDEX_HASH && index->record_count > (uint64_t)index->bucket_count * 2) index->stale = 1;
+    }
+}
+
+static void index_update(DBCFile *dbc, DBCIndex *index, uint32_t row, uint32_t old_key, FieldType type) {
+    if (!index_writable(index, dbc_index_word_count(index) + 1)) return;
+    uint32_t key = dbc->records[row][index->field].value.uint32_value;
+    if (index->type == DBC_INDEX_SORTED) {
+        index_sorted_remove(dbc, index, row, old_key, type);
+        index_sorted_insert(dbc, index, row, key, type);
+    } else {
+        index_chain_unlink(dbc, index, row, old_key, type);
+        index_chain_link(dbc, index, row, key, type);
+    }
+}
+
+// Later rows move down by one, so every reference to them is renumbered
+static void index_delete(DBCFile *dbc, DBCIndex *index, uint32_t row, FieldType type) {
+    if (!index_writable(index, dbc_index_word_count(index))) return;
+    uint32_t key = dbc->records[row][index->field].value.uint32_value;
+    uint32_t *words = index->words;
+    if (index->type == DBC_INDEX_SORTED) {
+        index_sorted_remove(dbc, index, row, key, type);
+        for (uint32_t e = 0; e < index->entry_count; e++) {
+            if (words[e] > row) words[e]--;
+        }
+    } else {
+        index_chain_unlink(dbc, index, row, key, type);
+        uint32_t *next = words + index->bucket_count;
+        memmove(&next[row], &next[row + 1], (index->record_count - row - 1) * sizeof(uint32_t));
+        size_t count = (size_t)index->bucket_count + index->record_count - 1;
+        for (size_t w = 0; w < count; w++) {
+            if (words[w] > row + 1) words[w]--;
+        }
+        index->entry_count--;
+    }
+    index->record_count--;
+}
+
+// The reverse of index_delete: `row` is back in the records and the rows
+// from it on moved up by one
+static void index_restore(DBCFile *dbc, DBCIndex *index, uint32_t row, FieldType type) {
+    if (!index_writable(index, dbc_index_word_count(index) + 1)) return;
+    uint32_t key = dbc->records[row][index->field].value.uint32_value;
+    uint32_t *words = index->words;
+    if (index->type == DBC_INDEX_SORTED) {
+        for (uint32_t e = 0; e < index->entry_count; e++) {
+            if (words[e] >= row) words[e]++;
+        }
+        index_sorted_insert(dbc, index, row, key, type);
+    } else {
+        uint32_t *next = words + index->bucket_count;
+        memmove(&next[row + 1], &next[row], (index->record_count - row) * sizeof(uint32_t));
+        size_t count = (size_t)index->bucket_count + index->record_count + 1;
+        for (size_t w = 0; w < count; w++) {
+            if (words[w] > row) words[w]++;
+        }
+        next[row] = 0;
+        index->entry_count++;
+        index_chain_link(dbc, index, row, key, type);
+        if (index->type == DBC_INDEX_HASH && index->record_count + 1 > (uint64_t)index->bucket_count * 2) index->stale = 1;
+    }
+    index->record_count++;
+}
+
+// Called after `row` was appended to the records
+void dbc_indexes_insert(DBCFile *dbc, uint32_t row) {
+    if (dbc->index_count == 0 || dbc->indexes_stale) return;
+    VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        DBCIndex *index = &dbc->indexes[k];
+        index_insert(dbc, index, row, index_field_type(dbc, field_names, index->field));
+    }
+}
+
+// Called after `field` of `row` changed from `old_key`
+void dbc_indexes_update(DBCFile *dbc, uint32_t row, uint32_t field, uint32_t old_key) {
+    if (dbc->index_count == 0 || dbc->indexes_stale) return;
+    FieldType type = TYPE_UINT32;
+    int typed = 0;
+
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        DBCIndex *index = &dbc->indexes[k];
+        if (index->field != field) continue;
+        if (!typed) {
+            VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+            type = index_field_type(dbc, field_names, field);
+            typed = 1;
+        }
+        index_update(dbc, index, row, old_key, type);
+    }
+}
+
+// Called before `row` is removed from the records
+void dbc_indexes_delete(DBCFile *dbc, uint32_t row) {
+    if (dbc->index_count == 0 || dbc->indexes_stale) return;
+    VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        DBCIndex *index = &dbc->indexes[k];
+        index_delete(dbc, index, row, index_field_type(dbc, field_names, index->field));
+    }
+}
+
+// Rolling a transaction back runs each change above in reverse. These take
+// the column types, since a rollback must not call back into Ruby.
+
+// Called after `field` of `row` went back to its old value from `key`
+void dbc_indexes_undo_word(DBCFile *dbc, uint32_t row, uint32_t field, uint32_t key, const FieldType *types) {
+    if (dbc->index_count == 0 || dbc->indexes_stale) return;
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        if (dbc->indexes[k].field == field) index_update(dbc, &dbc->indexes[k], row, key, types[field]);
+    }
+}
+
+// Called before the appended `row` is dropped
+void dbc_indexes_undo_insert(DBCFile *dbc, uint32_t row, const FieldType *types) {
+    if (dbc->index_count == 0 || dbc->indexes_stale) return;
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        index_delete(dbc, &dbc->indexes[k], row, types[dbc->indexes[k].field]);
+    }
+}
+
+// Called after a deleted record went back in at `row`
+void dbc_indexes_undo_delete(DBCFile *dbc, uint32_t row, const FieldType *types) {
+    if (dbc->index_count == 0 || dbc->indexes_stale) return;
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        index_restore(dbc, &dbc->indexes[k], row, types[dbc->indexes[k].field]);
+    }
+}
+
+// Converts a find_by value to key bits. Returns 0 when no record can match,
+// using the same rules as comparing with eql? against get_record values.
+static int index_query_key(VALUE value, FieldType type, uint32_t *key) {
+    switch (type) {
+        case TYPE_UINT32:
+        case TYPE_INT32: {
+            if (!FIXNUM_P(value)) return 0;
+            long v = FIX2LONG(value);
+            if (type == TYPE_UINT32 && (v < 0 || v > (long)UINT32_MAX)) return 0;
+            if (type == TYPE_INT32 && (v < INT32_MIN || v > INT32_MAX)) return 0;
+            *key = (uint32_t)v;
+            return 1;
+        }
+        case TYPE_FLOAT: {
+            if (!RB_FLOAT_TYPE_P(value)) return 0;
+            double d = RFLOAT_VALUE(value);
+            float f = (float)d;
+            if ((double)f != d) return 0;
+            memcpy(key, &f, sizeof(uint32_t));
+            if (*key == 0x80000000u) *key = 0;
+            return 1;
+        }
+        case TYPE_STRING:
+            return 0;
+    }
+    return 0;
+}
+
+// find_by through a direct or hash index. Returns Qundef when the field has
+// neither.
+VALUE dbc_index_lookup(DBCFile *dbc, uint32_t field, VALUE value, VALUE field_names) {
+    dbc_indexes_refresh(dbc);
+
+    DBCIndex *index = dbc_index_find(dbc, field, DBC_INDEX_DIRECT);
+    if (!index) index = dbc_index_find(dbc, field, DBC_INDEX_HASH);
+    if (!index) return Qundef;
+
+    VALUE result = rb_ary_new();
+    FieldType type = index_field_type(dbc, field_names, field);
+    const uint32_t *heads = index->words;
+    const uint32_t *next = index->words + index->bucket_count;
+    uint32_t head;
+    uint32_t key = 0;
+    const char *str = NULL;
+    long str_len = 0;
+
+    if (type == TYPE_STRING) {
+        if (!RB_TYPE_P(value, T_STRING)) return result;
+        str = RSTRING_PTR(value);
+        str_len = RSTRING_LEN(value);
+        if ((long)strnlen(str, (size_t)str_len) != str_len) return result;
+    } else if (!index_query_key(value, type, &key)) {
+        return result;
+    }
+
+    if (index->type == DBC_INDEX_DIRECT) {
+        int64_t offset = type == TYPE_INT32 ? (int64_t)(int32_t)key - (int32_t)index->min : (int64_t)key - index->min;
+        if (offset < 0 || offset >= index->bucket_count) return result;
+        head = heads[offset];
+    } else {
+        uint32_t hash = str ? index_hash_bytes(str, (size_t)str_len) : index_mix(key);
+        head = heads[hash & (index->bucket_count - 1)];
+    }
+
+    for (uint32_t entry = head; entry; entry = next[entry - 1]) {
+        uint32_t row = entry - 1;
+        uint32_t row_key = index_key(dbc, row, field, type);
+        if (str) {
+            const char *s = index_string(dbc, row_key);
+            if (strncmp(s, str, (size_t)str_len) != 0 || s[str_len] != '\0') continue;
+        } else if (row_key != key) {
+            continue;
+        }
+        rb_ary_push(result, dbc_record_to_hash(dbc, row, field_names));
+    }
+
+    RB_GC_GUARD(value);
+    return result;
+}
+
+VALUE dbc_index_type_to_symbol(DBCIndexType type) {
+    switch (type) {
+        case DBC_INDEX_DIRECT:
+            return ID2SYM(rb_intern("direct"));
+        case DBC_INDEX_HASH:
+            return ID2SYM(rb_intern("hash"));
+        case DBC_INDEX_SORTED:
+            return ID2SYM(rb_intern("sorted"));
+    }
+    return Qnil;
+}
+
+DBCIndexType dbc_index_type_from_symbol(VALUE type) {
+    if (RB_TYPE_P(type, T_SYMBOL)) {
+        ID id = SYM2ID(type);
+        if (id == rb_intern("direct")) return DBC_INDEX_DIRECT;
+        if (id == rb_intern("hash")) return DBC_INDEX_HASH;
+        if (id == rb_intern("sorted")) return DBC_INDEX_SORTED;
+    }
+    rb_raise(rb_eArgError, "Invalid index type: %"PRIsVALUE, type);
+}
+
+// Three-way comparison of a record's key against a find_range bound
+static int index_compare_bound(DBCFile *dbc, uint32_t row, uint32_t field, FieldType type, VALUE bound) {
+    uint32_t key = index_key(dbc, row, field, type);
+
+    if (type == TYPE_STRING) {
+        const unsigned char *s = (const unsigned char *)index_string(dbc, key);
+        const unsigned char *b = (const unsigned char *)RSTRING_PTR(bound);
+        long len = RSTRING_LEN(bound);
+        for (long i = 0;; i++) {
+            if (i == len) return s[i] ? 1 : 0;
+            if (s[i] != b[i]) return s[i] < b[i] ? -1 : 1;
+            if (s[i] == '\0') return -1;
+        }
+    }
+
+    double v;
+    switch (type) {
+        case TYPE_INT32:
+            v = (int32_t)key;
+            break;
+        case TYPE_FLOAT:
+            v = dbc->records[row][field].value.float_value;
+            break;
+        default:
+            v = key;
+            break;
+    }
+    double b = NUM2DBL(bound);
+    return v < b ? -1 : v > b;
+}
+
+// First position in the sorted index whose key compares >= bound (or >
+// bound when `after` is set)
+static uint32_t index_bound_position(DBCFile *dbc, DBCIndex *index, FieldType type, VALUE bound, int after) {
+    uint32_t lo = 0, hi = index->entry_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = index_compare_bound(dbc, index->words[mid], index->field, type, bound);
+        if (cmp < 0 || (after && cmp == 0)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static long index_field_argument(DBCFile *dbc, VALUE field_names, VALUE field) {
+    long field_idx = dbc_field_index(dbc, field_names, field);
+    if (field_idx < 0) {
+        rb_raise(rb_eArgError, "Invalid field name: %"PRIsVALUE, field);
+    }
+    return field_idx;
+}
+
+// DBCFile#build_index(field, type = :hash) -> self
+//
+// Declares an index on `field` and builds it. `type` is :hash, :sorted, or
+// :direct for a table indexed by key value, which suits dense ID fields.
+static VALUE dbc_build_index(int argc, VALUE *argv, VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_build_index, -1 - argc, argv, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    rb_check_frozen(self);
+
+    VALUE field, type_value;
+    rb_scan_args(argc, argv, "11", &field, &type_value);
+    DBCIndexType type = NIL_P(type_value) ? DBC_INDEX_HASH : dbc_index_type_from_symbol(type_value);
+
+    VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+    long field_idx = index_field_argument(dbc, field_names, field);
+
+    dbc_indexes_refresh(dbc);
+    VALUE types_buf;
+    FieldType *types = ALLOCV_N(FieldType, types_buf, dbc->header.field_count ? dbc->header.field_count : 1);
+    dbc_column_types(dbc, types);
+
+    DBCIndex index;
+    memset(&index, 0, sizeof(DBCIndex));
+    index.field = (uint32_t)field_idx;
+    index.requested = type;
+    index.type = type;
+    if (!index_build(dbc, &index, types)) {
+        rb_raise(rb_eArgError, "Field %"PRIsVALUE" is not suitable for a direct index", field);
+    }
+    ALLOCV_END(types_buf);
+
+    DBCIndex *slot = dbc_index_add(dbc, index.field, type);
+    *slot = index;
+    return self;
+}
+
+// DBCFile#drop_index(field, type = nil) -> self
+static VALUE dbc_drop_index(int argc, VALUE *argv, VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_drop_index, -1 - argc, argv, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    rb_check_frozen(self);
+
+    VALUE field, type_value;
+    rb_scan_args(argc, argv, "11", &field, &type_value);
+
+    VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+    uint32_t field_idx = (uint32_t)index_field_argument(dbc, field_names, field);
+
+    uint32_t kept = 0;
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        DBCIndex *index = &dbc->indexes[k];
+        if (index->field == field_idx && (NIL_P(type_value) || index->requested == dbc_index_type_from_symbol(type_value))) {
+            dbc_index_release(index);
+        } else {
+            dbc->indexes[kept++] = *index;
+        }
+    }
+    dbc->index_count = kept;
+    return self;
+}
+
+// DBCFile#indexes -> [[field, type], ...]
+static VALUE dbc_indexes(VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_indexes, 0, NULL, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    dbc_indexes_refresh(dbc);
+    VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+    VALUE result = rb_ary_new_capa(dbc->index_count);
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        DBCIndex *index = &dbc->indexes[k];
+        if (index->field >= dbc->header.field_count) continue;
+        rb_ary_push(result, rb_assoc_new(rb_ary_entry(field_names, index->field), dbc_index_type_to_symbol(index->requested)));
+    }
+    return result;
+}
+
+// DBCFile#find_range(field, range) -> [record, ...]
+//
+// Records whose `field` lies in `range`, in key order. Needs a sorted index
+// on the field. Either end of the range may be nil.
+static VALUE dbc_find_range(VALUE self, VALUE field, VALUE range) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_find_range, 2, ((VALUE[]){field, range}), &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+    uint32_t field_idx = (uint32_t)index_field_argument(dbc, field_names, field);
+
+    VALUE begin, end;
+    int exclude_end;
+    if (!rb_range_values(range, &begin, &end, &exclude_end)) {
+        rb_raise(rb_eTypeError, "Expected a Range");
+    }
+
+    dbc_indexes_refresh(dbc);
+    DBCIndex *index = dbc_index_find(dbc, field_idx, DBC_INDEX_SORTED);
+    if (!index) {
+        rb_raise(rb_eArgError, "No sorted index on %"PRIsVALUE, field);
+    }
+
+    FieldType type = index_field_type(dbc, field_names, field_idx);
+    if (type == TYPE_STRING) {
+        if (!NIL_P(begin)) StringValue(begin);
+        if (!NIL_P(end)) StringValue(end);
+    }
+
+    uint32_t first = NIL_P(begin) ? 0 : index_bound_position(dbc, index, type, begin, 0);
+    uint32_t last = NIL_P(end) ? index->entry_count : index_bound_position(dbc, index, type, end, !exclude_end);
+
+    VALUE result = rb_ary_new();
+    for (uint32_t k = first; k < last; k++) {
+        rb_ary_push(result, dbc_record_to_hash(dbc, index->words[k], field_names));
+    }
+    return result;
+}
+
+void Init_wow_dbc_index(void) {
+    rb_define_method(rb_cDBCFile, "build_index", dbc_build_index, -1);
+    rb_define_method(rb_cDBCFile, "drop_index", dbc_drop_index, -1);
+    rb_define_method(rb_cDBCFile, "indexes", dbc_indexes, 0);
+    rb_define_method(rb_cDBCFile, "find_range", dbc_find_range, 2);
+}
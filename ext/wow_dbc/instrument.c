@@ -0,0 +1,189 @@
+#include "wow_dbc.h"
+
+#include <ruby/thread_native.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Opt-in timing of DBCFile methods. Every method enters through dbc_guard,
+// which checks dbc_instrumenting alongside the concurrent flag, so turning
+// instrumentation off costs nothing beyond the test it already makes. When
+// on, each call is timed on the monotonic clock and adds to the stats of
+// its method: calls, total and longest time, Ruby objects allocated, and
+// the counters the I/O and scan paths report through DBC_COUNT. Stats are
+// process-wide, so calls from every thread and Ractor add up.
+
+typedef struct {
+    ID method;
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t allocated;
+    uint64_t rows_returned;
+    uint64_t counters[DBC_COUNTER_COUNT];
+} OpStats;
+
+typedef struct {
+    ID method;
+    VALUE (*run)(VALUE);
+    VALUE arg;
+    VALUE result;
+    uint64_t counters[DBC_COUNTER_COUNT];
+    uint64_t *outer;  // counters of the enclosing timed call
+    uint64_t start_ns;
+    size_t start_allocated;
+} Timing;
+
+int dbc_instrumenting;
+static rb_nativethread_lock_t stats_lock;
+static OpStats *stats;
+static size_t stats_count;
+static size_t stats_capacity;
+static __thread uint64_t *current_counters;  // of the innermost timed call, or NULL
+static VALUE sym_total_allocated_objects;
+static ID id_get_record;
+
+static uint64_t instrument_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void dbc_count(DBCCounter counter, uint64_t n) {
+    if (current_counters) current_counters[counter] += n;
+}
+
+// Called with stats_lock held. NULL when the table can't grow.
+static OpStats *stats_slot(ID method) {
+    for (size_t k = 0; k < stats_count; k++) {
+        if (stats[k].method == method) return &stats[k];
+    }
+    if (stats_count == stats_capacity) {
+        size_t capacity = stats_capacity ? stats_capacity * 2 : 32;
+        OpStats *grown = realloc(stats, capacity * sizeof(OpStats));
+        if (!grown) return NULL;
+        stats = grown;
+        stats_capacity = capacity;
+    }
+    OpStats *slot = &stats[stats_count++];
+    memset(slot, 0, sizeof(OpStats));
+    slot->method = method;
+    return slot;
+}
+
+// Rows handed back as hashes: one for get_record, each element of the
+// arrays of hashes find_by and find_range return
+static uint64_t instrument_rows_returned(const Timing *timing) {
+    VALUE result = timing->result;
+    if (RB_TYPE_P(result, T_HASH)) return timing->method == id_get_record ? 1 : 0;
+    if (RB_TYPE_P(result, T_ARRAY) && RARRAY_LEN(result) > 0 && RB_TYPE_P(RARRAY_AREF(result, 0), T_HASH)) {
+        return (uint64_t)RARRAY_LEN(result);
+    }
+    return 0;
+}
+
+static VALUE timing_run(VALUE arg) {
+    Timing *timing = (Timing *)arg;
+    timing->result = timing->run(timing->arg);
+    return timing->result;
+}
+
+static VALUE timing_end(VALUE arg) {
+    Timing *timing = (Timing *)arg;
+    uint64_t elapsed = instrument_now() - timing->start_ns;
+    uint64_t allocated = rb_gc_stat(sym_total_allocated_objects) - timing->start_allocated;
+    uint64_t rows_returned = instrument_rows_returned(timing);
+    current_counters = timing->outer;
+    // Index lookups and single rows touch only what they return
+    if (!timing->counters[DBC_ROWS_SCANNED]) timing->counters[DBC_ROWS_SCANNED] = rows_returned;
+
+    rb_nativethread_lock_lock(&stats_lock);
+    OpStats *slot = stats_slot(timing->method);
+    if (slot) {
+        slot->count++;
+        slot->total_ns += elapsed;
+        if (elapsed > slot->max_ns) slot->max_ns = elapsed;
+        slot->allocated += allocated;
+        slot->rows_returned += rows_returned;
+        for (int c = 0; c < DBC_COUNTER_COUNT; c++) slot->counters[c] += timing->counters[c];
+    }
+    rb_nativethread_lock_unlock(&stats_lock);
+    return Qnil;
+}
+
+// Times run(arg) as a call of `method`, failed calls included
+VALUE dbc_instrument(ID method, VALUE (*run)(VALUE), VALUE arg) {
+    Timing timing;
+    memset(&timing, 0, sizeof(Timing));
+    timing.method = method;
+    timing.run = run;
+    timing.arg = arg;
+    timing.result = Qnil;
+    timing.outer = current_counters;
+    current_counters = timing.counters;
+    timing.start_allocated = rb_gc_stat(sym_total_allocated_objects);
+    timing.start_ns = instrument_now();
+    return rb_ensure(timing_run, (VALUE)&timing, timing_end, (VALUE)&timing);
+}
+
+// WowDBC.instrument = true or false
+//
+// Turns timing of DBCFile methods on or off. Stats are kept while off.
+static VALUE wow_dbc_set_instrument(VALUE self, VALUE enabled) {
+    dbc_instrumenting = RTEST(enabled) ? 1 : 0;
+    return enabled;
+}
+
+// WowDBC.instrument? -> true or false
+static VALUE wow_dbc_instrument_p(VALUE self) {
+    return dbc_instrumenting ? Qtrue : Qfalse;
+}
+
+// WowDBC.stats -> {method => {count:, total_ns:, avg_ns:, max_ns:, ...}}
+//
+// Stats of each DBCFile method called while instrumented: calls, total,
+// average and longest time in nanoseconds, Ruby objects allocated, bytes
+// read and written, rows scanned and rows returned as hashes.
+static VALUE wow_dbc_stats(VALUE self) {
+    rb_nativethread_lock_lock(&stats_lock);
+    size_t count = stats_count;
+    OpStats *copy = malloc((count ? count : 1) * sizeof(OpStats));
+    if (copy) memcpy(copy, stats, count * sizeof(OpStats));
+    rb_nativethread_lock_unlock(&stats_lock);
+    if (!copy) rb_raise(rb_eNoMemError, "Could not copy stats");
+
+    VALUE result = rb_hash_new();
+    for (size_t k = 0; k < count; k++) {
+        const OpStats *op = &copy[k];
+        VALUE entry = rb_hash_new();
+        rb_hash_aset(entry, ID2SYM(rb_intern("count")), ULL2NUM(op->count));
+        rb_hash_aset(entry, ID2SYM(rb_intern("total_ns")), ULL2NUM(op->total_ns));
+        rb_hash_aset(entry, ID2SYM(rb_intern("avg_ns")), ULL2NUM(op->count ? op->total_ns / op->count : 0));
+        rb_hash_aset(entry, ID2SYM(rb_intern("max_ns")), ULL2NUM(op->max_ns));
+        rb_hash_aset(entry, ID2SYM(rb_intern("allocated_objects")), ULL2NUM(op->allocated));
+        rb_hash_aset(entry, ID2SYM(rb_intern("bytes_read")), ULL2NUM(op->counters[DBC_BYTES_READ]));
+        rb_hash_aset(entry, ID2SYM(rb_intern("bytes_written")), ULL2NUM(op->counters[DBC_BYTES_WRITTEN]));
+        rb_hash_aset(entry, ID2SYM(rb_intern("rows_scanned")), ULL2NUM(op->counters[DBC_ROWS_SCANNED]));
+        rb_hash_aset(entry, ID2SYM(rb_intern("rows_returned")), ULL2NUM(op->rows_returned));
+        rb_hash_aset(result, ID2SYM(op->method), entry);
+    }
+    free(copy);
+    return result;
+}
+
+// WowDBC.reset_stats -> nil
+static VALUE wow_dbc_reset_stats(VALUE self) {
+    rb_nativethread_lock_lock(&stats_lock);
+    stats_count = 0;
+    rb_nativethread_lock_unlock(&stats_lock);
+    return Qnil;
+}
+
+void Init_wow_dbc_instrument(void) {
+    rb_nativethread_lock_initialize(&stats_lock);
+    sym_total_allocated_objects = ID2SYM(rb_intern("total_allocated_objects"));
+    id_get_record = rb_intern("get_record");
+    rb_define_module_function(rb_mWowDBC, "instrument=", wow_dbc_set_instrument, 1);
+    rb_define_module_function(rb_mWowDBC, "instrument?", wow_dbc_instrument_p, 0);
+    rb_define_module_function(rb_mWowDBC, "stats", wow_dbc_stats, 0);
+    rb_define_module_function(rb_mWowDBC, "reset_stats", wow_dbc_reset_stats, 0);
+}
@@ -0,0 +1,252 @@
+#include "wow_dbc.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// JSON Lines: one object per record, written straight from the record
+// array without building Ruby hashes.
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Length of the valid UTF-8 sequence starting at s, or 0 if it is invalid
+static size_t json_utf8_sequence(const unsigned char *s, const unsigned char *end) {
+    unsigned char c = s[0];
+    size_t len;
+    uint32_t min;
+
+    if (c >= 0xC2 && c <= 0xDF) {
+        len = 2;
+        min = 0x80;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        len = 3;
+        min = 0x800;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        len = 4;
+        min = 0x10000;
+    } else {
+        return 0;
+    }
+    if ((size_t)(end - s) < len) return 0;
+
+    uint32_t codepoint = c & (0x3F >> (len - 1));
+    for (size_t k = 1; k < len; k++) {
+        if ((s[k] & 0xC0) != 0x80) return 0;
+        codepoint = (codepoint << 6) | (s[k] & 0x3F);
+    }
+    if (codepoint < min || codepoint > 0x10FFFF) return 0;
+    if (codepoint >= 0xD800 && codepoint <= 0xDFFF) return 0;
+    return len;
+}
+
+// Writes s as a quoted JSON string. Invalid UTF-8 bytes become U+FFFD.
+static void json_write_string(DBCBuffer *buf, const char *str, size_t len) {
+    const unsigned char *s = (const unsigned char *)str;
+    const unsigned char *end = s + len;
+
+    // Worst case is six bytes per input byte (\u00XX)
+    dbc_buf_reserve(buf, len * 6 + 2);
+    char *dst = buf->data + buf->size;
+    *dst++ = '"';
+
+    while (s < end) {
+        unsigned char c = *s;
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            *dst++ = (char)c;
+            s++;
+            continue;
+        }
+        if (c >= 0x80) {
+            size_t seq = json_utf8_sequence(s, end);
+            if (seq) {
+                memcpy(dst, s, seq);
+                dst += seq;
+                s += seq;
+            } else {
+                memcpy(dst, "\\ufffd", 6);
+                dst += 6;
+                s++;
+            }
+            continue;
+        }
+
+        *dst++ = '\\';
+        switch (c) {
+            case '"': *dst++ = '"'; break;
+            case '\\': *dst++ = '\\'; break;
+            case '\b': *dst++ = 'b'; break;
+            case '\f': *dst++ = 'f'; break;
+            case '\n': *dst++ = 'n'; break;
+            case '\r': *dst++ = 'r'; break;
+            case '\t': *dst++ = 't'; break;
+            default:
+                memcpy(dst, "u00", 3);
+                dst[3] = hex_digits[c >> 4];
+                dst[4] = hex_digits[c & 0xF];
+                dst += 5;
+                break;
+        }
+        s++;
+    }
+
+    *dst++ = '"';
+    buf->size = (size_t)(dst - buf->data);
+}
+
+typedef struct {
+    DBCFile *dbc;
+    VALUE field_names;
+    FieldType *types;
+    uint32_t *columns;     // selected field indices
+    uint32_t column_count;
+    DBCBuffer keys;        // `"name":` for every selected field, back to back
+    size_t *key_offsets;   // column_count + 1 offsets into keys
+    DBCOutput out;
+} JSONExport;
+
+static VALUE json_export_body(VALUE arg) {
+    JSONExport *ex = (JSONExport *)arg;
+    DBCFile *dbc = ex->dbc;
+    DBCBuffer *buf = &ex->out.buf;
+
+    for (uint32_t k = 0; k < ex->column_count; k++) {
+        uint32_t j = ex->columns[k];
+        VALUE name = rb_ary_entry(ex->field_names, j);
+        name = NIL_P(name) ? rb_sprintf("field_%u", j) : rb_obj_as_string(name);
+        ex->key_offsets[k] = ex->keys.size;
+        json_write_string(&ex->keys, RSTRING_PTR(name), (size_t)RSTRING_LEN(name));
+        dbc_buf_append(&ex->keys, ":", 1);
+    }
+    ex->key_offsets[ex->column_count] = ex->keys.size;
+
+    size_t row_reserve = ex->keys.size + (size_t)ex->column_count * (DBC_NUMBER_MAX + 1) + 3;
+
+    for (uint32_t i = 0; i < dbc->header.record_count; i++) {
+        FieldValue *record = dbc->records[i];
+        dbc_buf_reserve(buf, row_reserve);
+        buf->data[buf->size++] = '{';
+
+        for (uint32_t k = 0; k < ex->column_count; k++) {
+            uint32_t j = ex->columns[k];
+            size_t key_len = ex->key_offsets[k + 1] - ex->key_offsets[k];
+            if (k) buf->data[buf->size++] = ',';
+            memcpy(buf->data + buf->size, ex->keys.data + ex->key_offsets[k], key_len);
+            buf->size += key_len;
+
+            switch (ex->types[j]) {
+                case TYPE_UINT32:
+                    buf->size += dbc_format_uint32(buf->data + buf->size, record[j].value.uint32_value);
+                    break;
+                case TYPE_INT32:
+                    buf->size += dbc_format_int32(buf->data + buf->size, record[j].value.int32_value);
+                    break;
+                case TYPE_FLOAT:
+                    // JSON has no NaN or Infinity
+                    if (isfinite(record[j].value.float_value)) {
+                        buf->size += dbc_format_float(buf->data + buf->size, record[j].value.float_value);
+                    } else {
+                        memcpy(buf->data + buf->size, "null", 4);
+                        buf->size += 4;
+                    }
+                    break;
+                case TYPE_STRING: {
+                    uint32_t offset = record[j].value.string_offset;
+                    const char *s = offset < dbc->header.string_block_size ? &dbc->string_block[offset] : "";
+                    json_write_string(buf, s, strlen(s));
+                    // strings may have grown the buffer past the reservation
+                    dbc_buf_reserve(buf, row_reserve);
+                    break;
+                }
+            }
+        }
+
+        buf->data[buf->size++] = '}';
+        buf->data[buf->size++] = '\n';
+        if (buf->size >= DBC_OUTPUT_CHUNK) dbc_out_flush(&ex->out);
+    }
+    dbc_out_flush(&ex->out);
+
+    return Qnil;
+}
+
+static VALUE json_export_cleanup(VALUE arg) {
+    JSONExport *ex = (JSONExport *)arg;
+    dbc_buf_free(&ex->keys);
+    dbc_out_free(&ex->out);
+    return Qnil;
+}
+
+// DBCFile#each_json_line(io, fields: nil) -> self
+//
+// Writes one JSON object per record to `io`, keyed by field name. `fields`
+// selects and orders the fields to include; all fields by default.
+static VALUE dbc_each_json_line(int argc, VALUE *argv, VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_each_json_line, -1 - argc, argv, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    VALUE io, options;
+    rb_scan_args(argc, argv, "1:", &io, &options);
+
+    VALUE fields = Qnil;
+    if (!NIL_P(options)) {
+        ID keywords[1] = {rb_intern("fields")};
+        VALUE values[1];
+        rb_get_kwargs(options, keywords, 0, 1, values);
+        if (values[0] != Qundef) fields = values[0];
+    }
+
+    JSONExport ex;
+    memset(&ex, 0, sizeof(JSONExport));
+    ex.dbc = dbc;
+
+    // Neither `fields` nor the header's field count has an upper bound, so
+    // the per-column arrays go on the heap when large; the GC reclaims them
+    // if the export raises.
+    VALUE columns_buf, key_offsets_buf, types_buf;
+    uint32_t field_count = dbc->header.field_count;
+    VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+    if (NIL_P(fields)) {
+        ex.column_count = field_count;
+        ex.columns = ALLOCV_N(uint32_t, columns_buf, field_count ? field_count : 1);
+        for (uint32_t j = 0; j < field_count; j++) ex.columns[j] = j;
+    } else {
+        fields = rb_Array(fields);
+        ex.column_count = (uint32_t)RARRAY_LEN(fields);
+        ex.columns = ALLOCV_N(uint32_t, columns_buf, ex.column_count ? ex.column_count : 1);
+        for (uint32_t k = 0; k < ex.column_count; k++) {
+            VALUE field = rb_ary_entry(fields, k);
+            long field_idx = -1;
+            for (long j = 0; j < RARRAY_LEN(field_names) && (uint32_t)j < field_count; j++) {
+                if (rb_eql(rb_ary_entry(field_names, j), field)) {
+                    field_idx = j;
+                    break;
+                }
+            }
+            if (field_idx < 0) {
+                rb_raise(rb_eArgError, "Invalid field name: %"PRIsVALUE, field);
+            }
+            ex.columns[k] = (uint32_t)field_idx;
+        }
+    }
+
+    ex.types = ALLOCV_N(FieldType, types_buf, field_count ? field_count : 1);
+    dbc_column_types(dbc, ex.types);
+    ex.key_offsets = ALLOCV_N(size_t, key_offsets_buf, (size_t)ex.column_count + 1);
+
+    ex.field_names = field_names;
+    dbc_buf_init(&ex.keys, 256);
+    dbc_out_init(&ex.out, io);
+
+    rb_ensure(json_export_body, (VALUE)&ex, json_export_cleanup, (VALUE)&ex);
+    ALLOCV_END(types_buf);
+    ALLOCV_END(key_offsets_buf);
+    ALLOCV_END(columns_buf);
+    RB_GC_GUARD(fields);
+    RB_GC_GUARD(field_names);
+    return self;
+}
+
+void Init_wow_dbc_json(void) {
+    rb_define_method(rb_cDBCFile, "each_json_line", dbc_each_json_line, -1);
+}
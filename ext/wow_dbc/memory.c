@@ -0,0 +1,252 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+#ifdef HAVE_MALLOC_USABLE_SIZE
+#include <malloc.h>
+#endif
+
+// Memory accounting. Heap blocks are measured as the allocator reports
+// them (usable size plus its chunk header), so spare capacity and
+// allocator overhead are included. Memory shared with snapshots through a
+// copy-on-write base is split between the objects holding the base, so
+// summing ObjectSpace.memsize_of over every table and snapshot counts it
+// once. Arenas are counted whole, split the same way between the tables,
+// bases and undo logs holding them, and what lives in them is left out of
+// the other components. Mappings (POSIX shared memory, index sidecars,
+// loaded snapshots) are not heap memory and are reported separately.
+
+typedef struct {
+    size_t structure;
+    size_t records;         // the records array, spare slots included
+    size_t records_spare;
+    size_t rows;            // rows the table owns
+    size_t string_block;    // the string block if the table owns it
+    size_t strings_spare;
+    size_t indexes;
+    size_t indexes_mapped;
+    size_t undo_log;
+    size_t change_log;
+    size_t cow_flags;
+    size_t snapshot_share;  // this table's share of its copy-on-write bases
+    size_t arena;           // this table's share of its arena
+    uint32_t shared_rows;   // rows still shared with a base
+    size_t shared_memory;   // mapping holding shared rows and strings
+} DBCMemory;
+
+// Heap memory of a block, none if it lives in `arena`
+static size_t heap_size(const DBCArena *arena, const void *ptr, size_t nominal) {
+    if (!ptr || dbc_arena_owns(arena, ptr)) return 0;
+#ifdef HAVE_MALLOC_USABLE_SIZE
+    return malloc_usable_size((void *)ptr) + sizeof(size_t);
+#else
+    return nominal;
+#endif
+}
+
+// Share of an arena for one of the references to it
+static double arena_share(const DBCArena *arena) {
+    return arena ? (double)arena->size / arena->refs : 0.0;
+}
+
+// Heap memory of one base, without its parent
+static size_t cow_base_size(const DBCCowBase *base, uint32_t field_count) {
+    const DBCArena *arena = base->arena;
+    size_t size = heap_size(NULL, base, sizeof(DBCCowBase)) +
+                  heap_size(arena, base->records, base->record_count * sizeof(FieldValue *)) +
+                  heap_size(NULL, base->borrowed, base->record_count);
+    if (!base->mapping) {
+        for (uint32_t i = 0; i < base->record_count; i++) {
+            if (!base->borrowed || !base->borrowed[i]) {
+                size += heap_size(arena, base->records[i], field_count * sizeof(FieldValue));
+            }
+        }
+    }
+    if (base->owns_strings) size += heap_size(arena, base->string_block, 0);
+    return size;
+}
+
+// A base with its share of its arena and, through the reference it holds,
+// its share of the parent's
+static double cow_base_full_size(const DBCCowBase *base, uint32_t field_count) {
+    double size = (double)cow_base_size(base, field_count) + arena_share(base->arena);
+    if (base->parent) size += cow_base_full_size(base->parent, field_count) / base->parent->refs;
+    return size;
+}
+
+static const DBCMapping *cow_base_mapping(const DBCCowBase *base) {
+    for (; base; base = base->parent) {
+        if (base->mapping) return base->mapping;
+    }
+    return NULL;
+}
+
+// The log with its share of the arena its rows may come from
+static size_t undo_log_size(const DBCUndoLog *undo, uint32_t field_count) {
+    const DBCArena *arena = undo->arena;
+    size_t size = heap_size(NULL, undo, sizeof(DBCUndoLog)) +
+                  heap_size(NULL, undo->entries, undo->capacity * sizeof(DBCUndoEntry)) +
+                  (size_t)arena_share(arena);
+    for (uint32_t k = 0; k < undo->count; k++) {
+        const DBCUndoEntry *entry = &undo->entries[k];
+        if (entry->op == DBC_UNDO_DELETE && !entry->old.deleted.shared) {
+            size += heap_size(arena, entry->old.deleted.record, field_count * sizeof(FieldValue));
+        } else if (entry->op == DBC_UNDO_TABLE) {
+            const uint8_t *cow = entry->old.table.cow;
+            for (uint32_t i = 0; i < entry->row; i++) {
+                if (!cow || !cow[i]) {
+                    size += heap_size(arena, entry->old.table.records[i], field_count * sizeof(FieldValue));
+                }
+            }
+            size += heap_size(arena, entry->old.table.records, entry->row * sizeof(FieldValue *)) +
+                    heap_size(NULL, cow, entry->row);
+        }
+    }
+    return size;
+}
+
+static void dbc_memory(const DBCFile *dbc, DBCMemory *memory) {
+    memset(memory, 0, sizeof(DBCMemory));
+    uint32_t count = dbc->header.record_count;
+    uint32_t field_count = dbc->header.field_count;
+    size_t row_size = field_count * sizeof(FieldValue);
+    const DBCArena *arena = dbc->arena;
+
+    memory->structure = heap_size(NULL, dbc, sizeof(DBCFile));
+    if (dbc->records && !dbc->records_shared) {
+        uint32_t capacity = dbc->record_capacity ? dbc->record_capacity : count;
+        memory->records = heap_size(arena, dbc->records, capacity * sizeof(FieldValue *));
+        size_t used = count * sizeof(FieldValue *);
+        memory->records_spare = memory->records > used ? memory->records - used : 0;
+        for (uint32_t i = 0; i < count; i++) {
+            if (dbc->cow && dbc->cow[i]) {
+                memory->shared_rows++;
+            } else if (!dbc->rows_in_arena) {
+                memory->rows += heap_size(arena, dbc->records[i], row_size);
+            }
+        }
+    } else if (dbc->records_shared) {
+        memory->shared_rows = count;
+    }
+    if (dbc->string_block && !dbc->strings_shared) {
+        uint32_t capacity = dbc->string_capacity ? dbc->string_capacity : dbc->header.string_block_size;
+        memory->string_block = heap_size(arena, dbc->string_block, capacity);
+        size_t used = dbc->header.string_block_size;
+        memory->strings_spare = memory->string_block > used ? memory->string_block - used : 0;
+    }
+
+    memory->indexes = heap_size(NULL, dbc->indexes, dbc->index_count * sizeof(DBCIndex));
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        const DBCIndex *index = &dbc->indexes[k];
+        size_t words = dbc_index_word_count(index) * sizeof(uint32_t);
+        if (index->mapping) {
+            memory->indexes_mapped += words;
+        } else {
+            memory->indexes += heap_size(NULL, index->words, words);
+        }
+    }
+
+    if (dbc->undo) memory->undo_log = undo_log_size(dbc->undo, field_count);
+    if (dbc->changes) {
+        memory->change_log = heap_size(NULL, dbc->changes, sizeof(DBCChangeLog)) +
+                             heap_size(NULL, dbc->changes->entries, ((size_t)dbc->changes->mask + 1) * sizeof(DBCChange));
+    }
+    memory->cow_flags = heap_size(NULL, dbc->cow, dbc->cow_capacity);
+    memory->arena = (size_t)arena_share(arena);
+    if (dbc->cow_base) {
+        memory->snapshot_share = (size_t)(cow_base_full_size(dbc->cow_base, field_count) / dbc->cow_base->refs);
+        const DBCMapping *mapping = cow_base_mapping(dbc->cow_base);
+        if (mapping) memory->shared_memory = mapping->size;
+    }
+}
+
+static size_t dbc_memory_total(const DBCMemory *memory) {
+    return memory->structure + memory->records + memory->rows + memory->string_block + memory->indexes +
+           memory->undo_log + memory->change_log + memory->cow_flags + memory->snapshot_share + memory->arena;
+}
+
+// Heap memory held by the table, for ObjectSpace.memsize_of. Walks the
+// rows, so it costs O(records).
+size_t dbc_memsize(const void *ptr) {
+    DBCMemory memory;
+    dbc_memory((const DBCFile *)ptr, &memory);
+    return dbc_memory_total(&memory);
+}
+
+// Bytes of the string block referenced by string fields
+static size_t strings_live(const DBCFile *dbc, const FieldType *types) {
+    uint32_t size = dbc->header.string_block_size;
+    if (!size) return 0;
+    uint8_t *live = calloc(size, 1);
+    if (!live) rb_raise(rb_eNoMemError, "Could not allocate the string map");
+
+    for (uint32_t j = 0; j < dbc->header.field_count; j++) {
+        if (types[j] != TYPE_STRING) continue;
+        for (uint32_t i = 0; i < dbc->header.record_count; i++) {
+            uint32_t offset = dbc->records[i][j].value.string_offset;
+            if (offset >= size || live[offset]) continue;
+            const char *end = memchr(dbc->string_block + offset, '\0', size - offset);
+            uint32_t stop = end ? (uint32_t)(end - dbc->string_block) + 1 : size;
+            memset(live + offset, 1, stop - offset);
+        }
+    }
+    size_t count = 0;
+    for (uint32_t k = 0; k < size; k++) count += live[k];
+    free(live);
+    return count;
+}
+
+// DBCFile#memory_report -> Hash
+//
+// Breakdown of the memory behind the table, in bytes. :total is what the
+// table reports to ObjectSpace.memsize_of (which adds the object's own
+// slot) and is the sum of :structure, :records, :rows,
+// :string_block, :indexes, :undo_log, :change_log, :cow_flags,
+// :snapshot_share and :arena. :arena holds what #read loaded, so :records,
+// :rows and :string_block only count what was allocated since. The other
+// keys detail those or are outside the heap:
+// :records_spare and :strings_spare are allocated but unused,
+// :strings_live and :strings_garbage split the string block by whether
+// fields still point into it, :shared_rows counts rows still shared with
+// snapshots, and :indexes_mapped and :shared_memory are mapped files and
+// POSIX shared memory.
+static VALUE dbc_memory_report(VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_memory_report, 0, NULL, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    VALUE types_buf;
+    FieldType *types = ALLOCV_N(FieldType, types_buf, dbc->header.field_count ? dbc->header.field_count : 1);
+    dbc_column_types(dbc, types);
+    size_t live = strings_live(dbc, types);
+    ALLOCV_END(types_buf);
+
+    DBCMemory memory;
+    dbc_memory(dbc, &memory);
+    VALUE report = rb_hash_new();
+#define REPORT(key, value) rb_hash_aset(report, ID2SYM(rb_intern(key)), SIZET2NUM(value))
+    REPORT("total", dbc_memory_total(&memory));
+    REPORT("structure", memory.structure);
+    REPORT("records", memory.records);
+    REPORT("records_spare", memory.records_spare);
+    REPORT("rows", memory.rows);
+    REPORT("shared_rows", memory.shared_rows);
+    REPORT("string_block", memory.string_block);
+    REPORT("strings_live", live);
+    REPORT("strings_garbage", dbc->header.string_block_size - live);
+    REPORT("strings_spare", memory.strings_spare);
+    REPORT("indexes", memory.indexes);
+    REPORT("indexes_mapped", memory.indexes_mapped);
+    REPORT("undo_log", memory.undo_log);
+    REPORT("change_log", memory.change_log);
+    REPORT("cow_flags", memory.cow_flags);
+    REPORT("snapshot_share", memory.snapshot_share);
+    REPORT("arena", memory.arena);
+    REPORT("shared_memory", memory.shared_memory);
+#undef REPORT
+    return report;
+}
+
+void Init_wow_dbc_memory(void) {
+    rb_define_method(rb_cDBCFile, "memory_report", dbc_memory_report, 0);
+}
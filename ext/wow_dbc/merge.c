@@ -0,0 +1,280 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// Three-way merge of DBC files at field granularity. The three files are
+// loaded once and shared by three diffs: base rows keyed for pairing with
+// ours and with theirs, and ours rows keyed for pairing the rows both sides
+// added. A field takes the side that changed it; a field both sides changed
+// differently is a conflict and keeps ours.
+
+typedef struct {
+    DBCRaw base;
+    DBCRaw ours;
+    DBCRaw theirs;
+    DBCDiff diff_ours;      // base rows by key, paired with ours
+    DBCDiff diff_theirs;    // base rows by key, paired with theirs
+    DBCDiff diff_added;     // ours rows by key, paired with rows theirs added
+    uint32_t *pairs;        // row + 1 of the partner in another file, 0 for none
+    uint32_t *ours_base;
+    uint32_t *ours_theirs;
+    uint32_t *theirs_base;
+    uint32_t *theirs_ours;
+    uint32_t *base_ours;
+    uint32_t *base_theirs;
+    DBCBuilder builder;
+    VALUE klass;
+    VALUE filepath;
+    VALUE conflicts;
+} DBCMerge;
+
+static const uint32_t *merge_row(const DBCRaw *raw, uint32_t row) {
+    return raw->records + (size_t)row * raw->columns;
+}
+
+static int merge_rows_equal(const DBCDiff *diff, const uint32_t *old_row, const uint32_t *new_row) {
+    if (diff->same_strings) {
+        return memcmp(old_row, new_row, (size_t)diff->field_count * sizeof(uint32_t)) == 0;
+    }
+    for (uint32_t j = 0; j < diff->field_count; j++) {
+        if (!dbc_diff_field_equal(diff, old_row, new_row, j)) return 0;
+    }
+    return 1;
+}
+
+static void merge_set(DBCMerge *merge, FieldValue *record, const DBCRaw *raw, const uint32_t *row, uint32_t j) {
+    FieldType type = merge->diff_ours.types[j];
+    record[j].type = type;
+    if (type == TYPE_STRING) {
+        size_t len;
+        const char *s = dbc_diff_string(raw, row[j], &len);
+        record[j].value.string_offset = dbc_builder_add_string(&merge->builder, s, (uint32_t)len);
+    } else {
+        record[j].value.uint32_value = row[j];
+    }
+}
+
+static void merge_emit(DBCMerge *merge, const DBCRaw *raw, const uint32_t *row) {
+    FieldValue *record = dbc_builder_add_record(&merge->builder);
+    for (uint32_t j = 0; j < raw->columns; j++) {
+        merge_set(merge, record, raw, row, j);
+    }
+}
+
+static VALUE merge_key(const DBCMerge *merge, const DBCRaw *raw, const uint32_t *row) {
+    uint32_t key = merge->diff_ours.key;
+    return dbc_diff_value(raw, row, key, merge->diff_ours.types[key]);
+}
+
+// A record deleted on one side and changed on the other
+static void merge_row_conflict(DBCMerge *merge, VALUE key, const char *reason) {
+    VALUE conflict = rb_hash_new();
+    rb_hash_aset(conflict, ID2SYM(rb_intern("key")), key);
+    rb_hash_aset(conflict, ID2SYM(rb_intern("field")), Qnil);
+    rb_hash_aset(conflict, ID2SYM(rb_intern("reason")), ID2SYM(rb_intern(reason)));
+    rb_ary_push(merge->conflicts, conflict);
+}
+
+// Merges one record field by field. `base_row` is NULL for a record both
+// sides added.
+static void merge_fields(DBCMerge *merge, const uint32_t *base_row, const uint32_t *ours_row, const uint32_t *theirs_row) {
+    const DBCDiff *diff_ours = &merge->diff_ours;
+    const DBCDiff *diff_theirs = &merge->diff_theirs;
+    const DBCDiff *diff_added = &merge->diff_added;
+    FieldValue *record = dbc_builder_add_record(&merge->builder);
+
+    for (uint32_t j = 0; j < diff_ours->field_count; j++) {
+        if (base_row && dbc_diff_field_equal(diff_theirs, base_row, theirs_row, j)) {
+            merge_set(merge, record, &merge->ours, ours_row, j);
+        } else if (base_row && dbc_diff_field_equal(diff_ours, base_row, ours_row, j)) {
+            merge_set(merge, record, &merge->theirs, theirs_row, j);
+        } else {
+            merge_set(merge, record, &merge->ours, ours_row, j);
+            if (dbc_diff_field_equal(diff_added, ours_row, theirs_row, j)) continue;
+
+            FieldType type = diff_ours->types[j];
+            VALUE conflict = rb_hash_new();
+            rb_hash_aset(conflict, ID2SYM(rb_intern("key")), merge_key(merge, &merge->ours, ours_row));
+            rb_hash_aset(conflict, ID2SYM(rb_intern("field")), rb_ary_entry(diff_ours->field_names, j));
+            rb_hash_aset(conflict, ID2SYM(rb_intern("base")),
+                         base_row ? dbc_diff_value(&merge->base, base_row, j, type) : Qnil);
+            rb_hash_aset(conflict, ID2SYM(rb_intern("ours")), dbc_diff_value(&merge->ours, ours_row, j, type));
+            rb_hash_aset(conflict, ID2SYM(rb_intern("theirs")), dbc_diff_value(&merge->theirs, theirs_row, j, type));
+            rb_ary_push(merge->conflicts, conflict);
+        }
+    }
+}
+
+// Pairs the rows of the three files: ours and theirs with base, then the
+// rows only ours added with the rows only theirs added
+static void merge_pair(DBCMerge *merge) {
+    uint32_t base_count = merge->base.header.record_count;
+    uint32_t ours_count = merge->ours.header.record_count;
+    uint32_t theirs_count = merge->theirs.header.record_count;
+
+    merge->pairs = calloc(2 * ((size_t)base_count + ours_count + theirs_count) + 1, sizeof(uint32_t));
+    if (!merge->pairs) {
+        rb_raise(rb_eNoMemError, "Could not allocate merge table");
+    }
+    merge->ours_base = merge->pairs;
+    merge->ours_theirs = merge->ours_base + ours_count;
+    merge->theirs_base = merge->ours_theirs + ours_count;
+    merge->theirs_ours = merge->theirs_base + theirs_count;
+    merge->base_ours = merge->theirs_ours + theirs_count;
+    merge->base_theirs = merge->base_ours + base_count;
+
+    for (uint32_t o = 0; o < ours_count; o++) {
+        int64_t b = dbc_diff_match(&merge->diff_ours, merge_row(&merge->ours, o));
+        if (b < 0) continue;
+        merge->diff_ours.matched[b] = 1;
+        merge->ours_base[o] = (uint32_t)b + 1;
+        merge->base_ours[b] = o + 1;
+        merge->diff_added.matched[o] = 1;
+    }
+    for (uint32_t t = 0; t < theirs_count; t++) {
+        int64_t b = dbc_diff_match(&merge->diff_theirs, merge_row(&merge->theirs, t));
+        if (b < 0) continue;
+        merge->diff_theirs.matched[b] = 1;
+        merge->theirs_base[t] = (uint32_t)b + 1;
+        merge->base_theirs[b] = t + 1;
+    }
+    for (uint32_t t = 0; t < theirs_count; t++) {
+        if (merge->theirs_base[t]) continue;
+        int64_t o = dbc_diff_match(&merge->diff_added, merge_row(&merge->theirs, t));
+        if (o < 0) continue;
+        merge->diff_added.matched[o] = 1;
+        merge->theirs_ours[t] = (uint32_t)o + 1;
+        merge->ours_theirs[o] = t + 1;
+    }
+}
+
+static VALUE merge_body(VALUE arg) {
+    DBCMerge *merge = (DBCMerge *)arg;
+
+    dbc_raw_load(merge->diff_ours.old_path, &merge->base);
+    dbc_raw_load(merge->diff_ours.new_path, &merge->ours);
+    dbc_raw_load(merge->diff_theirs.new_path, &merge->theirs);
+
+    merge->diff_ours.old_raw = merge->base;
+    merge->diff_ours.new_raw = merge->ours;
+    merge->diff_theirs.old_raw = merge->base;
+    merge->diff_theirs.new_raw = merge->theirs;
+    merge->diff_added.old_raw = merge->ours;
+    merge->diff_added.new_raw = merge->theirs;
+    dbc_diff_prepare(&merge->diff_ours);
+    dbc_diff_prepare(&merge->diff_theirs);
+    dbc_diff_prepare(&merge->diff_added);
+
+    merge_pair(merge);
+    dbc_builder_init(&merge->builder, merge->ours.columns);
+
+    // Ours keeps its order, and records only theirs added go at the end
+    for (uint32_t o = 0; o < merge->ours.header.record_count; o++) {
+        const uint32_t *ours_row = merge_row(&merge->ours, o);
+        uint32_t b = merge->ours_base[o];
+
+        if (!b) {
+            uint32_t t = merge->ours_theirs[o];
+            if (t) {
+                merge_fields(merge, NULL, ours_row, merge_row(&merge->theirs, t - 1));
+            } else {
+                merge_emit(merge, &merge->ours, ours_row);
+            }
+            continue;
+        }
+
+        const uint32_t *base_row = merge_row(&merge->base, b - 1);
+        uint32_t t = merge->base_theirs[b - 1];
+        if (t) {
+            merge_fields(merge, base_row, ours_row, merge_row(&merge->theirs, t - 1));
+        } else if (!merge_rows_equal(&merge->diff_ours, base_row, ours_row)) {
+            merge_row_conflict(merge, merge_key(merge, &merge->ours, ours_row), "deleted_in_theirs");
+            merge_emit(merge, &merge->ours, ours_row);
+        }
+    }
+
+    for (uint32_t b = 0; b < merge->base.header.record_count; b++) {
+        uint32_t t = merge->base_theirs[b];
+        if (merge->base_ours[b] || !t) continue;
+        const uint32_t *base_row = merge_row(&merge->base, b);
+        if (!merge_rows_equal(&merge->diff_theirs, base_row, merge_row(&merge->theirs, t - 1))) {
+            merge_row_conflict(merge, merge_key(merge, &merge->base, base_row), "deleted_in_ours");
+        }
+    }
+
+    for (uint32_t t = 0; t < merge->theirs.header.record_count; t++) {
+        if (merge->theirs_base[t] || merge->theirs_ours[t]) continue;
+        merge_emit(merge, &merge->theirs, merge_row(&merge->theirs, t));
+    }
+
+    return dbc_builder_finish(&merge->builder, merge->klass, merge->filepath, merge->diff_ours.fields);
+}
+
+static VALUE merge_cleanup(VALUE arg) {
+    DBCMerge *merge = (DBCMerge *)arg;
+    DBCDiff *diffs[3] = {&merge->diff_ours, &merge->diff_theirs, &merge->diff_added};
+    for (int i = 0; i < 3; i++) {
+        free(diffs[i]->types);
+        free(diffs[i]->slots);
+        free(diffs[i]->matched);
+    }
+    free(merge->pairs);
+    dbc_builder_free(&merge->builder);
+    dbc_raw_release(&merge->base);
+    dbc_raw_release(&merge->ours);
+    dbc_raw_release(&merge->theirs);
+    return Qnil;
+}
+
+// WowDBC.merge3(base_path, ours_path, theirs_path, key: :id, fields: nil, output: nil)
+//   -> { table: DBCFile, conflicts: [conflict, ...] }
+//
+// Merges the changes from base to theirs into ours. Records are paired by
+// `key` as in WowDBC.diff, and each field takes the side that changed it.
+// Conflicts keep ours and are reported as
+// { key:, field:, base:, ours:, theirs: } for a field both sides changed
+// differently (`base` is nil when both sides added the record), or as
+// { key:, field: nil, reason: } for a record one side deleted and the
+// other changed, with `reason` :deleted_in_ours or :deleted_in_theirs.
+// The merged table is written to `output` when given, and otherwise has
+// ours as its path and is left unwritten.
+static VALUE wow_dbc_merge3(int argc, VALUE *argv, VALUE self) {
+    VALUE base_path, ours_path, theirs_path, options;
+    rb_scan_args(argc, argv, "3:", &base_path, &ours_path, &theirs_path, &options);
+
+    VALUE output = Qnil;
+    if (!NIL_P(options)) {
+        options = rb_hash_dup(options);
+        output = rb_hash_delete(options, ID2SYM(rb_intern("output")));
+    }
+
+    DBCMerge merge;
+    memset(&merge, 0, sizeof(DBCMerge));
+    dbc_diff_init(&merge.diff_ours, base_path, ours_path, options);
+    merge.diff_theirs = merge.diff_ours;
+    merge.diff_theirs.new_path = StringValueCStr(theirs_path);
+    merge.diff_added = merge.diff_theirs;
+    merge.diff_added.old_path = merge.diff_ours.new_path;
+    merge.klass = rb_cDBCFile;
+    merge.filepath = NIL_P(output) ? ours_path : output;
+    merge.conflicts = rb_ary_new();
+
+    VALUE table = rb_ensure(merge_body, (VALUE)&merge, merge_cleanup, (VALUE)&merge);
+    if (!NIL_P(output)) {
+        rb_funcall(table, rb_intern("write"), 0);
+    }
+
+    VALUE result = rb_hash_new();
+    rb_hash_aset(result, ID2SYM(rb_intern("table")), table);
+    rb_hash_aset(result, ID2SYM(rb_intern("conflicts")), merge.conflicts);
+    RB_GC_GUARD(merge.diff_ours.fields);
+    RB_GC_GUARD(merge.diff_ours.field_names);
+    RB_GC_GUARD(base_path);
+    RB_GC_GUARD(ours_path);
+    RB_GC_GUARD(theirs_path);
+    return result;
+}
+
+void Init_wow_dbc_merge(void) {
+    rb_define_module_function(rb_mWowDBC, "merge3", wow_dbc_merge3, -1);
+}
@@ -0,0 +1,181 @@
+#include "wow_dbc.h"
+
+// The MessagePack subset used for file metadata: maps, arrays, strings,
+// unsigned integers, booleans and nil. Readers raise IOError on anything
+// malformed or truncated.
+
+static void mp_write_be(DBCBuffer *buf, uint8_t marker, uint64_t v, int bytes) {
+    uint8_t out[9];
+    out[0] = marker;
+    for (int i = 0; i < bytes; i++) {
+        out[1 + i] = (uint8_t)(v >> (8 * (bytes - 1 - i)));
+    }
+    dbc_buf_append(buf, out, (size_t)bytes + 1);
+}
+
+void dbc_mp_write_map(DBCBuffer *buf, uint32_t count) {
+    if (count < 16) {
+        uint8_t marker = (uint8_t)(0x80 | count);
+        dbc_buf_append(buf, &marker, 1);
+    } else if (count <= 0xFFFF) {
+        mp_write_be(buf, 0xDE, count, 2);
+    } else {
+        mp_write_be(buf, 0xDF, count, 4);
+    }
+}
+
+void dbc_mp_write_array(DBCBuffer *buf, uint32_t count) {
+    if (count < 16) {
+        uint8_t marker = (uint8_t)(0x90 | count);
+        dbc_buf_append(buf, &marker, 1);
+    } else if (count <= 0xFFFF) {
+        mp_write_be(buf, 0xDC, count, 2);
+    } else {
+        mp_write_be(buf, 0xDD, count, 4);
+    }
+}
+
+void dbc_mp_write_str(DBCBuffer *buf, const char *s, size_t len) {
+    if (len < 32) {
+        uint8_t marker = (uint8_t)(0xA0 | len);
+        dbc_buf_append(buf, &marker, 1);
+    } else if (len <= 0xFF) {
+        mp_write_be(buf, 0xD9, len, 1);
+    } else if (len <= 0xFFFF) {
+        mp_write_be(buf, 0xDA, len, 2);
+    } else {
+        mp_write_be(buf, 0xDB, len, 4);
+    }
+    dbc_buf_append(buf, s, len);
+}
+
+void dbc_mp_write_uint(DBCBuffer *buf, uint64_t v) {
+    if (v < 128) {
+        uint8_t marker = (uint8_t)v;
+        dbc_buf_append(buf, &marker, 1);
+    } else if (v <= 0xFF) {
+        mp_write_be(buf, 0xCC, v, 1);
+    } else if (v <= 0xFFFF) {
+        mp_write_be(buf, 0xCD, v, 2);
+    } else if (v <= 0xFFFFFFFF) {
+        mp_write_be(buf, 0xCE, v, 4);
+    } else {
+        mp_write_be(buf, 0xCF, v, 8);
+    }
+}
+
+void dbc_mp_write_bool(DBCBuffer *buf, int v) {
+    uint8_t marker = v ? 0xC3 : 0xC2;
+    dbc_buf_append(buf, &marker, 1);
+}
+
+// Deeper than any metadata written here, shallow enough for the C stack
+#define MP_MAX_DEPTH 32
+
+static void mp_malformed(void) {
+    rb_raise(rb_eIOError, "Malformed MessagePack metadata");
+}
+
+static uint8_t mp_read_marker(DBCMsgReader *reader) {
+    if (reader->pos >= reader->end) mp_malformed();
+    return *reader->pos++;
+}
+
+static uint64_t mp_read_be(DBCMsgReader *reader, int bytes) {
+    if (reader->end - reader->pos < bytes) mp_malformed();
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) {
+        v = (v << 8) | reader->pos[i];
+    }
+    reader->pos += bytes;
+    return v;
+}
+
+uint32_t dbc_mp_read_map(DBCMsgReader *reader) {
+    uint8_t marker = mp_read_marker(reader);
+    if ((marker & 0xF0) == 0x80) return marker & 0x0F;
+    if (marker == 0xDE) return (uint32_t)mp_read_be(reader, 2);
+    if (marker == 0xDF) return (uint32_t)mp_read_be(reader, 4);
+    mp_malformed();
+    return 0;
+}
+
+uint32_t dbc_mp_read_array(DBCMsgReader *reader) {
+    uint8_t marker = mp_read_marker(reader);
+    if ((marker & 0xF0) == 0x90) return marker & 0x0F;
+    if (marker == 0xDC) return (uint32_t)mp_read_be(reader, 2);
+    if (marker == 0xDD) return (uint32_t)mp_read_be(reader, 4);
+    mp_malformed();
+    return 0;
+}
+
+const char *dbc_mp_read_str(DBCMsgReader *reader, uint32_t *len) {
+    uint8_t marker = mp_read_marker(reader);
+    if ((marker & 0xE0) == 0xA0) {
+        *len = marker & 0x1F;
+    } else if (marker == 0xD9) {
+        *len = (uint32_t)mp_read_be(reader, 1);
+    } else if (marker == 0xDA) {
+        *len = (uint32_t)mp_read_be(reader, 2);
+    } else if (marker == 0xDB) {
+        *len = (uint32_t)mp_read_be(reader, 4);
+    } else {
+        mp_malformed();
+    }
+    if ((uint64_t)(reader->end - reader->pos) < *len) mp_malformed();
+    const char *s = (const char *)reader->pos;
+    reader->pos += *len;
+    return s;
+}
+
+uint64_t dbc_mp_read_uint(DBCMsgReader *reader) {
+    uint8_t marker = mp_read_marker(reader);
+    if (marker < 0x80) return marker;
+    if (marker == 0xCC) return mp_read_be(reader, 1);
+    if (marker == 0xCD) return mp_read_be(reader, 2);
+    if (marker == 0xCE) return mp_read_be(reader, 4);
+    if (marker == 0xCF) return mp_read_be(reader, 8);
+    mp_malformed();
+    return 0;
+}
+
+int dbc_mp_read_bool(DBCMsgReader *reader) {
+    uint8_t marker = mp_read_marker(reader);
+    if (marker == 0xC2) return 0;
+    if (marker == 0xC3) return 1;
+    mp_malformed();
+    return 0;
+}
+
+static void mp_skip(DBCMsgReader *reader, int depth) {
+    if (reader->pos >= reader->end || depth > MP_MAX_DEPTH) mp_malformed();
+    uint8_t marker = *reader->pos;
+
+    if ((marker & 0xF0) == 0x80 || marker == 0xDE || marker == 0xDF) {
+        uint32_t count = dbc_mp_read_map(reader);
+        for (uint32_t i = 0; i < count; i++) {
+            mp_skip(reader, depth + 1);
+            mp_skip(reader, depth + 1);
+        }
+    } else if ((marker & 0xF0) == 0x90 || marker == 0xDC || marker == 0xDD) {
+        uint32_t count = dbc_mp_read_array(reader);
+        for (uint32_t i = 0; i < count; i++) mp_skip(reader, depth + 1);
+    } else if ((marker & 0xE0) == 0xA0 || (marker >= 0xD9 && marker <= 0xDB)) {
+        uint32_t len;
+        dbc_mp_read_str(reader, &len);
+    } else if (marker == 0xC0 || marker == 0xC2 || marker == 0xC3) {
+        reader->pos++;
+    } else {
+        dbc_mp_read_uint(reader);
+    }
+}
+
+// Skips one value of any supported type, for forward compatibility with
+// keys added later. Nesting deeper than MP_MAX_DEPTH is malformed.
+void dbc_mp_skip(DBCMsgReader *reader) {
+    mp_skip(reader, 0);
+}
+
+int dbc_mp_key_is(const char *key, uint32_t len, const char *name) {
+    return strlen(name) == len && memcmp(key, name, len) == 0;
+}
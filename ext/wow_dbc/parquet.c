@@ -0,0 +1,609 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// Parquet export (https://parquet.apache.org/docs/file-format/). Every
+// column is REQUIRED and uncompressed; each row group holds one dictionary
+// page (when dictionary encoded) and one data page per column. Metadata is
+// written with the Thrift compact protocol by the helpers below.
+
+#define PARQUET_MAGIC "PAR1"
+#define PARQUET_ROW_GROUP_ROWS 131072
+#define PARQUET_MAX_DICTIONARY (1 << 16)
+
+// parquet.thrift enums
+#define PARQUET_TYPE_INT32 1
+#define PARQUET_TYPE_FLOAT 4
+#define PARQUET_TYPE_BYTE_ARRAY 6
+#define PARQUET_REPETITION_REQUIRED 0
+#define PARQUET_CONVERTED_UTF8 0
+#define PARQUET_CONVERTED_UINT_32 13
+#define PARQUET_CONVERTED_INT_32 17
+#define PARQUET_ENCODING_PLAIN 0
+#define PARQUET_ENCODING_PLAIN_DICTIONARY 2
+#define PARQUET_ENCODING_RLE 3
+#define PARQUET_PAGE_DATA 0
+#define PARQUET_PAGE_DICTIONARY 2
+#define PARQUET_CODEC_UNCOMPRESSED 0
+
+// Thrift compact protocol field types
+#define THRIFT_TRUE 1
+#define THRIFT_FALSE 2
+#define THRIFT_BYTE 3
+#define THRIFT_I16 4
+#define THRIFT_I32 5
+#define THRIFT_I64 6
+#define THRIFT_BINARY 8
+#define THRIFT_LIST 9
+#define THRIFT_STRUCT 12
+
+#define THRIFT_MAX_DEPTH 8
+
+typedef enum {
+    ENCODING_AUTO,
+    ENCODING_PLAIN,
+    ENCODING_DICTIONARY
+} ParquetEncoding;
+
+typedef struct {
+    DBCBuffer *buf;
+    int16_t last_field[THRIFT_MAX_DEPTH];
+    int depth;
+} ThriftWriter;
+
+static void thrift_varint(ThriftWriter *tw, uint64_t v) {
+    uint8_t bytes[10];
+    size_t n = 0;
+    while (v >= 0x80) {
+        bytes[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    bytes[n++] = (uint8_t)v;
+    dbc_buf_append(tw->buf, bytes, n);
+}
+
+static void thrift_zigzag(ThriftWriter *tw, int64_t v) {
+    thrift_varint(tw, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void thrift_field(ThriftWriter *tw, int16_t id, uint8_t type) {
+    int16_t delta = id - tw->last_field[tw->depth];
+    if (delta > 0 && delta <= 15) {
+        uint8_t header = (uint8_t)((delta << 4) | type);
+        dbc_buf_append(tw->buf, &header, 1);
+    } else {
+        dbc_buf_append(tw->buf, &type, 1);
+        thrift_zigzag(tw, id);
+    }
+    tw->last_field[tw->depth] = id;
+}
+
+static void thrift_byte(ThriftWriter *tw, int16_t id, int8_t v) {
+    thrift_field(tw, id, THRIFT_BYTE);
+    dbc_buf_append(tw->buf, &v, 1);
+}
+
+static void thrift_i32(ThriftWriter *tw, int16_t id, int32_t v) {
+    thrift_field(tw, id, THRIFT_I32);
+    thrift_zigzag(tw, v);
+}
+
+static void thrift_i64(ThriftWriter *tw, int16_t id, int64_t v) {
+    thrift_field(tw, id, THRIFT_I64);
+    thrift_zigzag(tw, v);
+}
+
+static void thrift_bool(ThriftWriter *tw, int16_t id, int v) {
+    thrift_field(tw, id, v ? THRIFT_TRUE : THRIFT_FALSE);
+}
+
+static void thrift_string(ThriftWriter *tw, int16_t id, const char *s, size_t len) {
+    thrift_field(tw, id, THRIFT_BINARY);
+    thrift_varint(tw, len);
+    dbc_buf_append(tw->buf, s, len);
+}
+
+static void thrift_list(ThriftWriter *tw, int16_t id, uint8_t element_type, uint32_t size) {
+    thrift_field(tw, id, THRIFT_LIST);
+    if (size < 15) {
+        uint8_t header = (uint8_t)((size << 4) | element_type);
+        dbc_buf_append(tw->buf, &header, 1);
+    } else {
+        uint8_t header = (uint8_t)(0xF0 | element_type);
+        dbc_buf_append(tw->buf, &header, 1);
+        thrift_varint(tw, size);
+    }
+}
+
+// Starts a struct, either as field `id` of the current struct or as a list
+// element when id is 0.
+static void thrift_begin(ThriftWriter *tw, int16_t id) {
+    if (id) thrift_field(tw, id, THRIFT_STRUCT);
+    tw->last_field[++tw->depth] = 0;
+}
+
+static void thrift_end(ThriftWriter *tw) {
+    static const uint8_t stop = 0;
+    dbc_buf_append(tw->buf, &stop, 1);
+    tw->depth--;
+}
+
+static uint32_t parquet_bit_width(uint32_t max_value) {
+    uint32_t width = 0;
+    while (width < 32 && (max_value >> width)) width++;
+    return width ? width : 1;
+}
+
+static void parquet_varint(DBCBuffer *buf, uint32_t v) {
+    ThriftWriter tw = {buf, {0}, 0};
+    thrift_varint(&tw, v);
+}
+
+static void parquet_bit_pack(DBCBuffer *buf, const uint32_t *values, uint32_t count, uint32_t bit_width) {
+    uint32_t groups = (count + 7) / 8;
+    parquet_varint(buf, (groups << 1) | 1);
+    dbc_buf_reserve(buf, (size_t)groups * bit_width + 8);
+
+    uint64_t bits = 0;
+    uint32_t filled = 0;
+    for (uint32_t i = 0; i < groups * 8; i++) {
+        uint64_t v = i < count ? values[i] : 0;
+        bits |= v << filled;
+        filled += bit_width;
+        while (filled >= 8) {
+            buf->data[buf->size++] = (char)(bits & 0xFF);
+            bits >>= 8;
+            filled -= 8;
+        }
+    }
+}
+
+static void parquet_rle_run(DBCBuffer *buf, uint32_t value, uint32_t count, uint32_t bit_width) {
+    parquet_varint(buf, count << 1);
+    dbc_buf_append(buf, &value, (bit_width + 7) / 8);
+}
+
+// RLE/bit-packed hybrid encoding: runs of 8+ equal values become RLE runs,
+// everything in between is bit-packed in groups of 8.
+static void parquet_encode_hybrid(DBCBuffer *buf, const uint32_t *values, uint32_t count, uint32_t bit_width) {
+    uint32_t literal_start = 0;
+    uint32_t i = 0;
+
+    while (i < count) {
+        uint32_t run = 1;
+        while (i + run < count && values[i + run] == values[i]) run++;
+
+        if (run < 8) {
+            i += run;
+            continue;
+        }
+
+        // Literal runs must hold a multiple of 8 values, so borrow from the run
+        uint32_t pending = i - literal_start;
+        uint32_t pad = (8 - pending % 8) % 8;
+        if (pending && run - pad < 8) {
+            i += run;
+            continue;
+        }
+        if (pending) {
+            parquet_bit_pack(buf, values + literal_start, pending + pad, bit_width);
+            i += pad;
+            run -= pad;
+        }
+        parquet_rle_run(buf, values[i], run, bit_width);
+        i += run;
+        literal_start = i;
+    }
+
+    if (literal_start < count) {
+        parquet_bit_pack(buf, values + literal_start, count - literal_start, bit_width);
+    }
+}
+
+typedef struct {
+    int64_t dictionary_page_offset;
+    int64_t data_page_offset;
+    int64_t total_size;
+    int dictionary;
+} ParquetChunk;
+
+typedef struct {
+    DBCFile *dbc;
+    const char *path;
+    VALUE field_names;
+    FieldType *types;
+    ParquetEncoding *encodings;
+    FILE *file;
+    int64_t position;
+    DBCBuffer page;
+    DBCBuffer header;
+    DBCBuffer metadata;
+    uint32_t *indices;
+    uint32_t *dictionary;
+    uint32_t *slots;  // value hash -> dictionary entry + 1
+    uint32_t slot_mask;
+    ParquetChunk *chunks;
+    uint32_t row_group_count;
+} ParquetExport;
+
+static void parquet_write(ParquetExport *ex, const void *data, size_t len) {
+    if (len && fwrite(data, 1, len, ex->file) != len) {
+        rb_raise(rb_eIOError, "Failed to write Parquet file");
+    }
+    ex->position += (int64_t)len;
+    DBC_COUNT(DBC_BYTES_WRITTEN, len);
+}
+
+static void parquet_write_page(ParquetExport *ex, int page_type, uint32_t value_count, int encoding) {
+    ThriftWriter tw = {&ex->header, {0}, 0};
+    ex->header.size = 0;
+
+    thrift_i32(&tw, 1, page_type);
+    thrift_i32(&tw, 2, (int32_t)ex->page.size);
+    thrift_i32(&tw, 3, (int32_t)ex->page.size);
+    if (page_type == PARQUET_PAGE_DICTIONARY) {
+        thrift_begin(&tw, 7);
+        thrift_i32(&tw, 1, (int32_t)value_count);
+        thrift_i32(&tw, 2, encoding);
+        thrift_end(&tw);
+    } else {
+        thrift_begin(&tw, 5);
+        thrift_i32(&tw, 1, (int32_t)value_count);
+        thrift_i32(&tw, 2, encoding);
+        thrift_i32(&tw, 3, PARQUET_ENCODING_RLE);
+        thrift_i32(&tw, 4, PARQUET_ENCODING_RLE);
+        thrift_end(&tw);
+    }
+    static const uint8_t stop = 0;
+    dbc_buf_append(&ex->header, &stop, 1);
+
+    parquet_write(ex, ex->header.data, ex->header.size);
+    parquet_write(ex, ex->page.data, ex->page.size);
+}
+
+static uint32_t parquet_word(const DBCFile *dbc, uint32_t row, uint32_t column) {
+    return dbc->records[row][column].value.uint32_value;
+}
+
+static const char *parquet_string(const DBCFile *dbc, uint32_t offset) {
+    return offset < dbc->header.string_block_size ? &dbc->string_block[offset] : "";
+}
+
+// Builds a dictionary over the 32-bit words of a column chunk. Returns the
+// number of entries, or 0 when it would not be smaller than plain encoding
+// or, when forced, would not fit in PARQUET_MAX_DICTIONARY entries.
+static uint32_t parquet_word_dictionary(ParquetExport *ex, uint32_t column, uint32_t start, uint32_t rows, int forced) {
+    memset(ex->slots, 0, ((size_t)ex->slot_mask + 1) * sizeof(uint32_t));
+    uint32_t limit = forced ? PARQUET_MAX_DICTIONARY : rows / 2;
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < rows; i++) {
+        uint32_t v = parquet_word(ex->dbc, start + i, column);
+        uint32_t slot = (v * 2654435761u) & ex->slot_mask;
+        while (ex->slots[slot] && ex->dictionary[ex->slots[slot] - 1] != v) {
+            slot = (slot + 1) & ex->slot_mask;
+        }
+        if (!ex->slots[slot]) {
+            if (count == limit) return 0;
+            ex->dictionary[count++] = v;
+            ex->slots[slot] = count;
+        }
+        ex->indices[i] = ex->slots[slot] - 1;
+    }
+    return count;
+}
+
+static void parquet_write_chunk(ParquetExport *ex, uint32_t column, uint32_t start, uint32_t rows, ParquetChunk *chunk) {
+    DBCFile *dbc = ex->dbc;
+    FieldType type = ex->types[column];
+    ParquetEncoding encoding = ex->encodings[column];
+    int64_t chunk_start = ex->position;
+    uint32_t dictionary_count = 0;
+
+    memset(chunk, 0, sizeof(ParquetChunk));
+
+    if (type == TYPE_STRING && encoding != ENCODING_PLAIN) {
+        DBCStringTable strings;
+        dbc_strtab_init(&strings);
+        for (uint32_t i = 0; i < rows; i++) {
+            const char *s = parquet_string(dbc, parquet_word(dbc, start + i, column));
+            ex->indices[i] = dbc_strtab_intern(&strings, s, (uint32_t)strlen(s));
+        }
+        dictionary_count = strings.count;
+
+        ex->page.size = 0;
+        for (uint32_t k = 0; k < strings.count; k++) {
+            uint32_t len = strings.lengths[k];
+            dbc_buf_append(&ex->page, &len, 4);
+            dbc_buf_append(&ex->page, strings.data + strings.offsets[k], len);
+        }
+        dbc_strtab_free(&strings);
+    } else if (type != TYPE_STRING && encoding != ENCODING_PLAIN) {
+        dictionary_count = parquet_word_dictionary(ex, column, start, rows, encoding == ENCODING_DICTIONARY);
+        ex->page.size = 0;
+        dbc_buf_append(&ex->page, ex->dictionary, (size_t)dictionary_count * 4);
+    }
+
+    if (dictionary_count) {
+        chunk->dictionary = 1;
+        chunk->dictionary_page_offset = ex->position;
+        parquet_write_page(ex, PARQUET_PAGE_DICTIONARY, dictionary_count, PARQUET_ENCODING_PLAIN_DICTIONARY);
+
+        uint32_t bit_width = parquet_bit_width(dictionary_count - 1);
+        uint8_t width_byte = (uint8_t)bit_width;
+        ex->page.size = 0;
+        dbc_buf_append(&ex->page, &width_byte, 1);
+        parquet_encode_hybrid(&ex->page, ex->indices, rows, bit_width);
+
+        chunk->data_page_offset = ex->position;
+        parquet_write_page(ex, PARQUET_PAGE_DATA, rows, PARQUET_ENCODING_PLAIN_DICTIONARY);
+    } else {
+        ex->page.size = 0;
+        dbc_buf_reserve(&ex->page, (size_t)rows * 4);
+        for (uint32_t i = 0; i < rows; i++) {
+            uint32_t v = parquet_word(dbc, start + i, column);
+            if (type == TYPE_STRING) {
+                const char *s = parquet_string(dbc, v);
+                uint32_t len = (uint32_t)strlen(s);
+                dbc_buf_append(&ex->page, &len, 4);
+                dbc_buf_append(&ex->page, s, len);
+            } else {
+                memcpy(ex->page.data + ex->page.size, &v, 4);
+                ex->page.size += 4;
+            }
+        }
+
+        chunk->data_page_offset = ex->position;
+        parquet_write_page(ex, PARQUET_PAGE_DATA, rows, PARQUET_ENCODING_PLAIN);
+    }
+
+    chunk->total_size = ex->position - chunk_start;
+}
+
+static int parquet_physical_type(FieldType type) {
+    switch (type) {
+        case TYPE_FLOAT:
+            return PARQUET_TYPE_FLOAT;
+        case TYPE_STRING:
+            return PARQUET_TYPE_BYTE_ARRAY;
+        default:
+            return PARQUET_TYPE_INT32;
+    }
+}
+
+static VALUE parquet_column_name(VALUE field_names, uint32_t column) {
+    VALUE name = rb_ary_entry(field_names, column);
+    return NIL_P(name) ? rb_sprintf("field_%u", column) : rb_obj_as_string(name);
+}
+
+static void parquet_write_metadata(ParquetExport *ex) {
+    DBCFile *dbc = ex->dbc;
+    uint32_t field_count = dbc->header.field_count;
+    ThriftWriter tw = {&ex->metadata, {0}, 0};
+
+    thrift_i32(&tw, 1, 1);
+
+    // Schema: a root group followed by one leaf per column
+    thrift_list(&tw, 2, THRIFT_STRUCT, field_count + 1);
+    thrift_begin(&tw, 0);
+    thrift_string(&tw, 4, "schema", 6);
+    thrift_i32(&tw, 5, (int32_t)field_count);
+    thrift_end(&tw);
+    for (uint32_t j = 0; j < field_count; j++) {
+        VALUE name = parquet_column_name(ex->field_names, j);
+        thrift_begin(&tw, 0);
+        thrift_i32(&tw, 1, parquet_physical_type(ex->types[j]));
+        thrift_i32(&tw, 3, PARQUET_REPETITION_REQUIRED);
+        thrift_string(&tw, 4, RSTRING_PTR(name), RSTRING_LEN(name));
+        switch (ex->types[j]) {
+            case TYPE_UINT32:
+            case TYPE_INT32:
+                thrift_i32(&tw, 6, ex->types[j] == TYPE_UINT32 ? PARQUET_CONVERTED_UINT_32 : PARQUET_CONVERTED_INT_32);
+                thrift_begin(&tw, 10);
+                thrift_begin(&tw, 10);
+                thrift_byte(&tw, 1, 32);
+                thrift_bool(&tw, 2, ex->types[j] == TYPE_INT32);
+                thrift_end(&tw);
+                thrift_end(&tw);
+                break;
+            case TYPE_STRING:
+                thrift_i32(&tw, 6, PARQUET_CONVERTED_UTF8);
+                thrift_begin(&tw, 10);
+                thrift_begin(&tw, 1);
+                thrift_end(&tw);
+                thrift_end(&tw);
+                break;
+            case TYPE_FLOAT:
+                break;
+        }
+        thrift_end(&tw);
+    }
+
+    thrift_i64(&tw, 3, dbc->header.record_count);
+
+    thrift_list(&tw, 4, THRIFT_STRUCT, ex->row_group_count);
+    for (uint32_t g = 0; g < ex->row_group_count; g++) {
+        uint32_t start = g * PARQUET_ROW_GROUP_ROWS;
+        uint32_t rows = dbc->header.record_count - start < PARQUET_ROW_GROUP_ROWS ? dbc->header.record_count - start : PARQUET_ROW_GROUP_ROWS;
+        ParquetChunk *chunks = ex->chunks + (size_t)g * field_count;
+        int64_t total_size = 0;
+
+        thrift_begin(&tw, 0);
+        thrift_list(&tw, 1, THRIFT_STRUCT, field_count);
+        for (uint32_t j = 0; j < field_count; j++) {
+            ParquetChunk *chunk = &chunks[j];
+            VALUE name = parquet_column_name(ex->field_names, j);
+            int64_t first_page = chunk->dictionary ? chunk->dictionary_page_offset : chunk->data_page_offset;
+            total_size += chunk->total_size;
+
+            thrift_begin(&tw, 0);
+            thrift_i64(&tw, 2, first_page);
+            thrift_begin(&tw, 3);
+            thrift_i32(&tw, 1, parquet_physical_type(ex->types[j]));
+            if (chunk->dictionary) {
+                thrift_list(&tw, 2, THRIFT_I32, 2);
+                thrift_zigzag(&tw, PARQUET_ENCODING_PLAIN_DICTIONARY);
+                thrift_zigzag(&tw, PARQUET_ENCODING_RLE);
+            } else {
+                thrift_list(&tw, 2, THRIFT_I32, 1);
+                thrift_zigzag(&tw, PARQUET_ENCODING_PLAIN);
+            }
+            thrift_list(&tw, 3, THRIFT_BINARY, 1);
+            thrift_varint(&tw, (uint64_t)RSTRING_LEN(name));
+            dbc_buf_append(tw.buf, RSTRING_PTR(name), RSTRING_LEN(name));
+            thrift_i32(&tw, 4, PARQUET_CODEC_UNCOMPRESSED);
+            thrift_i64(&tw, 5, rows);
+            thrift_i64(&tw, 6, chunk->total_size);
+            thrift_i64(&tw, 7, chunk->total_size);
+            thrift_i64(&tw, 9, chunk->data_page_offset);
+            if (chunk->dictionary) thrift_i64(&tw, 11, chunk->dictionary_page_offset);
+            thrift_end(&tw);
+            thrift_end(&tw);
+        }
+        thrift_i64(&tw, 2, total_size);
+        thrift_i64(&tw, 3, rows);
+        thrift_end(&tw);
+    }
+
+    VALUE created_by = rb_sprintf("wow_dbc version %"PRIsVALUE, rb_const_get(rb_mWowDBC, rb_intern("VERSION")));
+    thrift_string(&tw, 6, RSTRING_PTR(created_by), RSTRING_LEN(created_by));
+
+    static const uint8_t stop = 0;
+    dbc_buf_append(&ex->metadata, &stop, 1);
+}
+
+static VALUE parquet_export_body(VALUE arg) {
+    ParquetExport *ex = (ParquetExport *)arg;
+    DBCFile *dbc = ex->dbc;
+    uint32_t field_count = dbc->header.field_count;
+    uint32_t record_count = dbc->header.record_count;
+
+    ex->row_group_count = (record_count + PARQUET_ROW_GROUP_ROWS - 1) / PARQUET_ROW_GROUP_ROWS;
+    ex->chunks = calloc((size_t)(ex->row_group_count ? ex->row_group_count : 1) * (field_count ? field_count : 1), sizeof(ParquetChunk));
+    ex->indices = malloc(PARQUET_ROW_GROUP_ROWS * sizeof(uint32_t));
+    ex->dictionary = malloc(PARQUET_MAX_DICTIONARY * sizeof(uint32_t));
+    ex->slot_mask = PARQUET_MAX_DICTIONARY * 4 - 1;
+    ex->slots = malloc(((size_t)ex->slot_mask + 1) * sizeof(uint32_t));
+    if (!ex->chunks || !ex->indices || !ex->dictionary || !ex->slots) {
+        rb_raise(rb_eNoMemError, "Could not allocate Parquet export buffers");
+    }
+    dbc_buf_init(&ex->page, 1 << 16);
+    dbc_buf_init(&ex->header, 64);
+    dbc_buf_init(&ex->metadata, 4096);
+
+    ex->file = fopen(ex->path, "wb");
+    if (!ex->file) {
+        rb_raise(rb_eIOError, "Could not open file for writing: %s", ex->path);
+    }
+
+    parquet_write(ex, PARQUET_MAGIC, 4);
+    for (uint32_t g = 0; g < ex->row_group_count; g++) {
+        uint32_t start = g * PARQUET_ROW_GROUP_ROWS;
+        uint32_t rows = record_count - start < PARQUET_ROW_GROUP_ROWS ? record_count - start : PARQUET_ROW_GROUP_ROWS;
+        for (uint32_t j = 0; j < field_count; j++) {
+            parquet_write_chunk(ex, j, start, rows, &ex->chunks[(size_t)g * field_count + j]);
+        }
+    }
+
+    parquet_write_metadata(ex);
+    uint32_t metadata_length = (uint32_t)ex->metadata.size;
+    parquet_write(ex, ex->metadata.data, ex->metadata.size);
+    parquet_write(ex, &metadata_length, 4);
+    parquet_write(ex, PARQUET_MAGIC, 4);
+
+    return Qnil;
+}
+
+static VALUE parquet_export_cleanup(VALUE arg) {
+    ParquetExport *ex = (ParquetExport *)arg;
+
+    if (ex->file) fclose(ex->file);
+    free(ex->chunks);
+    free(ex->indices);
+    free(ex->dictionary);
+    free(ex->slots);
+    dbc_buf_free(&ex->page);
+    dbc_buf_free(&ex->header);
+    dbc_buf_free(&ex->metadata);
+
+    return Qnil;
+}
+
+static ParquetEncoding parquet_encoding_option(VALUE value) {
+    if (RB_TYPE_P(value, T_SYMBOL)) {
+        ID id = SYM2ID(value);
+        if (id == rb_intern("auto")) return ENCODING_AUTO;
+        if (id == rb_intern("plain")) return ENCODING_PLAIN;
+        if (id == rb_intern("dictionary")) return ENCODING_DICTIONARY;
+    }
+    rb_raise(rb_eArgError, "Invalid Parquet encoding: %"PRIsVALUE" (expected :auto, :plain or :dictionary)", value);
+}
+
+// DBCFile#to_parquet(path, encodings: {}) -> self
+//
+// `encodings` maps field names to :auto (the default), :plain or
+// :dictionary. In auto mode strings are always dictionary encoded and
+// numeric columns are when that is smaller than plain encoding, so
+// low-cardinality fields get RLE/bit-packed dictionary indices. A numeric
+// column forced to :dictionary falls back to plain encoding in row groups
+// where it has more than PARQUET_MAX_DICTIONARY distinct values.
+static VALUE dbc_to_parquet(int argc, VALUE *argv, VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_to_parquet, -1 - argc, argv, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    VALUE filepath, options;
+    rb_scan_args(argc, argv, "1:", &filepath, &options);
+
+    VALUE encodings = Qnil;
+    if (!NIL_P(options)) {
+        ID keywords[1] = {rb_intern("encodings")};
+        VALUE values[1];
+        rb_get_kwargs(options, keywords, 0, 1, values);
+        if (values[0] != Qundef) encodings = values[0];
+    }
+    if (!NIL_P(encodings)) Check_Type(encodings, T_HASH);
+
+    ParquetExport ex;
+    memset(&ex, 0, sizeof(ParquetExport));
+    ex.dbc = dbc;
+    ex.path = StringValueCStr(filepath);
+    ex.field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+
+    uint32_t field_count = dbc->header.field_count ? dbc->header.field_count : 1;
+    VALUE types_buf, encodings_buf;
+    FieldType *types = ALLOCV_N(FieldType, types_buf, field_count);
+    ParquetEncoding *column_encodings = ALLOCV_N(ParquetEncoding, encodings_buf, field_count);
+    memset(column_encodings, 0, field_count * sizeof(ParquetEncoding));
+    dbc_column_types(dbc, types);
+
+    if (!NIL_P(encodings)) {
+        VALUE keys = rb_funcall(encodings, rb_intern("keys"), 0);
+        for (long i = 0; i < RARRAY_LEN(keys); i++) {
+            VALUE key = rb_ary_entry(keys, i);
+            long field_idx = -1;
+            for (long j = 0; j < RARRAY_LEN(ex.field_names) && (uint32_t)j < dbc->header.field_count; j++) {
+                if (rb_eql(rb_ary_entry(ex.field_names, j), key)) {
+                    field_idx = j;
+                    break;
+                }
+            }
+            if (field_idx < 0) {
+                rb_raise(rb_eArgError, "Invalid field name: %"PRIsVALUE, key);
+            }
+            column_encodings[field_idx] = parquet_encoding_option(rb_hash_aref(encodings, key));
+        }
+    }
+    ex.types = types;
+    ex.encodings = column_encodings;
+
+    rb_ensure(parquet_export_body, (VALUE)&ex, parquet_export_cleanup, (VALUE)&ex);
+    ALLOCV_END(encodings_buf);
+    ALLOCV_END(types_buf);
+    return self;
+}
+
+void Init_wow_dbc_parquet(void) {
+    rb_define_method(rb_cDBCFile, "to_parquet", dbc_to_parquet, -1);
+}
@@ -0,0 +1,592 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// Binary patches that turn one DBC file into another:
+//
+//   "WDBCPTCH"       magic
+//   base hash        u64, content_hash of the table the patch applies to
+//   columns          varint, then the column types two bits each, four
+//                    to a byte
+//   record_count, record_size (varints) and the 4-byte magic of the
+//                    patched header
+//   additions        varint size, then strings appended to the base string
+//                    block
+//   ops              varint opcodes until PATCH_END
+//
+// Ops walk the base records with a cursor. Base rows that are never
+// reached are deleted. Words are varints; string words are offsets into the
+// base string block followed by the additions, so strings the base already
+// holds are never shipped again. The patched string block keeps every base
+// string, so the result has the same records as the target file but not
+// necessarily the same bytes.
+
+#define PATCH_MAGIC "WDBCPTCH"
+
+enum {
+    PATCH_END,
+    PATCH_KEEP,    // n: copy n base rows unchanged
+    PATCH_SKIP,    // n: drop n base rows
+    PATCH_SEEK,    // row: move the cursor to any base row
+    PATCH_MODIFY,  // count, then (field delta, word) pairs: copy one base row with changes
+    PATCH_INSERT   // columns words: a new row
+};
+
+static void patch_write_varint(DBCBuffer *buf, uint64_t v) {
+    uint8_t out[10];
+    size_t len = 0;
+    do {
+        uint8_t byte = v & 0x7F;
+        v >>= 7;
+        out[len++] = v ? (byte | 0x80) : byte;
+    } while (v);
+    dbc_buf_append(buf, out, len);
+}
+
+/* Make */
+
+typedef struct {
+    DBCDiff diff;
+    DBCBuffer head;
+    DBCBuffer out;
+    DBCStringTable additions;
+    uint32_t *base_slots;  // base string offset + 1 by content hash
+    size_t base_mask;
+    int additions_used;
+    uint32_t keep_run;
+} PatchBuild;
+
+static uint64_t patch_string_hash(const char *s, size_t len) {
+    return dbc_hash64(s, len, 0);
+}
+
+// Indexes every string that starts in the base string block, on first use
+static void patch_index_base_strings(PatchBuild *build) {
+    const DBCRaw *raw = &build->diff.old_raw;
+    uint32_t size = raw->header.string_block_size;
+
+    uint32_t starts = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        if (i == 0 || raw->string_block[i - 1] == '\0') starts++;
+    }
+    size_t slot_count = 16;
+    while (slot_count < (uint64_t)starts * 2) slot_count <<= 1;
+    build->base_slots = calloc(slot_count, sizeof(uint32_t));
+    if (!build->base_slots) rb_raise(rb_eNoMemError, "Could not index the base strings");
+    build->base_mask = slot_count - 1;
+
+    for (uint32_t i = 0; i < size; i++) {
+        if (i != 0 && raw->string_block[i - 1] != '\0') continue;
+        size_t len;
+        const char *s = dbc_diff_string(raw, i, &len);
+        size_t slot = patch_string_hash(s, len) & build->base_mask;
+        while (build->base_slots[slot]) slot = (slot + 1) & build->base_mask;
+        build->base_slots[slot] = i + 1;
+    }
+}
+
+// Offset of a string from the new file in the patched string block
+static uint32_t patch_string_word(PatchBuild *build, uint32_t new_offset) {
+    const DBCRaw *base = &build->diff.old_raw;
+    size_t len;
+    const char *s = dbc_diff_string(&build->diff.new_raw, new_offset, &len);
+
+    if (!build->base_slots) patch_index_base_strings(build);
+    size_t slot = patch_string_hash(s, len) & build->base_mask;
+    for (; build->base_slots[slot]; slot = (slot + 1) & build->base_mask) {
+        uint32_t offset = build->base_slots[slot] - 1;
+        size_t base_len;
+        const char *base_s = dbc_diff_string(base, offset, &base_len);
+        if (base_len == len && memcmp(base_s, s, len) == 0) return offset;
+    }
+
+    uint32_t entry = dbc_strtab_intern(&build->additions, s, (uint32_t)len);
+    build->additions_used = 1;
+    return base->header.string_block_size + build->additions.offsets[entry];
+}
+
+static uint32_t patch_word(PatchBuild *build, const uint32_t *row, uint32_t j) {
+    return build->diff.types[j] == TYPE_STRING ? patch_string_word(build, row[j]) : row[j];
+}
+
+static void patch_flush_keep(PatchBuild *build) {
+    if (!build->keep_run) return;
+    patch_write_varint(&build->out, PATCH_KEEP);
+    patch_write_varint(&build->out, build->keep_run);
+    build->keep_run = 0;
+}
+
+static VALUE patch_build_body(VALUE arg) {
+    PatchBuild *build = (PatchBuild *)arg;
+    DBCDiff *diff = &build->diff;
+    dbc_diff_load(diff);
+
+    const DBCRaw *old_raw = &diff->old_raw;
+    const DBCRaw *new_raw = &diff->new_raw;
+    uint32_t columns = new_raw->columns;
+    size_t row_bytes = (size_t)columns * sizeof(uint32_t);
+    DBCBuffer *out = &build->out;
+    VALUE changed_buf;
+    uint32_t *changed = ALLOCV_N(uint32_t, changed_buf, columns ? columns : 1);
+
+    uint32_t cursor = 0;
+    for (uint32_t i = 0; i < new_raw->header.record_count; i++) {
+        const uint32_t *new_row = new_raw->records + (size_t)i * columns;
+        int64_t match = dbc_diff_match(diff, new_row);
+
+        if (match < 0) {
+            patch_flush_keep(build);
+            patch_write_varint(out, PATCH_INSERT);
+            for (uint32_t j = 0; j < columns; j++) {
+                patch_write_varint(out, patch_word(build, new_row, j));
+            }
+            continue;
+        }
+        diff->matched[match] = 1;
+
+        if ((uint32_t)match != cursor) {
+            patch_flush_keep(build);
+            if ((uint32_t)match > cursor) {
+                patch_write_varint(out, PATCH_SKIP);
+                patch_write_varint(out, (uint32_t)match - cursor);
+            } else {
+                patch_write_varint(out, PATCH_SEEK);
+                patch_write_varint(out, (uint64_t)match);
+            }
+            cursor = (uint32_t)match;
+        }
+
+        const uint32_t *old_row = old_raw->records + (size_t)match * columns;
+        uint32_t changed_count = 0;
+        if (!diff->same_strings || memcmp(old_row, new_row, row_bytes) != 0) {
+            for (uint32_t j = 0; j < columns; j++) {
+                if (!dbc_diff_field_equal(diff, old_row, new_row, j)) changed[changed_count++] = j;
+            }
+        }
+        cursor++;
+
+        if (changed_count == 0) {
+            build->keep_run++;
+            continue;
+        }
+        patch_flush_keep(build);
+        patch_write_varint(out, PATCH_MODIFY);
+        patch_write_varint(out, changed_count);
+        uint32_t previous = 0;
+        for (uint32_t k = 0; k < changed_count; k++) {
+            patch_write_varint(out, changed[k] - previous);
+            patch_write_varint(out, patch_word(build, new_row, changed[k]));
+            previous = changed[k];
+        }
+    }
+    patch_flush_keep(build);
+    patch_write_varint(out, PATCH_END);
+    ALLOCV_END(changed_buf);
+
+    // The patch applies to the base as DBCFile#content_hash sees it: the
+    // header, records and string block without any trailing bytes
+    size_t base_size = sizeof(DBCHeader) + (size_t)old_raw->header.record_count * old_raw->header.record_size +
+                       old_raw->header.string_block_size;
+    uint64_t base_hash = dbc_hash64(old_raw->data, base_size, 0);
+    uint32_t additions_size = build->additions_used ? (uint32_t)build->additions.data_size : 0;
+
+    DBCBuffer *head = &build->head;
+    dbc_buf_append(head, PATCH_MAGIC, 8);
+    dbc_buf_append(head, &base_hash, sizeof(uint64_t));
+    patch_write_varint(head, columns);
+    for (uint32_t j = 0; j < columns; j += 4) {
+        uint8_t packed = 0;
+        for (uint32_t k = j; k < columns && k < j + 4; k++) packed |= (uint8_t)(diff->types[k] << (2 * (k - j)));
+        dbc_buf_append(head, &packed, 1);
+    }
+    patch_write_varint(head, new_raw->header.record_count);
+    patch_write_varint(head, new_raw->header.record_size);
+    dbc_buf_append(head, new_raw->header.magic, 4);
+    patch_write_varint(head, additions_size);
+
+    VALUE patch = rb_str_buf_new((long)(head->size + additions_size + out->size));
+    rb_str_buf_cat(patch, head->data, (long)head->size);
+    rb_str_buf_cat(patch, build->additions.data, (long)additions_size);
+    rb_str_buf_cat(patch, out->data, (long)out->size);
+    return patch;
+}
+
+static VALUE patch_build_cleanup(VALUE arg) {
+    PatchBuild *build = (PatchBuild *)arg;
+    dbc_diff_cleanup((VALUE)&build->diff);
+    dbc_buf_free(&build->head);
+    dbc_buf_free(&build->out);
+    dbc_strtab_free(&build->additions);
+    free(build->base_slots);
+    return Qnil;
+}
+
+// WowDBC.make_patch(old_path, new_path, key: :id, fields: nil) -> String
+//
+// Binary patch that DBCFile#apply_patch! applies to the table read from
+// `old_path` to get the records of `new_path`. Records are paired by key as
+// in WowDBC.diff, which also describes the options.
+static VALUE wow_dbc_make_patch(int argc, VALUE *argv, VALUE self) {
+    VALUE old_path, new_path, options;
+    rb_scan_args(argc, argv, "2:", &old_path, &new_path, &options);
+
+    PatchBuild build;
+    memset(&build, 0, sizeof(PatchBuild));
+    dbc_diff_init(&build.diff, old_path, new_path, options);
+    dbc_buf_init(&build.head, 64);
+    dbc_buf_init(&build.out, 4096);
+    dbc_strtab_init(&build.additions);
+
+    VALUE patch = rb_ensure(patch_build_body, (VALUE)&build, patch_build_cleanup, (VALUE)&build);
+    RB_GC_GUARD(build.diff.fields);
+    RB_GC_GUARD(build.diff.field_names);
+    return patch;
+}
+
+/* Apply */
+
+typedef struct {
+    const uint8_t *pos;
+    const uint8_t *end;
+} PatchReader;
+
+static void patch_malformed(void) {
+    rb_raise(rb_eArgError, "Malformed patch");
+}
+
+static uint64_t patch_read_varint(PatchReader *reader) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->pos >= reader->end) patch_malformed();
+        uint8_t byte = *reader->pos++;
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return v;
+    }
+    patch_malformed();
+    return 0;
+}
+
+static uint32_t patch_read_u32(PatchReader *reader) {
+    uint64_t v = patch_read_varint(reader);
+    if (v > UINT32_MAX) patch_malformed();
+    return (uint32_t)v;
+}
+
+typedef struct {
+    uint32_t columns;
+    uint32_t record_count;
+    uint32_t record_size;
+    char magic[4];
+    const char *additions;
+    uint32_t additions_size;
+    PatchReader ops;
+} PatchHeader;
+
+static void patch_read_header(PatchReader *reader, const DBCFile *dbc, const FieldType *types, PatchHeader *header) {
+    if (reader->end - reader->pos < 16 || memcmp(reader->pos, PATCH_MAGIC, 8) != 0) patch_malformed();
+    uint64_t base_hash;
+    memcpy(&base_hash, reader->pos + 8, sizeof(uint64_t));
+    reader->pos += 16;
+
+    header->columns = patch_read_u32(reader);
+    if (header->columns != dbc->header.field_count) {
+        rb_raise(rb_eArgError, "Patch does not apply to this table");
+    }
+    size_t type_bytes = ((size_t)header->columns + 3) / 4;
+    if ((size_t)(reader->end - reader->pos) < type_bytes) patch_malformed();
+    for (uint32_t j = 0; j < header->columns; j++) {
+        if ((FieldType)((reader->pos[j / 4] >> (2 * (j % 4))) & 3) != types[j]) {
+            rb_raise(rb_eArgError, "Patch was made for different column types");
+        }
+    }
+    reader->pos += type_bytes;
+    header->record_count = patch_read_u32(reader);
+    header->record_size = patch_read_u32(reader);
+    if (reader->end - reader->pos < 4) patch_malformed();
+    memcpy(header->magic, reader->pos, 4);
+    reader->pos += 4;
+    header->additions_size = patch_read_u32(reader);
+    if ((uint64_t)(reader->end - reader->pos) < header->additions_size) patch_malformed();
+    header->additions = (const char *)reader->pos;
+    reader->pos += header->additions_size;
+    header->ops = *reader;
+
+    if (base_hash != dbc_content_hash(dbc)) {
+        rb_raise(rb_eArgError, "Patch does not apply to this table");
+    }
+    if ((uint64_t)dbc->header.string_block_size + header->additions_size > UINT32_MAX) patch_malformed();
+}
+
+// Walks the ops without touching the table, so a bad patch is rejected
+// before anything changes
+static void patch_validate(PatchHeader *header, const DBCFile *dbc, const FieldType *types) {
+    PatchReader reader = header->ops;
+    uint32_t base_count = dbc->header.record_count;
+    uint64_t string_limit = (uint64_t)dbc->header.string_block_size + header->additions_size;
+    uint64_t cursor = 0, rows = 0;
+
+    for (;;) {
+        uint64_t op = patch_read_varint(&reader);
+        if (op == PATCH_END) break;
+        switch (op) {
+            case PATCH_KEEP: {
+                uint64_t n = patch_read_varint(&reader);
+                if (n > base_count - cursor) patch_malformed();
+                cursor += n;
+                rows += n;
+                break;
+            }
+            case PATCH_SKIP: {
+                uint64_t n = patch_read_varint(&reader);
+                if (n > base_count - cursor) patch_malformed();
+                cursor += n;
+                break;
+            }
+            case PATCH_SEEK:
+                cursor = patch_read_varint(&reader);
+                if (cursor > base_count) patch_malformed();
+                break;
+            case PATCH_MODIFY: {
+                if (cursor >= base_count) patch_malformed();
+                uint64_t count = patch_read_varint(&reader);
+                uint64_t field = 0;
+                for (uint64_t k = 0; k < count; k++) {
+                    field += patch_read_varint(&reader);
+                    if (field >= header->columns) patch_malformed();
+                    uint32_t word = patch_read_u32(&reader);
+                    if (types[field] == TYPE_STRING && word >= string_limit) patch_malformed();
+                }
+                cursor++;
+                rows++;
+                break;
+            }
+            case PATCH_INSERT:
+                for (uint32_t j = 0; j < header->columns; j++) {
+                    uint32_t word = patch_read_u32(&reader);
+                    if (types[j] == TYPE_STRING && word >= string_limit) patch_malformed();
+                }
+                rows++;
+                break;
+            default:
+                patch_malformed();
+        }
+    }
+    if (reader.pos != reader.end || rows != header->record_count) patch_malformed();
+    if (header->additions_size && header->additions[header->additions_size - 1] != '\0') patch_malformed();
+}
+
+// State of one apply_patch!. Every allocation is made before the table
+// changes, so running out of memory leaves it untouched.
+typedef struct {
+    DBCFile *dbc;
+    PatchHeader *header;
+    const FieldType *types;
+    FieldValue **records;  // the patched array, NULL once installed
+    uint8_t *used;         // base rows already handed out
+    FieldValue **spares;   // rows for copies and inserts, taken from the end
+    uint64_t spare_count;
+} PatchApply;
+
+// Whether the patched table needs a copy of base `row`: the second time it
+// is used, or every time for rows shared with a snapshot or inside a
+// transaction
+static int patch_needs_copy(const DBCFile *dbc, uint8_t *used, uint32_t row) {
+    if (!used[row] && !dbc->undo && !(dbc->cow && dbc->cow[row])) {
+        used[row] = 1;
+        return 0;
+    }
+    return 1;
+}
+
+// Rows the ops will copy or insert. Runs over validated ops.
+static uint64_t patch_count_spares(const PatchApply *apply) {
+    PatchReader ops = apply->header->ops;
+    uint32_t cursor = 0;
+    uint64_t spares = 0;
+
+    for (;;) {
+        uint64_t op = patch_read_varint(&ops);
+        if (op == PATCH_END) break;
+        switch (op) {
+            case PATCH_KEEP: {
+                uint32_t n = (uint32_t)patch_read_varint(&ops);
+                for (uint32_t k = 0; k < n; k++) spares += patch_needs_copy(apply->dbc, apply->used, cursor++);
+                break;
+            }
+            case PATCH_SKIP:
+                cursor += (uint32_t)patch_read_varint(&ops);
+                break;
+            case PATCH_SEEK:
+                cursor = (uint32_t)patch_read_varint(&ops);
+                break;
+            case PATCH_MODIFY: {
+                spares += patch_needs_copy(apply->dbc, apply->used, cursor++);
+                uint64_t count = patch_read_varint(&ops);
+                for (uint64_t k = 0; k < count * 2; k++) patch_read_varint(&ops);
+                break;
+            }
+            case PATCH_INSERT:
+                for (uint32_t j = 0; j < apply->header->columns; j++) patch_read_varint(&ops);
+                spares++;
+                break;
+        }
+    }
+    return spares;
+}
+
+// Hands out base rows for the patched table, copying them when needed
+static FieldValue *patch_take(PatchApply *apply, uint32_t row) {
+    DBCFile *dbc = apply->dbc;
+    if (!patch_needs_copy(dbc, apply->used, row)) return dbc->records[row];
+    FieldValue *copy = apply->spares[--apply->spare_count];
+    memcpy(copy, dbc->records[row], (size_t)dbc->header.field_count * sizeof(FieldValue));
+    return copy;
+}
+
+static void patch_alloc_failed(void) {
+    rb_raise(rb_eNoMemError, "Could not allocate the patched records");
+}
+
+static VALUE patch_apply_body(VALUE arg) {
+    PatchApply *apply = (PatchApply *)arg;
+    DBCFile *dbc = apply->dbc;
+    PatchHeader *header = apply->header;
+    uint32_t columns = header->columns;
+    uint32_t base_count = dbc->header.record_count;
+
+    apply->records = malloc((header->record_count ? header->record_count : 1) * sizeof(FieldValue *));
+    apply->used = calloc(base_count ? base_count : 1, 1);
+    if (!apply->records || !apply->used) patch_alloc_failed();
+    uint64_t spares = patch_count_spares(apply);
+    memset(apply->used, 0, base_count ? base_count : 1);
+    apply->spares = malloc((spares ? spares : 1) * sizeof(FieldValue *));
+    if (!apply->spares) patch_alloc_failed();
+    while (apply->spare_count < spares) {
+        FieldValue *row = malloc((columns ? columns : 1) * sizeof(FieldValue));
+        if (!row) patch_alloc_failed();
+        apply->spares[apply->spare_count++] = row;
+    }
+
+    // Inside a transaction the log keeps the base records, so nothing is
+    // freed and every record in the new array is a copy
+    int logged = dbc_undo_table(dbc, dbc->records, base_count);
+
+    // Nothing below can raise
+    FieldValue **records = apply->records;
+    const FieldType *types = apply->types;
+    uint32_t cursor = 0, out = 0;
+    PatchReader ops = header->ops;
+
+    for (;;) {
+        uint64_t op = patch_read_varint(&ops);
+        if (op == PATCH_END) break;
+        switch (op) {
+            case PATCH_KEEP: {
+                uint32_t n = (uint32_t)patch_read_varint(&ops);
+                for (uint32_t k = 0; k < n; k++) records[out++] = patch_take(apply, cursor++);
+                break;
+            }
+            case PATCH_SKIP:
+                cursor += (uint32_t)patch_read_varint(&ops);
+                break;
+            case PATCH_SEEK:
+                cursor = (uint32_t)patch_read_varint(&ops);
+                break;
+            case PATCH_MODIFY: {
+                FieldValue *record = patch_take(apply, cursor++);
+                uint32_t count = (uint32_t)patch_read_varint(&ops);
+                uint32_t field = 0;
+                for (uint32_t k = 0; k < count; k++) {
+                    field += (uint32_t)patch_read_varint(&ops);
+                    record[field].value.uint32_value = (uint32_t)patch_read_varint(&ops);
+                }
+                records[out++] = record;
+                break;
+            }
+            case PATCH_INSERT: {
+                FieldValue *record = apply->spares[--apply->spare_count];
+                for (uint32_t j = 0; j < columns; j++) {
+                    record[j].type = types[j];
+                    record[j].value.uint32_value = (uint32_t)patch_read_varint(&ops);
+                }
+                records[out++] = record;
+                break;
+            }
+        }
+    }
+
+    if (!logged) {
+        for (uint32_t i = 0; i < base_count; i++) {
+            if (!apply->used[i] && !(dbc->cow && dbc->cow[i])) dbc_arena_retire(dbc->arena, dbc->records[i]);
+        }
+        dbc_arena_retire(dbc->arena, dbc->records);
+        free(dbc->cow);
+    }
+    dbc->records = records;
+    apply->records = NULL;
+    dbc->cow = NULL;
+    dbc->cow_capacity = 0;
+    dbc->record_capacity = 0;
+    dbc->rows_in_arena = 0;
+
+    if (header->additions_size) {
+        memcpy(dbc->string_block + dbc->header.string_block_size, header->additions, header->additions_size);
+        dbc->header.string_block_size += header->additions_size;
+    }
+    memcpy(dbc->header.magic, header->magic, 4);
+    dbc->header.record_count = header->record_count;
+    dbc->header.record_size = header->record_size;
+    dbc_mark_modified(dbc);
+    dbc_change(dbc, DBC_CHANGE_RESET, DBC_CHANGE_NONE, DBC_CHANGE_NONE);
+    return Qnil;
+}
+
+static VALUE patch_apply_cleanup(VALUE arg) {
+    PatchApply *apply = (PatchApply *)arg;
+    while (apply->spare_count) free(apply->spares[--apply->spare_count]);
+    free(apply->spares);
+    free(apply->used);
+    free(apply->records);
+    return Qnil;
+}
+
+// DBCFile#apply_patch!(patch) -> self
+//
+// Applies a patch from WowDBC.make_patch in one pass over the table.
+// Raises ArgumentError, leaving the table untouched, if the patch is
+// malformed or was made for different base data or column types.
+static VALUE dbc_apply_patch(VALUE self, VALUE patch) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_apply_patch, 1, &patch, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    rb_check_frozen(self);
+
+    StringValue(patch);
+    PatchReader reader = {(const uint8_t *)RSTRING_PTR(patch), (const uint8_t *)RSTRING_PTR(patch) + RSTRING_LEN(patch)};
+    VALUE types_buf;
+    FieldType *types = ALLOCV_N(FieldType, types_buf, dbc->header.field_count ? dbc->header.field_count : 1);
+    dbc_column_types(dbc, types);
+    PatchHeader header;
+    patch_read_header(&reader, dbc, types, &header);
+    patch_validate(&header, dbc, types);
+
+    dbc_cow_prepare(dbc);
+    if (header.additions_size) dbc_strings_reserve(dbc, header.additions_size);
+
+    PatchApply apply;
+    memset(&apply, 0, sizeof(PatchApply));
+    apply.dbc = dbc;
+    apply.header = &header;
+    apply.types = types;
+    rb_ensure(patch_apply_body, (VALUE)&apply, patch_apply_cleanup, (VALUE)&apply);
+    ALLOCV_END(types_buf);
+
+    RB_GC_GUARD(patch);
+    return self;
+}
+
+void Init_wow_dbc_patch(void) {
+    rb_define_module_function(rb_mWowDBC, "make_patch", wow_dbc_make_patch, -1);
+    rb_define_method(rb_cDBCFile, "apply_patch!", dbc_apply_patch, 1);
+}
@@ -0,0 +1,68 @@
+#include "wow_dbc.h"
+
+// Frozen tables are shareable between Ractors. Freezing settles everything
+// the read paths would otherwise do lazily (index rebuilds), so reads from
+// several Ractors at once only load from memory nobody writes.
+
+static ID id_write_lock;
+static ID id_make_shareable;
+
+// Deep-frozen copy of the field definitions, so freezing a table never
+// freezes a hash or string anyone else holds
+static VALUE ractor_frozen_definitions(VALUE definitions) {
+    VALUE copy = rb_hash_new();
+    VALUE keys = rb_funcall(definitions, rb_intern("keys"), 0);
+    for (long i = 0; i < RARRAY_LEN(keys); i++) {
+        VALUE key = rb_ary_entry(keys, i);
+        VALUE value = rb_hash_aref(definitions, key);
+        if (RB_TYPE_P(key, T_STRING)) key = rb_str_new_frozen(key);
+        if (RB_TYPE_P(value, T_STRING)) value = rb_str_new_frozen(value);
+        rb_hash_aset(copy, key, value);
+    }
+    return rb_obj_freeze(copy);
+}
+
+// DBCFile#freeze -> self
+//
+// Makes the table immutable: every method that changes records, indexes or
+// the file path raises FrozenError afterwards. Indexes are rebuilt now if
+// stale, and concurrent mode is dropped since there is nothing left to
+// serialize. The table switches to frozen copies of its field definitions
+// and path, so it is ready for Ractor.make_shareable.
+static VALUE dbc_freeze(VALUE self) {
+    if (OBJ_FROZEN(self)) return self;
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_freeze, 0, NULL, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    if (dbc->undo) {
+        rb_raise(rb_eRuntimeError, "Cannot freeze inside a transaction");
+    }
+
+    dbc_indexes_refresh(dbc);
+    if (dbc->concurrent) {
+        dbc->concurrent = 0;
+        rb_ivar_set(self, id_write_lock, Qnil);
+    }
+    VALUE filepath = rb_iv_get(self, "@filepath");
+    if (RB_TYPE_P(filepath, T_STRING)) rb_iv_set(self, "@filepath", rb_str_new_frozen(filepath));
+    dbc->field_definitions = ractor_frozen_definitions(dbc->field_definitions);
+    rb_iv_set(self, "@field_definitions", dbc->field_definitions);
+
+    return rb_call_super(0, NULL);
+}
+
+// DBCFile#make_shareable -> self
+//
+// Freezes the table and everything it references so it can be passed to
+// other Ractors without copying. Same as Ractor.make_shareable(dbc).
+static VALUE dbc_make_shareable(VALUE self) {
+    return rb_funcall(rb_const_get(rb_cObject, rb_intern("Ractor")), id_make_shareable, 1, self);
+}
+
+void Init_wow_dbc_ractor(void) {
+    id_write_lock = rb_intern("@write_lock");
+    id_make_shareable = rb_intern("make_shareable");
+    rb_define_method(rb_cDBCFile, "freeze", dbc_freeze, 0);
+    rb_define_method(rb_cDBCFile, "make_shareable", dbc_make_shareable, 0);
+}
@@ -0,0 +1,59 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// Loads a whole DBC file into one buffer and points the record and string
+// block views into it. Raises IOError on anything that is not a sane DBC.
+void dbc_raw_load(const char *path, DBCRaw *raw) {
+    memset(raw, 0, sizeof(DBCRaw));
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        rb_raise(rb_eIOError, "Could not open file: %s", path);
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0) {
+        fclose(file);
+        rb_raise(rb_eIOError, "Failed to seek in file: %s", path);
+    }
+    long size = ftell(file);
+    rewind(file);
+
+    if (size < (long)sizeof(DBCHeader)) {
+        fclose(file);
+        rb_raise(rb_eIOError, "Failed to read DBC header");
+    }
+
+    raw->data = malloc((size_t)size);
+    if (!raw->data) {
+        fclose(file);
+        rb_raise(rb_eNoMemError, "Could not allocate %ld bytes for %s", size, path);
+    }
+    if (fread(raw->data, 1, (size_t)size, file) != (size_t)size) {
+        fclose(file);
+        dbc_raw_release(raw);
+        rb_raise(rb_eIOError, "Failed to read DBC file");
+    }
+    fclose(file);
+
+    raw->size = (size_t)size;
+    memcpy(&raw->header, raw->data, sizeof(DBCHeader));
+
+    uint64_t record_bytes = (uint64_t)raw->header.record_count * raw->header.record_size;
+    if (raw->header.record_size % sizeof(uint32_t) != 0 ||
+        sizeof(DBCHeader) + record_bytes + raw->header.string_block_size > raw->size) {
+        dbc_raw_release(raw);
+        rb_raise(rb_eIOError, "Truncated or malformed DBC file: %s", path);
+    }
+
+    raw->columns = raw->header.record_size / sizeof(uint32_t);
+    raw->records = (const uint32_t *)(raw->data + sizeof(DBCHeader));
+    raw->string_block = (const char *)(raw->data + sizeof(DBCHeader) + record_bytes);
+}
+
+void dbc_raw_release(DBCRaw *raw) {
+    free(raw->data);
+    raw->data = NULL;
+    raw->records = NULL;
+    raw->string_block = NULL;
+}
@@ -0,0 +1,181 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// WotLK/TBC locstrings are 16 locale offsets followed by a flags word,
+// vanilla ones only carry 8 locales.
+static const uint32_t locstring_sizes[] = {16, 8};
+
+// Floats in game data sit well inside this exponent window; integer columns
+// below 2^23 decode as denormals and never match.
+#define FLOAT_MIN_EXPONENT (127 - 30)
+#define FLOAT_MAX_EXPONENT (127 + 30)
+#define SMALL_NEGATIVE_MIN (-(1 << 24))
+
+typedef struct {
+    uint32_t nonzero;
+    uint32_t first_nonzero;
+    uint32_t max_value;
+    int distinct;
+    int all_strings;
+    int all_floats;
+    int all_small_negatives;
+    int any_negative;
+    FieldType type;
+    int32_t group;
+    int32_t slot;
+} ColumnStats;
+
+static VALUE rb_mSchema;
+
+// Returns 0 when out of memory.
+static int classify_columns(const DBCRaw *raw, ColumnStats *stats) {
+    uint32_t columns = raw->columns;
+    uint32_t string_block_size = raw->header.string_block_size;
+
+    // A string offset must point at the start of a string: offset 0 or the
+    // byte right after a terminator.
+    uint8_t *starts = calloc(string_block_size + 1, 1);
+    if (!starts) return 0;
+    if (string_block_size > 0) {
+        starts[0] = 1;
+        for (uint32_t i = 1; i < string_block_size; i++) {
+            starts[i] = raw->string_block[i - 1] == '\0';
+        }
+    }
+
+    for (uint32_t j = 0; j < columns; j++) {
+        stats[j].all_strings = 1;
+        stats[j].all_floats = 1;
+        stats[j].all_small_negatives = 1;
+        stats[j].group = -1;
+        stats[j].slot = -1;
+    }
+
+    const uint32_t *row = raw->records;
+    for (uint32_t i = 0; i < raw->header.record_count; i++, row += columns) {
+        for (uint32_t j = 0; j < columns; j++) {
+            uint32_t v = row[j];
+            ColumnStats *s = &stats[j];
+            if (v == 0) continue;
+
+            if (s->nonzero++ == 0) {
+                s->first_nonzero = v;
+            } else if (v != s->first_nonzero) {
+                s->distinct = 1;
+            }
+            if (v > s->max_value) s->max_value = v;
+
+            if (v >= string_block_size || !starts[v]) s->all_strings = 0;
+
+            uint32_t exponent = (v >> 23) & 0xFF;
+            if (exponent < FLOAT_MIN_EXPONENT || exponent > FLOAT_MAX_EXPONENT) s->all_floats = 0;
+
+            if ((int32_t)v < 0) {
+                s->any_negative = 1;
+                if ((int32_t)v < SMALL_NEGATIVE_MIN) s->all_small_negatives = 0;
+            }
+        }
+    }
+
+    free(starts);
+
+    for (uint32_t j = 0; j < columns; j++) {
+        ColumnStats *s = &stats[j];
+        if (s->nonzero == 0) {
+            s->type = TYPE_UINT32;
+        } else if (s->all_strings && string_block_size > 1 && (s->distinct || s->max_value > 1)) {
+            // 0/1 columns would otherwise pass as offsets into "\0x\0..."
+            s->type = TYPE_STRING;
+        } else if (s->all_floats) {
+            s->type = TYPE_FLOAT;
+        } else if (s->any_negative && s->all_small_negatives) {
+            s->type = TYPE_INT32;
+        } else {
+            s->type = TYPE_UINT32;
+        }
+    }
+    return 1;
+}
+
+static int locstring_group_at(const ColumnStats *stats, uint32_t columns, uint32_t start, uint32_t size) {
+    if (stats[start].type != TYPE_STRING || start + size >= columns) return 0;
+
+    // Clients only fill their own locale, so most slots of a real locstring
+    // are empty; runs of populated string columns are ordinary fields.
+    uint32_t empty_slots = 0;
+    for (uint32_t k = 1; k < size; k++) {
+        const ColumnStats *s = &stats[start + k];
+        if (s->nonzero == 0) {
+            empty_slots++;
+        } else if (s->type != TYPE_STRING) {
+            return 0;
+        }
+    }
+    return empty_slots * 2 >= size && stats[start + size].type != TYPE_STRING;
+}
+
+static void detect_locstrings(ColumnStats *stats, uint32_t columns) {
+    for (uint32_t j = 0; j < columns; j++) {
+        for (size_t n = 0; n < sizeof(locstring_sizes) / sizeof(locstring_sizes[0]); n++) {
+            uint32_t size = locstring_sizes[n];
+            if (!locstring_group_at(stats, columns, j, size)) continue;
+
+            for (uint32_t k = 0; k < size; k++) {
+                stats[j + k].type = TYPE_STRING;
+                stats[j + k].group = (int32_t)j;
+                stats[j + k].slot = (int32_t)k;
+            }
+            stats[j + size].type = TYPE_UINT32;
+            stats[j + size].group = (int32_t)j;
+            stats[j + size].slot = (int32_t)size;
+            j += size;
+            break;
+        }
+    }
+}
+
+// WowDBC::Schema.analyze(path) -> [{ type:, group:, slot: }, ...]
+//
+// One entry per 32-bit column. `group` is the first column of the locstring
+// the column belongs to and `slot` its position in it (the flags word comes
+// last), both nil for plain columns.
+static VALUE schema_analyze(VALUE self, VALUE filepath) {
+    DBCRaw raw;
+    dbc_raw_load(StringValueCStr(filepath), &raw);
+
+    uint32_t columns = raw.columns;
+    ColumnStats *stats = calloc(columns ? columns : 1, sizeof(ColumnStats));
+    if (!stats) {
+        dbc_raw_release(&raw);
+        rb_raise(rb_eNoMemError, "Could not allocate column statistics");
+    }
+
+    if (!classify_columns(&raw, stats)) {
+        free(stats);
+        dbc_raw_release(&raw);
+        rb_raise(rb_eNoMemError, "Could not allocate the string start map");
+    }
+    detect_locstrings(stats, columns);
+    dbc_raw_release(&raw);
+
+    VALUE result = rb_ary_new_capa(columns);
+    VALUE sym_type = ID2SYM(rb_intern("type"));
+    VALUE sym_group = ID2SYM(rb_intern("group"));
+    VALUE sym_slot = ID2SYM(rb_intern("slot"));
+    for (uint32_t j = 0; j < columns; j++) {
+        VALUE column = rb_hash_new();
+        rb_hash_aset(column, sym_type, field_type_to_symbol(stats[j].type));
+        rb_hash_aset(column, sym_group, stats[j].group < 0 ? Qnil : INT2FIX(stats[j].group));
+        rb_hash_aset(column, sym_slot, stats[j].slot < 0 ? Qnil : INT2FIX(stats[j].slot));
+        rb_ary_push(result, column);
+    }
+    free(stats);
+
+    return result;
+}
+
+void Init_wow_dbc_schema(void) {
+    rb_mSchema = rb_define_module_under(rb_mWowDBC, "Schema");
+    rb_define_module_function(rb_mSchema, "analyze", schema_analyze, 1);
+}
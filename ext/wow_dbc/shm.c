@@ -0,0 +1,453 @@
+#include "wow_dbc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Tables published to POSIX shared memory, so processes on one host can
+// read a single decoded copy instead of each holding its own:
+//
+//   header    "WDBCSHM", version, DBC header and section offsets
+//   records   record_count rows of field_count FieldValues, used in place
+//   strings   the string block, used in place
+//   indexes   the words of every index, each 8-byte aligned
+//   metadata  MessagePack map with the column types and index directory
+//
+// A segment is written under a temporary name and renamed into place when
+// complete, so one found by name is always whole. Attached tables share
+// it as the base of a copy-on-write table: edits stay private to the
+// process, and the segment itself is never written after publishing.
+
+#define SHM_MAGIC "WDBCSHM"
+#define SHM_VERSION 1
+#define SHM_DIR "/dev/shm"
+#define SHM_NAME_MAX 200
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t value_size;  // sizeof(FieldValue) of the publishing build
+    DBCHeader header;
+    int32_t modified;     // the records differ from the file at @filepath
+    DBCStamp stamp;       // @filepath when the table was read
+    uint64_t records_offset;
+    uint64_t strings_offset;
+    uint64_t metadata_offset;
+    uint64_t metadata_size;
+} ShmHeader;
+
+typedef struct {
+    DBCFile *dbc;
+    const char *name;
+    DBCMapping *mapping;
+    ShmHeader header;
+    FieldType *types;
+    DBCIndex *indexes;
+    uint64_t *index_offsets;
+    uint32_t index_count;
+} ShmAttach;
+
+// "/name" as shm_open wants it, checked for characters it can't hold
+static VALUE shm_object_name(VALUE name) {
+    StringValue(name);
+    const char *s = StringValueCStr(name);
+    if (RSTRING_LEN(name) == 0 || RSTRING_LEN(name) > SHM_NAME_MAX || strchr(s, '/')) {
+        rb_raise(rb_eArgError, "Invalid shared table name: %"PRIsVALUE, name);
+    }
+    return rb_sprintf("/%s", s);
+}
+
+// Default name: the file's content and the column types, so tables of
+// different files or schemas never meet
+static VALUE shm_default_name(VALUE path, VALUE field_definitions) {
+    DBCMapping *mapping = dbc_mapping_open(StringValueCStr(path));
+    uint64_t file_hash = dbc_hash64(mapping->addr, mapping->size, 0);
+    dbc_mapping_release(mapping);
+
+    VALUE types = rb_funcall(field_definitions, rb_intern("values"), 0);
+    long count = RARRAY_LEN(types);
+    VALUE bytes_buf;
+    uint8_t *bytes = ALLOCV_N(uint8_t, bytes_buf, count ? count : 1);
+    for (long j = 0; j < count; j++) bytes[j] = (uint8_t)ruby_to_field_type(rb_ary_entry(types, j));
+    uint64_t schema_hash = dbc_hash64(bytes, (size_t)count, 0);
+    ALLOCV_END(bytes_buf);
+
+    return rb_sprintf("wow_dbc-%016llx-%016llx", (unsigned long long)file_hash, (unsigned long long)schema_hash);
+}
+
+// Maps the segment read-only, or returns NULL when there is none
+static DBCMapping *shm_map(const char *object_name) {
+    int fd = shm_open(object_name, O_RDONLY, 0);
+    if (fd < 0) {
+        if (errno == ENOENT) return NULL;
+        rb_raise(rb_eIOError, "Could not open shared table: %s", object_name);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmHeader)) {
+        close(fd);
+        rb_raise(rb_eIOError, "Malformed shared table: %s", object_name);
+    }
+    // Anyone can create a segment under a guessed name; only trust our own
+    if (st.st_uid != geteuid()) {
+        close(fd);
+        rb_raise(rb_eIOError, "Shared table is owned by another user: %s", object_name);
+    }
+    void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        rb_raise(rb_eIOError, "Could not map shared table: %s", object_name);
+    }
+
+    DBCMapping *mapping = malloc(sizeof(DBCMapping));
+    if (!mapping) {
+        munmap(addr, (size_t)st.st_size);
+        rb_raise(rb_eNoMemError, "Could not allocate shared table mapping");
+    }
+    mapping->addr = addr;
+    mapping->size = (size_t)st.st_size;
+    mapping->refs = 1;
+    return mapping;
+}
+
+/* Publish */
+
+typedef struct {
+    DBCFile *dbc;
+    const char *object_name;
+    char temp_name[SHM_NAME_MAX + 64];
+    int fd;
+    uint8_t *addr;
+    size_t size;
+    DBCBuffer metadata;
+    uint64_t *index_offsets;
+    int renamed;
+} ShmPublish;
+
+static uint64_t shm_align(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+static VALUE shm_publish_body(VALUE arg) {
+    ShmPublish *publish = (ShmPublish *)arg;
+    DBCFile *dbc = publish->dbc;
+    uint32_t record_count = dbc->header.record_count;
+    uint32_t field_count = dbc->header.field_count;
+    size_t row_size = (size_t)field_count * sizeof(FieldValue);
+
+    VALUE types_buf;
+    FieldType *types = ALLOCV_N(FieldType, types_buf, field_count ? field_count : 1);
+    dbc_column_types(dbc, types);
+    dbc_indexes_refresh(dbc);
+
+    ShmHeader header;
+    memset(&header, 0, sizeof(ShmHeader));
+    memcpy(header.magic, SHM_MAGIC, sizeof(SHM_MAGIC));
+    header.version = SHM_VERSION;
+    header.value_size = sizeof(FieldValue);
+    header.header = dbc->header;
+    header.modified = dbc->modified;
+    header.stamp = dbc->stamp;
+    header.records_offset = shm_align(sizeof(ShmHeader));
+    header.strings_offset = header.records_offset + (uint64_t)record_count * row_size;
+
+    uint64_t offset = shm_align(header.strings_offset + dbc->header.string_block_size);
+    dbc_mp_write_map(&publish->metadata, 2);
+    dbc_mp_write_str(&publish->metadata, "types", 5);
+    dbc_mp_write_array(&publish->metadata, field_count);
+    for (uint32_t j = 0; j < field_count; j++) dbc_mp_write_uint(&publish->metadata, types[j]);
+    ALLOCV_END(types_buf);
+    dbc_mp_write_str(&publish->metadata, "indexes", 7);
+    dbc_mp_write_array(&publish->metadata, dbc->index_count);
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        publish->index_offsets[k] = offset;
+        dbc_index_write_meta(&publish->metadata, &dbc->indexes[k], offset);
+        offset = shm_align(offset + dbc_index_word_count(&dbc->indexes[k]) * sizeof(uint32_t));
+    }
+    header.metadata_offset = offset;
+    header.metadata_size = publish->metadata.size;
+    publish->size = (size_t)(offset + publish->metadata.size);
+
+    static uint32_t attempts;
+    snprintf(publish->temp_name, sizeof(publish->temp_name), "%s.%ld.%u.tmp", publish->object_name, (long)getpid(),
+             __atomic_add_fetch(&attempts, 1, __ATOMIC_RELAXED));
+    publish->fd = shm_open(publish->temp_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (publish->fd < 0) {
+        rb_raise(rb_eIOError, "Could not create shared table: %s", publish->object_name);
+    }
+    if (ftruncate(publish->fd, (off_t)publish->size) != 0) {
+        rb_raise(rb_eIOError, "Could not size shared table: %s", publish->object_name);
+    }
+    void *addr = mmap(NULL, publish->size, PROT_READ | PROT_WRITE, MAP_SHARED, publish->fd, 0);
+    if (addr == MAP_FAILED) {
+        rb_raise(rb_eIOError, "Could not map shared table: %s", publish->object_name);
+    }
+    publish->addr = addr;
+
+    memcpy(publish->addr, &header, sizeof(ShmHeader));
+    FieldValue *rows = (FieldValue *)(publish->addr + header.records_offset);
+    for (uint32_t i = 0; i < record_count; i++) {
+        memcpy(rows + (size_t)i * field_count, dbc->records[i], row_size);
+    }
+    memcpy(publish->addr + header.strings_offset, dbc->string_block, dbc->header.string_block_size);
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        memcpy(publish->addr + publish->index_offsets[k], dbc->indexes[k].words,
+               dbc_index_word_count(&dbc->indexes[k]) * sizeof(uint32_t));
+    }
+    memcpy(publish->addr + header.metadata_offset, publish->metadata.data, publish->metadata.size);
+
+    // shm_open names live in SHM_DIR on Linux; renaming there publishes the
+    // whole segment at once
+    char from[sizeof(publish->temp_name) + sizeof(SHM_DIR)];
+    char to[SHM_NAME_MAX + sizeof(SHM_DIR) + 2];
+    snprintf(from, sizeof(from), SHM_DIR "%s", publish->temp_name);
+    snprintf(to, sizeof(to), SHM_DIR "%s", publish->object_name);
+    if (rename(from, to) != 0) {
+        rb_raise(rb_eIOError, "Could not publish shared table: %s", publish->object_name);
+    }
+    publish->renamed = 1;
+    return Qnil;
+}
+
+static VALUE shm_publish_cleanup(VALUE arg) {
+    ShmPublish *publish = (ShmPublish *)arg;
+    if (publish->addr) munmap(publish->addr, publish->size);
+    if (publish->fd >= 0) {
+        close(publish->fd);
+        if (!publish->renamed) shm_unlink(publish->temp_name);
+    }
+    dbc_buf_free(&publish->metadata);
+    free(publish->index_offsets);
+    return Qnil;
+}
+
+static void shm_publish(DBCFile *dbc, const char *object_name) {
+    ShmPublish publish;
+    memset(&publish, 0, sizeof(ShmPublish));
+    publish.dbc = dbc;
+    publish.object_name = object_name;
+    publish.fd = -1;
+    dbc_buf_init(&publish.metadata, 256);
+    publish.index_offsets = calloc(dbc->index_count ? dbc->index_count : 1, sizeof(uint64_t));
+    if (!publish.index_offsets) {
+        dbc_buf_free(&publish.metadata);
+        rb_raise(rb_eNoMemError, "Could not allocate shared table layout");
+    }
+    rb_ensure(shm_publish_body, (VALUE)&publish, shm_publish_cleanup, (VALUE)&publish);
+}
+
+/* Attach */
+
+static void shm_malformed(ShmAttach *attach) {
+    rb_raise(rb_eIOError, "Malformed shared table: %s", attach->name);
+}
+
+static void shm_check_range(ShmAttach *attach, uint64_t offset, uint64_t size, uint64_t align) {
+    if (offset % align != 0 || offset > attach->mapping->size || size > attach->mapping->size - offset) {
+        shm_malformed(attach);
+    }
+}
+
+static void shm_read_metadata(ShmAttach *attach) {
+    const uint8_t *base = attach->mapping->addr;
+    ShmHeader *header = &attach->header;
+    memcpy(header, base, sizeof(ShmHeader));
+    if (memcmp(header->magic, SHM_MAGIC, sizeof(SHM_MAGIC)) != 0 || header->version != SHM_VERSION ||
+        header->value_size != sizeof(FieldValue)) {
+        rb_raise(rb_eIOError, "Not a shared table for this version of wow_dbc: %s", attach->name);
+    }
+
+    uint32_t record_count = header->header.record_count;
+    uint32_t field_count = header->header.field_count;
+    shm_check_range(attach, header->records_offset,
+                    (uint64_t)record_count * field_count * sizeof(FieldValue), sizeof(uint32_t));
+    shm_check_range(attach, header->strings_offset, header->header.string_block_size, 1);
+    shm_check_range(attach, header->metadata_offset, header->metadata_size, 1);
+    if (header->header.string_block_size && base[header->strings_offset + header->header.string_block_size - 1] != '\0') {
+        shm_malformed(attach);
+    }
+
+    DBCMsgReader reader = {base + header->metadata_offset, base + header->metadata_offset + header->metadata_size};
+    uint32_t count = dbc_mp_read_map(&reader);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t len;
+        const char *key = dbc_mp_read_str(&reader, &len);
+        if (dbc_mp_key_is(key, len, "types")) {
+            if (attach->types || dbc_mp_read_array(&reader) != field_count) shm_malformed(attach);
+            attach->types = ALLOC_N(FieldType, field_count ? field_count : 1);
+            for (uint32_t j = 0; j < field_count; j++) {
+                uint64_t type = dbc_mp_read_uint(&reader);
+                if (type > TYPE_STRING) shm_malformed(attach);
+                attach->types[j] = (FieldType)type;
+            }
+        } else if (dbc_mp_key_is(key, len, "indexes")) {
+            uint32_t index_count = dbc_mp_read_array(&reader);
+            if (attach->indexes) shm_malformed(attach);
+            attach->indexes = ALLOC_N(DBCIndex, index_count ? index_count : 1);
+            attach->index_offsets = ALLOC_N(uint64_t, index_count ? index_count : 1);
+            for (uint32_t k = 0; k < index_count; k++) {
+                if (!dbc_index_read_meta(&reader, &attach->indexes[k], &attach->index_offsets[k])) {
+                    shm_malformed(attach);
+                }
+                attach->index_count++;
+            }
+        } else {
+            dbc_mp_skip(&reader);
+        }
+    }
+    if (!attach->types || !attach->indexes) shm_malformed(attach);
+}
+
+static VALUE shm_attach_body(VALUE arg) {
+    ShmAttach *attach = (ShmAttach *)arg;
+    DBCFile *dbc = attach->dbc;
+    shm_read_metadata(attach);
+
+    DBCHeader *header = &attach->header.header;
+    uint32_t field_count = header->field_count;
+    VALUE types_buf;
+    FieldType *types = ALLOCV_N(FieldType, types_buf, field_count ? field_count : 1);
+    DBCHeader saved = dbc->header;
+    dbc->header.field_count = field_count;
+    dbc_column_types(dbc, types);
+    dbc->header = saved;
+    for (uint32_t j = 0; j < field_count; j++) {
+        if (types[j] != attach->types[j]) {
+            rb_raise(rb_eArgError, "Shared table %s was published with different field types", attach->name);
+        }
+    }
+    // Rows are used in place, so their type tags must agree with the schema
+    const FieldValue *values = (const FieldValue *)((uint8_t *)attach->mapping->addr + attach->header.records_offset);
+    for (uint64_t v = 0; v < (uint64_t)header->record_count * field_count; v++) {
+        if (values[v].type != types[v % field_count]) shm_malformed(attach);
+    }
+    for (uint32_t k = 0; k < attach->index_count; k++) {
+        if (!dbc_index_attach(&attach->indexes[k], attach->mapping, attach->index_offsets[k], types,
+                              field_count, header->record_count)) {
+            shm_malformed(attach);
+        }
+    }
+    ALLOCV_END(types_buf);
+
+    DBCCowBase *base = calloc(1, sizeof(DBCCowBase));
+    FieldValue **records = malloc((header->record_count ? header->record_count : 1) * sizeof(FieldValue *));
+    if (!base || !records) {
+        free(base);
+        free(records);
+        rb_raise(rb_eNoMemError, "Could not allocate shared table");
+    }
+    uint8_t *addr = attach->mapping->addr;
+    FieldValue *rows = (FieldValue *)(addr + attach->header.records_offset);
+    for (uint32_t i = 0; i < header->record_count; i++) records[i] = rows + (size_t)i * field_count;
+
+    // Nothing below can raise. The base takes the reference on the mapping.
+    base->refs = 1;
+    base->records = records;
+    base->record_count = header->record_count;
+    base->string_block = (char *)addr + attach->header.strings_offset;
+    base->mapping = attach->mapping;
+
+    dbc_release_records(dbc);
+    dbc->header = *header;
+    dbc->cow_base = base;
+    dbc->records = records;
+    dbc->string_block = base->string_block;
+    dbc->records_shared = 1;
+    dbc->strings_shared = 1;
+    dbc->modified = attach->header.modified;
+    dbc->stamp = attach->header.stamp;
+
+    dbc_indexes_clear(dbc);
+    for (uint32_t k = 0; k < attach->index_count; k++) {
+        attach->indexes[k].mapping = attach->mapping;
+        __atomic_add_fetch(&attach->mapping->refs, 1, __ATOMIC_ACQ_REL);
+    }
+    dbc->indexes = attach->indexes;
+    dbc->index_count = attach->index_count;
+    dbc->indexes_stale = 0;
+    attach->indexes = NULL;
+    attach->mapping = NULL;
+    return Qnil;
+}
+
+static VALUE shm_attach_cleanup(VALUE arg) {
+    ShmAttach *attach = (ShmAttach *)arg;
+    xfree(attach->types);
+    xfree(attach->indexes);
+    xfree(attach->index_offsets);
+    if (attach->mapping) dbc_mapping_release(attach->mapping);
+    return Qnil;
+}
+
+// Attaches the table to the named segment, or returns 0 when there is none
+static int shm_attach(DBCFile *dbc, const char *object_name) {
+    ShmAttach attach;
+    memset(&attach, 0, sizeof(ShmAttach));
+    attach.dbc = dbc;
+    attach.name = object_name;
+    attach.mapping = shm_map(object_name);
+    if (!attach.mapping) return 0;
+    rb_ensure(shm_attach_body, (VALUE)&attach, shm_attach_cleanup, (VALUE)&attach);
+    return 1;
+}
+
+// DBCFile.open_shared(path, field_definitions, name: nil) { |dbc| ... } -> DBCFile
+//
+// Attaches to the table published under `name`, or reads the file and
+// publishes it when no process has yet. The block runs only in the
+// publishing process, before publishing, to build the indexes every
+// process should share. `name` defaults to one derived from the file's
+// content and the field types; give one explicitly when processes build
+// different indexes. Edits to the returned table stay in this process.
+static VALUE dbc_open_shared(int argc, VALUE *argv, VALUE klass) {
+    VALUE path, field_definitions, options;
+    rb_scan_args(argc, argv, "2:", &path, &field_definitions, &options);
+    Check_Type(field_definitions, T_HASH);
+
+    VALUE name = Qnil;
+    if (!NIL_P(options)) {
+        ID keywords[1] = {rb_intern("name")};
+        VALUE values[1];
+        rb_get_kwargs(options, keywords, 0, 1, values);
+        if (values[0] != Qundef) name = values[0];
+    }
+    if (NIL_P(name)) name = shm_default_name(path, field_definitions);
+    VALUE object_name = shm_object_name(name);
+
+    VALUE init_argv[2] = {path, field_definitions};
+    VALUE self = rb_class_new_instance(2, init_argv, klass);
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    rb_iv_set(self, "@shared_name", rb_str_new_frozen(name));
+
+    if (shm_attach(dbc, RSTRING_PTR(object_name))) return self;
+
+    rb_funcall(self, rb_intern("read"), 0);
+    if (rb_block_given_p()) rb_yield(self);
+    shm_publish(dbc, RSTRING_PTR(object_name));
+    if (!shm_attach(dbc, RSTRING_PTR(object_name))) {
+        rb_raise(rb_eIOError, "Shared table disappeared while publishing: %"PRIsVALUE, name);
+    }
+    RB_GC_GUARD(object_name);
+    return self;
+}
+
+// DBCFile.drop_shared(name) -> true or false
+//
+// Removes the named segment. Processes attached to it keep their mapping;
+// later open_shared calls publish afresh. False if there was none.
+static VALUE dbc_drop_shared(VALUE klass, VALUE name) {
+    VALUE object_name = shm_object_name(name);
+    if (shm_unlink(RSTRING_PTR(object_name)) == 0) return Qtrue;
+    if (errno == ENOENT) return Qfalse;
+    rb_raise(rb_eIOError, "Could not remove shared table: %"PRIsVALUE, name);
+}
+
+void Init_wow_dbc_shm(void) {
+    rb_define_singleton_method(rb_cDBCFile, "open_shared", dbc_open_shared, -1);
+    rb_define_singleton_method(rb_cDBCFile, "drop_shared", dbc_drop_shared, 1);
+    rb_define_attr(rb_cDBCFile, "shared_name", 1, 0);
+}
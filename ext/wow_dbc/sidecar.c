@@ -0,0 +1,439 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Index sidecar files (Item.dbc.idx) keep the indexes of a table next to
+// its DBC, so processes can map them instead of rebuilding at startup:
+//
+//   header    "WDBCINDX", version, metadata offset and size
+//   indexes   the words of every index, each 8-byte aligned
+//   metadata  MessagePack map with the DBC's size, mtime and content hash,
+//             the column types and the index directory
+//
+// A sidecar is only mapped while the DBC matches its key and the table in
+// memory is exactly that file. Otherwise the indexes it lists are rebuilt
+// and the sidecar is rewritten.
+
+#define SIDECAR_MAGIC "WDBCINDX"
+#define SIDECAR_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t metadata_offset;
+    uint64_t metadata_size;
+} SidecarHeader;
+
+typedef struct {
+    DBCStamp stamp;
+    uint64_t hash;
+} SidecarKey;
+
+int dbc_stamp_path(const char *path, DBCStamp *stamp) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        memset(stamp, 0, sizeof(DBCStamp));
+        return 0;
+    }
+    stamp->size = (uint64_t)st.st_size;
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+    stamp->mtime = (uint64_t)st.st_mtim.tv_sec * 1000000000 + (uint64_t)st.st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    stamp->mtime = (uint64_t)st.st_mtimespec.tv_sec * 1000000000 + (uint64_t)st.st_mtimespec.tv_nsec;
+#else
+    stamp->mtime = (uint64_t)st.st_mtime * 1000000000;
+#endif
+    return 1;
+}
+
+static uint64_t sidecar_file_hash(const char *path) {
+    DBCMapping *mapping = dbc_mapping_open(path);
+    uint64_t hash = dbc_hash64(mapping->addr, mapping->size, 0);
+    dbc_mapping_release(mapping);
+    return hash;
+}
+
+// Whether the records in memory are exactly the DBC at `dbc_path`: no
+// unsaved changes, and the file is untouched since it was read or written
+static int sidecar_table_current(DBCFile *dbc, const char *dbc_path, DBCStamp *now) {
+    if (dbc->modified || !dbc_stamp_path(dbc_path, now)) return 0;
+    return now->size == dbc->stamp.size && now->mtime == dbc->stamp.mtime;
+}
+
+static VALUE sidecar_default_path(VALUE self, int argc, VALUE *argv) {
+    VALUE path;
+    rb_scan_args(argc, argv, "01", &path);
+    if (NIL_P(path)) {
+        VALUE filepath = rb_iv_get(self, "@filepath");
+        path = rb_str_plus(rb_obj_as_string(filepath), rb_str_new_cstr(".idx"));
+    }
+    StringValueCStr(path);
+    return path;
+}
+
+/* Write */
+
+typedef struct {
+    DBCFile *dbc;
+    const char *path;
+    const SidecarKey *key;
+    VALUE tmp_path;
+    FILE *file;
+    int renamed;
+    DBCBuffer metadata;
+} SidecarWrite;
+
+static void sidecar_write(SidecarWrite *write, const void *data, size_t len) {
+    if (len && fwrite(data, 1, len, write->file) != len) {
+        rb_raise(rb_eIOError, "Failed to write index sidecar: %s", write->path);
+    }
+    DBC_COUNT(DBC_BYTES_WRITTEN, len);
+}
+
+static uint64_t sidecar_align(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+static VALUE sidecar_write_body(VALUE arg) {
+    SidecarWrite *write = (SidecarWrite *)arg;
+    DBCFile *dbc = write->dbc;
+    DBCBuffer *meta = &write->metadata;
+    static const char zeros[8] = {0};
+
+    VALUE types_buf;
+    FieldType *types = ALLOCV_N(FieldType, types_buf, dbc->header.field_count ? dbc->header.field_count : 1);
+    dbc_column_types(dbc, types);
+
+    dbc_mp_write_map(meta, 5);
+    dbc_mp_write_str(meta, "size", 4);
+    dbc_mp_write_uint(meta, write->key->stamp.size);
+    dbc_mp_write_str(meta, "mtime", 5);
+    dbc_mp_write_uint(meta, write->key->stamp.mtime);
+    dbc_mp_write_str(meta, "hash", 4);
+    dbc_mp_write_uint(meta, write->key->hash);
+    dbc_mp_write_str(meta, "types", 5);
+    dbc_mp_write_array(meta, dbc->header.field_count);
+    for (uint32_t j = 0; j < dbc->header.field_count; j++) {
+        dbc_mp_write_uint(meta, types[j]);
+    }
+    ALLOCV_END(types_buf);
+
+    // Index words are laid out back to back after the header, so the
+    // directory can be written before them
+    uint64_t offset = sizeof(SidecarHeader);
+    dbc_mp_write_str(meta, "indexes", 7);
+    dbc_mp_write_array(meta, dbc->index_count);
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        dbc_index_write_meta(meta, &dbc->indexes[k], offset);
+        offset = sidecar_align(offset + dbc_index_word_count(&dbc->indexes[k]) * sizeof(uint32_t));
+    }
+
+    SidecarHeader header;
+    memset(&header, 0, sizeof(SidecarHeader));
+    memcpy(header.magic, SIDECAR_MAGIC, 8);
+    header.version = SIDECAR_VERSION;
+    header.metadata_offset = offset;
+    header.metadata_size = meta->size;
+
+    // Written under a temporary name and renamed into place, so processes
+    // starting at the same time never map a partial file
+    write->tmp_path = rb_sprintf("%s.%ld.tmp", write->path, (long)getpid());
+    write->file = fopen(RSTRING_PTR(write->tmp_path), "wb");
+    if (!write->file) {
+        rb_raise(rb_eIOError, "Could not open file for writing: %s", RSTRING_PTR(write->tmp_path));
+    }
+
+    sidecar_write(write, &header, sizeof(SidecarHeader));
+    offset = sizeof(SidecarHeader);
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        size_t size = dbc_index_word_count(&dbc->indexes[k]) * sizeof(uint32_t);
+        sidecar_write(write, dbc->indexes[k].words, size);
+        sidecar_write(write, zeros, (size_t)(sidecar_align(offset + size) - offset - size));
+        offset = sidecar_align(offset + size);
+    }
+    sidecar_write(write, meta->data, meta->size);
+
+    FILE *file = write->file;
+    write->file = NULL;
+    if (fclose(file) != 0) {
+        rb_raise(rb_eIOError, "Failed to write index sidecar: %s", write->path);
+    }
+    if (rename(RSTRING_PTR(write->tmp_path), write->path) != 0) {
+        rb_raise(rb_eIOError, "Could not replace index sidecar: %s", write->path);
+    }
+    write->renamed = 1;
+
+    return Qnil;
+}
+
+static VALUE sidecar_write_cleanup(VALUE arg) {
+    SidecarWrite *write = (SidecarWrite *)arg;
+    if (write->file) fclose(write->file);
+    if (!NIL_P(write->tmp_path) && !write->renamed) unlink(RSTRING_PTR(write->tmp_path));
+    dbc_buf_free(&write->metadata);
+    return Qnil;
+}
+
+static void sidecar_save(DBCFile *dbc, const char *path, const SidecarKey *key) {
+    dbc_indexes_refresh(dbc);
+
+    SidecarWrite write;
+    memset(&write, 0, sizeof(SidecarWrite));
+    write.dbc = dbc;
+    write.path = path;
+    write.key = key;
+    write.tmp_path = Qnil;
+    dbc_buf_init(&write.metadata, 256);
+
+    rb_ensure(sidecar_write_body, (VALUE)&write, sidecar_write_cleanup, (VALUE)&write);
+    RB_GC_GUARD(write.tmp_path);
+}
+
+/* Load */
+
+typedef struct {
+    DBCFile *dbc;
+    const char *path;
+    const char *dbc_path;
+    DBCMapping *mapping;
+    SidecarKey key;
+    int seen_key;
+    FieldType *types;
+    uint32_t type_count;
+    DBCIndex *indexes;
+    uint64_t *index_offsets;
+    uint32_t index_count;
+} SidecarLoad;
+
+static void sidecar_malformed(SidecarLoad *load) {
+    rb_raise(rb_eIOError, "Malformed index sidecar: %s", load->path);
+}
+
+static void sidecar_read_types(SidecarLoad *load, DBCMsgReader *reader) {
+    uint32_t count = dbc_mp_read_array(reader);
+    if (load->types) sidecar_malformed(load);
+    load->types = ALLOC_N(FieldType, count ? count : 1);
+    for (uint32_t j = 0; j < count; j++) {
+        uint64_t type = dbc_mp_read_uint(reader);
+        if (type > TYPE_STRING) sidecar_malformed(load);
+        load->types[j] = (FieldType)type;
+    }
+    load->type_count = count;
+}
+
+static void sidecar_read_indexes(SidecarLoad *load, DBCMsgReader *reader) {
+    uint32_t count = dbc_mp_read_array(reader);
+    if (load->indexes) sidecar_malformed(load);
+    load->indexes = ALLOC_N(DBCIndex, count ? count : 1);
+    load->index_offsets = ALLOC_N(uint64_t, count ? count : 1);
+    for (uint32_t k = 0; k < count; k++) {
+        if (!dbc_index_read_meta(reader, &load->indexes[k], &load->index_offsets[k])) sidecar_malformed(load);
+        load->index_count++;
+    }
+}
+
+// Maps the sidecar and reads its key and directory. Index words are only
+// checked once the sidecar is known to match the table.
+static VALUE sidecar_parse_body(VALUE arg) {
+    SidecarLoad *load = (SidecarLoad *)arg;
+
+    load->mapping = dbc_mapping_open(load->path);
+    const uint8_t *base = load->mapping->addr;
+    SidecarHeader header;
+
+    if (load->mapping->size < sizeof(SidecarHeader)) sidecar_malformed(load);
+    memcpy(&header, base, sizeof(SidecarHeader));
+    if (memcmp(header.magic, SIDECAR_MAGIC, 8) != 0 || header.version != SIDECAR_VERSION) {
+        sidecar_malformed(load);
+    }
+    if (header.metadata_offset > load->mapping->size ||
+        header.metadata_size > load->mapping->size - header.metadata_offset) {
+        sidecar_malformed(load);
+    }
+
+    DBCMsgReader reader = {base + header.metadata_offset, base + header.metadata_offset + header.metadata_size};
+    int seen = 0;
+    uint32_t count = dbc_mp_read_map(&reader);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t len;
+        const char *key = dbc_mp_read_str(&reader, &len);
+        if (dbc_mp_key_is(key, len, "size")) {
+            load->key.stamp.size = dbc_mp_read_uint(&reader);
+            seen |= 1;
+        } else if (dbc_mp_key_is(key, len, "mtime")) {
+            load->key.stamp.mtime = dbc_mp_read_uint(&reader);
+            seen |= 2;
+        } else if (dbc_mp_key_is(key, len, "hash")) {
+            load->key.hash = dbc_mp_read_uint(&reader);
+            seen |= 4;
+        } else if (dbc_mp_key_is(key, len, "types")) {
+            sidecar_read_types(load, &reader);
+        } else if (dbc_mp_key_is(key, len, "indexes")) {
+            sidecar_read_indexes(load, &reader);
+        } else {
+            dbc_mp_skip(&reader);
+        }
+    }
+    if (seen != 7 || !load->types || !load->indexes) sidecar_malformed(load);
+
+    return Qnil;
+}
+
+static VALUE sidecar_load_cleanup(VALUE arg) {
+    SidecarLoad *load = (SidecarLoad *)arg;
+    xfree(load->indexes);
+    xfree(load->index_offsets);
+    xfree(load->types);
+    load->indexes = NULL;
+    load->index_offsets = NULL;
+    load->types = NULL;
+    if (load->mapping) dbc_mapping_release(load->mapping);
+    load->mapping = NULL;
+    return Qnil;
+}
+
+// Whether the mapped indexes can be used as they are for the table
+static int sidecar_attach(SidecarLoad *load, const FieldType *types, const DBCStamp *now) {
+    DBCFile *dbc = load->dbc;
+    uint32_t field_count = dbc->header.field_count;
+
+    if (load->type_count != field_count) return 0;
+    for (uint32_t j = 0; j < field_count; j++) {
+        if (load->types[j] != types[j]) return 0;
+    }
+    if (now->size != load->key.stamp.size) return 0;
+    // A copy or checkout changes the mtime but not the content
+    if (now->mtime != load->key.stamp.mtime && sidecar_file_hash(load->dbc_path) != load->key.hash) return 0;
+
+    for (uint32_t k = 0; k < load->index_count; k++) {
+        if (!dbc_index_attach(&load->indexes[k], load->mapping, load->index_offsets[k], types,
+                              field_count, dbc->header.record_count)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static VALUE sidecar_apply_body(VALUE arg) {
+    SidecarLoad *load = (SidecarLoad *)arg;
+    DBCFile *dbc = load->dbc;
+    uint32_t field_count = dbc->header.field_count;
+
+    VALUE types_buf;
+    FieldType *types = ALLOCV_N(FieldType, types_buf, field_count ? field_count : 1);
+    dbc_column_types(dbc, types);
+    DBCStamp now;
+    int current = sidecar_table_current(dbc, load->dbc_path, &now);
+    int attached = current && sidecar_attach(load, types, &now);
+    ALLOCV_END(types_buf);
+
+    if (attached) {
+        dbc_indexes_clear(dbc);
+        for (uint32_t k = 0; k < load->index_count; k++) {
+            load->indexes[k].mapping = load->mapping;
+            __atomic_add_fetch(&load->mapping->refs, 1, __ATOMIC_ACQ_REL);
+        }
+        dbc->indexes = load->indexes;
+        dbc->index_count = load->index_count;
+        dbc->indexes_stale = 0;
+        load->indexes = NULL;
+
+        if (now.mtime != load->key.stamp.mtime) {
+            SidecarKey key = {now, load->key.hash};
+            sidecar_save(dbc, load->path, &key);
+        }
+        return Qtrue;
+    }
+
+    // Stale: rebuild the indexes the sidecar lists, for the fields that
+    // still exist
+    dbc_indexes_clear(dbc);
+    for (uint32_t k = 0; k < load->index_count; k++) {
+        if (load->indexes[k].field < field_count) {
+            dbc_index_add(dbc, load->indexes[k].field, load->indexes[k].requested);
+        }
+    }
+    dbc->indexes_stale = 1;
+    dbc_indexes_refresh(dbc);
+
+    if (current) {
+        SidecarKey key = {now, sidecar_file_hash(load->dbc_path)};
+        sidecar_save(dbc, load->path, &key);
+    }
+    return Qtrue;
+}
+
+// DBCFile#save_indexes(path = "#{filepath}.idx") -> self
+//
+// Writes all declared indexes to a sidecar keyed by the DBC file. The table
+// must match the file, so save after read or write.
+static VALUE dbc_save_indexes(int argc, VALUE *argv, VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_save_indexes, -1 - argc, argv, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    VALUE path = sidecar_default_path(self, argc, argv);
+    VALUE dbc_path = rb_iv_get(self, "@filepath");
+    const char *dbc_cpath = StringValueCStr(dbc_path);
+
+    SidecarKey key;
+    if (!sidecar_table_current(dbc, dbc_cpath, &key.stamp)) {
+        rb_raise(rb_eIOError, "Table does not match %s; read or write it before saving indexes", dbc_cpath);
+    }
+    key.hash = sidecar_file_hash(dbc_cpath);
+
+    sidecar_save(dbc, RSTRING_PTR(path), &key);
+    RB_GC_GUARD(path);
+    return self;
+}
+
+// DBCFile#load_indexes(path = "#{filepath}.idx") -> true or false
+//
+// Replaces the declared indexes with those of a sidecar written by
+// save_indexes. They are mapped straight from the file while the DBC still
+// matches it; otherwise they are rebuilt and the sidecar is rewritten.
+// Returns false, leaving the indexes alone, when there is no usable
+// sidecar.
+static VALUE dbc_load_indexes(int argc, VALUE *argv, VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_load_indexes, -1 - argc, argv, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    rb_check_frozen(self);
+
+    VALUE path = sidecar_default_path(self, argc, argv);
+    VALUE dbc_path = rb_iv_get(self, "@filepath");
+
+    SidecarLoad load;
+    memset(&load, 0, sizeof(SidecarLoad));
+    load.dbc = dbc;
+    load.path = RSTRING_PTR(path);
+    load.dbc_path = StringValueCStr(dbc_path);
+
+    DBCStamp stamp;
+    if (!dbc_stamp_path(load.path, &stamp)) return Qfalse;
+
+    // A damaged sidecar is treated like a missing one
+    int state = 0;
+    rb_protect(sidecar_parse_body, (VALUE)&load, &state);
+    if (state) {
+        sidecar_load_cleanup((VALUE)&load);
+        if (!rb_obj_is_kind_of(rb_errinfo(), rb_eIOError)) rb_jump_tag(state);
+        rb_set_errinfo(Qnil);
+        return Qfalse;
+    }
+
+    VALUE result = rb_ensure(sidecar_apply_body, (VALUE)&load, sidecar_load_cleanup, (VALUE)&load);
+    RB_GC_GUARD(path);
+    RB_GC_GUARD(dbc_path);
+    return result;
+}
+
+void Init_wow_dbc_sidecar(void) {
+    rb_define_method(rb_cDBCFile, "save_indexes", dbc_save_indexes, -1);
+    rb_define_method(rb_cDBCFile, "load_indexes", dbc_load_indexes, -1);
+}
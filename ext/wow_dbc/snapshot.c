@@ -0,0 +1,455 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// Snapshot files hold everything needed to restore a table without parsing
+// or re-indexing:
+//
+//   header    "WDBCSNAP", version, metadata offset and size
+//   records   record_count * field_count FieldValues, row-major
+//   strings   interned string block; string fields point into it
+//   indexes   the words of every index, each 8-byte aligned
+//   metadata  MessagePack map with the DBC header, schema and the
+//             directory of sections and indexes
+//
+// Records, strings and index words are used in place from a read-only
+// mapping of the file, as shm.c does with shared tables: loading
+// allocates only the records array, and rows are copied on first write.
+
+#define SNAPSHOT_MAGIC "WDBCSNAP"
+#define SNAPSHOT_VERSION 2
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t metadata_offset;
+    uint64_t metadata_size;
+} SnapshotHeader;
+
+typedef struct {
+    DBCFile *dbc;
+    const char *path;
+    FILE *file;
+    uint64_t offset;
+    FieldType *types;
+    DBCStringTable strings;
+    DBCBuffer chunk;
+    DBCBuffer metadata;
+    uint64_t *index_offsets;
+} SnapshotDump;
+
+static void snapshot_write(SnapshotDump *dump, const void *data, size_t len) {
+    if (len && fwrite(data, 1, len, dump->file) != len) {
+        rb_raise(rb_eIOError, "Failed to write snapshot file");
+    }
+    dump->offset += len;
+    DBC_COUNT(DBC_BYTES_WRITTEN, len);
+}
+
+static void snapshot_align(SnapshotDump *dump) {
+    static const char zeros[8] = {0};
+    snapshot_write(dump, zeros, (size_t)(-dump->offset & 7));
+}
+
+static void snapshot_write_records(SnapshotDump *dump) {
+    DBCFile *dbc = dump->dbc;
+    uint32_t field_count = dbc->header.field_count;
+    size_t row_size = (size_t)field_count * sizeof(FieldValue);
+
+    for (uint32_t i = 0; i < dbc->header.record_count; i++) {
+        dbc_buf_reserve(&dump->chunk, row_size);
+        FieldValue *row = (FieldValue *)(dump->chunk.data + dump->chunk.size);
+        for (uint32_t j = 0; j < field_count; j++) {
+            uint32_t v = dbc->records[i][j].value.uint32_value;
+            if (dump->types[j] == TYPE_STRING) {
+                const char *s = v < dbc->header.string_block_size ? &dbc->string_block[v] : "";
+                uint32_t entry = dbc_strtab_intern(&dump->strings, s, (uint32_t)strlen(s));
+                v = dump->strings.offsets[entry];
+            }
+            row[j].type = dump->types[j];
+            row[j].value.uint32_value = v;
+        }
+        dump->chunk.size += row_size;
+
+        if (dump->chunk.size >= DBC_OUTPUT_CHUNK) {
+            snapshot_write(dump, dump->chunk.data, dump->chunk.size);
+            dump->chunk.size = 0;
+        }
+    }
+    snapshot_write(dump, dump->chunk.data, dump->chunk.size);
+    dump->chunk.size = 0;
+}
+
+static void snapshot_write_metadata(SnapshotDump *dump, uint64_t strings_offset) {
+    DBCFile *dbc = dump->dbc;
+    DBCBuffer *meta = &dump->metadata;
+    VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+
+    dbc_mp_write_map(meta, 9);
+    dbc_mp_write_str(meta, "value_size", 10);
+    dbc_mp_write_uint(meta, sizeof(FieldValue));
+    dbc_mp_write_str(meta, "magic", 5);
+    dbc_mp_write_str(meta, dbc->header.magic, 4);
+    dbc_mp_write_str(meta, "record_count", 12);
+    dbc_mp_write_uint(meta, dbc->header.record_count);
+    dbc_mp_write_str(meta, "field_count", 11);
+    dbc_mp_write_uint(meta, dbc->header.field_count);
+    dbc_mp_write_str(meta, "record_size", 11);
+    dbc_mp_write_uint(meta, dbc->header.record_size);
+
+    // [name, name is a symbol, type]
+    dbc_mp_write_str(meta, "fields", 6);
+    dbc_mp_write_array(meta, dbc->header.field_count);
+    for (uint32_t j = 0; j < dbc->header.field_count; j++) {
+        VALUE name = rb_ary_entry(field_names, j);
+        int symbol = RB_TYPE_P(name, T_SYMBOL);
+        name = NIL_P(name) ? rb_sprintf("field_%u", j) : rb_obj_as_string(name);
+        VALUE type = rb_sym2str(field_type_to_symbol(dump->types[j]));
+        dbc_mp_write_array(meta, 3);
+        dbc_mp_write_str(meta, RSTRING_PTR(name), (size_t)RSTRING_LEN(name));
+        dbc_mp_write_bool(meta, symbol);
+        dbc_mp_write_str(meta, RSTRING_PTR(type), (size_t)RSTRING_LEN(type));
+    }
+
+    dbc_mp_write_str(meta, "records", 7);
+    dbc_mp_write_uint(meta, sizeof(SnapshotHeader));
+
+    dbc_mp_write_str(meta, "strings", 7);
+    dbc_mp_write_array(meta, 2);
+    dbc_mp_write_uint(meta, strings_offset);
+    dbc_mp_write_uint(meta, dump->strings.data_size);
+
+    dbc_mp_write_str(meta, "indexes", 7);
+    dbc_mp_write_array(meta, dbc->index_count);
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        dbc_index_write_meta(meta, &dbc->indexes[k], dump->index_offsets[k]);
+    }
+}
+
+static VALUE snapshot_dump_body(VALUE arg) {
+    SnapshotDump *dump = (SnapshotDump *)arg;
+    DBCFile *dbc = dump->dbc;
+
+    dump->file = fopen(dump->path, "wb");
+    if (!dump->file) {
+        rb_raise(rb_eIOError, "Could not open file for writing: %s", dump->path);
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(SnapshotHeader));
+    snapshot_write(dump, &header, sizeof(SnapshotHeader));
+
+    snapshot_write_records(dump);
+    snapshot_align(dump);
+
+    uint64_t strings_offset = dump->offset;
+    snapshot_write(dump, dump->strings.data, dump->strings.data_size);
+    snapshot_align(dump);
+
+    for (uint32_t k = 0; k < dbc->index_count; k++) {
+        dump->index_offsets[k] = dump->offset;
+        snapshot_write(dump, dbc->indexes[k].words, dbc_index_word_count(&dbc->indexes[k]) * sizeof(uint32_t));
+        snapshot_align(dump);
+    }
+
+    snapshot_write_metadata(dump, strings_offset);
+    memcpy(header.magic, SNAPSHOT_MAGIC, 8);
+    header.version = SNAPSHOT_VERSION;
+    header.metadata_offset = dump->offset;
+    header.metadata_size = dump->metadata.size;
+    snapshot_write(dump, dump->metadata.data, dump->metadata.size);
+
+    if (fseek(dump->file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(SnapshotHeader), 1, dump->file) != 1) {
+        rb_raise(rb_eIOError, "Failed to write snapshot header");
+    }
+    if (fclose(dump->file) != 0) {
+        dump->file = NULL;
+        rb_raise(rb_eIOError, "Failed to write snapshot file");
+    }
+    dump->file = NULL;
+
+    return Qnil;
+}
+
+static VALUE snapshot_dump_cleanup(VALUE arg) {
+    SnapshotDump *dump = (SnapshotDump *)arg;
+    if (dump->file) fclose(dump->file);
+    dbc_strtab_free(&dump->strings);
+    dbc_buf_free(&dump->chunk);
+    dbc_buf_free(&dump->metadata);
+    free(dump->index_offsets);
+    return Qnil;
+}
+
+// DBCFile#dump_snapshot(path) -> self
+//
+// Writes records, schema, interned strings and all declared indexes to a
+// single file for load_snapshot.
+static VALUE dbc_dump_snapshot(VALUE self, VALUE path) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_dump_snapshot, 1, &path, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    dbc_indexes_refresh(dbc);
+
+    SnapshotDump dump;
+    memset(&dump, 0, sizeof(SnapshotDump));
+    dump.dbc = dbc;
+    dump.path = StringValueCStr(path);
+    VALUE types_buf;
+    dump.types = ALLOCV_N(FieldType, types_buf, dbc->header.field_count ? dbc->header.field_count : 1);
+    dbc_column_types(dbc, dump.types);
+
+    dbc_strtab_init(&dump.strings);
+    dbc_buf_init(&dump.chunk, DBC_OUTPUT_CHUNK + 4096);
+    dbc_buf_init(&dump.metadata, 1024);
+    dump.index_offsets = calloc(dbc->index_count ? dbc->index_count : 1, sizeof(uint64_t));
+    if (!dump.index_offsets) {
+        dbc_strtab_free(&dump.strings);
+        dbc_buf_free(&dump.chunk);
+        dbc_buf_free(&dump.metadata);
+        rb_raise(rb_eNoMemError, "Could not allocate snapshot index offsets");
+    }
+
+    rb_ensure(snapshot_dump_body, (VALUE)&dump, snapshot_dump_cleanup, (VALUE)&dump);
+    ALLOCV_END(types_buf);
+    return self;
+}
+
+/* Load */
+
+typedef struct {
+    VALUE klass;
+    VALUE filepath;
+    const char *path;
+    DBCMapping *mapping;
+    DBCHeader header;
+    VALUE field_definitions;
+    FieldType *types;
+    uint64_t value_size;
+    uint64_t records_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint32_t fields_count;
+    uint64_t *index_offsets;
+    DBCIndex *indexes;
+    uint32_t index_count;
+} SnapshotLoad;
+
+static void snapshot_malformed(SnapshotLoad *load) {
+    rb_raise(rb_eIOError, "Malformed snapshot file: %s", load->path);
+}
+
+// Checks that [offset, offset + size) lies inside the file
+static void snapshot_check_range(SnapshotLoad *load, uint64_t offset, uint64_t size, uint64_t align) {
+    if (offset % align != 0 || offset > load->mapping->size || size > load->mapping->size - offset) {
+        snapshot_malformed(load);
+    }
+}
+
+static void snapshot_read_fields(SnapshotLoad *load, DBCMsgReader *reader) {
+    uint32_t count = dbc_mp_read_array(reader);
+    if (load->types) snapshot_malformed(load);
+    load->fields_count = count;
+
+    load->types = ALLOC_N(FieldType, count ? count : 1);
+    for (uint32_t j = 0; j < count; j++) {
+        uint32_t len;
+        if (dbc_mp_read_array(reader) != 3) snapshot_malformed(load);
+        const char *name = dbc_mp_read_str(reader, &len);
+        VALUE key = rb_str_new(name, len);
+        if (dbc_mp_read_bool(reader)) key = rb_str_intern(key);
+        const char *type = dbc_mp_read_str(reader, &len);
+        VALUE type_symbol = ID2SYM(rb_intern2(type, len));
+        load->types[j] = ruby_to_field_type(type_symbol);
+        rb_hash_aset(load->field_definitions, key, type_symbol);
+    }
+}
+
+static void snapshot_read_indexes(SnapshotLoad *load, DBCMsgReader *reader) {
+    uint32_t count = dbc_mp_read_array(reader);
+    if (load->indexes) snapshot_malformed(load);
+    load->indexes = ALLOC_N(DBCIndex, count ? count : 1);
+    load->index_offsets = ALLOC_N(uint64_t, count ? count : 1);
+    memset(load->indexes, 0, (count ? count : 1) * sizeof(DBCIndex));
+
+    for (uint32_t k = 0; k < count; k++) {
+        if (!dbc_index_read_meta(reader, &load->indexes[k], &load->index_offsets[k])) snapshot_malformed(load);
+        load->index_count++;
+    }
+}
+
+// Runs once the whole metadata map is known, since keys may come in any
+// order
+static void snapshot_check_indexes(SnapshotLoad *load) {
+    for (uint32_t k = 0; k < load->index_count; k++) {
+        if (!dbc_index_attach(&load->indexes[k], load->mapping, load->index_offsets[k], load->types,
+                              load->header.field_count, load->header.record_count)) {
+            snapshot_malformed(load);
+        }
+    }
+}
+
+static void snapshot_read_metadata(SnapshotLoad *load) {
+    const uint8_t *base = load->mapping->addr;
+    SnapshotHeader header;
+
+    if (load->mapping->size < sizeof(SnapshotHeader)) snapshot_malformed(load);
+    memcpy(&header, base, sizeof(SnapshotHeader));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, 8) != 0) {
+        rb_raise(rb_eIOError, "Not a snapshot file: %s", load->path);
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        rb_raise(rb_eIOError, "Unsupported snapshot version %u: %s", header.version, load->path);
+    }
+    snapshot_check_range(load, header.metadata_offset, header.metadata_size, 1);
+
+    DBCMsgReader reader = {base + header.metadata_offset, base + header.metadata_offset + header.metadata_size};
+    int seen_records = 0, seen_strings = 0;
+    uint32_t count = dbc_mp_read_map(&reader);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t len;
+        const char *key = dbc_mp_read_str(&reader, &len);
+        if (dbc_mp_key_is(key, len, "value_size")) {
+            load->value_size = dbc_mp_read_uint(&reader);
+        } else if (dbc_mp_key_is(key, len, "magic")) {
+            uint32_t magic_len;
+            const char *magic = dbc_mp_read_str(&reader, &magic_len);
+            if (magic_len != 4) snapshot_malformed(load);
+            memcpy(load->header.magic, magic, 4);
+        } else if (dbc_mp_key_is(key, len, "record_count")) {
+            load->header.record_count = (uint32_t)dbc_mp_read_uint(&reader);
+        } else if (dbc_mp_key_is(key, len, "field_count")) {
+            load->header.field_count = (uint32_t)dbc_mp_read_uint(&reader);
+        } else if (dbc_mp_key_is(key, len, "record_size")) {
+            load->header.record_size = (uint32_t)dbc_mp_read_uint(&reader);
+        } else if (dbc_mp_key_is(key, len, "fields")) {
+            snapshot_read_fields(load, &reader);
+        } else if (dbc_mp_key_is(key, len, "records")) {
+            load->records_offset = dbc_mp_read_uint(&reader);
+            seen_records = 1;
+        } else if (dbc_mp_key_is(key, len, "strings")) {
+            if (dbc_mp_read_array(&reader) != 2) snapshot_malformed(load);
+            load->strings_offset = dbc_mp_read_uint(&reader);
+            load->strings_size = dbc_mp_read_uint(&reader);
+            seen_strings = 1;
+        } else if (dbc_mp_key_is(key, len, "indexes")) {
+            snapshot_read_indexes(load, &reader);
+        } else {
+            dbc_mp_skip(&reader);
+        }
+    }
+    if (!load->types || !seen_records || !seen_strings) snapshot_malformed(load);
+    if (load->fields_count != load->header.field_count) snapshot_malformed(load);
+    // Rows are used in place, so they must have this build's layout
+    if (load->value_size != sizeof(FieldValue)) {
+        rb_raise(rb_eIOError, "Snapshot was written with another record layout: %s", load->path);
+    }
+    snapshot_check_indexes(load);
+
+    uint32_t field_count = load->header.field_count;
+    uint64_t record_values = (uint64_t)load->header.record_count * field_count;
+    snapshot_check_range(load, load->records_offset, record_values * sizeof(FieldValue), _Alignof(FieldValue));
+    snapshot_check_range(load, load->strings_offset, load->strings_size, 1);
+    if (load->strings_size > UINT32_MAX ||
+        (load->strings_size && base[load->strings_offset + load->strings_size - 1] != '\0')) {
+        snapshot_malformed(load);
+    }
+    load->header.string_block_size = (uint32_t)load->strings_size;
+
+    // ... and their type tags must agree with the schema
+    const FieldValue *values = (const FieldValue *)(base + load->records_offset);
+    for (uint64_t v = 0; v < record_values; v++) {
+        if (values[v].type != load->types[v % field_count]) snapshot_malformed(load);
+    }
+}
+
+static VALUE snapshot_load_body(VALUE arg) {
+    SnapshotLoad *load = (SnapshotLoad *)arg;
+
+    load->mapping = dbc_mapping_open(load->path);
+    snapshot_read_metadata(load);
+
+    VALUE argv[2] = {load->filepath, load->field_definitions};
+    VALUE obj = rb_class_new_instance(2, argv, load->klass);
+    DBCFile *dbc;
+    TypedData_Get_Struct(obj, DBCFile, &dbc_data_type, dbc);
+
+    uint32_t record_count = load->header.record_count;
+    uint32_t field_count = load->header.field_count;
+    DBCCowBase *base = calloc(1, sizeof(DBCCowBase));
+    FieldValue **records = malloc((record_count ? record_count : 1) * sizeof(FieldValue *));
+    if (!base || !records) {
+        free(base);
+        free(records);
+        rb_raise(rb_eNoMemError, "Could not allocate records");
+    }
+    uint8_t *addr = load->mapping->addr;
+    FieldValue *rows = (FieldValue *)(addr + load->records_offset);
+    for (uint32_t i = 0; i < record_count; i++) records[i] = rows + (size_t)i * field_count;
+
+    // Nothing below can raise. The base takes the reference on the mapping.
+    base->refs = 1;
+    base->records = records;
+    base->record_count = record_count;
+    base->string_block = (char *)addr + load->strings_offset;
+    base->mapping = load->mapping;
+
+    dbc_release_records(dbc);
+    dbc->header = load->header;
+    dbc->cow_base = base;
+    dbc->records = records;
+    dbc->string_block = base->string_block;
+    dbc->records_shared = 1;
+    dbc->strings_shared = 1;
+    dbc->modified = 1;
+
+    dbc_indexes_clear(dbc);
+    for (uint32_t k = 0; k < load->index_count; k++) {
+        load->indexes[k].mapping = load->mapping;
+        __atomic_add_fetch(&load->mapping->refs, 1, __ATOMIC_ACQ_REL);
+    }
+    dbc->indexes = load->indexes;
+    dbc->index_count = load->index_count;
+    dbc->indexes_stale = 0;
+    load->indexes = NULL;
+    load->mapping = NULL;
+
+    return obj;
+}
+
+static VALUE snapshot_load_cleanup(VALUE arg) {
+    SnapshotLoad *load = (SnapshotLoad *)arg;
+    xfree(load->indexes);
+    xfree(load->index_offsets);
+    xfree(load->types);
+    if (load->mapping) dbc_mapping_release(load->mapping);
+    return Qnil;
+}
+
+// DBCFile.load_snapshot(path, filepath = nil) -> DBCFile
+//
+// Restores a table written by dump_snapshot, with its indexes ready for
+// lookups. `filepath` is the path used by #write.
+static VALUE dbc_load_snapshot(int argc, VALUE *argv, VALUE klass) {
+    SnapshotLoad load;
+    memset(&load, 0, sizeof(SnapshotLoad));
+
+    VALUE path;
+    rb_scan_args(argc, argv, "11", &path, &load.filepath);
+    load.klass = klass;
+    load.path = StringValueCStr(path);
+    load.field_definitions = rb_hash_new();
+
+    VALUE obj = rb_ensure(snapshot_load_body, (VALUE)&load, snapshot_load_cleanup, (VALUE)&load);
+    RB_GC_GUARD(path);
+    RB_GC_GUARD(load.field_definitions);
+    return obj;
+}
+
+void Init_wow_dbc_snapshot(void) {
+    rb_define_method(rb_cDBCFile, "dump_snapshot", dbc_dump_snapshot, 1);
+    rb_define_singleton_method(rb_cDBCFile, "load_snapshot", dbc_load_snapshot, -1);
+}
@@ -0,0 +1,244 @@
+#include "wow_dbc.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// MySQL dumps: multi-row INSERT statements, or tab separated rows in the
+// default LOAD DATA INFILE format.
+
+#define SQL_DEFAULT_BATCH_ROWS 1000
+
+typedef enum {
+    SQL_FORMAT_INSERT,
+    SQL_FORMAT_TSV
+} SQLFormat;
+
+// Escape sequence for each byte, 0 when the byte is copied as is
+static char sql_escapes[256];
+static char tsv_escapes[256];
+
+static void sql_init_escapes(void) {
+    sql_escapes['\0'] = '0';
+    sql_escapes['\b'] = 'b';
+    sql_escapes['\n'] = 'n';
+    sql_escapes['\r'] = 'r';
+    sql_escapes['\t'] = 't';
+    sql_escapes['\x1a'] = 'Z';
+    sql_escapes['\''] = '\'';
+    sql_escapes['"'] = '"';
+    sql_escapes['\\'] = '\\';
+
+    tsv_escapes['\0'] = '0';
+    tsv_escapes['\n'] = 'n';
+    tsv_escapes['\r'] = 'r';
+    tsv_escapes['\t'] = 't';
+    tsv_escapes['\\'] = '\\';
+}
+
+static void sql_write_escaped(DBCBuffer *buf, const char *s, const char *escapes) {
+    size_t len = strlen(s);
+    dbc_buf_reserve(buf, len * 2);
+
+    char *dst = buf->data + buf->size;
+    for (size_t i = 0; i < len; i++) {
+        char escape = escapes[(unsigned char)s[i]];
+        if (escape) {
+            *dst++ = '\\';
+            *dst++ = escape;
+        } else {
+            *dst++ = s[i];
+        }
+    }
+    buf->size = (size_t)(dst - buf->data);
+}
+
+static void sql_write_identifier(DBCBuffer *buf, VALUE name) {
+    const char *s = RSTRING_PTR(name);
+    long len = RSTRING_LEN(name);
+
+    dbc_buf_append(buf, "`", 1);
+    for (long i = 0; i < len; i++) {
+        dbc_buf_append(buf, &s[i], 1);
+        if (s[i] == '`') dbc_buf_append(buf, "`", 1);
+    }
+    dbc_buf_append(buf, "`", 1);
+}
+
+typedef struct {
+    DBCFile *dbc;
+    FieldType *types;
+    SQLFormat format;
+    VALUE table;
+    long batch_rows;
+    DBCBuffer prefix;  // "INSERT INTO ... VALUES\n", rendered once
+    DBCOutput out;
+} SQLExport;
+
+static void sql_write_insert_prefix(SQLExport *ex) {
+    DBCBuffer *buf = &ex->prefix;
+    VALUE field_names = rb_funcall(ex->dbc->field_definitions, rb_intern("keys"), 0);
+
+    dbc_buf_append(buf, "INSERT INTO ", 12);
+    sql_write_identifier(buf, ex->table);
+    dbc_buf_append(buf, " (", 2);
+    for (uint32_t j = 0; j < ex->dbc->header.field_count; j++) {
+        VALUE name = rb_ary_entry(field_names, j);
+        name = NIL_P(name) ? rb_sprintf("field_%u", j) : rb_obj_as_string(name);
+        if (j) dbc_buf_append(buf, ",", 1);
+        sql_write_identifier(buf, name);
+    }
+    dbc_buf_append(buf, ") VALUES\n", 9);
+}
+
+static VALUE sql_export_body(VALUE arg) {
+    SQLExport *ex = (SQLExport *)arg;
+    DBCFile *dbc = ex->dbc;
+    DBCBuffer *buf = &ex->out.buf;
+    uint32_t field_count = dbc->header.field_count;
+    int insert = ex->format == SQL_FORMAT_INSERT;
+    const char *escapes = insert ? sql_escapes : tsv_escapes;
+    char separator = insert ? ',' : '\t';
+
+    if (insert) {
+        dbc_buf_init(&ex->prefix, 256);
+        sql_write_insert_prefix(ex);
+    }
+
+    long batch = 0;
+    for (uint32_t i = 0; i < dbc->header.record_count; i++) {
+        FieldValue *record = dbc->records[i];
+
+        if (insert) {
+            if (batch == 0) {
+                dbc_buf_append(buf, ex->prefix.data, ex->prefix.size);
+            } else {
+                dbc_buf_append(buf, ",\n", 2);
+            }
+            dbc_buf_append(buf, "(", 1);
+        }
+
+        dbc_buf_reserve(buf, (size_t)field_count * (DBC_NUMBER_MAX + 1) + 3);
+        for (uint32_t j = 0; j < field_count; j++) {
+            if (j) buf->data[buf->size++] = separator;
+            switch (ex->types[j]) {
+                case TYPE_UINT32:
+                    buf->size += dbc_format_uint32(buf->data + buf->size, record[j].value.uint32_value);
+                    break;
+                case TYPE_INT32:
+                    buf->size += dbc_format_int32(buf->data + buf->size, record[j].value.int32_value);
+                    break;
+                case TYPE_FLOAT:
+                    if (isfinite(record[j].value.float_value)) {
+                        buf->size += dbc_format_float(buf->data + buf->size, record[j].value.float_value);
+                    } else if (insert) {
+                        memcpy(buf->data + buf->size, "NULL", 4);
+                        buf->size += 4;
+                    } else {
+                        memcpy(buf->data + buf->size, "\\N", 2);
+                        buf->size += 2;
+                    }
+                    break;
+                case TYPE_STRING: {
+                    uint32_t offset = record[j].value.string_offset;
+                    const char *s = offset < dbc->header.string_block_size ? &dbc->string_block[offset] : "";
+                    if (insert) dbc_buf_append(buf, "'", 1);
+                    sql_write_escaped(buf, s, escapes);
+                    if (insert) dbc_buf_append(buf, "'", 1);
+                    // strings may have grown the buffer past the reservation
+                    dbc_buf_reserve(buf, (size_t)(field_count - j) * (DBC_NUMBER_MAX + 1) + 3);
+                    break;
+                }
+            }
+        }
+
+        if (insert) {
+            buf->data[buf->size++] = ')';
+            if (++batch == ex->batch_rows || i + 1 == dbc->header.record_count) {
+                dbc_buf_append(buf, ";\n", 2);
+                batch = 0;
+            }
+        } else {
+            buf->data[buf->size++] = '\n';
+        }
+
+        if (buf->size >= DBC_OUTPUT_CHUNK) dbc_out_flush(&ex->out);
+    }
+    dbc_out_flush(&ex->out);
+
+    return Qnil;
+}
+
+static VALUE sql_export_cleanup(VALUE arg) {
+    SQLExport *ex = (SQLExport *)arg;
+    dbc_buf_free(&ex->prefix);
+    dbc_out_free(&ex->out);
+    return Qnil;
+}
+
+static void sql_export(DBCFile *dbc, SQLExport *ex, VALUE io) {
+    ex->dbc = dbc;
+    dbc_column_types(dbc, ex->types);
+    dbc_out_init(&ex->out, io);
+    rb_ensure(sql_export_body, (VALUE)ex, sql_export_cleanup, (VALUE)ex);
+}
+
+// DBCFile#to_sql(io, table:, batch_rows: 1000) -> self
+//
+// Writes `INSERT INTO table (...) VALUES (...),(...);` statements with at
+// most `batch_rows` rows each. Strings use MySQL backslash escaping.
+static VALUE dbc_to_sql(int argc, VALUE *argv, VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_to_sql, -1 - argc, argv, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    VALUE io, options;
+    rb_scan_args(argc, argv, "1:", &io, &options);
+
+    ID keywords[2] = {rb_intern("table"), rb_intern("batch_rows")};
+    VALUE values[2];
+    rb_get_kwargs(NIL_P(options) ? rb_hash_new() : options, keywords, 1, 1, values);
+
+    SQLExport ex;
+    memset(&ex, 0, sizeof(SQLExport));
+    ex.format = SQL_FORMAT_INSERT;
+    ex.table = rb_obj_as_string(values[0]);
+    ex.batch_rows = values[1] == Qundef ? SQL_DEFAULT_BATCH_ROWS : NUM2LONG(values[1]);
+    if (ex.batch_rows < 1) {
+        rb_raise(rb_eArgError, "batch_rows must be positive");
+    }
+    VALUE types_buf;
+    ex.types = ALLOCV_N(FieldType, types_buf, dbc->header.field_count ? dbc->header.field_count : 1);
+
+    sql_export(dbc, &ex, io);
+    ALLOCV_END(types_buf);
+    RB_GC_GUARD(ex.table);
+    return self;
+}
+
+// DBCFile#to_tsv(io) -> self
+//
+// One tab separated line per record, readable by a plain
+// `LOAD DATA INFILE 'file' INTO TABLE t`.
+static VALUE dbc_to_tsv(VALUE self, VALUE io) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_to_tsv, 1, &io, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    SQLExport ex;
+    memset(&ex, 0, sizeof(SQLExport));
+    ex.format = SQL_FORMAT_TSV;
+    VALUE types_buf;
+    ex.types = ALLOCV_N(FieldType, types_buf, dbc->header.field_count ? dbc->header.field_count : 1);
+
+    sql_export(dbc, &ex, io);
+    ALLOCV_END(types_buf);
+    return self;
+}
+
+void Init_wow_dbc_sql(void) {
+    sql_init_escapes();
+    rb_define_method(rb_cDBCFile, "to_sql", dbc_to_sql, -1);
+    rb_define_method(rb_cDBCFile, "to_tsv", dbc_to_tsv, 1);
+}
@@ -0,0 +1,223 @@
+#include "wow_dbc.h"
+
+#ifdef HAVE_SQLITE3
+
+#include <sqlite3.h>
+
+// Loads a table into SQLite with a single prepared INSERT, rebinding raw
+// column values for every record inside one transaction.
+
+typedef struct {
+    DBCFile *dbc;
+    const char *path;
+    VALUE table;
+    VALUE field_names;
+    VALUE indexes;
+    FieldType *types;
+    sqlite3 *db;
+    sqlite3_stmt *insert;
+    int in_transaction;
+    DBCBuffer sql;
+} SQLiteExport;
+
+static void sqlite_check(SQLiteExport *ex, int rc) {
+    if (rc != SQLITE_OK && rc != SQLITE_DONE) {
+        rb_raise(rb_eIOError, "SQLite error: %s", sqlite3_errmsg(ex->db));
+    }
+}
+
+static void sqlite_write_identifier(DBCBuffer *buf, VALUE name) {
+    const char *s = RSTRING_PTR(name);
+    long len = RSTRING_LEN(name);
+
+    dbc_buf_append(buf, "\"", 1);
+    for (long i = 0; i < len; i++) {
+        dbc_buf_append(buf, &s[i], 1);
+        if (s[i] == '"') dbc_buf_append(buf, "\"", 1);
+    }
+    dbc_buf_append(buf, "\"", 1);
+}
+
+// Runs the statement accumulated in ex->sql
+static void sqlite_exec_sql(SQLiteExport *ex) {
+    dbc_buf_append(&ex->sql, "", 1);
+    sqlite_check(ex, sqlite3_exec(ex->db, ex->sql.data, NULL, NULL, NULL));
+    ex->sql.size = 0;
+}
+
+static VALUE sqlite_field_name(SQLiteExport *ex, uint32_t j) {
+    VALUE name = rb_ary_entry(ex->field_names, j);
+    return NIL_P(name) ? rb_sprintf("field_%u", j) : rb_obj_as_string(name);
+}
+
+static void sqlite_bind_record(SQLiteExport *ex, FieldValue *record) {
+    DBCFile *dbc = ex->dbc;
+
+    for (uint32_t j = 0; j < dbc->header.field_count; j++) {
+        int param = (int)j + 1;
+        switch (ex->types[j]) {
+            case TYPE_UINT32:
+                sqlite3_bind_int64(ex->insert, param, record[j].value.uint32_value);
+                break;
+            case TYPE_INT32:
+                sqlite3_bind_int(ex->insert, param, record[j].value.int32_value);
+                break;
+            case TYPE_FLOAT:
+                sqlite3_bind_double(ex->insert, param, record[j].value.float_value);
+                break;
+            case TYPE_STRING: {
+                uint32_t offset = record[j].value.string_offset;
+                const char *s = offset < dbc->header.string_block_size ? &dbc->string_block[offset] : "";
+                sqlite3_bind_text(ex->insert, param, s, -1, SQLITE_STATIC);
+                break;
+            }
+        }
+    }
+}
+
+static VALUE sqlite_export_body(VALUE arg) {
+    SQLiteExport *ex = (SQLiteExport *)arg;
+    DBCFile *dbc = ex->dbc;
+    uint32_t field_count = dbc->header.field_count;
+    DBCBuffer *sql = &ex->sql;
+
+    if (sqlite3_open_v2(ex->path, &ex->db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK) {
+        rb_raise(rb_eIOError, "Could not open SQLite database: %s", ex->path);
+    }
+    // NORMAL skips most fsyncs of the one big transaction but still syncs
+    // the journal before the database is overwritten. OFF would let a
+    // power loss corrupt a database the export is appended to.
+    sqlite_check(ex, sqlite3_exec(ex->db, "PRAGMA synchronous = NORMAL", NULL, NULL, NULL));
+    sqlite_check(ex, sqlite3_exec(ex->db, "BEGIN", NULL, NULL, NULL));
+    ex->in_transaction = 1;
+
+    dbc_buf_append(sql, "DROP TABLE IF EXISTS ", 21);
+    sqlite_write_identifier(sql, ex->table);
+    sqlite_exec_sql(ex);
+
+    dbc_buf_append(sql, "CREATE TABLE ", 13);
+    sqlite_write_identifier(sql, ex->table);
+    dbc_buf_append(sql, " (", 2);
+    for (uint32_t j = 0; j < field_count; j++) {
+        if (j) dbc_buf_append(sql, ", ", 2);
+        sqlite_write_identifier(sql, sqlite_field_name(ex, j));
+        switch (ex->types[j]) {
+            case TYPE_UINT32:
+            case TYPE_INT32:
+                dbc_buf_append(sql, " INTEGER", 8);
+                break;
+            case TYPE_FLOAT:
+                dbc_buf_append(sql, " REAL", 5);
+                break;
+            case TYPE_STRING:
+                dbc_buf_append(sql, " TEXT", 5);
+                break;
+        }
+    }
+    dbc_buf_append(sql, ")", 1);
+    sqlite_exec_sql(ex);
+
+    dbc_buf_append(sql, "INSERT INTO ", 12);
+    sqlite_write_identifier(sql, ex->table);
+    dbc_buf_append(sql, " VALUES (", 9);
+    for (uint32_t j = 0; j < field_count; j++) {
+        dbc_buf_append(sql, j ? ", ?" : "?", j ? 3 : 1);
+    }
+    dbc_buf_append(sql, ")", 1);
+    sqlite_check(ex, sqlite3_prepare_v2(ex->db, sql->data, (int)sql->size, &ex->insert, NULL));
+    sql->size = 0;
+
+    for (uint32_t i = 0; i < dbc->header.record_count; i++) {
+        sqlite_bind_record(ex, dbc->records[i]);
+        sqlite_check(ex, sqlite3_step(ex->insert));
+        sqlite3_reset(ex->insert);
+    }
+
+    // Indexes are built after the load, which is much cheaper than
+    // maintaining them row by row
+    for (long k = 0; k < RARRAY_LEN(ex->indexes); k++) {
+        VALUE field = rb_ary_entry(ex->indexes, k);
+        VALUE name = rb_obj_as_string(field);
+        dbc_buf_append(sql, "CREATE INDEX ", 13);
+        sqlite_write_identifier(sql, rb_sprintf("%"PRIsVALUE"_%"PRIsVALUE"_idx", ex->table, name));
+        dbc_buf_append(sql, " ON ", 4);
+        sqlite_write_identifier(sql, ex->table);
+        dbc_buf_append(sql, " (", 2);
+        sqlite_write_identifier(sql, name);
+        dbc_buf_append(sql, ")", 1);
+        sqlite_exec_sql(ex);
+    }
+
+    sqlite_check(ex, sqlite3_exec(ex->db, "COMMIT", NULL, NULL, NULL));
+    ex->in_transaction = 0;
+
+    return Qnil;
+}
+
+static VALUE sqlite_export_cleanup(VALUE arg) {
+    SQLiteExport *ex = (SQLiteExport *)arg;
+    if (ex->insert) sqlite3_finalize(ex->insert);
+    if (ex->in_transaction) sqlite3_exec(ex->db, "ROLLBACK", NULL, NULL, NULL);
+    if (ex->db) sqlite3_close(ex->db);
+    dbc_buf_free(&ex->sql);
+    return Qnil;
+}
+
+// DBCFile#to_sqlite(db_path, table:, indexes: []) -> self
+//
+// Replaces `table` in the database with one INTEGER, REAL or TEXT column
+// per field, and creates a single-column index for each field listed in
+// `indexes`.
+static VALUE dbc_to_sqlite(int argc, VALUE *argv, VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_to_sqlite, -1 - argc, argv, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    VALUE db_path, options;
+    rb_scan_args(argc, argv, "1:", &db_path, &options);
+
+    ID keywords[2] = {rb_intern("table"), rb_intern("indexes")};
+    VALUE values[2];
+    rb_get_kwargs(NIL_P(options) ? rb_hash_new() : options, keywords, 1, 1, values);
+
+    SQLiteExport ex;
+    memset(&ex, 0, sizeof(SQLiteExport));
+    ex.dbc = dbc;
+    ex.path = StringValueCStr(db_path);
+    ex.table = rb_obj_as_string(values[0]);
+    ex.indexes = values[1] == Qundef || NIL_P(values[1]) ? rb_ary_new() : rb_Array(values[1]);
+    ex.field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+
+    for (long k = 0; k < RARRAY_LEN(ex.indexes); k++) {
+        VALUE field = rb_ary_entry(ex.indexes, k);
+        if (!RTEST(rb_ary_includes(ex.field_names, field))) {
+            rb_raise(rb_eArgError, "Invalid field name: %"PRIsVALUE, field);
+        }
+    }
+
+    VALUE types_buf;
+    ex.types = ALLOCV_N(FieldType, types_buf, dbc->header.field_count ? dbc->header.field_count : 1);
+    dbc_column_types(dbc, ex.types);
+    dbc_buf_init(&ex.sql, 256);
+
+    rb_ensure(sqlite_export_body, (VALUE)&ex, sqlite_export_cleanup, (VALUE)&ex);
+    ALLOCV_END(types_buf);
+    RB_GC_GUARD(ex.table);
+    RB_GC_GUARD(ex.indexes);
+    RB_GC_GUARD(ex.field_names);
+    return self;
+}
+
+#else
+
+static VALUE dbc_to_sqlite(int argc, VALUE *argv, VALUE self) {
+    rb_raise(rb_eNotImpError, "wow_dbc was built without SQLite support");
+    return Qnil;
+}
+
+#endif
+
+void Init_wow_dbc_sqlite(void) {
+    rb_define_method(rb_cDBCFile, "to_sqlite", dbc_to_sqlite, -1);
+}
@@ -0,0 +1,99 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// Insertion-ordered string intern table. Strings are stored NUL-terminated
+// back to back, and entry 0 is always the empty string, so `data` doubles as
+// a DBC string block and `offsets` as the matching string offsets.
+
+static uint32_t strtab_hash(const char *s, uint32_t len) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)s[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void strtab_grow_slots(DBCStringTable *table) {
+    uint32_t slot_count = table->slot_mask ? (table->slot_mask + 1) * 2 : 64;
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (!slots) {
+        rb_raise(rb_eNoMemError, "Could not grow the string table");
+    }
+
+    for (uint32_t i = 0; i < table->count; i++) {
+        uint32_t slot = table->hashes[i] & (slot_count - 1);
+        while (slots[slot]) slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = i + 1;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->slot_mask = slot_count - 1;
+}
+
+static void *strtab_grow(void *ptr, size_t size) {
+    void *grown = realloc(ptr, size);
+    if (!grown) {
+        rb_raise(rb_eNoMemError, "Could not grow the string table");
+    }
+    return grown;
+}
+
+void dbc_strtab_init(DBCStringTable *table) {
+    memset(table, 0, sizeof(DBCStringTable));
+    dbc_strtab_intern(table, "", 0);
+}
+
+uint32_t dbc_strtab_intern(DBCStringTable *table, const char *s, uint32_t len) {
+    if ((table->count + 1) * 2 > table->slot_mask) {
+        strtab_grow_slots(table);
+    }
+
+    uint32_t hash = strtab_hash(s, len);
+    uint32_t slot = hash & table->slot_mask;
+    while (table->slots[slot]) {
+        uint32_t entry = table->slots[slot] - 1;
+        if (table->hashes[entry] == hash && table->lengths[entry] == len &&
+            memcmp(table->data + table->offsets[entry], s, len) == 0) {
+            return entry;
+        }
+        slot = (slot + 1) & table->slot_mask;
+    }
+
+    if (table->count == table->capacity) {
+        uint32_t capacity = table->capacity ? table->capacity * 2 : 64;
+        // Each array keeps its contents when a later one fails to grow
+        table->offsets = strtab_grow(table->offsets, capacity * sizeof(uint32_t));
+        table->lengths = strtab_grow(table->lengths, capacity * sizeof(uint32_t));
+        table->hashes = strtab_grow(table->hashes, capacity * sizeof(uint32_t));
+        table->capacity = capacity;
+    }
+    if (table->data_size + len + 1 > table->data_capacity) {
+        size_t capacity = table->data_capacity ? table->data_capacity : 4096;
+        while (table->data_size + len + 1 > capacity) capacity *= 2;
+        table->data = strtab_grow(table->data, capacity);
+        table->data_capacity = capacity;
+    }
+
+    uint32_t entry = table->count++;
+    table->offsets[entry] = (uint32_t)table->data_size;
+    table->lengths[entry] = len;
+    table->hashes[entry] = hash;
+    memcpy(table->data + table->data_size, s, len);
+    table->data[table->data_size + len] = '\0';
+    table->data_size += len + 1;
+    table->slots[slot] = entry + 1;
+
+    return entry;
+}
+
+void dbc_strtab_free(DBCStringTable *table) {
+    free(table->slots);
+    free(table->offsets);
+    free(table->lengths);
+    free(table->hashes);
+    free(table->data);
+    memset(table, 0, sizeof(DBCStringTable));
+}
@@ -0,0 +1,232 @@
+#include "wow_dbc.h"
+
+#include <ruby/thread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Deterministic synthetic DBC files for scaling benchmarks. Rows are
+// streamed to disk as they are generated, so only the string block and
+// the offsets of its distinct strings stay in memory. The values follow
+// the shape of real tables: ascending ids with occasional gaps, small
+// enum-like integers, sparse -1s, and path-like strings of which a share
+// repeat earlier ones, as texture and model names do.
+
+static VALUE rb_mSynth;
+
+typedef struct {
+    const char *path;
+    const FieldType *types;
+    uint32_t field_count;
+    uint32_t rows;
+    double string_ratio;  // share of string cells that are not empty
+    double dup_ratio;     // share of non-empty strings repeating an earlier one
+    uint64_t seed;
+    DBCHeader header;
+    const char *error;
+    volatile int cancelled;  // set by synth_cancel to stop between rows
+} Synth;
+
+static uint64_t synth_next(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1)
+static double synth_unit(uint64_t *state) {
+    return (double)(synth_next(state) >> 11) / 9007199254740992.0;
+}
+
+static uint32_t synth_string(Synth *synth, DBCBuffer *strings, uint32_t **pool, size_t *pool_count,
+                             size_t *pool_capacity, uint32_t column, uint64_t *state) {
+    if (synth_unit(state) >= synth->string_ratio) return 0;
+    if (*pool_count && synth_unit(state) < synth->dup_ratio) {
+        return (*pool)[synth_next(state) % *pool_count];
+    }
+
+    static const char *const dirs[] = {"Item\\ObjectComponents\\Weapon", "Creature\\Murloc", "World\\Generic\\Human",
+                                       "Spells", "Interface\\Icons", "Character\\Textures"};
+    static const char *const exts[] = {".m2", ".blp", ".mdx", ".wmo"};
+    char text[160];
+    uint64_t r = synth_next(state);
+    int len = snprintf(text, sizeof(text), "%s\\Column%u_%010llx%.*s%s", dirs[r % 6], column,
+                       (unsigned long long)(r >> 8), (int)((r >> 40) % 24), "_Variant_Alternate_Large", exts[(r >> 4) % 4]);
+    if (strings->size + (size_t)len + 1 > UINT32_MAX) return 0;
+    if (!dbc_buf_try_reserve(strings, (size_t)len + 1)) {
+        synth->error = "Could not allocate the string block";
+        return 0;
+    }
+
+    uint32_t offset = (uint32_t)strings->size;
+    dbc_buf_append(strings, text, (size_t)len + 1);
+    if (*pool_count == *pool_capacity) {
+        size_t capacity = *pool_capacity ? *pool_capacity * 2 : 1024;
+        uint32_t *grown = realloc(*pool, capacity * sizeof(uint32_t));
+        if (!grown) return offset;  // only dedup candidates are lost
+        *pool = grown;
+        *pool_capacity = capacity;
+    }
+    (*pool)[(*pool_count)++] = offset;
+    return offset;
+}
+
+static void *synth_generate_without_gvl(void *arg) {
+    Synth *synth = (Synth *)arg;
+    FILE *file = fopen(synth->path, "wb");
+    if (!file) {
+        synth->error = "Could not open file for writing";
+        return NULL;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    DBCHeader *header = &synth->header;
+    memcpy(header->magic, "WDBC", 4);
+    header->record_count = synth->rows;
+    header->field_count = synth->field_count;
+    header->record_size = synth->field_count * (uint32_t)sizeof(uint32_t);
+    header->string_block_size = 0;
+    // Rewritten with the string block size at the end
+    if (fwrite(header, sizeof(DBCHeader), 1, file) != 1) {
+        fclose(file);
+        synth->error = "Failed to write DBC header";
+        return NULL;
+    }
+
+    DBCBuffer strings;
+    dbc_buf_init(&strings, 1 << 16);
+    if (dbc_buf_try_reserve(&strings, 1)) {
+        dbc_buf_append(&strings, "", 1);
+    } else {
+        synth->error = "Could not allocate the string block";
+    }
+    uint32_t *pool = NULL;
+    size_t pool_count = 0, pool_capacity = 0;
+    uint32_t *row = malloc((synth->field_count ? synth->field_count : 1) * sizeof(uint32_t));
+    uint64_t state = synth->seed;
+    uint32_t id = 0;
+
+    for (uint32_t i = 0; i < synth->rows && row && !synth->error && !synth->cancelled; i++) {
+        for (uint32_t j = 0; j < synth->field_count; j++) {
+            uint64_t r = synth_next(&state);
+            if (j == 0 && synth->types[0] != TYPE_STRING && synth->types[0] != TYPE_FLOAT) {
+                id += 1 + ((r & 15) == 0 ? (uint32_t)(r >> 4) % 8 : 0);
+                row[j] = id;
+                continue;
+            }
+            switch (synth->types[j]) {
+                case TYPE_UINT32:
+                    row[j] = (r & 3) == 0 ? 0 : (uint32_t)((r >> 2) % (1u << (4 + (j * 7) % 20)));
+                    break;
+                case TYPE_INT32: {
+                    int32_t value = (r & 7) == 0 ? -1 : (int32_t)((r >> 3) % 10000);
+                    memcpy(&row[j], &value, sizeof(uint32_t));
+                    break;
+                }
+                case TYPE_FLOAT: {
+                    float value = (float)((r >> 3) % 100000) / 100.0f;
+                    memcpy(&row[j], &value, sizeof(uint32_t));
+                    break;
+                }
+                case TYPE_STRING:
+                    row[j] = synth_string(synth, &strings, &pool, &pool_count, &pool_capacity, j, &state);
+                    break;
+            }
+        }
+        if (fwrite(row, sizeof(uint32_t), synth->field_count, file) != synth->field_count) {
+            synth->error = "Failed to write DBC record";
+        }
+    }
+    if (!row) synth->error = "Could not allocate a record";
+
+    if (!synth->error && !synth->cancelled) {
+        header->string_block_size = (uint32_t)strings.size;
+        if (fwrite(strings.data, 1, strings.size, file) != strings.size || fseek(file, 0, SEEK_SET) != 0 ||
+            fwrite(header, sizeof(DBCHeader), 1, file) != 1) {
+            synth->error = "Failed to write DBC string block";
+        }
+    }
+    if (fclose(file) != 0 && !synth->error) synth->error = "Failed to write DBC file";
+    if (synth->error || synth->cancelled) remove(synth->path);
+
+    free(row);
+    free(pool);
+    dbc_buf_free(&strings);
+    return NULL;
+}
+
+// Unblocking function: Ctrl-C and Thread#kill stop generation at the next row
+static void synth_cancel(void *arg) {
+    ((Synth *)arg)->cancelled = 1;
+}
+
+static double synth_ratio(VALUE value, double fallback, const char *name) {
+    if (value == Qundef) return fallback;
+    double ratio = NUM2DBL(value);
+    if (!(ratio >= 0.0 && ratio <= 1.0)) rb_raise(rb_eArgError, "%s must be between 0 and 1", name);
+    return ratio;
+}
+
+// WowDBC::Synth.generate(path, rows:, schema:, string_ratio: 0.8, dup_ratio: 0.5, seed: 1) -> header
+//
+// Writes a DBC file of `rows` records with the columns of `schema`, a
+// field definitions hash as for DBCFile.new. The same arguments always
+// produce the same file. `string_ratio` is the share of string cells that
+// are not empty and `dup_ratio` the share of those that repeat an earlier
+// string. The file is generated with the GVL released; an interrupt or a
+// failed write stops it and removes the partial file.
+static VALUE synth_generate(int argc, VALUE *argv, VALUE self) {
+    VALUE path, options;
+    rb_scan_args(argc, argv, "1:", &path, &options);
+    ID keywords[5] = {rb_intern("rows"), rb_intern("schema"), rb_intern("string_ratio"), rb_intern("dup_ratio"),
+                      rb_intern("seed")};
+    VALUE values[5];
+    rb_get_kwargs(options, keywords, 2, 3, values);
+
+    long rows = NUM2LONG(values[0]);
+    if (rows < 0 || (unsigned long)rows > UINT32_MAX) rb_raise(rb_eArgError, "rows must fit in 32 bits");
+    VALUE schema = values[1];
+    Check_Type(schema, T_HASH);
+    VALUE field_types = rb_funcall(schema, rb_intern("values"), 0);
+    long field_count = RARRAY_LEN(field_types);
+    if (field_count == 0) rb_raise(rb_eArgError, "schema must have at least one field");
+
+    FieldType *types = ALLOCA_N(FieldType, field_count);
+    for (long j = 0; j < field_count; j++) {
+        VALUE field_type = rb_ary_entry(field_types, j);
+        types[j] = NIL_P(field_type) ? TYPE_UINT32 : ruby_to_field_type(field_type);
+    }
+
+    Synth synth;
+    memset(&synth, 0, sizeof(Synth));
+    synth.path = StringValueCStr(path);
+    synth.types = types;
+    synth.field_count = (uint32_t)field_count;
+    synth.rows = (uint32_t)rows;
+    synth.string_ratio = synth_ratio(values[2], 0.8, "string_ratio");
+    synth.dup_ratio = synth_ratio(values[3], 0.5, "dup_ratio");
+    synth.seed = values[4] == Qundef ? 1 : NUM2ULL(values[4]);
+
+    rb_thread_call_without_gvl(synth_generate_without_gvl, &synth, synth_cancel, &synth);
+    RB_GC_GUARD(path);
+    if (synth.cancelled) {
+        // Raises the pending Interrupt or kill; a trap handler may have
+        // consumed it instead
+        rb_thread_check_ints();
+        rb_raise(rb_eIOError, "Generation was interrupted: %s", synth.path);
+    }
+    if (synth.error) rb_raise(rb_eIOError, "%s: %s", synth.error, synth.path);
+
+    VALUE header = rb_hash_new();
+    rb_hash_aset(header, ID2SYM(rb_intern("magic")), rb_str_new(synth.header.magic, 4));
+    rb_hash_aset(header, ID2SYM(rb_intern("record_count")), UINT2NUM(synth.header.record_count));
+    rb_hash_aset(header, ID2SYM(rb_intern("field_count")), UINT2NUM(synth.header.field_count));
+    rb_hash_aset(header, ID2SYM(rb_intern("record_size")), UINT2NUM(synth.header.record_size));
+    rb_hash_aset(header, ID2SYM(rb_intern("string_block_size")), UINT2NUM(synth.header.string_block_size));
+    return header;
+}
+
+void Init_wow_dbc_synth(void) {
+    rb_mSynth = rb_define_module_under(rb_mWowDBC, "Synth");
+    rb_define_module_function(rb_mSynth, "generate", synth_generate, -1);
+}
@@ -0,0 +1,227 @@
+#include "wow_dbc.h"
+
+#include <stdlib.h>
+
+// Undo log for DBCFile#transaction. Mutations record what they overwrite
+// (old field words, appended rows, removed records) so a rollback only
+// touches what changed. String block appends need no entries: restoring
+// the header cuts the block back to its old length.
+
+static void undo_push(DBCFile *dbc, const DBCUndoEntry *entry) {
+    DBCUndoLog *undo = dbc->undo;
+    if (undo->count == undo->capacity) {
+        uint32_t capacity = undo->capacity ? undo->capacity * 2 : 64;
+        DBCUndoEntry *entries = realloc(undo->entries, capacity * sizeof(DBCUndoEntry));
+        if (!entries) {
+            rb_raise(rb_eNoMemError, "Could not grow the undo log");
+        }
+        undo->entries = entries;
+        undo->capacity = capacity;
+    }
+    undo->entries[undo->count++] = *entry;
+}
+
+// Called before a field is overwritten
+void dbc_undo_word(DBCFile *dbc, uint32_t row, uint32_t field) {
+    if (!dbc->undo) return;
+    DBCUndoEntry entry = {.op = DBC_UNDO_WORD, .row = row};
+    entry.old.word.field = field;
+    entry.old.word.value = dbc->records[row][field];
+    undo_push(dbc, &entry);
+}
+
+// Called after a record is appended at `row`
+void dbc_undo_insert(DBCFile *dbc, uint32_t row) {
+    if (!dbc->undo) return;
+    DBCUndoEntry entry = {.op = DBC_UNDO_INSERT, .row = row};
+    undo_push(dbc, &entry);
+}
+
+// Called before the record at `row` is removed. Returns 1 when the log
+// took the record, in which case the caller must not free it.
+int dbc_undo_delete(DBCFile *dbc, uint32_t row) {
+    if (!dbc->undo) return 0;
+    DBCUndoEntry entry = {.op = DBC_UNDO_DELETE, .row = row};
+    entry.old.deleted.record = dbc->records[row];
+    entry.old.deleted.shared = dbc->cow && dbc->cow[row];
+    undo_push(dbc, &entry);
+    return 1;
+}
+
+// Called before the records array is replaced wholesale. Returns 1 when
+// the log took the array, its shared row flags and every record in it.
+int dbc_undo_table(DBCFile *dbc, FieldValue **records, uint32_t record_count) {
+    if (!dbc->undo) return 0;
+    DBCUndoEntry entry = {.op = DBC_UNDO_TABLE, .row = record_count};
+    entry.old.table.records = records;
+    entry.old.table.cow = dbc->cow;
+    undo_push(dbc, &entry);
+    return 1;
+}
+
+// Frees the log and the records it still holds
+void dbc_undo_free(DBCUndoLog *undo) {
+    for (uint32_t k = 0; k < undo->count; k++) {
+        DBCUndoEntry *entry = &undo->entries[k];
+        if (entry->op == DBC_UNDO_DELETE) {
+            if (!entry->old.deleted.shared) dbc_arena_retire(undo->arena, entry->old.deleted.record);
+        } else if (entry->op == DBC_UNDO_TABLE) {
+            uint8_t *cow = entry->old.table.cow;
+            for (uint32_t i = 0; i < entry->row; i++) {
+                if (!cow || !cow[i]) dbc_arena_retire(undo->arena, entry->old.table.records[i]);
+            }
+            dbc_arena_retire(undo->arena, entry->old.table.records);
+            free(cow);
+        }
+    }
+    dbc_retire(undo->arena, (void (*)(void *))dbc_arena_release);
+    free(undo->entries);
+    free(undo);
+}
+
+typedef struct {
+    VALUE self;
+    DBCFile *dbc;
+    int outer;
+    uint32_t mark;     // log entries before this transaction
+    DBCHeader header;  // record count and string block length to go back to
+    int modified;
+    FieldType *types;  // column types while rolling back
+} Transaction;
+
+static VALUE rollback_column_types(VALUE arg) {
+    DBCFile *dbc = ((Transaction *)arg)->dbc;
+    dbc_column_types(dbc, ((Transaction *)arg)->types);
+    return Qnil;
+}
+
+// Column types for keeping the indexes in step with the rollback, looked
+// up before anything is undone. NULL when there are no indexes to keep or
+// the lookup failed, in which case they rebuild on the next lookup.
+static FieldType *rollback_types(Transaction *tx) {
+    DBCFile *dbc = tx->dbc;
+    if (dbc->index_count == 0 || dbc->indexes_stale) return NULL;
+    tx->types = malloc((dbc->header.field_count ? dbc->header.field_count : 1) * sizeof(FieldType));
+    int state = 0;
+    if (tx->types) rb_protect(rollback_column_types, (VALUE)tx, &state);
+    if (!tx->types || state) {
+        free(tx->types);
+        tx->types = NULL;
+        rb_set_errinfo(Qnil);
+        dbc->indexes_stale = 1;
+    }
+    return tx->types;
+}
+
+// Undoes the entries after the transaction's mark, newest first, and the
+// index changes that went with them. Cannot raise: deletes never shrink
+// the records array or the shared row flags, so a removed record always
+// has its slot to go back to. Snapshots can't be taken inside a
+// transaction, so the rows written or inserted here are never shared.
+static void transaction_rollback(Transaction *tx) {
+    DBCFile *dbc = tx->dbc;
+    DBCUndoLog *undo = dbc->undo;
+    uint32_t count = dbc->header.record_count;
+    int undone = undo->count > tx->mark;
+    const FieldType *types = undone ? rollback_types(tx) : NULL;
+
+    while (undo->count > tx->mark) {
+        DBCUndoEntry *entry = &undo->entries[--undo->count];
+        switch (entry->op) {
+            case DBC_UNDO_WORD: {
+                FieldValue *value = &dbc->records[entry->row][entry->old.word.field];
+                uint32_t key = value->value.uint32_value;
+                *value = entry->old.word.value;
+                if (types) dbc_indexes_undo_word(dbc, entry->row, entry->old.word.field, key, types);
+                break;
+            }
+            case DBC_UNDO_INSERT:
+                if (types) dbc_indexes_undo_insert(dbc, entry->row, types);
+                dbc_arena_retire(dbc->arena, dbc->records[entry->row]);
+                count = entry->row;
+                break;
+            case DBC_UNDO_DELETE:
+                memmove(&dbc->records[entry->row + 1], &dbc->records[entry->row],
+                        (count - entry->row) * sizeof(FieldValue *));
+                dbc->records[entry->row] = entry->old.deleted.record;
+                if (dbc->cow) {
+                    memmove(&dbc->cow[entry->row + 1], &dbc->cow[entry->row], count - entry->row);
+                    dbc->cow[entry->row] = (uint8_t)entry->old.deleted.shared;
+                }
+                count++;
+                if (types) dbc_indexes_undo_delete(dbc, entry->row, types);
+                break;
+            case DBC_UNDO_TABLE:
+                for (uint32_t i = 0; i < count; i++) dbc_arena_retire(dbc->arena, dbc->records[i]);
+                dbc_arena_retire(dbc->arena, dbc->records);
+                dbc->records = entry->old.table.records;
+                dbc->cow = entry->old.table.cow;
+                dbc->cow_capacity = entry->row;
+                dbc->record_capacity = 0;
+                count = entry->row;
+                // A patch replaced every row, so the indexes rebuild
+                dbc->indexes_stale = 1;
+                break;
+        }
+    }
+
+    free(tx->types);
+    tx->types = NULL;
+    dbc->header = tx->header;
+    dbc->modified = tx->modified || undo->written;
+    if (undone) dbc_change(dbc, DBC_CHANGE_RESET, DBC_CHANGE_NONE, DBC_CHANGE_NONE);
+}
+
+static VALUE transaction_body(VALUE arg) {
+    return rb_yield(((Transaction *)arg)->self);
+}
+
+static VALUE transaction_rescue(VALUE arg, VALUE error) {
+    transaction_rollback((Transaction *)arg);
+    rb_exc_raise(error);
+    return Qnil;
+}
+
+static VALUE transaction_run(VALUE arg) {
+    return rb_rescue2(transaction_body, arg, transaction_rescue, arg, rb_eException, (VALUE)0);
+}
+
+static VALUE transaction_end(VALUE arg) {
+    Transaction *tx = (Transaction *)arg;
+    if (tx->outer) {
+        dbc_undo_free(tx->dbc->undo);
+        tx->dbc->undo = NULL;
+    }
+    return Qnil;
+}
+
+// DBCFile#transaction { |dbc| ... } -> result of the block
+//
+// Runs the block and keeps its changes, or undoes them if the block raises.
+// Rollback costs time in proportion to the changes made, not to the size
+// of the table. Nested transactions roll back on their own and otherwise
+// become part of the enclosing one. `read` is not allowed inside.
+static VALUE dbc_transaction(VALUE self) {
+    rb_need_block();
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_transaction, 0, NULL, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    rb_check_frozen(self);
+
+    Transaction tx = {self, dbc, !dbc->undo, 0, dbc->header, dbc->modified, NULL};
+    if (tx.outer) {
+        dbc->undo = calloc(1, sizeof(DBCUndoLog));
+        if (!dbc->undo) {
+            rb_raise(rb_eNoMemError, "Could not allocate the undo log");
+        }
+        dbc->undo->arena = dbc_arena_retain(dbc->arena);
+    }
+    tx.mark = dbc->undo->count;
+
+    return rb_ensure(transaction_run, (VALUE)&tx, transaction_end, (VALUE)&tx);
+}
+
+void Init_wow_dbc_transaction(void) {
+    rb_define_method(rb_cDBCFile, "transaction", dbc_transaction, 0);
+}
@@ -1,79 +1,108 @@
-#include <ruby.h>
-#include <stdio.h>
-#include <stdint.h>
-#include <string.h>
-
-typedef enum {
-    TYPE_UINT32,
-    TYPE_INT32,
-    TYPE_FLOAT,
-    TYPE_STRING
-} FieldType;
+#include "wow_dbc.h"
 
-typedef struct {
-    FieldType type;
-    union {
-        uint32_t uint32_value;
-        int32_t int32_value;
-        float float_value;
-        uint32_t string_offset;
-    } value;
-} FieldValue;
+#include <ruby/thread.h>
+#include <stdlib.h>
 
-typedef struct {
-    char magic[4];
-    uint32_t record_count;
-    uint32_t field_count;
-    uint32_t record_size;
-    uint32_t string_block_size;
-} DBCHeader;
+VALUE rb_mWowDBC;
+VALUE rb_cDBCFile;
 
-typedef struct {
-    DBCHeader header;
-    FieldValue **records;
-    char *string_block;
-    VALUE field_definitions;  // Ruby hash of field names and types
-} DBCFile;
+// Frees the records and string block, leaving whatever is shared with
+// snapshots to their base. Readers may still hold them, so they are retired.
+// Rows in the arena go with it, so a table as read frees in O(chunks).
+void dbc_release_records(DBCFile *dbc) {
+    if (dbc->records && !dbc->records_shared) {
+        for (uint32_t i = 0; i < dbc->header.record_count && !dbc->rows_in_arena; i++) {
+            if (!dbc->cow || !dbc->cow[i]) dbc_arena_retire(dbc->arena, dbc->records[i]);
+        }
+        dbc_arena_retire(dbc->arena, dbc->records);
+    }
+    dbc->records = NULL;
+    if (dbc->string_block && !dbc->strings_shared) {
+        dbc_arena_retire(dbc->arena, dbc->string_block);
+    }
+    dbc->string_block = NULL;
+
+    free(dbc->cow);
+    dbc->cow = NULL;
+    dbc->cow_capacity = 0;
+    dbc_retire(dbc->cow_base, (void (*)(void *))dbc_cow_base_release);
+    dbc->cow_base = NULL;
+    dbc_retire(dbc->arena, (void (*)(void *))dbc_arena_release);
+    dbc->arena = NULL;
+    dbc->rows_in_arena = 0;
+    dbc->records_shared = 0;
+    dbc->strings_shared = 0;
+    dbc->record_capacity = 0;
+    dbc->string_capacity = 0;
+}
+
+// Makes room for `count` records, growing geometrically so appends stay
+// cheap when readers force the old array to be copied rather than resized
+void dbc_records_reserve(DBCFile *dbc, uint32_t count) {
+    dbc_cow_prepare(dbc);
+    if (count <= dbc->record_capacity) return;
+
+    uint32_t capacity = dbc->header.record_count + dbc->header.record_count / 2;
+    if (capacity < count) capacity = count;
+    if (capacity < 16) capacity = 16;
+    dbc->records = dbc_arena_grow(dbc->arena, dbc->records, (size_t)dbc->header.record_count * sizeof(FieldValue *),
+                                  (size_t)capacity * sizeof(FieldValue *));
+    dbc->record_capacity = capacity;
+}
 
-static VALUE rb_mWowDBC;
-static VALUE rb_cDBCFile;
+// Swaps in records and a string block built elsewhere (imports, snapshots),
+// taking ownership of both.
+void dbc_install(DBCFile *dbc, const DBCHeader *header, FieldValue **records, char *string_block) {
+    dbc_release_records(dbc);
+    dbc->header = *header;
+    dbc->records = records;
+    dbc->string_block = string_block;
+    dbc_mark_modified(dbc);
+    dbc_change(dbc, DBC_CHANGE_RESET, DBC_CHANGE_NONE, DBC_CHANGE_NONE);
+}
+
+// Size of the table as a DBC file
+uint64_t dbc_file_size(const DBCFile *dbc) {
+    return sizeof(DBCHeader) + (uint64_t)dbc->header.record_count * dbc->header.field_count * sizeof(uint32_t) +
+           dbc->header.string_block_size;
+}
+
+// Called by mutations that replace the records wholesale: indexes rebuild
+// lazily, and the records no longer match the file at @filepath until the
+// next read or write. Creating, updating and deleting single records
+// update the indexes in place instead.
+void dbc_mark_modified(DBCFile *dbc) {
+    dbc->indexes_stale = 1;
+    dbc->modified = 1;
+}
 
 static void dbc_free(void *ptr) {
     DBCFile *dbc = (DBCFile *)ptr;
-    if (dbc->records) {
-        for (uint32_t i = 0; i < dbc->header.record_count; i++) {
-            free(dbc->records[i]);
-        }
-        free(dbc->records);
-    }
-    if (dbc->string_block) {
-        free(dbc->string_block);
+    if (dbc->undo) dbc_undo_free(dbc->undo);
+    if (dbc->changes) {
+        free(dbc->changes->entries);
+        free(dbc->changes);
     }
+    dbc_release_records(dbc);
+    dbc_indexes_clear(dbc);
     free(dbc);
 }
 
-static size_t dbc_memsize(const void *ptr) {
-    const DBCFile *dbc = (const DBCFile *)ptr;
-    return sizeof(DBCFile) +
-           (dbc->header.record_count * sizeof(FieldValue *)) +
-           (dbc->header.record_count * dbc->header.field_count * sizeof(FieldValue)) +
-           dbc->header.string_block_size;
-}
-
-static const rb_data_type_t dbc_data_type = {
+const rb_data_type_t dbc_data_type = {
     "WowDBC::DBCFile",
     {NULL, dbc_free, dbc_memsize,},
     0, 0,
-    RUBY_TYPED_FREE_IMMEDIATELY,
+    RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_FROZEN_SHAREABLE,
 };
 
 static VALUE dbc_alloc(VALUE klass) {
     DBCFile *dbc = ALLOC(DBCFile);
     memset(dbc, 0, sizeof(DBCFile));
+    dbc->modified = 1;
     return TypedData_Wrap_Struct(klass, &dbc_data_type, dbc);
 }
 
-static FieldType ruby_to_field_type(VALUE type_value) {
+FieldType ruby_to_field_type(VALUE type_value) {
     ID type_id;
 
     if (RB_TYPE_P(type_value, T_SYMBOL)) {
@@ -92,6 +121,31 @@ static FieldType ruby_to_field_type(VALUE type_value) {
     rb_raise(rb_eArgError, "Invalid field type: %s", rb_id2name(type_id));
 }
 
+VALUE field_type_to_symbol(FieldType type) {
+    switch (type) {
+        case TYPE_UINT32:
+            return ID2SYM(rb_intern("uint32"));
+        case TYPE_INT32:
+            return ID2SYM(rb_intern("int32"));
+        case TYPE_FLOAT:
+            return ID2SYM(rb_intern("float"));
+        case TYPE_STRING:
+            return ID2SYM(rb_intern("string"));
+    }
+    return Qnil;
+}
+
+// Resolves the type of every column from the field definitions, defaulting
+// to UINT32 like dbc_read does. Per-value types can't be trusted for this
+// since create_record leaves them zeroed.
+void dbc_column_types(const DBCFile *dbc, FieldType *types) {
+    VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
+    for (uint32_t j = 0; j < dbc->header.field_count; j++) {
+        VALUE field_type = rb_hash_aref(dbc->field_definitions, rb_ary_entry(field_names, j));
+        types[j] = NIL_P(field_type) ? TYPE_UINT32 : ruby_to_field_type(field_type);
+    }
+}
+
 static VALUE dbc_initialize(VALUE self, VALUE filepath, VALUE field_definitions) {
     DBCFile *dbc;
     TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
@@ -103,80 +157,158 @@ static VALUE dbc_initialize(VALUE self, VALUE filepath, VALUE field_definitions)
     return self;
 }
 
-static VALUE dbc_read(VALUE self) {
-    DBCFile *dbc;
-    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+typedef struct {
+    const char *path;
+    const FieldType *types;  // types of the defined fields, UINT32 past them
+    uint32_t type_count;
+    DBCHeader header;
+    DBCArena *arena;         // holds the records array, rows and string block
+    FieldValue **records;
+    char *string_block;
+    const char *error;       // IOError message when the file can't be read
+} DBCLoad;
+
+static void dbc_load_free(DBCLoad *load) {
+    dbc_arena_release(load->arena);
+    load->arena = NULL;
+    load->records = NULL;
+    load->string_block = NULL;
+}
 
-    VALUE filepath = rb_iv_get(self, "@filepath");
-    FILE *file = fopen(StringValueCStr(filepath), "rb");
+// Reads and decodes a DBC file without touching Ruby, so it can run with
+// the GVL released. Sets `error` and frees what it allocated on failure.
+static void *dbc_load_without_gvl(void *arg) {
+    DBCLoad *load = (DBCLoad *)arg;
+    FILE *file = fopen(load->path, "rb");
     if (!file) {
-        rb_raise(rb_eIOError, "Could not open file");
+        load->error = "Could not open file";
+        return NULL;
     }
-
-    if (fread(&dbc->header, sizeof(DBCHeader), 1, file) != 1) {
+    if (fread(&load->header, sizeof(DBCHeader), 1, file) != 1) {
         fclose(file);
-        rb_raise(rb_eIOError, "Failed to read DBC header");
-    }
-
-    if (dbc->records) {
-        for (uint32_t i = 0; i < dbc->header.record_count; i++) {
-            free(dbc->records[i]);
+        load->error = "Failed to read DBC header";
+        return NULL;
+    }
+
+    uint32_t record_count = load->header.record_count;
+    uint32_t field_count = load->header.field_count;
+    size_t array_size = (size_t)(record_count ? record_count : 1) * sizeof(FieldValue *);
+    size_t row_size = (size_t)(field_count ? field_count : 1) * sizeof(FieldValue);
+    size_t rows_size = (size_t)record_count * row_size;
+    size_t strings_size = load->header.string_block_size ? load->header.string_block_size : 1;
+    // Records are read in batches of about 64 KiB
+    size_t row_bytes = (size_t)(field_count ? field_count : 1) * sizeof(uint32_t);
+    uint32_t batch = row_bytes < 65536 ? (uint32_t)(65536 / row_bytes) : 1;
+    uint32_t *values = malloc(batch * row_bytes);
+    // Room for the alignment of each of the three parts
+    load->arena = dbc_arena_new(array_size + rows_size + strings_size + 3 * 16);
+    FieldValue *rows = NULL;
+    if (load->arena) {
+        load->records = dbc_arena_alloc(load->arena, array_size);
+        rows = dbc_arena_alloc(load->arena, rows_size ? rows_size : 1);
+    }
+    if (!values || !load->records || !rows) {
+        free(values);
+        fclose(file);
+        dbc_load_free(load);
+        load->error = "Could not allocate records";
+        return NULL;
+    }
+
+    for (uint32_t first = 0; first < record_count; first += batch) {
+        uint32_t n = record_count - first < batch ? record_count - first : batch;
+        size_t words = (size_t)n * field_count;
+        if (fread(values, sizeof(uint32_t), words, file) != words) {
+            free(values);
+            fclose(file);
+            dbc_load_free(load);
+            load->error = "Failed to read DBC record field";
+            return NULL;
         }
-        free(dbc->records);
-    }
-
-    dbc->records = ALLOC_N(FieldValue *, dbc->header.record_count);
-    VALUE field_definitions = rb_iv_get(self, "@field_definitions");
-    VALUE field_names = rb_funcall(field_definitions, rb_intern("keys"), 0);
-
-    for (uint32_t i = 0; i < dbc->header.record_count; i++) {
-        dbc->records[i] = ALLOC_N(FieldValue, dbc->header.field_count);
-        for (uint32_t j = 0; j < dbc->header.field_count; j++) {
-            VALUE field_name = rb_ary_entry(field_names, j);
-            VALUE field_type = rb_hash_aref(field_definitions, field_name);
-
-            FieldType type;
-            if (NIL_P(field_type)) {
-                type = TYPE_UINT32;  // Default to UINT32 if type is nil
-            } else {
-                type = ruby_to_field_type(field_type);
-            }
-            dbc->records[i][j].type = type;
-
-            if (fread(&dbc->records[i][j].value, sizeof(uint32_t), 1, file) != 1) {
-                fclose(file);
-                rb_raise(rb_eIOError, "Failed to read DBC record field");
-            }
-
-            switch (type) {
-                case TYPE_UINT32:
-                    break;
-                case TYPE_INT32:
-                    break;
-                case TYPE_FLOAT:
-                    break;
-                case TYPE_STRING:
-                    break;
+        for (uint32_t k = 0; k < n; k++) {
+            FieldValue *record = (FieldValue *)((char *)rows + (size_t)(first + k) * row_size);
+            const uint32_t *row = values + (size_t)k * field_count;
+            load->records[first + k] = record;
+            for (uint32_t j = 0; j < field_count; j++) {
+                record[j].type = j < load->type_count ? load->types[j] : TYPE_UINT32;
+                record[j].value.uint32_value = row[j];
             }
         }
     }
+    free(values);
 
-    if (dbc->string_block) {
-        free(dbc->string_block);
-    }
-
-    dbc->string_block = ALLOC_N(char, dbc->header.string_block_size);
-    if (fread(dbc->string_block, 1, dbc->header.string_block_size, file) != dbc->header.string_block_size) {
+    load->string_block = dbc_arena_alloc(load->arena, strings_size);
+    if (!load->string_block ||
+        fread(load->string_block, 1, load->header.string_block_size, file) != load->header.string_block_size) {
+        load->error = load->string_block ? "Failed to read DBC string block" : "Could not allocate the string block";
         fclose(file);
-        rb_raise(rb_eIOError, "Failed to read DBC string block");
+        dbc_load_free(load);
+        return NULL;
     }
 
     fclose(file);
+    return NULL;
+}
+
+// DBCFile#read -> self
+//
+// Loads the file at @filepath, replacing the records. The file is decoded
+// with the GVL released, and the table is left as it was if that fails.
+// Records and strings land in one arena sized from the header.
+static VALUE dbc_read(VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_read, 0, NULL, &guarded)) return guarded;
+    DBCFile *dbc;
+    TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+
+    rb_check_frozen(self);
+    if (dbc->undo) {
+        rb_raise(rb_eRuntimeError, "Cannot read inside a transaction");
+    }
+
+    VALUE filepath = rb_iv_get(self, "@filepath");
+    VALUE field_definitions = rb_iv_get(self, "@field_definitions");
+    VALUE field_types = rb_funcall(field_definitions, rb_intern("values"), 0);
+    uint32_t type_count = (uint32_t)RARRAY_LEN(field_types);
+    FieldType *types = ALLOCA_N(FieldType, type_count ? type_count : 1);
+    for (uint32_t j = 0; j < type_count; j++) {
+        VALUE field_type = rb_ary_entry(field_types, j);
+        types[j] = NIL_P(field_type) ? TYPE_UINT32 : ruby_to_field_type(field_type);  // Default to UINT32 if type is nil
+    }
+
+    DBCLoad load;
+    memset(&load, 0, sizeof(DBCLoad));
+    load.path = StringValueCStr(filepath);
+    load.types = types;
+    load.type_count = type_count;
+
+    // Taken before reading so a concurrent rewrite shows up as a change
+    DBCStamp stamp;
+    dbc_stamp_path(load.path, &stamp);
+    rb_thread_call_without_gvl(dbc_load_without_gvl, &load, NULL, NULL);
+    RB_GC_GUARD(filepath);
+    if (load.error) {
+        rb_raise(rb_eIOError, "%s", load.error);
+    }
+
+    dbc_release_records(dbc);
+    dbc->header = load.header;
+    dbc->records = load.records;
+    dbc->string_block = load.string_block;
+    dbc->arena = load.arena;
+    dbc->rows_in_arena = 1;
+    dbc->indexes_stale = 1;
+    dbc->modified = 0;
+    dbc->stamp = stamp;
+    dbc_change(dbc, DBC_CHANGE_RESET, DBC_CHANGE_NONE, DBC_CHANGE_NONE);
+    DBC_COUNT(DBC_BYTES_READ, dbc_file_size(dbc));
 
     return self;
 }
 
 static VALUE dbc_write(VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_write, 0, NULL, &guarded)) return guarded;
     DBCFile *dbc;
     TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
 
@@ -206,6 +338,12 @@ static VALUE dbc_write(VALUE self) {
     }
 
     fclose(file);
+    DBC_COUNT(DBC_BYTES_WRITTEN, dbc_file_size(dbc));
+    // Frozen tables may be shared between Ractors, so they keep no record
+    if (OBJ_FROZEN(self)) return self;
+    dbc->modified = 0;
+    if (dbc->undo) dbc->undo->written = 1;
+    dbc_stamp_path(StringValueCStr(filepath), &dbc->stamp);
     return self;
 }
 
@@ -223,6 +361,23 @@ static VALUE field_value_to_ruby(FieldValue *value, char *string_block) {
     return Qnil;
 }
 
+VALUE dbc_record_to_hash(DBCFile *dbc, uint32_t index, VALUE field_names) {
+    VALUE record = rb_hash_new();
+    for (uint32_t i = 0; i < dbc->header.field_count; i++) {
+        VALUE field_name = rb_ary_entry(field_names, i);
+        rb_hash_aset(record, field_name, field_value_to_ruby(&dbc->records[index][i], dbc->string_block));
+    }
+    return record;
+}
+
+// Position of `field` in the field definitions, or -1
+long dbc_field_index(DBCFile *dbc, VALUE field_names, VALUE field) {
+    for (long i = 0; i < RARRAY_LEN(field_names) && (uint32_t)i < dbc->header.field_count; i++) {
+        if (rb_eql(rb_ary_entry(field_names, i), field)) return i;
+    }
+    return -1;
+}
+
 static void ruby_to_field_value(VALUE ruby_value, FieldType type, FieldValue *field_value) {
     field_value->type = type;
     switch (type) {
@@ -242,22 +397,34 @@ static void ruby_to_field_value(VALUE ruby_value, FieldType type, FieldValue *fi
 }
 
 static VALUE dbc_create_record(VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_create_record, 0, NULL, &guarded)) return guarded;
     DBCFile *dbc;
     TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    rb_check_frozen(self);
 
     uint32_t new_count = dbc->header.record_count + 1;
-    REALLOC_N(dbc->records, FieldValue *, new_count);
+    dbc_records_reserve(dbc, new_count);
     dbc->records[new_count - 1] = ALLOC_N(FieldValue, dbc->header.field_count);
+    dbc->rows_in_arena = 0;
     memset(dbc->records[new_count - 1], 0, dbc->header.field_count * sizeof(FieldValue));
 
     dbc->header.record_count = new_count;
+    dbc_cow_grow(dbc, new_count);
+    dbc_undo_insert(dbc, new_count - 1);
+    dbc->modified = 1;
+    dbc_indexes_insert(dbc, new_count - 1);
+    dbc_change(dbc, DBC_CHANGE_CREATE, new_count - 1, DBC_CHANGE_NONE);
 
     return INT2FIX(new_count - 1);
 }
 
 static VALUE dbc_update_record(VALUE self, VALUE index, VALUE field, VALUE value) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_update_record, 3, ((VALUE[]){index, field, value}), &guarded)) return guarded;
     DBCFile *dbc;
     TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    rb_check_frozen(self);
 
     long idx = FIX2LONG(index);
     long field_idx = -1;
@@ -276,6 +443,8 @@ static VALUE dbc_update_record(VALUE self, VALUE index, VALUE field, VALUE value
 
     VALUE field_type = rb_hash_aref(dbc->field_definitions, field);
     FieldType type = ruby_to_field_type(field_type);
+    dbc->modified = 1;
+    FieldValue converted;
 
     if (type == TYPE_STRING) {
         // For string fields, we need to update the string block
@@ -283,20 +452,31 @@ static VALUE dbc_update_record(VALUE self, VALUE index, VALUE field, VALUE value
         uint32_t offset = dbc->header.string_block_size;
         uint32_t str_len = strlen(str) + 1;
 
-        dbc->string_block = realloc(dbc->string_block, dbc->header.string_block_size + str_len);
+        dbc_strings_reserve(dbc, str_len);
         memcpy(dbc->string_block + offset, str, str_len);
         dbc->header.string_block_size += str_len;
 
-        dbc->records[idx][field_idx].type = TYPE_STRING;
-        dbc->records[idx][field_idx].value.string_offset = offset;
+        converted.type = TYPE_STRING;
+        converted.value.string_offset = offset;
+        dbc_cow_row(dbc, (uint32_t)idx);
+        dbc_undo_word(dbc, (uint32_t)idx, (uint32_t)field_idx);
     } else {
-        ruby_to_field_value(value, type, &dbc->records[idx][field_idx]);
+        dbc_cow_row(dbc, (uint32_t)idx);
+        dbc_undo_word(dbc, (uint32_t)idx, (uint32_t)field_idx);
+        ruby_to_field_value(value, type, &converted);
     }
+    // Read after converting, which may have called back into Ruby
+    uint32_t old_key = dbc->records[idx][field_idx].value.uint32_value;
+    dbc->records[idx][field_idx] = converted;
+    dbc_indexes_update(dbc, (uint32_t)idx, (uint32_t)field_idx, old_key);
+    dbc_change(dbc, DBC_CHANGE_UPDATE, (uint32_t)idx, (uint32_t)field_idx);
 
     return Qnil;
 }
 
 static VALUE dbc_get_record(VALUE self, VALUE index) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_get_record, 1, &index, &guarded)) return guarded;
     DBCFile *dbc;
     TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
 
@@ -306,17 +486,13 @@ static VALUE dbc_get_record(VALUE self, VALUE index) {
         rb_raise(rb_eArgError, "Invalid record index");
     }
 
-    VALUE record = rb_hash_new();
     VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
-    for (uint32_t i = 0; i < dbc->header.field_count; i++) {
-        VALUE field_name = rb_ary_entry(field_names, i);
-        rb_hash_aset(record, field_name, field_value_to_ruby(&dbc->records[idx][i], dbc->string_block));
-    }
-
-    return record;
+    return dbc_record_to_hash(dbc, (uint32_t)idx, field_names);
 }
 
 static VALUE dbc_get_header(VALUE self) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_get_header, 0, NULL, &guarded)) return guarded;
     DBCFile *dbc;
     TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
 
@@ -331,8 +507,11 @@ static VALUE dbc_get_header(VALUE self) {
 }
 
 static VALUE dbc_update_record_multi(VALUE self, VALUE index, VALUE updates) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_update_record_multi, 2, ((VALUE[]){index, updates}), &guarded)) return guarded;
     DBCFile *dbc;
     TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    rb_check_frozen(self);
 
     long idx = FIX2LONG(index);
 
@@ -358,7 +537,15 @@ static VALUE dbc_update_record_multi(VALUE self, VALUE index, VALUE updates) {
             if (field_idx >= 0 && (uint32_t)field_idx < dbc->header.field_count) {
                 VALUE field_type = rb_hash_aref(dbc->field_definitions, key);
                 FieldType type = ruby_to_field_type(field_type);
-                ruby_to_field_value(value, type, &dbc->records[idx][field_idx]);
+                dbc_cow_row(dbc, (uint32_t)idx);
+                dbc_undo_word(dbc, (uint32_t)idx, (uint32_t)field_idx);
+                FieldValue converted;
+                ruby_to_field_value(value, type, &converted);
+                uint32_t old_key = dbc->records[idx][field_idx].value.uint32_value;
+                dbc->records[idx][field_idx] = converted;
+                dbc->modified = 1;
+                dbc_indexes_update(dbc, (uint32_t)idx, (uint32_t)field_idx, old_key);
+                dbc_change(dbc, DBC_CHANGE_UPDATE, (uint32_t)idx, (uint32_t)field_idx);
             } else {
                 rb_raise(rb_eArgError, "Invalid field name: %"PRIsVALUE, key);
             }
@@ -371,8 +558,11 @@ static VALUE dbc_update_record_multi(VALUE self, VALUE index, VALUE updates) {
 }
 
 static VALUE dbc_delete_record(VALUE self, VALUE index) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_delete_record, 1, &index, &guarded)) return guarded;
     DBCFile *dbc;
     TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    rb_check_frozen(self);
 
     long idx = FIX2LONG(index);
 
@@ -380,14 +570,23 @@ static VALUE dbc_delete_record(VALUE self, VALUE index) {
         rb_raise(rb_eArgError, "Invalid record index");
     }
 
-    free(dbc->records[idx]);
+    dbc_cow_prepare(dbc);
+    int logged = dbc_undo_delete(dbc, (uint32_t)idx);
+    // The indexes still need the record's keys
+    dbc_indexes_delete(dbc, (uint32_t)idx);
+    if (!logged && !(dbc->cow && dbc->cow[idx])) dbc_arena_retire(dbc->arena, dbc->records[idx]);
     memmove(&dbc->records[idx], &dbc->records[idx + 1], (dbc->header.record_count - idx - 1) * sizeof(FieldValue *));
+    if (dbc->cow) memmove(&dbc->cow[idx], &dbc->cow[idx + 1], dbc->header.record_count - idx - 1);
     dbc->header.record_count--;
+    dbc->modified = 1;
+    dbc_change(dbc, DBC_CHANGE_DELETE, (uint32_t)idx, DBC_CHANGE_NONE);
 
     return Qnil;
 }
 
 static VALUE dbc_find_by(VALUE self, VALUE field, VALUE value) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_find_by, 2, ((VALUE[]){field, value}), &guarded)) return guarded;
     DBCFile *dbc;
     TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
 
@@ -405,17 +604,15 @@ static VALUE dbc_find_by(VALUE self, VALUE field, VALUE value) {
         rb_raise(rb_eArgError, "Invalid field name");
     }
 
-    VALUE result = rb_ary_new();
+    VALUE result = dbc_index_lookup(dbc, (uint32_t)field_idx, value, field_names);
+    if (result != Qundef) return result;
 
+    DBC_COUNT(DBC_ROWS_SCANNED, dbc->header.record_count);
+    result = rb_ary_new();
     for (uint32_t i = 0; i < dbc->header.record_count; i++) {
         VALUE field_value = field_value_to_ruby(&dbc->records[i][field_idx], dbc->string_block);
         if (rb_eql(field_value, value)) {
-            VALUE record = rb_hash_new();
-            for (uint32_t j = 0; j < dbc->header.field_count; j++) {
-                VALUE field_name = rb_ary_entry(field_names, j);
-                rb_hash_aset(record, field_name, field_value_to_ruby(&dbc->records[i][j], dbc->string_block));
-            }
-            rb_ary_push(result, record);
+            rb_ary_push(result, dbc_record_to_hash(dbc, i, field_names));
         }
     }
 
@@ -423,6 +620,8 @@ static VALUE dbc_find_by(VALUE self, VALUE field, VALUE value) {
 }
 
 static VALUE dbc_write_to(VALUE self, VALUE new_filepath) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_READER, (DBCMethod)dbc_write_to, 1, &new_filepath, &guarded)) return guarded;
     DBCFile *dbc;
     TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
 
@@ -454,12 +653,16 @@ static VALUE dbc_write_to(VALUE self, VALUE new_filepath) {
     }
 
     fclose(file);
+    DBC_COUNT(DBC_BYTES_WRITTEN, dbc_file_size(dbc));
     return self;
 }
 
 static VALUE dbc_create_record_with_values(VALUE self, VALUE values) {
+    VALUE guarded;
+    if (dbc_guard(self, DBC_WRITER, (DBCMethod)dbc_create_record_with_values, 1, &values, &guarded)) return guarded;
     DBCFile *dbc;
     TypedData_Get_Struct(self, DBCFile, &dbc_data_type, dbc);
+    rb_check_frozen(self);
 
     if (!RB_TYPE_P(values, T_HASH)) {
         rb_raise(rb_eArgError, "Values must be a hash");
@@ -475,8 +678,9 @@ static VALUE dbc_create_record_with_values(VALUE self, VALUE values) {
     }
 
     uint32_t new_count = dbc->header.record_count + 1;
-    REALLOC_N(dbc->records, FieldValue *, new_count);
+    dbc_records_reserve(dbc, new_count);
     dbc->records[new_count - 1] = ALLOC_N(FieldValue, dbc->header.field_count);
+    dbc->rows_in_arena = 0;
 
     VALUE field_names = rb_funcall(dbc->field_definitions, rb_intern("keys"), 0);
     for (uint32_t i = 0; i < dbc->header.field_count; i++) {
@@ -505,7 +709,7 @@ static VALUE dbc_create_record_with_values(VALUE self, VALUE values) {
                 uint32_t offset = dbc->header.string_block_size;
                 uint32_t str_len = strlen(str) + 1;
 
-                dbc->string_block = realloc(dbc->string_block, dbc->header.string_block_size + str_len);
+                dbc_strings_reserve(dbc, str_len);
                 memcpy(dbc->string_block + offset, str, str_len);
                 dbc->header.string_block_size += str_len;
 
@@ -519,11 +723,17 @@ static VALUE dbc_create_record_with_values(VALUE self, VALUE values) {
     }
 
     dbc->header.record_count = new_count;
+    dbc_cow_grow(dbc, new_count);
+    dbc_undo_insert(dbc, new_count - 1);
+    dbc->modified = 1;
+    dbc_indexes_insert(dbc, new_count - 1);
+    dbc_change(dbc, DBC_CHANGE_CREATE, new_count - 1, DBC_CHANGE_NONE);
 
     return INT2FIX(new_count - 1);
 }
 
 void Init_wow_dbc(void) {
+    rb_ext_ractor_safe(true);
     rb_mWowDBC = rb_define_module("WowDBC");
     rb_cDBCFile = rb_define_class_under(rb_mWowDBC, "DBCFile", rb_cObject);
     rb_define_alloc_func(rb_cDBCFile, dbc_alloc);
@@ -539,4 +749,29 @@ void Init_wow_dbc(void) {
     rb_define_method(rb_cDBCFile, "get_record", dbc_get_record, 1);
     rb_define_method(rb_cDBCFile, "header", dbc_get_header, 0);
     rb_define_method(rb_cDBCFile, "find_by", dbc_find_by, 2);
+
+    Init_wow_dbc_schema();
+    Init_wow_dbc_arrow();
+    Init_wow_dbc_parquet();
+    Init_wow_dbc_csv();
+    Init_wow_dbc_sql();
+    Init_wow_dbc_sqlite();
+    Init_wow_dbc_json();
+    Init_wow_dbc_index();
+    Init_wow_dbc_snapshot();
+    Init_wow_dbc_sidecar();
+    Init_wow_dbc_hash();
+    Init_wow_dbc_diff();
+    Init_wow_dbc_patch();
+    Init_wow_dbc_merge();
+    Init_wow_dbc_transaction();
+    Init_wow_dbc_cow();
+    Init_wow_dbc_epoch();
+    Init_wow_dbc_ractor();
+    Init_wow_dbc_shm();
+    Init_wow_dbc_catalog();
+    Init_wow_dbc_changelog();
+    Init_wow_dbc_synth();
+    Init_wow_dbc_instrument();
+    Init_wow_dbc_memory();
 }
\ No newline at end of file
@@ -0,0 +1,444 @@
+#ifndef WOW_DBC_H
+#define WOW_DBC_H
+
+#include <ruby.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum {
+    TYPE_UINT32,
+    TYPE_INT32,
+    TYPE_FLOAT,
+    TYPE_STRING
+} FieldType;
+
+typedef struct {
+    FieldType type;
+    union {
+        uint32_t uint32_value;
+        int32_t int32_value;
+        float float_value;
+        uint32_t string_offset;
+    } value;
+} FieldValue;
+
+typedef struct {
+    char magic[4];
+    uint32_t record_count;
+    uint32_t field_count;
+    uint32_t record_size;
+    uint32_t string_block_size;
+} DBCHeader;
+
+typedef enum {
+    DBC_INDEX_DIRECT,  // ID direct table: heads[key - min]
+    DBC_INDEX_HASH,
+    DBC_INDEX_SORTED
+} DBCIndexType;
+
+// A read-only file mapping shared by the indexes loaded from it
+typedef struct {
+    void *addr;
+    size_t size;
+    uint32_t refs;
+} DBCMapping;
+
+// Indexes are flat uint32 arrays so they can be written to disk and used
+// straight from a mapping. Direct and hash indexes store `bucket_count`
+// chain heads followed by one `next` link per record, both as row + 1
+// with 0 ending the chain. Sorted indexes store `entry_count` row numbers
+// in key order (NaN floats are left out).
+typedef struct {
+    uint32_t field;
+    DBCIndexType requested;  // as declared by build_index
+    DBCIndexType type;       // as built; direct falls back to hash
+    uint32_t min;           // direct: smallest key
+    uint32_t bucket_count;  // direct: key range, hash: power of two
+    uint32_t record_count;
+    uint32_t entry_count;
+    uint32_t *words;
+    DBCMapping *mapping;    // set when words point into a mapped file
+    size_t capacity;        // words allocated on the heap, 0 when mapped
+    int stale;              // rebuilt on the next lookup
+} DBCIndex;
+
+// Size and modification time of a file, used to tell whether it changed
+typedef struct {
+    uint64_t size;
+    uint64_t mtime;  // nanoseconds
+} DBCStamp;
+
+typedef enum {
+    DBC_UNDO_WORD,    // a field was overwritten
+    DBC_UNDO_INSERT,  // a record was appended
+    DBC_UNDO_DELETE,  // a record was removed, the log keeps it
+    DBC_UNDO_TABLE    // the records array was replaced, the log keeps it
+} DBCUndoOp;
+
+typedef struct {
+    DBCUndoOp op;
+    uint32_t row;  // table: record count of the replaced array
+    union {
+        struct {
+            uint32_t field;
+            FieldValue value;
+        } word;
+        struct {
+            FieldValue *record;
+            int shared;      // the record belongs to a snapshot base
+        } deleted;
+        struct {
+            FieldValue **records;
+            uint8_t *cow;    // shared rows of the replaced array, or NULL
+        } table;
+    } old;
+} DBCUndoEntry;
+
+// Chunked bump allocator holding what DBCFile#read loads, see arena.c
+typedef struct DBCArenaChunk DBCArenaChunk;
+
+typedef struct {
+    uint32_t refs;
+    DBCArenaChunk *chunks;  // newest first
+    size_t size;            // bytes of all chunks
+} DBCArena;
+
+// Changes made inside DBCFile#transaction, undone newest first on rollback.
+// String block appends are undone by restoring the header, which also
+// records the tail length.
+typedef struct {
+    DBCUndoEntry *entries;
+    uint32_t count;
+    uint32_t capacity;
+    int written;  // #write ran, so the file no longer matches the old records
+    DBCArena *arena;  // the table's arena when the log started, for the rows it keeps
+} DBCUndoLog;
+
+typedef enum {
+    DBC_CHANGE_UPDATE,
+    DBC_CHANGE_CREATE,
+    DBC_CHANGE_DELETE,
+    DBC_CHANGE_RESET   // the whole table was replaced
+} DBCChangeOp;
+
+#define DBC_CHANGE_NONE UINT32_MAX  // row or field not given
+
+typedef struct {
+    uint32_t op;
+    uint32_t row;
+    uint32_t field;
+} DBCChange;
+
+// Ring of the most recent changes, set by DBCFile#track_changes. Entry n
+// of the sequence lives in slot n & mask until capacity later entries
+// overwrite it.
+typedef struct {
+    DBCChange *entries;
+    uint32_t mask;   // capacity - 1, capacity a power of two
+    uint64_t next;   // sequence number of the next entry
+} DBCChangeLog;
+
+// Records and string block frozen by DBCFile#snapshot. Snapshot views
+// read them, and the live table shares them until it writes. A base frees
+// what it owns when the last view and the live table let go of it; rows
+// and strings it took over while they were still shared belong to
+// `parent`.
+typedef struct DBCCowBase {
+    uint32_t refs;
+    struct DBCCowBase *parent;
+    FieldValue **records;
+    uint32_t record_count;
+    uint8_t *borrowed;   // rows owned by the parent, or NULL for none
+    char *string_block;
+    int owns_strings;
+    DBCMapping *mapping;  // rows and strings live in this mapping, see shm.c
+    DBCArena *arena;      // arena of the table the base was taken from
+} DBCCowBase;
+
+typedef struct {
+    DBCHeader header;
+    FieldValue **records;
+    char *string_block;
+    VALUE field_definitions;  // Ruby hash of field names and types
+    DBCIndex *indexes;
+    uint32_t index_count;
+    int indexes_stale;        // every index rebuilds lazily; see also DBCIndex.stale
+    int modified;             // records differ from the file at @filepath
+    DBCStamp stamp;           // @filepath as of the last read or write
+    DBCUndoLog *undo;         // set inside a transaction
+    DBCCowBase *cow_base;     // base shared with snapshots, if any
+    uint8_t *cow;             // rows still shared with cow_base, or NULL
+    uint32_t cow_capacity;    // flags allocated in `cow`, never below record_capacity
+    int records_shared;       // `records` is the base's array (all rows shared)
+    int strings_shared;       // `string_block` is the base's block
+    uint32_t record_capacity; // slots allocated in `records`, 0 if unknown
+    uint32_t string_capacity; // bytes allocated in `string_block`, 0 if unknown
+    int concurrent;           // set by #concurrent!
+    int writing;              // 1 while a guarded writer runs, 2 if readers rebuilt indexes meanwhile
+    DBCChangeLog *changes;    // set by #track_changes
+    DBCArena *arena;          // holds what #read loaded, or NULL
+    int rows_in_arena;        // every row the table owns is in `arena`
+} DBCFile;
+
+typedef enum {
+    DBC_READER,  // runs alongside other readers and writers
+    DBC_WRITER   // runs alone among writers
+} DBCAccess;
+
+typedef VALUE (*DBCMethod)(ANYARGS);
+
+// Read-only view of a DBC file loaded straight from disk, used by the
+// operations that work on files rather than on a DBCFile instance.
+typedef struct {
+    DBCHeader header;
+    uint8_t *data;
+    size_t size;
+    const uint32_t *records;
+    const char *string_block;
+    uint32_t columns;
+} DBCRaw;
+
+typedef struct {
+    uint32_t *slots;
+    uint32_t slot_mask;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *offsets;
+    uint32_t *lengths;
+    uint32_t *hashes;
+    char *data;
+    size_t data_size;
+    size_t data_capacity;
+} DBCStringTable;
+
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} DBCBuffer;
+
+typedef struct {
+    DBCBuffer buf;
+    VALUE io;
+    size_t bytes_written;
+} DBCOutput;
+
+typedef struct {
+    FieldValue **records;
+    uint32_t record_count;
+    uint32_t record_capacity;
+    uint32_t field_count;
+    DBCStringTable strings;
+} DBCBuilder;
+
+typedef struct {
+    const uint8_t *pos;
+    const uint8_t *end;
+} DBCMsgReader;
+
+// Two DBC files loaded raw, with the old file's rows in a hash table by key
+// so rows of the new file can be paired with them
+typedef struct {
+    const char *old_path;
+    const char *new_path;
+    DBCRaw old_raw;
+    DBCRaw new_raw;
+    VALUE fields;       // field definitions covering every column
+    VALUE field_names;
+    FieldType *types;
+    uint32_t field_count;
+    uint32_t key;
+    int same_strings;   // the string blocks are byte for byte identical
+    uint32_t *slots;    // old row + 1, 0 for empty
+    size_t slot_mask;
+    uint8_t *matched;   // old rows already paired
+} DBCDiff;
+
+// Streaming state for dbc_hash64
+typedef struct {
+    uint64_t seed0;
+    uint64_t total;
+    uint64_t seed;
+    uint64_t lane1;
+    uint64_t lane2;
+    uint8_t buf[64];  // the last 16 bytes hashed, then up to 48 pending
+    size_t pending;
+    int striped;
+} DBCHashState;
+
+// Output is handed to the IO in chunks of this size
+#define DBC_OUTPUT_CHUNK (64 * 1024)
+// Longest text produced by the dbc_format_* functions
+#define DBC_NUMBER_MAX 32
+
+extern VALUE rb_mWowDBC;
+extern VALUE rb_cDBCFile;
+extern const rb_data_type_t dbc_data_type;
+
+FieldType ruby_to_field_type(VALUE type_value);
+VALUE field_type_to_symbol(FieldType type);
+void dbc_column_types(const DBCFile *dbc, FieldType *types);
+void dbc_release_records(DBCFile *dbc);
+void dbc_install(DBCFile *dbc, const DBCHeader *header, FieldValue **records, char *string_block);
+void dbc_mark_modified(DBCFile *dbc);
+uint64_t dbc_file_size(const DBCFile *dbc);
+size_t dbc_memsize(const void *ptr);
+
+void dbc_undo_word(DBCFile *dbc, uint32_t row, uint32_t field);
+void dbc_undo_insert(DBCFile *dbc, uint32_t row);
+int dbc_undo_delete(DBCFile *dbc, uint32_t row);
+int dbc_undo_table(DBCFile *dbc, FieldValue **records, uint32_t record_count);
+void dbc_undo_free(DBCUndoLog *undo);
+
+void dbc_change(DBCFile *dbc, DBCChangeOp op, uint32_t row, uint32_t field);
+
+void dbc_cow_prepare(DBCFile *dbc);
+void dbc_cow_row(DBCFile *dbc, uint32_t row);
+void dbc_cow_grow(DBCFile *dbc, uint32_t record_count);
+void dbc_cow_base_release(DBCCowBase *base);
+void dbc_strings_reserve(DBCFile *dbc, uint32_t extra);
+void dbc_records_reserve(DBCFile *dbc, uint32_t count);
+
+uint64_t dbc_epoch_enter(void);
+void dbc_epoch_exit(uint64_t epoch);
+int dbc_epoch_active(void);
+void dbc_retire(void *ptr, void (*release)(void *));
+void *dbc_grow(void *ptr, size_t used, size_t size);
+
+DBCArena *dbc_arena_new(size_t size);
+void *dbc_arena_alloc(DBCArena *arena, size_t size);
+int dbc_arena_owns(const DBCArena *arena, const void *ptr);
+DBCArena *dbc_arena_retain(DBCArena *arena);
+void dbc_arena_release(DBCArena *arena);
+void dbc_arena_retire(const DBCArena *arena, void *ptr);
+void *dbc_arena_grow(const DBCArena *arena, void *ptr, size_t used, size_t size);
+int dbc_guard(VALUE self, DBCAccess access, DBCMethod fn, int arity, const VALUE *argv, VALUE *result);
+
+typedef enum {
+    DBC_BYTES_READ,
+    DBC_BYTES_WRITTEN,
+    DBC_ROWS_SCANNED,
+    DBC_COUNTER_COUNT
+} DBCCounter;
+
+extern int dbc_instrumenting;  // set by WowDBC.instrument=
+VALUE dbc_instrument(ID method, VALUE (*run)(VALUE), VALUE arg);
+void dbc_count(DBCCounter counter, uint64_t n);
+// Adds to a counter of the operation being timed, a single branch when
+// instrumentation is off
+#define DBC_COUNT(counter, n) do { if (RB_UNLIKELY(dbc_instrumenting)) dbc_count((counter), (n)); } while (0)
+
+VALUE dbc_record_to_hash(DBCFile *dbc, uint32_t index, VALUE field_names);
+long dbc_field_index(DBCFile *dbc, VALUE field_names, VALUE field);
+
+size_t dbc_index_word_count(const DBCIndex *index);
+void dbc_index_build(DBCFile *dbc, DBCIndex *index, const FieldType *types);
+int dbc_index_valid(const DBCIndex *index, uint32_t record_count);
+void dbc_index_release(DBCIndex *index);
+DBCIndex *dbc_index_add(DBCFile *dbc, uint32_t field, DBCIndexType type);
+DBCIndex *dbc_index_find(DBCFile *dbc, uint32_t field, DBCIndexType type);
+void dbc_indexes_clear(DBCFile *dbc);
+void dbc_indexes_refresh(DBCFile *dbc);
+void dbc_indexes_insert(DBCFile *dbc, uint32_t row);
+void dbc_indexes_update(DBCFile *dbc, uint32_t row, uint32_t field, uint32_t old_key);
+void dbc_indexes_delete(DBCFile *dbc, uint32_t row);
+void dbc_indexes_undo_word(DBCFile *dbc, uint32_t row, uint32_t field, uint32_t key, const FieldType *types);
+void dbc_indexes_undo_insert(DBCFile *dbc, uint32_t row, const FieldType *types);
+void dbc_indexes_undo_delete(DBCFile *dbc, uint32_t row, const FieldType *types);
+VALUE dbc_index_lookup(DBCFile *dbc, uint32_t field, VALUE value, VALUE field_names);
+VALUE dbc_index_type_to_symbol(DBCIndexType type);
+DBCIndexType dbc_index_type_from_symbol(VALUE type);
+void dbc_index_write_meta(DBCBuffer *meta, const DBCIndex *index, uint64_t offset);
+int dbc_index_read_meta(DBCMsgReader *reader, DBCIndex *index, uint64_t *offset);
+int dbc_index_attach(DBCIndex *index, DBCMapping *mapping, uint64_t offset,
+                     const FieldType *types, uint32_t field_count, uint32_t record_count);
+DBCMapping *dbc_mapping_open(const char *path);
+void dbc_mapping_release(DBCMapping *mapping);
+
+uint64_t dbc_hash64(const void *data, size_t len, uint64_t seed);
+void dbc_hash_init(DBCHashState *state, uint64_t seed);
+void dbc_hash_update(DBCHashState *state, const void *data, size_t len);
+uint64_t dbc_hash_final(const DBCHashState *state);
+uint64_t dbc_content_hash(const DBCFile *dbc);
+uint64_t dbc_record_hash(const DBCFile *dbc, uint32_t index, const FieldType *types);
+int dbc_stamp_path(const char *path, DBCStamp *stamp);
+
+void dbc_diff_init(DBCDiff *diff, VALUE old_path, VALUE new_path, VALUE options);
+void dbc_diff_load(DBCDiff *diff);
+void dbc_diff_prepare(DBCDiff *diff);
+int64_t dbc_diff_match(DBCDiff *diff, const uint32_t *new_row);
+int dbc_diff_field_equal(const DBCDiff *diff, const uint32_t *old_row, const uint32_t *new_row, uint32_t j);
+const char *dbc_diff_string(const DBCRaw *raw, uint32_t offset, size_t *len);
+VALUE dbc_diff_value(const DBCRaw *raw, const uint32_t *row, uint32_t j, FieldType type);
+VALUE dbc_diff_cleanup(VALUE arg);
+
+void dbc_raw_load(const char *path, DBCRaw *raw);
+void dbc_raw_release(DBCRaw *raw);
+
+void dbc_strtab_init(DBCStringTable *table);
+uint32_t dbc_strtab_intern(DBCStringTable *table, const char *s, uint32_t len);
+void dbc_strtab_free(DBCStringTable *table);
+
+void dbc_buf_init(DBCBuffer *buf, size_t capacity);
+int dbc_buf_try_reserve(DBCBuffer *buf, size_t len);
+void dbc_buf_reserve(DBCBuffer *buf, size_t len);
+void dbc_buf_append(DBCBuffer *buf, const void *data, size_t len);
+void dbc_buf_free(DBCBuffer *buf);
+
+void dbc_out_init(DBCOutput *out, VALUE io);
+void dbc_out_write(DBCOutput *out, const void *data, size_t len);
+void dbc_out_flush(DBCOutput *out);
+void dbc_out_free(DBCOutput *out);
+
+void dbc_builder_init(DBCBuilder *builder, uint32_t field_count);
+FieldValue *dbc_builder_add_record(DBCBuilder *builder);
+uint32_t dbc_builder_add_string(DBCBuilder *builder, const char *s, uint32_t len);
+VALUE dbc_builder_finish(DBCBuilder *builder, VALUE klass, VALUE filepath, VALUE field_definitions);
+void dbc_builder_free(DBCBuilder *builder);
+
+void dbc_mp_write_map(DBCBuffer *buf, uint32_t count);
+void dbc_mp_write_array(DBCBuffer *buf, uint32_t count);
+void dbc_mp_write_str(DBCBuffer *buf, const char *s, size_t len);
+void dbc_mp_write_uint(DBCBuffer *buf, uint64_t v);
+void dbc_mp_write_bool(DBCBuffer *buf, int v);
+uint32_t dbc_mp_read_map(DBCMsgReader *reader);
+uint32_t dbc_mp_read_array(DBCMsgReader *reader);
+const char *dbc_mp_read_str(DBCMsgReader *reader, uint32_t *len);
+uint64_t dbc_mp_read_uint(DBCMsgReader *reader);
+int dbc_mp_read_bool(DBCMsgReader *reader);
+void dbc_mp_skip(DBCMsgReader *reader);
+int dbc_mp_key_is(const char *key, uint32_t len, const char *name);
+
+size_t dbc_format_uint32(char *dst, uint32_t v);
+size_t dbc_format_int32(char *dst, int32_t v);
+size_t dbc_format_float(char *dst, float f);
+int dbc_parse_int64(const char *s, size_t len, int64_t min, int64_t max, int64_t *out);
+int dbc_parse_float(const char *s, size_t len, float *out);
+
+void Init_wow_dbc_schema(void);
+void Init_wow_dbc_arrow(void);
+void Init_wow_dbc_parquet(void);
+void Init_wow_dbc_csv(void);
+void Init_wow_dbc_sql(void);
+void Init_wow_dbc_sqlite(void);
+void Init_wow_dbc_json(void);
+void Init_wow_dbc_index(void);
+void Init_wow_dbc_snapshot(void);
+void Init_wow_dbc_sidecar(void);
+void Init_wow_dbc_hash(void);
+void Init_wow_dbc_diff(void);
+void Init_wow_dbc_patch(void);
+void Init_wow_dbc_merge(void);
+void Init_wow_dbc_transaction(void);
+void Init_wow_dbc_cow(void);
+void Init_wow_dbc_epoch(void);
+void Init_wow_dbc_ractor(void);
+void Init_wow_dbc_shm(void);
+void Init_wow_dbc_catalog(void);
+void Init_wow_dbc_changelog(void);
+void Init_wow_dbc_synth(void);
+void Init_wow_dbc_instrument(void);
+void Init_wow_dbc_memory(void);
+
+#endif
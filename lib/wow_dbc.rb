@@ -4,6 +4,8 @@
 
 require 'wow_dbc/wow_dbc'
 require 'wow_dbc/version'
+require 'wow_dbc/schema'
+require 'wow_dbc/catalog'
 
 module WowDBC
   class DBCFile
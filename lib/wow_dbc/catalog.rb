@@ -0,0 +1,138 @@
+# frozen_string_literal: true
+
+module WowDBC
+  # The DBC files of a data directory, loaded on first use and reloaded in
+  # place when they change on disk (see #watch). Catalog.changes and the
+  # Watcher are implemented in C.
+  class Catalog
+    attr_reader :dir
+
+    # +schemas+ maps file names to field definitions. Files without one get
+    # a schema from Schema.infer each time they are loaded.
+    def initialize(dir, schemas = {})
+      @dir = dir
+      @schemas = schemas
+      @tables = {}
+      @callbacks = []
+      @lock = Mutex.new
+    end
+
+    # The table for file +name+, read on first use
+    def [](name)
+      @tables[name] || @lock.synchronize { @tables[name] ||= load(name, schema(name)) }
+    end
+
+    def names
+      Dir.children(@dir).grep(/\.dbc\z/i).sort
+    end
+
+    def loaded?(name)
+      @tables.key?(name)
+    end
+
+    # Registers a block called as block.call(name, changes, table) after a
+    # loaded table is replaced, with +changes+ as from Catalog.changes.
+    def on_change(&block)
+      @callbacks << block
+      self
+    end
+
+    # Starts a background thread that waits on inotify for files written
+    # into the directory or moved there, and reloads the ones in use. Each
+    # file is read and decoded with the GVL released and compared with the
+    # table it replaces, then swapped in; readers see either version whole.
+    # A file that fails to load keeps its current table. If waiting on the
+    # directory fails, the thread warns and stops, and #watching? turns
+    # false.
+    def watch(&block)
+      on_change(&block) if block
+      @lock.synchronize do
+        return self if @thread
+
+        @watcher = Watcher.new(@dir)
+        @thread = Thread.new { watch_loop }
+      end
+      self
+    end
+
+    def watching?
+      !@thread.nil?
+    end
+
+    def stop
+      thread = @lock.synchronize { @thread.tap { @thread = nil } }
+      return unless thread
+
+      thread.kill
+      thread.join
+      @watcher.close
+      @watcher = nil
+    end
+
+    # Reloads +name+ if it is loaded and returns its changes, nil otherwise.
+    # A callback that raises is reported and the others still run.
+    def reload(name)
+      table, changes = swap(name)
+      return unless table
+
+      @callbacks.each do |callback|
+        callback.call(name, changes, table)
+      rescue StandardError => e
+        warn "wow_dbc: on_change callback for #{name} failed: #{e.class}: #{e.message}"
+      end
+      changes
+    end
+
+    private
+
+    # Loads +name+ again and swaps it in, returning [table, changes], or nil
+    # when it is not loaded or the new file fails to load
+    def swap(name)
+      @lock.synchronize do
+        old = @tables[name]
+        return unless old
+
+        fields = schema(name)
+        table = load(name, fields, old.indexes)
+        changes = Catalog.changes(old, table, fields.keys.first)
+        @tables[name] = table
+        [table, changes]
+      end
+    rescue IOError, ArgumentError, SystemCallError => e
+      warn "wow_dbc: keeping #{name}, reload failed: #{e.message}"
+      nil
+    end
+
+    def watch_loop
+      loop do
+        @watcher.wait.each do |name|
+          reload(name)
+        rescue StandardError => e
+          warn "wow_dbc: reloading #{name} failed: #{e.class}: #{e.message}"
+        end
+      end
+    rescue StandardError => e
+      warn "wow_dbc: stopped watching #{@dir}: #{e.class}: #{e.message}"
+    ensure
+      # #stop clears @thread before killing the thread and closes the watcher
+      # itself
+      @lock.synchronize do
+        if @thread.equal?(Thread.current)
+          @thread = nil
+          @watcher.close
+          @watcher = nil
+        end
+      end
+    end
+
+    def schema(name)
+      @schemas[name] || Schema.infer(File.join(@dir, name))
+    end
+
+    def load(name, fields, indexes = [])
+      table = DBCFile.new(File.join(@dir, name), fields).read
+      indexes.each { |field, type| table.build_index(field, type) }
+      table
+    end
+  end
+end
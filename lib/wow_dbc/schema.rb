@@ -0,0 +1,33 @@
+# frozen_string_literal: true
+
+module WowDBC
+  module Schema
+    LOCALES = %i[
+      en_us ko_kr fr_fr de_de zh_cn zh_tw es_es es_mx
+      ru_ru loc_9 loc_10 loc_11 loc_12 loc_13 loc_14 loc_15
+    ].freeze
+
+    # Builds a field definitions hash for DBCFile.new from the raw column data
+    # of the file at +path+ (see Schema.analyze, implemented in C).
+    #
+    # Plain columns are named field_<index>. Locstring columns are named after
+    # the first column of their group: field_<group>_<locale>, followed by
+    # field_<group>_flags.
+    def self.infer(path)
+      columns = analyze(path)
+      columns.each_with_index.to_h do |column, index|
+        [field_name(column, index, columns), column[:type]]
+      end
+    end
+
+    def self.field_name(column, index, columns)
+      return :"field_#{index}" if column[:group].nil?
+
+      group = column[:group]
+      size = columns.count { |c| c[:group] == group } - 1
+      suffix = column[:slot] == size ? :flags : LOCALES[column[:slot]]
+      :"field_#{group}_#{suffix}"
+    end
+    private_class_method :field_name
+  end
+end
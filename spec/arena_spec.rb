@@ -0,0 +1,60 @@
+# frozen_string_literal: true
+
+require 'tmpdir'
+
+RSpec.describe WowDBC do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  describe 'arena' do
+    it 'frees what the previous read loaded when reading again' do
+      arena = dbc_file.memory_report[:arena]
+      3.times { dbc_file.read }
+
+      expect(dbc_file.memory_report[:arena]).to eq(arena)
+      expect(dbc_file.get_record(0)[:model_name_1]).to eq(
+        WowDBC::DBCFile.new(test_file, field_definitions).read.get_record(0)[:model_name_1]
+      )
+    end
+
+    it 'mixes rows from the arena with rows created, copied and restored later' do
+      first = dbc_file.get_record(1)
+      snapshot = dbc_file.snapshot
+      dbc_file.delete_record(0)
+      dbc_file.update_record(0, :model_name_1, 'Arena')
+      row = dbc_file.create_record_with_values(id: 9_999_999, flags: 7)
+      rollback = lambda do
+        dbc_file.transaction do |dbc|
+          dbc.delete_record(1)
+          raise 'roll back'
+        end
+      end
+      expect(&rollback).to raise_error(RuntimeError)
+
+      expect(dbc_file.get_record(0)).to eq(first.merge(model_name_1: 'Arena'))
+      expect(dbc_file.get_record(row)[:flags]).to eq(7)
+      expect(dbc_file.memory_report[:rows]).to be > 0
+      dbc_file.read
+      expect(snapshot.get_record(1)).to eq(first)
+    end
+
+    it 'leaves the rows of snapshots loaded from disk in their mapping' do
+      Dir.mktmpdir do |dir|
+        path = File.join(dir, 'items.snapshot')
+        dbc_file.dump_snapshot(path)
+        loaded = WowDBC::DBCFile.load_snapshot(path)
+
+        expect(loaded.memory_report[:arena]).to eq(0)
+        expect(loaded.get_record(5)).to eq(dbc_file.get_record(5))
+        loaded.delete_record(5)
+        expect(loaded.get_record(5)).to eq(dbc_file.get_record(6))
+      end
+    end
+  end
+end
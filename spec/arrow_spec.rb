@@ -0,0 +1,89 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC::DBCFile do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  let(:arrow_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_test.arrow') }
+  let(:new_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_new.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  after(:each) do
+    File.delete(arrow_file) if File.exist?(arrow_file)
+    File.delete(new_file) if File.exist?(new_file)
+  end
+
+  describe '#to_arrow' do
+    it 'writes an Arrow IPC file' do
+      dbc_file.to_arrow(arrow_file)
+      content = File.binread(arrow_file)
+      expect(content[0, 6]).to eq('ARROW1')
+      expect(content[-6, 6]).to eq('ARROW1')
+    end
+
+    it 'raises an error when the path is invalid' do
+      expect { dbc_file.to_arrow('/invalid/path/file.arrow') }.to raise_error(IOError)
+    end
+
+    context 'with more fields than fit on the stack' do
+      include_context 'wide dbc'
+
+      it 'writes an Arrow IPC file' do
+        wide_dbc.to_arrow(arrow_file)
+        expect(File.binread(arrow_file, 6)).to eq('ARROW1')
+      end
+    end
+  end
+
+  describe '.from_arrow' do
+    it 'round-trips every record' do
+      dbc_file.to_arrow(arrow_file)
+      imported = WowDBC::DBCFile.from_arrow(arrow_file)
+
+      expect(imported.header[:record_count]).to eq(dbc_file.header[:record_count])
+      expect(imported.header[:field_count]).to eq(dbc_file.header[:field_count])
+      (0...dbc_file.header[:record_count]).step(97) do |index|
+        expect(imported.get_record(index)).to eq(dbc_file.get_record(index))
+      end
+      last = dbc_file.header[:record_count] - 1
+      expect(imported.get_record(last)).to eq(dbc_file.get_record(last))
+    end
+
+    it 'keeps records created in memory' do
+      index = dbc_file.create_record_with_values(id: 99999, model_name_1: 'NewModelName', particle_color_id: 0.5)
+      dbc_file.to_arrow(arrow_file)
+      imported = WowDBC::DBCFile.from_arrow(arrow_file)
+
+      expect(imported.get_record(index)).to eq(dbc_file.get_record(index))
+    end
+
+    it 'writes the imported table back as a DBC file' do
+      dbc_file.to_arrow(arrow_file)
+      imported = WowDBC::DBCFile.from_arrow(arrow_file, new_file)
+      imported.write
+
+      reread = WowDBC::DBCFile.new(new_file, field_definitions)
+      reread.read
+      expect(reread.get_record(0)).to eq(dbc_file.get_record(0))
+    end
+
+    it 'raises an error when a validity bitmap is shorter than its column' do
+      dbc_file.to_arrow(arrow_file)
+      content = File.binread(arrow_file)
+      # The first field node of the batch, marked as having nulls it has no bitmap for
+      node = content.index([dbc_file.header[:record_count], 0].pack('q<q<'))
+      content[node + 8, 8] = [1].pack('q<')
+      File.binwrite(arrow_file, content)
+
+      expect { WowDBC::DBCFile.from_arrow(arrow_file) }.to raise_error(IOError)
+    end
+
+    it 'raises an error for files that are not Arrow files' do
+      expect { WowDBC::DBCFile.from_arrow(test_file) }.to raise_error(IOError)
+    end
+  end
+end
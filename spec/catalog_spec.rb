@@ -0,0 +1,169 @@
+# frozen_string_literal: true
+
+require 'fileutils'
+require 'stringio'
+require 'tmpdir'
+require 'timeout'
+
+RSpec.describe WowDBC do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+  let(:dir) { Dir.mktmpdir('wow_dbc_catalog') }
+  let(:name) { 'ItemDisplayInfo.dbc' }
+  let(:catalog) { WowDBC::Catalog.new(dir, name => field_definitions) }
+
+  before(:each) do
+    FileUtils.cp(test_file, File.join(dir, name))
+  end
+
+  after(:each) do
+    catalog.stop
+    FileUtils.rm_rf(dir)
+  end
+
+  # Writes an edited copy of the test file next to the catalog directory and
+  # moves it in, the way a deploy would
+  def publish(edit)
+    dbc = WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read)
+    edit.call(dbc)
+    staged = File.join(dir, '.staged')
+    dbc.write_to(staged)
+    File.rename(staged, File.join(dir, name))
+    dbc
+  end
+
+  def edit(dbc)
+    dbc.update_record(1, :model_name_1, 'Reloaded')
+    dbc.delete_record(2)
+    dbc.create_record_with_values(id: 9_999_999, model_name_1: 'New')
+  end
+
+  describe '.changes' do
+    it 'lists the keys of added, removed and changed rows' do
+      old = WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read)
+      new = WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read)
+      removed_id = new.get_record(2)[:id]
+      changed_id = new.get_record(1)[:id]
+      edit(new)
+
+      changes = WowDBC::Catalog.changes(old, new, :id)
+
+      expect(changes).to eq(added: [9_999_999], removed: [removed_id], changed: [changed_id])
+      expect(WowDBC::Catalog.changes(old, old, :id)).to eq(added: [], removed: [], changed: [])
+    end
+
+    it 'rejects a key that is not a field of both tables' do
+      old = WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read)
+
+      expect { WowDBC::Catalog.changes(old, old, :nope) }.to raise_error(ArgumentError, /Unknown key/)
+    end
+  end
+
+  describe '#reload' do
+    it 'swaps in the new table and keeps its indexes' do
+      old = catalog[name].build_index(:id)
+      expected = publish(method(:edit))
+
+      changes = catalog.reload(name)
+
+      expect(changes[:added]).to eq([9_999_999])
+      expect(catalog[name]).not_to equal(old)
+      expect(catalog[name].content_hash).to eq(expected.content_hash)
+      expect(catalog[name].indexes).to eq([%i[id hash]])
+      expect(catalog[name].find_by(:id, 9_999_999).first[:model_name_1]).to eq('New')
+      expect(old.get_record(1)[:model_name_1]).not_to eq('Reloaded')
+    end
+
+    it 'keeps the current table when the new file cannot be read' do
+      old = catalog[name]
+      File.write(File.join(dir, name), 'short')
+
+      stderr = $stderr
+      $stderr = StringIO.new
+      begin
+        expect(catalog.reload(name)).to be_nil
+      ensure
+        $stderr = stderr
+      end
+      expect(catalog[name]).to equal(old)
+    end
+
+    it 'runs the other callbacks when one raises' do
+      catalog[name]
+      seen = []
+      catalog.on_change { raise 'callback failed' }
+      catalog.on_change { |changed_name| seen << changed_name }
+      publish(method(:edit))
+
+      stderr = $stderr
+      $stderr = StringIO.new
+      begin
+        expect(catalog.reload(name)[:added]).to eq([9_999_999])
+        expect($stderr.string).to include('callback failed')
+      ensure
+        $stderr = stderr
+      end
+      expect(seen).to eq([name])
+    end
+
+    it 'skips tables that were never loaded' do
+      expect(catalog.reload(name)).to be_nil
+      expect(catalog.loaded?(name)).to be false
+    end
+  end
+
+  describe '#watch' do
+    it 'reloads a table when a new file is moved into the directory' do
+      catalog[name]
+      events = Queue.new
+      catalog.watch { |*event| events << event }
+      publish(method(:edit))
+
+      changed_name, changes, table = Timeout.timeout(5) { events.pop }
+
+      expect(changed_name).to eq(name)
+      expect(changes[:added]).to eq([9_999_999])
+      expect(changes[:changed].size).to eq(1)
+      expect(table).to equal(catalog[name])
+      expect(catalog.watching?).to be true
+    end
+
+    it 'stops watching' do
+      catalog.watch
+      catalog.stop
+
+      expect(catalog.watching?).to be false
+    end
+  end
+
+  describe WowDBC::Catalog::Watcher do
+    it 'returns no names when nothing changes before the timeout' do
+      watcher = WowDBC::Catalog::Watcher.new(dir)
+
+      expect(watcher.wait(0.05)).to eq([])
+      FileUtils.cp(test_file, File.join(dir, 'Other.dbc'))
+      File.write(File.join(dir, 'notes.txt'), 'x')
+      expect(watcher.wait(1)).to eq(['Other.dbc'])
+      watcher.close
+    end
+
+    it 'keeps its timeout while other files change' do
+      watcher = WowDBC::Catalog::Watcher.new(dir)
+      writer = Thread.new do
+        40.times do |i|
+          File.write(File.join(dir, 'notes.txt'), i.to_s)
+          sleep 0.05
+        end
+      end
+
+      started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      expect(watcher.wait(0.3)).to eq([])
+      expect(Process.clock_gettime(Process::CLOCK_MONOTONIC) - started).to be < 1
+    ensure
+      writer&.kill
+      watcher&.close
+    end
+  end
+end
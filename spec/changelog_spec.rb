@@ -0,0 +1,82 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  describe '#changes_since' do
+    it 'logs each mutation as op, row and field' do
+      cursor = dbc_file.track_changes
+      dbc_file.update_record(3, :flags, 1)
+      dbc_file.update_record_multi(4, { geoset_group_1: 5, item_visual: -1 })
+      row = dbc_file.create_record
+      new_row = dbc_file.create_record_with_values(id: 9_999_999)
+      dbc_file.delete_record(0)
+
+      expect(dbc_file.changes_since(cursor)).to eq([
+                                                     [:update, 3, :flags],
+                                                     [:update, 4, :geoset_group_1],
+                                                     [:update, 4, :item_visual],
+                                                     [:create, row, nil],
+                                                     [:create, new_row, nil],
+                                                     [:delete, 0, nil]
+                                                   ])
+      expect(dbc_file.change_cursor).to eq(cursor + 6)
+    end
+
+    it 'hands out changes in batches' do
+      cursor = dbc_file.track_changes
+      10.times { |i| dbc_file.update_record(i, :flags, i) }
+
+      batches = []
+      loop do
+        batch = dbc_file.changes_since(cursor, 4)
+        break if batch.empty?
+
+        batches << batch.map { |_, row, _| row }
+        cursor += batch.size
+      end
+
+      expect(batches).to eq([[0, 1, 2, 3], [4, 5, 6, 7], [8, 9]])
+    end
+
+    it 'returns nil once the ring has overwritten unread changes' do
+      cursor = dbc_file.track_changes(8)
+      8.times { |i| dbc_file.update_record(i, :flags, i) }
+      expect(dbc_file.changes_since(cursor).size).to eq(8)
+
+      dbc_file.update_record(8, :flags, 8)
+
+      expect(dbc_file.changes_since(cursor)).to be_nil
+      expect(dbc_file.changes_since(cursor + 1).size).to eq(8)
+    end
+
+    it 'logs a reset when the whole table is replaced' do
+      cursor = dbc_file.track_changes
+      dbc_file.transaction(&:create_record)
+      expect do
+        dbc_file.transaction do |dbc|
+          dbc.update_record(0, :flags, 1)
+          raise 'undo'
+        end
+      end.to raise_error(RuntimeError)
+      dbc_file.read
+
+      expect(dbc_file.changes_since(cursor).map(&:first)).to eq(%i[create update reset reset])
+    end
+
+    it 'requires tracking and a cursor it has reached' do
+      expect(dbc_file.change_cursor).to be_nil
+      expect { dbc_file.changes_since(0) }.to raise_error(RuntimeError, /track_changes/)
+
+      dbc_file.track_changes
+      expect { dbc_file.changes_since(1) }.to raise_error(ArgumentError)
+    end
+  end
+end
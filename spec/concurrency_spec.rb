@@ -0,0 +1,119 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  # Hands control to other threads on every write, so readers are paused
+  # in the middle of an export while writers run
+  let(:yielding_io) do
+    Class.new do
+      attr_reader :lines
+
+      def initialize
+        @lines = 0
+      end
+
+      def write(*chunks)
+        Thread.pass
+        chunks.sum { |chunk| @lines += chunk.count("\n"); chunk.bytesize }
+      end
+    end
+  end
+
+  describe '#concurrent!' do
+    it 'is off until enabled' do
+      expect(dbc_file.concurrent?).to be false
+      expect(dbc_file.concurrent!).to equal(dbc_file)
+      expect(dbc_file.concurrent?).to be true
+    end
+
+    it 'lets readers run while writers change the table' do
+      dbc_file.concurrent!
+      dbc_file.build_index(:id)
+      count = dbc_file.header[:record_count]
+      done = false
+
+      readers = Array.new(3) do
+        Thread.new do
+          exports = 0
+          until done
+            io = yielding_io.new
+            dbc_file.each_json_line(io)
+            expect(io.lines).to be_between(count - 400, count + 400)
+            expect(dbc_file.find_by(:id, dbc_file.get_record(10)[:id]).size).to eq(1)
+            exports += 1
+          end
+          exports
+        end
+      end
+      writers = Array.new(2) do |w|
+        Thread.new do
+          200.times do |k|
+            dbc_file.update_record(k, :model_name_1, "Writer #{w} #{k}")
+            dbc_file.create_record_with_values(id: 10_000_000 + (w * 1000) + k, model_name_1: 'New')
+            dbc_file.delete_record(count - k - (w * 200) - 1)
+            Thread.pass
+          end
+        end
+      end
+      writers.each(&:join)
+      done = true
+
+      expect(readers.map(&:value)).to all(be_positive)
+      expect(dbc_file.header[:record_count]).to eq(count)
+      expect(dbc_file.find_by(:id, 10_000_199).first[:model_name_1]).to eq('New')
+      expect(dbc_file.find_by(:id, 10_001_199).size).to eq(1)
+    end
+
+    it 'serializes writers, holding them off for a whole transaction' do
+      dbc_file.concurrent!
+      flags = dbc_file.get_record(0)[:flags]
+      started = Queue.new
+
+      transaction = Thread.new do
+        dbc_file.transaction do |dbc|
+          dbc.update_record(0, :flags, flags + 1)
+          started << true
+          sleep 0.05
+          raise 'undo'
+        end
+      rescue RuntimeError
+        nil
+      end
+      started.pop
+      dbc_file.update_record(0, :flags, flags + 2)
+      transaction.join
+
+      expect(dbc_file.get_record(0)[:flags]).to eq(flags + 2)
+    end
+
+    it 'does not make readers wait for a writer' do
+      dbc_file.concurrent!
+      release = Queue.new
+      started = Queue.new
+
+      writer = Thread.new do
+        dbc_file.transaction do |dbc|
+          dbc.update_record(0, :flags, 1234)
+          started << true
+          release.pop
+        end
+      end
+      started.pop
+
+      expect(dbc_file.get_record(0)[:flags]).to eq(1234)
+      expect(dbc_file.header[:record_count]).to be_positive
+      release << true
+      writer.join
+    end
+  end
+end
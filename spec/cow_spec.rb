@@ -0,0 +1,131 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+  let(:new_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_cow.dbc') }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  after(:each) do
+    File.delete(new_file) if File.exist?(new_file)
+  end
+
+  def records(dbc)
+    (0...dbc.header[:record_count]).map { |i| dbc.get_record(i) }
+  end
+
+  describe '#snapshot' do
+    it 'returns a frozen view that cannot be changed' do
+      snapshot = dbc_file.snapshot
+
+      expect(snapshot).to be_frozen
+      expect(snapshot.header).to eq(dbc_file.header)
+      expect(snapshot.get_record(7)).to eq(dbc_file.get_record(7))
+      expect { snapshot.update_record(0, :flags, 1) }.to raise_error(FrozenError)
+      expect { snapshot.delete_record(0) }.to raise_error(FrozenError)
+      expect { snapshot.create_record }.to raise_error(FrozenError)
+    end
+
+    it 'keeps its view while the live table changes' do
+      expected = records(dbc_file)
+      hash = dbc_file.content_hash
+      snapshot = dbc_file.snapshot
+
+      dbc_file.update_record(0, :flags, 77)
+      dbc_file.update_record(1, :model_name_1, 'Changed')
+      dbc_file.update_record_multi(2, { geoset_group_1: 5 })
+      dbc_file.delete_record(3)
+      dbc_file.create_record_with_values(id: 9_999_999, model_name_1: 'New')
+
+      expect(snapshot.content_hash).to eq(hash)
+      expect(records(snapshot)).to eq(expected)
+      expect(dbc_file.get_record(1)[:model_name_1]).to eq('Changed')
+      expect(snapshot.find_by(:id, 9_999_999)).to be_empty
+    end
+
+    it 'keeps every snapshot of a chain valid as the others are collected' do
+      first = dbc_file.snapshot
+      dbc_file.update_record(0, :flags, 1)
+      second = dbc_file.snapshot
+      second_records = records(second)
+      dbc_file.delete_record(0)
+      dbc_file.update_record(1, :model_name_1, 'Live')
+      third = dbc_file.snapshot
+      third_records = records(third)
+      dbc_file.update_record(2, :flags, 3)
+
+      first = nil
+      GC.start
+      expect(records(second)).to eq(second_records)
+
+      second = nil
+      GC.start
+      expect(records(third)).to eq(third_records)
+      expect(dbc_file.get_record(0)).to eq(third_records[0])
+      expect([first, second]).to all(be_nil)
+    end
+
+    it 'outlives the live table' do
+      expected = records(dbc_file).first(10)
+      snapshot = dbc_file.snapshot
+      dbc_file.read
+      dbc_file.delete_record(0)
+
+      expect(records(snapshot).first(10)).to eq(expected)
+    end
+
+    it 'stays intact through patches and rolled back transactions on the live table' do
+      target = WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read)
+      target.update_record(4, :model_name_1, 'Patched')
+      target.delete_record(5)
+      target.write_to(new_file)
+      patch = WowDBC.make_patch(test_file, new_file, fields: field_definitions)
+      hash = dbc_file.content_hash
+      snapshot = dbc_file.snapshot
+
+      expect do
+        dbc_file.transaction do |dbc|
+          dbc.delete_record(0)
+          dbc.update_record(1, :flags, 1)
+          raise 'undo'
+        end
+      end.to raise_error(RuntimeError)
+      dbc_file.apply_patch!(patch)
+
+      expect(dbc_file.get_record(4)[:model_name_1]).to eq('Patched')
+      expect(snapshot.content_hash).to eq(hash)
+    end
+
+    it 'keeps the shared rows of a rolled back transaction that deletes and appends' do
+      snapshot = dbc_file.snapshot
+      hash = snapshot.content_hash
+      last = dbc_file.header[:record_count] - 1
+      expected = records(dbc_file)
+      dbc_file.update_record_multi(0, {})
+
+      expect do
+        dbc_file.transaction do |dbc|
+          dbc.delete_record(last)
+          dbc.delete_record(last - 1)
+          dbc.create_record
+          raise 'undo'
+        end
+      end.to raise_error(RuntimeError)
+      dbc_file.update_record(last, :flags, 1)
+      dbc_file.update_record(last - 1, :flags, 1)
+
+      expect(records(dbc_file)[0...(last - 1)]).to eq(expected[0...(last - 1)])
+      expect(snapshot.content_hash).to eq(hash)
+      expect(records(snapshot)).to eq(expected)
+    end
+
+    it 'is not available inside a transaction' do
+      expect { dbc_file.transaction(&:snapshot) }.to raise_error(RuntimeError, /inside a transaction/)
+    end
+  end
+end
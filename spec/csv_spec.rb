@@ -0,0 +1,88 @@
+# frozen_string_literal: true
+
+require 'stringio'
+
+RSpec.describe WowDBC::DBCFile do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  let(:csv_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_test.csv') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  after(:each) do
+    File.delete(csv_file) if File.exist?(csv_file)
+  end
+
+  describe '#to_csv' do
+    it 'writes a header row and one line per record' do
+      io = StringIO.new
+      dbc_file.to_csv(io)
+      lines = io.string.lines
+
+      expect(lines.first.chomp).to eq(field_definitions.keys.join(','))
+      expect(lines.size).to eq(dbc_file.header[:record_count] + 1)
+      expect(lines[1]).to start_with("#{dbc_file.get_record(0)[:id]},")
+    end
+
+    it 'quotes strings containing separators and quotes' do
+      dbc_file.update_record(0, :model_name_1, 'a,"b"')
+      io = StringIO.new
+      dbc_file.to_csv(io)
+
+      expect(io.string.lines[1]).to include(',"a,""b""",')
+    end
+
+    context 'with more fields than fit on the stack' do
+      include_context 'wide dbc'
+
+      it 'writes the header row' do
+        io = StringIO.new
+        wide_dbc.to_csv(io)
+        expect(io.string.lines.size).to eq(1)
+      end
+    end
+  end
+
+  describe '.from_csv' do
+    it 'round-trips every record' do
+      dbc_file.update_record(1, :model_name_1, "multi\nline, \"quoted\"")
+      dbc_file.update_record(2, :item_visual, -5)
+      dbc_file.update_record(3, :particle_color_id, 0.1)
+      File.open(csv_file, 'w') { |io| dbc_file.to_csv(io) }
+      imported = File.open(csv_file) { |io| WowDBC::DBCFile.from_csv(io, field_definitions) }
+
+      expect(imported.header[:record_count]).to eq(dbc_file.header[:record_count])
+      (0...dbc_file.header[:record_count]).step(97) do |index|
+        expect(imported.get_record(index)).to eq(dbc_file.get_record(index))
+      end
+      (1..3).each do |index|
+        expect(imported.get_record(index)).to eq(dbc_file.get_record(index))
+      end
+    end
+
+    it 'matches columns by name and leaves missing columns zero' do
+      io = StringIO.new("model_name_1,id\r\nfoo,7\r\n\r\n\"bar\",8\r\n")
+      imported = WowDBC::DBCFile.from_csv(io, field_definitions)
+
+      expect(imported.header[:record_count]).to eq(2)
+      expect(imported.get_record(0)[:id]).to eq(7)
+      expect(imported.get_record(0)[:model_name_1]).to eq('foo')
+      expect(imported.get_record(1)[:model_name_1]).to eq('bar')
+      expect(imported.get_record(1)[:flags]).to eq(0)
+    end
+
+    it 'raises an error for unknown columns' do
+      io = StringIO.new("id,nope\n1,2\n")
+      expect { WowDBC::DBCFile.from_csv(io, field_definitions) }.to raise_error(ArgumentError, /nope/)
+    end
+
+    it 'raises an error for invalid numbers' do
+      io = StringIO.new("id,flags\n1,2\n3,x\n")
+      expect { WowDBC::DBCFile.from_csv(io, field_definitions) }.to raise_error(ArgumentError, /line 3/)
+    end
+  end
+end
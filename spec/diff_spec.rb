@@ -0,0 +1,57 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+  let(:new_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_diff.dbc') }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  after(:each) do
+    File.delete(new_file) if File.exist?(new_file)
+  end
+
+  describe '.diff' do
+    it 'reports added, removed and changed records' do
+      removed = dbc_file.get_record(20)
+      dbc_file.update_record(3, :flags, 77)
+      dbc_file.update_record(10, :model_name_1, 'Changed')
+      dbc_file.delete_record(20)
+      dbc_file.create_record_with_values(id: 9_999_999, model_name_1: 'New')
+      dbc_file.write_to(new_file)
+
+      diff = WowDBC.diff(test_file, new_file, fields: field_definitions)
+
+      expect(diff[:added].map { |record| record[:id] }).to eq([9_999_999])
+      expect(diff[:removed]).to eq([removed])
+      expect(diff[:changed].map { |change| [change[:key], change[:fields]] }).to eq(
+        [[dbc_file.get_record(3)[:id], [:flags]], [dbc_file.get_record(10)[:id], [:model_name_1]]]
+      )
+      expect(diff[:changed][1][:new]).to eq(dbc_file.get_record(10))
+    end
+
+    it 'compares strings by content when the string blocks differ' do
+      dbc_file.update_record(0, :model_name_1, dbc_file.get_record(0)[:model_name_1].dup)
+      dbc_file.write_to(new_file)
+
+      diff = WowDBC.diff(test_file, new_file, fields: field_definitions)
+      expect(diff.values).to all(be_empty)
+    end
+
+    it 'infers field definitions and keys by the first column' do
+      dbc_file.update_record(5, :flags, 1234)
+      dbc_file.write_to(new_file)
+
+      changes = WowDBC.diff(test_file, new_file)[:changed]
+      expect(changes.map { |change| change[:key] }).to eq([dbc_file.get_record(5)[:id]])
+    end
+
+    it 'raises an error for unknown key fields' do
+      expect { WowDBC.diff(test_file, test_file, key: :unknown, fields: field_definitions) }.to raise_error(ArgumentError)
+    end
+  end
+end
@@ -0,0 +1,60 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC::DBCFile do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  describe '#content_hash' do
+    it 'matches the hash of the file it was read from' do
+      expect(dbc_file.content_hash).to eq(WowDBC.file_hash(test_file))
+    end
+
+    it 'changes when a record changes' do
+      before = dbc_file.content_hash
+      dbc_file.update_record(0, :flags, dbc_file.get_record(0)[:flags] + 1)
+
+      expect(dbc_file.content_hash).not_to eq(before)
+    end
+  end
+
+  describe '.file_hash' do
+    it 'raises an error for missing files' do
+      expect { WowDBC.file_hash('nonexistent.dbc') }.to raise_error(IOError)
+    end
+  end
+
+  describe '#record_hash' do
+    it 'hashes string fields by content' do
+      hash = dbc_file.record_hash(1)
+      dbc_file.update_record(1, :model_name_1, dbc_file.get_record(1)[:model_name_1].dup)
+
+      expect(dbc_file.record_hash(1)).to eq(hash)
+      expect(dbc_file.record_hashes[1]).to eq(hash)
+    end
+
+    it 'tells different records apart' do
+      expect(dbc_file.record_hashes.uniq.size).to eq(dbc_file.header[:record_count])
+    end
+
+    it 'raises an error for invalid indices' do
+      expect { dbc_file.record_hash(-1) }.to raise_error(ArgumentError)
+    end
+
+    context 'with more fields than fit on the stack' do
+      include_context 'wide dbc'
+
+      it 'hashes records and content' do
+        wide_dbc.update_record(wide_dbc.create_record, :id, 7)
+
+        expect(wide_dbc.record_hashes).to eq([wide_dbc.record_hash(0)])
+        expect(wide_dbc.write.content_hash).to eq(WowDBC.file_hash(wide_file))
+      end
+    end
+  end
+end
@@ -0,0 +1,107 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC::DBCFile do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+  let(:plain_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    dbc_file.read
+    plain_file.read
+  end
+
+  describe '#build_index' do
+    it 'answers find_by like a full scan' do
+      dbc_file.build_index(:id, :direct)
+      dbc_file.build_index(:inventory_icon_1)
+      dbc_file.build_index(:item_visual, :hash)
+
+      id = plain_file.get_record(1234)[:id]
+      expect(dbc_file.find_by(:id, id)).to eq(plain_file.find_by(:id, id))
+      expect(dbc_file.find_by(:inventory_icon_1, 'INV_Boots_01')).to eq(plain_file.find_by(:inventory_icon_1, 'INV_Boots_01'))
+      expect(dbc_file.find_by(:item_visual, 0).size).to eq(plain_file.find_by(:item_visual, 0).size)
+      expect(dbc_file.find_by(:id, 'not an id')).to be_empty
+    end
+
+    it 'stays current after records change' do
+      dbc_file.build_index(:id, :direct)
+      index = dbc_file.create_record_with_values(id: 999_999, model_name_1: 'Indexed')
+      dbc_file.update_record(0, :id, 12_345_678)
+
+      expect(dbc_file.find_by(:id, 999_999)).to eq([dbc_file.get_record(index)])
+      expect(dbc_file.find_by(:id, 12_345_678).size).to eq(1)
+      expect(dbc_file.indexes).to eq([%i[id direct]])
+    end
+
+    it 'keeps hash and sorted indexes current across deletes' do
+      dbc_file.build_index(:inventory_icon_1)
+      dbc_file.build_index(:group_sound_index, :sorted)
+      [5, 0, 700].each do |index|
+        dbc_file.delete_record(index)
+        plain_file.delete_record(index)
+      end
+      dbc_file.update_record(3, :group_sound_index, 11)
+      plain_file.update_record(3, :group_sound_index, 11)
+
+      expect(dbc_file.find_by(:inventory_icon_1, 'INV_Boots_01')).to eq(plain_file.find_by(:inventory_icon_1, 'INV_Boots_01'))
+      expect(dbc_file.find_range(:group_sound_index, 11..11).map { |record| record[:id] })
+        .to eq(plain_file.find_by(:group_sound_index, 11).map { |record| record[:id] })
+    end
+
+    it 'raises an error when a direct index does not fit the field' do
+      expect { dbc_file.build_index(:model_name_1, :direct) }.to raise_error(ArgumentError)
+      expect { dbc_file.build_index(:id, :btree) }.to raise_error(ArgumentError)
+      expect { dbc_file.build_index(:nope) }.to raise_error(ArgumentError)
+    end
+
+    context 'with more fields than fit on the stack' do
+      include_context 'wide dbc'
+
+      it 'keeps the index current across creates and deletes' do
+        wide_dbc.build_index(:id, :sorted)
+        wide_dbc.update_record(wide_dbc.create_record, :id, 7)
+        wide_dbc.update_record(wide_dbc.create_record, :id, 3)
+        wide_dbc.delete_record(0)
+
+        expect(wide_dbc.find_by(:id, 3).map { |record| record[:id] }).to eq([3])
+        expect(wide_dbc.find_by(:id, 7)).to be_empty
+      end
+    end
+  end
+
+  describe '#find_range' do
+    it 'returns records in key order' do
+      dbc_file.build_index(:group_sound_index, :sorted)
+      result = dbc_file.find_range(:group_sound_index, 10...13)
+      expected = (0...plain_file.header[:record_count]).count { |i| (10...13).cover?(plain_file.get_record(i)[:group_sound_index]) }
+
+      expect(result.size).to eq(expected)
+      expect(result.map { |record| record[:group_sound_index] }).to eq(result.map { |record| record[:group_sound_index] }.sort)
+    end
+
+    it 'supports string fields and open ranges' do
+      dbc_file.build_index(:inventory_icon_1, :sorted)
+      icons = dbc_file.find_range(:inventory_icon_1, 'INV_Boots_01'..'INV_Boots_01')
+
+      expect(icons.size).to eq(plain_file.find_by(:inventory_icon_1, 'INV_Boots_01').size)
+      expect(dbc_file.find_range(:inventory_icon_1, nil..nil).size).to eq(dbc_file.header[:record_count])
+    end
+
+    it 'requires a sorted index' do
+      expect { dbc_file.find_range(:id, 1..10) }.to raise_error(ArgumentError)
+    end
+  end
+
+  describe '#drop_index' do
+    it 'removes indexes on a field' do
+      dbc_file.build_index(:id)
+      dbc_file.build_index(:id, :sorted)
+      dbc_file.drop_index(:id, :hash)
+      expect(dbc_file.indexes).to eq([%i[id sorted]])
+      dbc_file.drop_index(:id)
+      expect(dbc_file.indexes).to be_empty
+    end
+  end
+end
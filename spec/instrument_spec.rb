@@ -0,0 +1,83 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+  let(:new_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_instrument.dbc') }
+
+  before(:each) do
+    dbc_file.read
+    WowDBC.reset_stats
+  end
+
+  after(:each) do
+    WowDBC.instrument = false
+    WowDBC.reset_stats
+    File.delete(new_file) if File.exist?(new_file)
+  end
+
+  describe '.stats' do
+    it 'records nothing while instrumentation is off' do
+      dbc_file.get_record(0)
+      dbc_file.find_by(:id, 1)
+
+      expect(WowDBC.instrument?).to be false
+      expect(WowDBC.stats).to eq({})
+    end
+
+    it 'counts and times each method' do
+      WowDBC.instrument = true
+      3.times { |i| dbc_file.get_record(i) }
+      dbc_file.update_record(0, :flags, 1)
+
+      stats = WowDBC.stats
+      expect(stats.keys).to match_array(%i[get_record update_record])
+      expect(stats[:get_record][:count]).to eq(3)
+      expect(stats[:get_record][:total_ns]).to be >= stats[:get_record][:max_ns]
+      expect(stats[:get_record][:avg_ns]).to eq(stats[:get_record][:total_ns] / 3)
+      expect(stats[:get_record][:rows_returned]).to eq(3)
+      expect(stats[:get_record][:allocated_objects]).to be > 0
+    end
+
+    it 'reports bytes read and written' do
+      WowDBC.instrument = true
+      dbc_file.read
+      dbc_file.write_to(new_file)
+
+      size = File.size(test_file)
+      expect(WowDBC.stats[:read][:bytes_read]).to eq(size)
+      expect(WowDBC.stats[:write_to][:bytes_written]).to eq(size)
+    end
+
+    it 'tells rows scanned from rows returned' do
+      id = dbc_file.get_record(10)[:id]
+      WowDBC.instrument = true
+      dbc_file.find_by(:id, id)
+      scan = WowDBC.stats[:find_by]
+      WowDBC.reset_stats
+      dbc_file.build_index(:id)
+      dbc_file.find_by(:id, id)
+      indexed = WowDBC.stats[:find_by]
+
+      expect(scan[:rows_scanned]).to eq(dbc_file.header[:record_count])
+      expect(scan[:rows_returned]).to eq(1)
+      expect(indexed[:rows_scanned]).to eq(1)
+      expect(indexed[:rows_returned]).to eq(1)
+    end
+
+    it 'counts failed calls and calls on concurrent tables' do
+      dbc_file.concurrent!
+      WowDBC.instrument = true
+      expect { dbc_file.get_record(-1) }.to raise_error(ArgumentError)
+      dbc_file.transaction { |dbc| dbc.update_record(0, :flags, 2) }
+
+      stats = WowDBC.stats
+      expect(stats[:get_record][:count]).to eq(1)
+      expect(stats[:transaction][:count]).to eq(1)
+      expect(stats[:update_record][:count]).to eq(1)
+      expect(dbc_file.get_record(0)[:flags]).to eq(2)
+    end
+  end
+end
@@ -0,0 +1,66 @@
+# frozen_string_literal: true
+
+require 'json'
+require 'stringio'
+
+RSpec.describe WowDBC::DBCFile do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  describe '#each_json_line' do
+    it 'writes one JSON object per record' do
+      io = StringIO.new
+      dbc_file.each_json_line(io)
+      lines = io.string.lines
+
+      expect(lines.size).to eq(dbc_file.header[:record_count])
+      [0, 1, lines.size - 1].each do |index|
+        expect(JSON.parse(lines[index], symbolize_names: true)).to eq(dbc_file.get_record(index))
+      end
+    end
+
+    it 'selects and orders fields' do
+      io = StringIO.new
+      dbc_file.each_json_line(io, fields: %i[inventory_icon_1 id])
+      record = dbc_file.get_record(0)
+
+      expect(io.string.lines.first).to eq(%({"inventory_icon_1":"#{record[:inventory_icon_1]}","id":#{record[:id]}}\n))
+    end
+
+    it 'escapes strings and replaces invalid UTF-8' do
+      dbc_file.update_record(0, :model_name_1, "a\"b\\c\n\u0001\u00e9\xff".b)
+      io = StringIO.new
+      dbc_file.each_json_line(io, fields: [:model_name_1])
+
+      expect(JSON.parse(io.string.lines.first)['model_name_1']).to eq("a\"b\\c\n\u0001\u00e9\ufffd")
+    end
+
+    it 'writes null for non-finite floats' do
+      dbc_file.update_record(0, :particle_color_id, Float::NAN)
+      io = StringIO.new
+      dbc_file.each_json_line(io, fields: [:particle_color_id])
+
+      expect(io.string.lines.first).to eq(%({"particle_color_id":null}\n))
+    end
+
+    it 'raises an error for unknown fields' do
+      expect { dbc_file.each_json_line(StringIO.new, fields: [:nope]) }.to raise_error(ArgumentError)
+    end
+
+    context 'with more fields than fit on the stack' do
+      include_context 'wide dbc'
+
+      it 'writes nothing for an empty table' do
+        io = StringIO.new
+        wide_dbc.each_json_line(io)
+        expect(io.string).to be_empty
+      end
+    end
+  end
+end
@@ -0,0 +1,69 @@
+# frozen_string_literal: true
+
+require 'objspace'
+
+RSpec.describe WowDBC do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  let(:components) do
+    %i[structure records rows string_block indexes undo_log change_log cow_flags snapshot_share arena]
+  end
+
+  describe '#memory_report' do
+    it 'adds up to the size reported to ObjectSpace' do
+      report = dbc_file.memory_report
+      count = dbc_file.header[:record_count]
+
+      expect(report[:total]).to eq(report.values_at(*components).sum)
+      expect(ObjectSpace.memsize_of(dbc_file)).to be >= report[:total]
+      expect(report[:arena]).to be >= count * (25 * 8 + 8) + dbc_file.header[:string_block_size]
+      expect(report.values_at(:records, :rows, :string_block)).to eq([0, 0, 0])
+      expect(report[:strings_garbage]).to eq(0)
+    end
+
+    it 'reports replaced strings as garbage and the indexes and logs it holds' do
+      dbc_file.update_record(0, :model_name_1, 'a' * 99)
+      dbc_file.update_record(0, :model_name_1, 'b')
+      dbc_file.build_index(:id)
+      dbc_file.track_changes(1024)
+
+      report = dbc_file.memory_report
+      expect(report[:strings_garbage]).to be >= 100
+      expect(report[:strings_spare]).to be > 0
+      expect(report[:indexes]).to be >= dbc_file.header[:record_count] * 4
+      expect(report[:change_log]).to be >= 1024 * 12
+      dbc_file.transaction do |dbc|
+        dbc.delete_record(0)
+        expect(dbc.memory_report[:undo_log]).to be > 0
+      end
+    end
+
+    it 'counts memory shared with snapshots once' do
+      before = dbc_file.memory_report[:total]
+      snapshot = dbc_file.snapshot
+      dbc_file.update_record(0, :flags, 1)
+
+      live = dbc_file.memory_report
+      view = snapshot.memory_report
+      expect(live[:shared_rows]).to eq(dbc_file.header[:record_count] - 1)
+      expect(view[:rows]).to eq(0)
+      expect(live[:snapshot_share]).to eq(view[:snapshot_share])
+      expect(live[:total] + view[:total]).to be_between(before, before * 1.1)
+    end
+
+    context 'with more fields than fit on the stack' do
+      include_context 'wide dbc'
+
+      it 'reports the string block' do
+        expect(wide_dbc.memory_report[:strings_garbage]).to eq(1)
+      end
+    end
+  end
+end
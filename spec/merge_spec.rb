@@ -0,0 +1,100 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:ours_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_ours.dbc') }
+  let(:theirs_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_theirs.dbc') }
+  let(:merged_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_merged.dbc') }
+  let(:ours) { WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read) }
+  let(:theirs) { WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read) }
+
+  after(:each) do
+    [ours_file, theirs_file, merged_file].each { |file| File.delete(file) if File.exist?(file) }
+  end
+
+  def merge3(**options)
+    ours.write_to(ours_file)
+    theirs.write_to(theirs_file)
+    WowDBC.merge3(test_file, ours_file, theirs_file, fields: field_definitions, **options)
+  end
+
+  describe '.merge3' do
+    it 'takes each field from the side that changed it' do
+      ours.update_record(3, :flags, 77)
+      theirs.update_record(3, :model_name_1, 'Theirs')
+      theirs.update_record(8, :item_visual, -5)
+
+      result = merge3
+      table = result[:table]
+
+      expect(result[:conflicts]).to be_empty
+      expect(table.get_record(3)).to eq(ours.get_record(3).merge(model_name_1: 'Theirs'))
+      expect(table.get_record(8)).to eq(theirs.get_record(8))
+      expect(table.header[:record_count]).to eq(ours.header[:record_count])
+    end
+
+    it 'merges inserts and deletes from both sides' do
+      ours_removed = ours.get_record(20)[:id]
+      theirs_removed = theirs.get_record(30)[:id]
+      ours.delete_record(20)
+      theirs.delete_record(30)
+      ours.create_record_with_values(id: 9_000_001, model_name_1: 'Ours')
+      theirs.create_record_with_values(id: 9_000_002, model_name_1: 'Theirs')
+      theirs.create_record_with_values(id: 9_000_001, model_name_1: 'Ours')
+
+      result = merge3
+      ids = (0...result[:table].header[:record_count]).map { |i| result[:table].get_record(i)[:id] }
+
+      expect(result[:conflicts]).to be_empty
+      expect(ids).not_to include(ours_removed, theirs_removed)
+      expect(ids.last(2)).to eq([9_000_001, 9_000_002])
+      expect(ids.count(9_000_001)).to eq(1)
+      expect(ids.size).to eq(ours.header[:record_count])
+    end
+
+    it 'reports conflicting fields and keeps ours' do
+      id = ours.get_record(5)[:id]
+      base = ours.get_record(5)[:flags]
+      ours.update_record(5, :flags, 1)
+      theirs.update_record(5, :flags, 2)
+      ours.update_record(6, :flags, 3)
+      theirs.update_record(6, :flags, 3)
+
+      result = merge3
+
+      expect(result[:conflicts]).to eq([{ key: id, field: :flags, base: base, ours: 1, theirs: 2 }])
+      expect(result[:table].get_record(5)[:flags]).to eq(1)
+      expect(result[:table].get_record(6)[:flags]).to eq(3)
+    end
+
+    it 'reports records deleted on one side and changed on the other' do
+      changed_by_ours = ours.get_record(10)[:id]
+      changed_by_theirs = ours.get_record(11)[:id]
+      ours.update_record(10, :flags, 1)
+      theirs.delete_record(10)
+      ours.delete_record(11)
+      theirs.update_record(10, :flags, 2)
+
+      conflicts = merge3[:conflicts]
+
+      expect(conflicts).to eq(
+        [{ key: changed_by_ours, field: nil, reason: :deleted_in_theirs },
+         { key: changed_by_theirs, field: nil, reason: :deleted_in_ours }]
+      )
+    end
+
+    it 'writes the merged table to output' do
+      ours.update_record(0, :model_name_1, 'Ours')
+      theirs.update_record(1, :model_name_1, 'Theirs')
+
+      result = merge3(output: merged_file)
+      merged = WowDBC::DBCFile.new(merged_file, field_definitions).tap(&:read)
+
+      expect(merged.get_record(0)[:model_name_1]).to eq('Ours')
+      expect(merged.get_record(1)[:model_name_1]).to eq('Theirs')
+      expect(merged.header[:record_count]).to eq(result[:table].header[:record_count])
+    end
+  end
+end
@@ -0,0 +1,205 @@
+# frozen_string_literal: true
+
+require 'stringio'
+
+RSpec.describe WowDBC::DBCFile do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'Item.dbc') }
+  let(:parquet_file) { File.join(File.dirname(__FILE__), 'resources', 'Item_test.parquet') }
+  let(:plain_file) { File.join(File.dirname(__FILE__), 'resources', 'Item_plain.parquet') }
+  let(:field_definitions) do
+    {
+      id: :uint32,
+      class: :uint32,
+      subclass: :uint32,
+      sound_override_subclass: :int32,
+      material: :uint32,
+      displayid: :uint32,
+      inventory_type: :uint32,
+      sheath_type: :uint32
+    }
+  end
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  after(:each) do
+    File.delete(parquet_file) if File.exist?(parquet_file)
+    File.delete(plain_file) if File.exist?(plain_file)
+  end
+
+  # Reads the Thrift compact struct at the start of +io+ as { field id => value }
+  def thrift_struct(io)
+    fields = {}
+    last = 0
+    loop do
+      byte = io.readbyte
+      return fields if byte.zero?
+
+      last = (byte >> 4).zero? ? zigzag(varint(io)) : last + (byte >> 4)
+      fields[last] = thrift_value(io, byte & 0x0F)
+    end
+  end
+
+  def thrift_value(io, type)
+    case type
+    when 1 then true
+    when 2 then false
+    when 3 then io.readbyte
+    when 4, 5, 6 then zigzag(varint(io))
+    when 8 then io.read(varint(io))
+    when 9
+      header = io.readbyte
+      size = header >> 4 == 15 ? varint(io) : header >> 4
+      Array.new(size) { thrift_value(io, header & 0x0F) }
+    when 12 then thrift_struct(io)
+    else raise "Unexpected Thrift type #{type}"
+    end
+  end
+
+  def varint(io)
+    value = shift = 0
+    loop do
+      byte = io.readbyte
+      value |= (byte & 0x7F) << shift
+      return value if byte < 0x80
+
+      shift += 7
+    end
+  end
+
+  def zigzag(value)
+    (value >> 1) ^ -(value & 1)
+  end
+
+  # PLAIN values of a physical type: INT32 is read unsigned, like DBC words
+  def plain_values(io, type, count)
+    case type
+    when 1 then io.read(count * 4).unpack('V*')
+    when 4 then io.read(count * 4).unpack('e*')
+    when 6 then Array.new(count) { io.read(io.read(4).unpack1('V')).force_encoding('UTF-8') }
+    end
+  end
+
+  # RLE/bit-packed hybrid dictionary indices
+  def hybrid_values(io, bit_width, count)
+    values = []
+    while values.size < count
+      header = varint(io)
+      if header.odd?
+        bits = io.read((header >> 1) * bit_width).unpack1('b*')
+        values.concat(bits.scan(/.{#{bit_width}}/).map { |value| value.reverse.to_i(2) })
+      else
+        value = io.read((bit_width + 7) / 8).ljust(4, "\0").unpack1('V')
+        values.concat([value] * (header >> 1))
+      end
+    end
+    values.first(count)
+  end
+
+  # Decodes every column chunk of +path+ into { name => [encodings, values] }
+  def read_parquet(path)
+    content = File.binread(path)
+    length = content[-8, 4].unpack1('V')
+    metadata = thrift_struct(StringIO.new(content[-8 - length, length]))
+    io = StringIO.new(content)
+
+    metadata[4].each_with_object({}) do |row_group, columns|
+      row_group[1].each do |chunk|
+        meta = chunk[3]
+        dictionary = nil
+        if meta[11]
+          io.seek(meta[11])
+          header = thrift_struct(io)
+          dictionary = plain_values(io, meta[1], header[7][1])
+        end
+
+        io.seek(meta[9])
+        count = thrift_struct(io)[5][1]
+        values = if dictionary
+                   hybrid_values(io, io.readbyte, count).map { |k| dictionary[k] }
+                 else
+                   plain_values(io, meta[1], count)
+                 end
+        column = columns[meta[3].first.to_sym] ||= [meta[2], []]
+        column[1].concat(values)
+      end
+    end
+  end
+
+  describe '#to_parquet' do
+    it 'writes a Parquet file' do
+      dbc_file.to_parquet(parquet_file)
+      content = File.binread(parquet_file)
+      expect(content[0, 4]).to eq('PAR1')
+      expect(content[-4, 4]).to eq('PAR1')
+
+      metadata_length = content[-8, 4].unpack1('V')
+      expect(metadata_length).to be < content.bytesize
+      expect(content[-8 - metadata_length, metadata_length]).to include('inventory_type')
+    end
+
+    it 'dictionary encodes low-cardinality columns' do
+      dbc_file.to_parquet(parquet_file)
+      dbc_file.to_parquet(plain_file, encodings: field_definitions.keys.to_h { |field| [field, :plain] })
+      expect(File.size(parquet_file)).to be < File.size(plain_file)
+    end
+
+    it 'round-trips plain and dictionary encoded columns' do
+      dbc_file.to_parquet(parquet_file, encodings: { sheath_type: :plain })
+      columns = read_parquet(parquet_file)
+
+      expect(columns.keys).to eq(field_definitions.keys)
+      expect(columns[:id][0]).to eq([0])
+      expect(columns[:sheath_type][0]).to eq([0])
+      expect(columns[:inventory_type][0]).to eq([2, 3])
+      records = (0...dbc_file.header[:record_count]).map { |index| dbc_file.get_record(index) }
+      %i[id sheath_type inventory_type material].each do |field|
+        expect(columns[field][1]).to eq(records.map { |record| record[field] })
+      end
+      signed = records.map { |record| record[:sound_override_subclass] & 0xFFFFFFFF }
+      expect(columns[:sound_override_subclass][1]).to eq(signed)
+    end
+
+    it 'round-trips string columns' do
+      definitions = {
+        id: :uint32, model_name_1: :string, model_name_2: :string, model_texture_1: :string,
+        model_texture_2: :string, inventory_icon_1: :string
+      }
+      path = File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc')
+      dbc = WowDBC::DBCFile.new(path, definitions).tap(&:read)
+      dbc.to_parquet(parquet_file, encodings: { model_name_2: :plain })
+      columns = read_parquet(parquet_file)
+
+      expect(columns[:model_name_1][0]).to eq([2, 3])
+      expect(columns[:model_name_2][0]).to eq([0])
+      records = (0...dbc.header[:record_count]).map { |index| dbc.get_record(index) }
+      %i[model_name_1 model_name_2 inventory_icon_1].each do |field|
+        expect(columns[field][1]).to eq(records.map { |record| record[field] })
+      end
+    end
+
+    it 'raises an error for an invalid encoding' do
+      expect { dbc_file.to_parquet(parquet_file, encodings: { id: :zstd }) }.to raise_error(ArgumentError)
+    end
+
+    it 'raises an error for an invalid field name' do
+      expect { dbc_file.to_parquet(parquet_file, encodings: { invalid_field: :plain }) }.to raise_error(ArgumentError)
+    end
+
+    it 'raises an error when the path is invalid' do
+      expect { dbc_file.to_parquet('/invalid/path/file.parquet') }.to raise_error(IOError)
+    end
+
+    context 'with more fields than fit on the stack' do
+      include_context 'wide dbc'
+
+      it 'writes a Parquet file' do
+        wide_dbc.to_parquet(parquet_file)
+        expect(File.binread(parquet_file, 4)).to eq('PAR1')
+      end
+    end
+  end
+end
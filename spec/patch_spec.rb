@@ -0,0 +1,100 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+  let(:new_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_patch.dbc') }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  after(:each) do
+    File.delete(new_file) if File.exist?(new_file)
+  end
+
+  def patched(patch)
+    WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read).apply_patch!(patch)
+  end
+
+  describe '.make_patch' do
+    it 'produces a patch much smaller than the file' do
+      dbc_file.update_record(3, :flags, 77)
+      dbc_file.write_to(new_file)
+
+      expect(WowDBC.make_patch(test_file, new_file, fields: field_definitions).bytesize).to be < 100
+    end
+  end
+
+  describe '#apply_patch!' do
+    it 'reproduces the records of the new file' do
+      dbc_file.update_record(3, :flags, 77)
+      dbc_file.update_record(10, :model_name_1, 'Changed')
+      dbc_file.update_record(11, :model_name_2, dbc_file.get_record(12)[:model_name_1])
+      dbc_file.delete_record(20)
+      dbc_file.create_record_with_values(id: 9_999_999, model_name_1: 'New', particle_color_id: 1.5)
+      dbc_file.write_to(new_file)
+
+      result = patched(WowDBC.make_patch(test_file, new_file, fields: field_definitions))
+
+      expect(result.header[:record_count]).to eq(dbc_file.header[:record_count])
+      [3, 10, 11, 19, 20, dbc_file.header[:record_count] - 1].each do |index|
+        expect(result.get_record(index)).to eq(dbc_file.get_record(index))
+      end
+    end
+
+    it 'applies patches that reorder records' do
+      first = dbc_file.get_record(0)
+      dbc_file.delete_record(0)
+      dbc_file.create_record_with_values(first)
+      dbc_file.write_to(new_file)
+
+      result = patched(WowDBC.make_patch(test_file, new_file, fields: field_definitions))
+      last = dbc_file.header[:record_count] - 1
+      expect(result.get_record(0)).to eq(dbc_file.get_record(0))
+      expect(result.get_record(last)).to eq(first)
+    end
+
+    it 'refuses patches made for other data' do
+      dbc_file.update_record(3, :flags, 77)
+      dbc_file.write_to(new_file)
+      patch = WowDBC.make_patch(test_file, new_file, fields: field_definitions)
+
+      expect { dbc_file.apply_patch!(patch) }.to raise_error(ArgumentError, /does not apply/)
+    end
+
+    it 'refuses patches made for other column types' do
+      dbc_file.update_record(3, :flags, 77)
+      dbc_file.write_to(new_file)
+      patch = WowDBC.make_patch(test_file, new_file, fields: field_definitions.merge(particle_color_id: :uint32))
+
+      expect { patched(patch) }.to raise_error(ArgumentError, /column types/)
+    end
+
+    it 'leaves the table untouched when the patch is malformed' do
+      dbc_file.update_record(3, :flags, 77)
+      dbc_file.write_to(new_file)
+      patch = WowDBC.make_patch(test_file, new_file, fields: field_definitions)
+      base = WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read)
+
+      expect { base.apply_patch!(patch[0...-2]) }.to raise_error(ArgumentError, /Malformed/)
+      expect(base.content_hash).to eq(WowDBC.file_hash(test_file))
+    end
+
+    context 'with more fields than fit on the stack' do
+      include_context 'wide dbc'
+
+      it 'round-trips a patch' do
+        wide_dbc.update_record(wide_dbc.create_record, :id, 7)
+        wide_dbc.write_to(new_file)
+        fields = Array.new(2_500_000) { |j| [j, :uint32] }.to_h
+        patch = WowDBC.make_patch(wide_file, new_file, fields: fields)
+        base = WowDBC::DBCFile.new(wide_file, { id: :uint32 }).tap(&:read)
+
+        expect(base.apply_patch!(patch).get_record(0)[:id]).to eq(7)
+      end
+    end
+  end
+end
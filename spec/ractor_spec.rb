@@ -0,0 +1,94 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    @experimental = Warning[:experimental]
+    Warning[:experimental] = false
+    dbc_file.read
+  end
+
+  after(:each) do
+    Warning[:experimental] = @experimental
+  end
+
+  describe '#freeze' do
+    it 'makes the table immutable' do
+      dbc_file.build_index(:id)
+      dbc_file.freeze
+
+      expect(dbc_file).to be_frozen
+      expect { dbc_file.update_record(0, :flags, 1) }.to raise_error(FrozenError)
+      expect { dbc_file.create_record }.to raise_error(FrozenError)
+      expect { dbc_file.build_index(:flags) }.to raise_error(FrozenError)
+      expect { dbc_file.drop_index(:id) }.to raise_error(FrozenError)
+      expect { dbc_file.transaction { nil } }.to raise_error(FrozenError)
+      expect { dbc_file.read }.to raise_error(FrozenError)
+      expect(dbc_file.snapshot).to equal(dbc_file)
+      expect(dbc_file.find_by(:id, dbc_file.get_record(3)[:id])).to eq([dbc_file.get_record(3)])
+    end
+
+    it 'freezes a copy of the field definitions' do
+      definitions = dbc_file.instance_variable_get(:@field_definitions)
+      dbc_file.freeze
+
+      expect(definitions.frozen?).to be false
+      expect(dbc_file.instance_variable_get(:@field_definitions).frozen?).to be true
+      expect(dbc_file.instance_variable_get(:@field_definitions)).to eq(definitions)
+    end
+
+    it 'leaves concurrent mode' do
+      dbc_file.concurrent!.freeze
+
+      expect(dbc_file.concurrent?).to be false
+      expect(Ractor.shareable?(dbc_file.make_shareable)).to be true
+    end
+  end
+
+  describe '#make_shareable' do
+    it 'lets several Ractors read the table without copying it' do
+      dbc_file.build_index(:id)
+      dbc_file.build_index(:flags, :sorted)
+      dbc_file.update_record(5, :model_name_1, 'Shared')
+      ids = (0...8).map { |i| dbc_file.get_record(i * 1000)[:id] }
+      expected = ids.map { |id| dbc_file.find_by(:id, id) }
+      range = dbc_file.find_range(:flags, 1..4).size
+      hash = dbc_file.content_hash
+
+      expect(dbc_file.make_shareable).to equal(dbc_file)
+      expect(Ractor.shareable?(dbc_file)).to be true
+
+      ractors = Array.new(4) do
+        Ractor.new(dbc_file, ids) do |dbc, keys|
+          [keys.map { |id| dbc.find_by(:id, id) }, dbc.find_range(:flags, 1..4).size,
+           dbc.get_record(5)[:model_name_1], dbc.content_hash, dbc.indexes]
+        end
+      end
+
+      ractors.map(&:take).each do |found, found_range, name, found_hash, indexes|
+        expect(found).to eq(expected)
+        expect(found_range).to eq(range)
+        expect(name).to eq('Shared')
+        expect(found_hash).to eq(hash)
+        expect(indexes).to eq([%i[id hash], %i[flags sorted]])
+      end
+    end
+
+    it 'shares snapshots while the live table keeps changing' do
+      snapshot = dbc_file.snapshot.make_shareable
+      name = snapshot.get_record(0)[:model_name_1]
+      reader = Ractor.new(snapshot) { |view| Array.new(50) { view.get_record(0)[:model_name_1] }.uniq }
+
+      dbc_file.update_record(0, :model_name_1, 'Changed')
+      expect(reader.take).to eq([name])
+      expect(dbc_file).not_to be_frozen
+      expect(dbc_file.get_record(0)[:model_name_1]).to eq('Changed')
+    end
+  end
+end
@@ -0,0 +1,70 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC::Schema do
+  let(:item_file) { File.join(File.dirname(__FILE__), 'resources', 'Item.dbc') }
+  let(:display_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  let(:locstring_file) { File.join(File.dirname(__FILE__), 'resources', 'Locstring_test.dbc') }
+
+  after(:each) do
+    File.delete(locstring_file) if File.exist?(locstring_file)
+  end
+
+  # id, name (16 locales + flags), scale
+  def write_locstring_dbc(path)
+    strings = "\0Sword\0Shield\0"
+    rows = [
+      [1, 1, *Array.new(15, 0), 0xFF01FE, [1.5].pack('e').unpack1('V')],
+      [2, 7, *Array.new(15, 0), 0xFF01FE, [0.25].pack('e').unpack1('V')]
+    ]
+    header = ['WDBC', rows.size, 19, 19 * 4, strings.bytesize].pack('a4V4')
+    File.binwrite(path, header + rows.flatten.pack('V*') + strings)
+  end
+
+  describe '.infer' do
+    it 'returns one field per column' do
+      definitions = described_class.infer(item_file)
+      expect(definitions.size).to eq(WowDBC::DBCFile.new(item_file, {}).read.header[:field_count])
+    end
+
+    it 'classifies integer columns' do
+      definitions = described_class.infer(item_file)
+      expect(definitions[:field_0]).to eq(:uint32)
+      expect(definitions[:field_3]).to eq(:int32)
+    end
+
+    it 'classifies string columns' do
+      definitions = described_class.infer(display_file)
+      expect(definitions[:field_1]).to eq(:string)
+      expect(definitions[:field_5]).to eq(:string)
+      expect(definitions[:field_0]).to eq(:uint32)
+      expect(definitions[:field_10]).to eq(:uint32)
+    end
+
+    it 'produces definitions that read the same records as hand-written ones' do
+      definitions = described_class.infer(display_file)
+      dbc_file = WowDBC::DBCFile.new(display_file, definitions)
+      dbc_file.read
+      expect(dbc_file.get_record(0)[:field_1]).to be_a(String)
+    end
+
+    it 'detects float columns and locstring groups' do
+      write_locstring_dbc(locstring_file)
+      definitions = described_class.infer(locstring_file)
+
+      expect(definitions[:field_0]).to eq(:uint32)
+      expect(definitions[:field_1_en_us]).to eq(:string)
+      expect(definitions[:field_1_ru_ru]).to eq(:string)
+      expect(definitions[:field_1_flags]).to eq(:uint32)
+      expect(definitions[:field_18]).to eq(:float)
+
+      dbc_file = WowDBC::DBCFile.new(locstring_file, definitions)
+      dbc_file.read
+      expect(dbc_file.get_record(1)[:field_1_en_us]).to eq('Shield')
+      expect(dbc_file.get_record(0)[:field_18]).to eq(1.5)
+    end
+
+    it 'raises an error for a missing file' do
+      expect { described_class.infer('/invalid/path/file.dbc') }.to raise_error(IOError)
+    end
+  end
+end
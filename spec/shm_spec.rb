@@ -0,0 +1,110 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  let(:name) { "wow_dbc_spec_#{Process.pid}" }
+
+  after(:each) do
+    WowDBC::DBCFile.drop_shared(name)
+  end
+
+  describe '.open_shared' do
+    it 'publishes the table on first use and attaches to it afterwards' do
+      published = WowDBC::DBCFile.open_shared(test_file, field_definitions, name: name) { |dbc| dbc.build_index(:id) }
+      built = false
+      attached = WowDBC::DBCFile.open_shared(test_file, field_definitions, name: name) { built = true }
+      private_copy = WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read)
+
+      expect(built).to be false
+      expect(attached.header).to eq(private_copy.header)
+      expect(attached.content_hash).to eq(private_copy.content_hash)
+      expect(published.content_hash).to eq(private_copy.content_hash)
+      expect(attached.indexes).to eq([%i[id hash]])
+      expect(attached.find_by(:id, private_copy.get_record(9)[:id])).to eq([private_copy.get_record(9)])
+      expect(attached.shared_name).to eq(name)
+    end
+
+    it 'lets other processes attach without reading the file' do
+      WowDBC::DBCFile.open_shared(test_file, field_definitions, name: name) { |dbc| dbc.build_index(:id) }
+      expected = WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read).get_record(42)
+
+      reader, writer = IO.pipe
+      pid = fork do
+        reader.close
+        dbc = WowDBC::DBCFile.open_shared(test_file, field_definitions, name: name) { raise 'published again' }
+        writer.write(Marshal.dump([dbc.get_record(42), dbc.find_by(:id, expected[:id])]))
+        writer.close
+        exit!(0)
+      end
+      writer.close
+      record, found = Marshal.load(reader.read)
+      Process.wait(pid)
+
+      expect(record).to eq(expected)
+      expect(found).to eq([expected])
+    end
+
+    it 'keeps edits private to the table that makes them' do
+      first = WowDBC::DBCFile.open_shared(test_file, field_definitions, name: name)
+      second = WowDBC::DBCFile.open_shared(test_file, field_definitions, name: name)
+      original = second.get_record(0)
+
+      first.update_record(0, :model_name_1, 'Private')
+      first.delete_record(1)
+      first.create_record_with_values(id: 9_999_999)
+
+      expect(first.get_record(0)[:model_name_1]).to eq('Private')
+      expect(second.get_record(0)).to eq(original)
+      expect(WowDBC::DBCFile.open_shared(test_file, field_definitions, name: name).get_record(0)).to eq(original)
+    end
+
+    it 'names tables after their content and schema by default' do
+      dbc = WowDBC::DBCFile.open_shared(test_file, field_definitions)
+      other = WowDBC::DBCFile.open_shared(test_file, field_definitions.merge(flags: :int32))
+
+      expect(dbc.shared_name).to start_with('wow_dbc-')
+      expect(other.shared_name).not_to eq(dbc.shared_name)
+      expect(WowDBC::DBCFile.drop_shared(dbc.shared_name)).to be true
+      expect(WowDBC::DBCFile.drop_shared(dbc.shared_name)).to be false
+      expect(WowDBC::DBCFile.drop_shared(other.shared_name)).to be true
+    end
+
+    it 'refuses a table published with other field types' do
+      WowDBC::DBCFile.open_shared(test_file, field_definitions, name: name)
+
+      expect do
+        WowDBC::DBCFile.open_shared(test_file, field_definitions.merge(flags: :float), name: name)
+      end.to raise_error(ArgumentError, /different field types/)
+      expect { WowDBC::DBCFile.open_shared(test_file, field_definitions, name: 'a/b') }.to raise_error(ArgumentError)
+    end
+
+    it 'refuses a table whose rows disagree with its field types' do
+      WowDBC::DBCFile.open_shared(test_file, field_definitions, name: name)
+      File.open("/dev/shm/#{name}", 'r+b') do |segment|
+        segment.seek(56)
+        records_offset = segment.read(8).unpack1('Q<')
+        segment.seek(records_offset)
+        segment.write([3].pack('L<'))
+      end
+
+      expect do
+        WowDBC::DBCFile.open_shared(test_file, field_definitions, name: name)
+      end.to raise_error(IOError, /Malformed/)
+    end
+
+    context 'with more fields than fit on the stack' do
+      include_context 'wide dbc'
+
+      it 'publishes the table and attaches to it' do
+        wide_dbc
+        WowDBC::DBCFile.open_shared(wide_file, { id: :uint32 }, name: name)
+
+        expect(WowDBC::DBCFile.open_shared(wide_file, { id: :uint32 }, name: name).header).to eq(wide_dbc.header)
+      end
+    end
+  end
+end
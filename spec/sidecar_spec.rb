@@ -0,0 +1,126 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC::DBCFile do
+  let(:source_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_sidecar.dbc') }
+  let(:sidecar_file) { "#{test_file}.idx" }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    FileUtils.cp(source_file, test_file)
+    dbc_file.read
+  end
+
+  after(:each) do
+    [test_file, sidecar_file].each { |file| File.delete(file) if File.exist?(file) }
+  end
+
+  def reopen
+    WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read)
+  end
+
+  describe '#load_indexes' do
+    before(:each) do
+      dbc_file.build_index(:id, :direct)
+      dbc_file.build_index(:inventory_icon_1)
+      dbc_file.build_index(:group_sound_index, :sorted)
+    end
+
+    it 'returns false without a sidecar' do
+      expect(reopen.load_indexes).to be(false)
+    end
+
+    it 'restores direct, hash and sorted indexes' do
+      dbc_file.save_indexes
+      loaded = reopen
+      id = dbc_file.get_record(500)[:id]
+      icon = dbc_file.get_record(20)[:inventory_icon_1]
+
+      expect(loaded.load_indexes).to be(true)
+      expect(loaded.indexes).to eq(dbc_file.indexes)
+      expect(loaded.find_by(:id, id)).to eq(dbc_file.find_by(:id, id))
+      expect(loaded.find_by(:inventory_icon_1, icon)).to eq(dbc_file.find_by(:inventory_icon_1, icon))
+      expect(loaded.find_range(:group_sound_index, 3..9)).to eq(dbc_file.find_range(:group_sound_index, 3..9))
+    end
+
+    it 'keeps using the sidecar when only the mtime changes' do
+      dbc_file.save_indexes
+      File.utime(Time.now + 60, Time.now + 60, test_file)
+
+      expect(reopen.load_indexes).to be(true)
+      expect(reopen.find_by(:id, dbc_file.get_record(7)[:id])).to eq([dbc_file.get_record(7)])
+    end
+
+    it 'rebuilds the indexes when the DBC changed' do
+      dbc_file.save_indexes
+      dbc_file.update_record(0, :id, 999_999)
+      dbc_file.write
+      loaded = reopen
+
+      expect(loaded.load_indexes).to be(true)
+      expect(loaded.indexes).to eq(dbc_file.indexes)
+      expect(loaded.find_by(:id, 999_999).size).to eq(1)
+      expect(reopen.tap(&:load_indexes).find_by(:id, 999_999).size).to eq(1)
+    end
+
+    it 'keeps the mapped indexes when an unindexed field changes' do
+      dbc_file.save_indexes
+      loaded = reopen.tap(&:load_indexes)
+      mapped = loaded.memory_report[:indexes_mapped]
+      loaded.update_record(0, :flags, 7)
+
+      expect(loaded.find_by(:id, dbc_file.get_record(0)[:id]).first[:flags]).to eq(7)
+      expect(loaded.memory_report[:indexes_mapped]).to eq(mapped)
+      expect(mapped).to be > 0
+    end
+
+    it 'ignores a damaged sidecar' do
+      File.binwrite(sidecar_file, 'not an index sidecar')
+      expect(reopen.load_indexes).to be(false)
+    end
+
+    it 'ignores a sidecar whose metadata nests too deeply' do
+      dbc_file.save_indexes
+      sidecar = File.binread(sidecar_file)
+      offset, size = sidecar[16, 16].unpack('Q<Q<')
+      metadata = sidecar[offset, size]
+      nested = "\xA1x".b + ("\x91".b * 1_000_000) + "\xC0".b
+      metadata = (metadata.getbyte(0) + 1).chr + nested + metadata[1..]
+      File.binwrite(sidecar_file, sidecar[0, 16] + [sidecar.bytesize, metadata.bytesize].pack('Q<Q<') +
+                                  sidecar[32..] + metadata)
+
+      expect(reopen.load_indexes).to be(false)
+    end
+  end
+
+  describe '#save_indexes' do
+    it 'refuses to key unsaved changes to the DBC' do
+      dbc_file.update_record(0, :id, 999_999)
+      expect { dbc_file.save_indexes }.to raise_error(IOError)
+    end
+
+    it 'writes to the given path' do
+      path = "#{test_file}.custom"
+      dbc_file.build_index(:id, :direct).save_indexes(path)
+
+      expect(reopen.load_indexes(path)).to be(true)
+    ensure
+      File.delete(path) if File.exist?(path)
+    end
+
+    context 'with more fields than fit on the stack' do
+      include_context 'wide dbc'
+
+      it 'round-trips the sidecar' do
+        path = "#{wide_file}.idx"
+        wide_dbc.build_index(:id, :sorted).save_indexes(path)
+
+        expect(WowDBC::DBCFile.new(wide_file, { id: :uint32 }).tap(&:read).load_indexes(path)).to be(true)
+      ensure
+        File.delete(path) if path && File.exist?(path)
+      end
+    end
+  end
+end
@@ -0,0 +1,102 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC::DBCFile do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  let(:snapshot_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_test.snapshot') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  after(:each) do
+    File.delete(snapshot_file) if File.exist?(snapshot_file)
+  end
+
+  describe '#dump_snapshot' do
+    context 'with more fields than fit on the stack' do
+      include_context 'wide dbc'
+
+      it 'writes a snapshot' do
+        wide_dbc.dump_snapshot(snapshot_file)
+        expect(WowDBC::DBCFile.load_snapshot(snapshot_file).header).to eq(wide_dbc.header)
+      end
+    end
+  end
+
+  describe '.load_snapshot' do
+    it 'restores every record and the schema' do
+      dbc_file.update_record(0, :model_name_1, 'Snapshot')
+      dbc_file.dump_snapshot(snapshot_file)
+      loaded = WowDBC::DBCFile.load_snapshot(snapshot_file)
+
+      expect(loaded.header[:record_count]).to eq(dbc_file.header[:record_count])
+      expect(loaded.instance_variable_get(:@field_definitions)).to eq(field_definitions)
+      (0...dbc_file.header[:record_count]).step(89) do |index|
+        expect(loaded.get_record(index)).to eq(dbc_file.get_record(index))
+      end
+    end
+
+    it 'restores indexes ready for lookups' do
+      dbc_file.build_index(:id, :direct)
+      dbc_file.build_index(:group_sound_index, :sorted)
+      dbc_file.dump_snapshot(snapshot_file)
+      loaded = WowDBC::DBCFile.load_snapshot(snapshot_file)
+      id = dbc_file.get_record(500)[:id]
+
+      expect(loaded.indexes).to eq(dbc_file.indexes)
+      expect(loaded.find_by(:id, id)).to eq(dbc_file.find_by(:id, id))
+      expect(loaded.find_range(:group_sound_index, 7..7).size).to eq(dbc_file.find_range(:group_sound_index, 7..7).size)
+    end
+
+    it 'uses the records in place and copies them on write' do
+      dbc_file.dump_snapshot(snapshot_file)
+      file_hash = WowDBC.file_hash(snapshot_file)
+      loaded = WowDBC::DBCFile.load_snapshot(snapshot_file)
+
+      expect(loaded.memory_report[:shared_rows]).to eq(dbc_file.header[:record_count])
+      loaded.update_record(0, :model_name_1, 'Edited')
+      loaded.delete_record(1)
+      expect(loaded.get_record(0)[:model_name_1]).to eq('Edited')
+      expect(loaded.get_record(1)).to eq(dbc_file.get_record(2))
+      expect(WowDBC.file_hash(snapshot_file)).to eq(file_hash)
+      expect(WowDBC::DBCFile.load_snapshot(snapshot_file).get_record(0)).to eq(dbc_file.get_record(0))
+    end
+
+    it 'keeps its mapped indexes through a rolled back transaction' do
+      dbc_file.build_index(:id, :direct).dump_snapshot(snapshot_file)
+      loaded = WowDBC::DBCFile.load_snapshot(snapshot_file)
+      id = dbc_file.get_record(7)[:id]
+
+      expect do
+        loaded.transaction do |dbc|
+          dbc.update_record(7, :flags, 1)
+          raise 'undo'
+        end
+      end.to raise_error(RuntimeError)
+      expect(loaded.find_by(:id, id)).to eq([dbc_file.get_record(7)])
+      expect(loaded.memory_report[:indexes_mapped]).to be_positive
+    end
+
+    it 'interns duplicate strings' do
+      3.times { |index| dbc_file.update_record(index, :model_name_1, 'Duplicate') }
+      dbc_file.dump_snapshot(snapshot_file)
+      loaded = WowDBC::DBCFile.load_snapshot(snapshot_file)
+
+      expect(loaded.header[:string_block_size]).to be < dbc_file.header[:string_block_size]
+      expect(loaded.get_record(2)[:model_name_1]).to eq('Duplicate')
+    end
+
+    it 'raises an error for files that are not snapshots' do
+      expect { WowDBC::DBCFile.load_snapshot(test_file) }.to raise_error(IOError)
+    end
+
+    it 'raises an error for truncated snapshots' do
+      dbc_file.dump_snapshot(snapshot_file)
+      File.binwrite(snapshot_file, File.binread(snapshot_file, 4096))
+      expect { WowDBC::DBCFile.load_snapshot(snapshot_file) }.to raise_error(IOError)
+    end
+  end
+end
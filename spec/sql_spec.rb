@@ -0,0 +1,66 @@
+# frozen_string_literal: true
+
+require 'stringio'
+
+RSpec.describe WowDBC::DBCFile do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  describe '#to_sql' do
+    it 'writes multi-row INSERT statements in batches' do
+      io = StringIO.new
+      dbc_file.to_sql(io, table: 'item_display_info_dbc', batch_rows: 1000)
+      statements = io.string.split(";\n")
+
+      expect(statements.size).to eq((dbc_file.header[:record_count] + 999) / 1000)
+      expect(statements.first).to start_with('INSERT INTO `item_display_info_dbc` (`id`,`model_name_1`,')
+      expect(statements.first).to include("VALUES\n(#{dbc_file.get_record(0)[:id]},")
+    end
+
+    it 'escapes strings for MySQL' do
+      dbc_file.update_record(0, :model_name_1, "it's a \\ \"test\"\n")
+      io = StringIO.new
+      dbc_file.to_sql(io, table: 'items', batch_rows: 1)
+
+      expect(io.string.lines[1]).to include(%q('it\'s a \\\\ \"test\"\n'))
+    end
+
+    it 'requires a table name' do
+      expect { dbc_file.to_sql(StringIO.new) }.to raise_error(ArgumentError)
+    end
+
+    it 'raises an error for a non-positive batch size' do
+      expect { dbc_file.to_sql(StringIO.new, table: 'items', batch_rows: 0) }.to raise_error(ArgumentError)
+    end
+  end
+
+  describe '#to_tsv' do
+    it 'writes one tab separated line per record' do
+      dbc_file.update_record(0, :model_name_1, "a\tb")
+      io = StringIO.new
+      dbc_file.to_tsv(io)
+      lines = io.string.lines
+
+      expect(lines.size).to eq(dbc_file.header[:record_count])
+      expect(lines[0].chomp.split("\t").size).to eq(field_definitions.size)
+      expect(lines[0]).to include("\ta\\tb\t")
+    end
+
+    context 'with more fields than fit on the stack' do
+      include_context 'wide dbc'
+
+      it 'writes nothing for an empty table' do
+        io = StringIO.new
+        wide_dbc.to_sql(io, table: 'wide')
+        wide_dbc.to_tsv(io)
+        expect(io.string).to be_empty
+      end
+    end
+  end
+end
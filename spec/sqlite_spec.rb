@@ -0,0 +1,47 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC::DBCFile do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  let(:sqlite_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_test.sqlite3') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  after(:each) do
+    File.delete(sqlite_file) if File.exist?(sqlite_file)
+  end
+
+  describe '#to_sqlite' do
+    it 'writes an SQLite database' do
+      dbc_file.to_sqlite(sqlite_file, table: 'item_display_info', indexes: [:id])
+      expect(File.binread(sqlite_file, 16)).to eq("SQLite format 3\0")
+    end
+
+    it 'replaces the table when exporting again' do
+      dbc_file.to_sqlite(sqlite_file, table: 'item_display_info')
+      size = File.size(sqlite_file)
+      dbc_file.to_sqlite(sqlite_file, table: 'item_display_info')
+      expect(File.size(sqlite_file)).to be_within(size / 10).of(size)
+    end
+
+    it 'raises an error for unknown index fields' do
+      expect { dbc_file.to_sqlite(sqlite_file, table: 'item_display_info', indexes: [:nope]) }.to raise_error(ArgumentError)
+    end
+
+    it 'raises an error when the path is invalid' do
+      expect { dbc_file.to_sqlite('/invalid/path/file.sqlite3', table: 'item_display_info') }.to raise_error(IOError)
+    end
+
+    context 'with more fields than fit on the stack' do
+      include_context 'wide dbc'
+
+      it 'fails on the column limit instead of the stack' do
+        expect { wide_dbc.to_sqlite(sqlite_file, table: 'wide') }.to raise_error(IOError)
+      end
+    end
+  end
+end
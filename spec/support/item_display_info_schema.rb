@@ -0,0 +1,34 @@
+# frozen_string_literal: true
+
+# The ItemDisplayInfo.dbc layout most specs read, as `field_definitions`.
+RSpec.shared_context 'item display info schema' do
+  let(:field_definitions) do
+    {
+      id: :uint32,
+      model_name_1: :string,
+      model_name_2: :string,
+      model_texture_1: :string,
+      model_texture_2: :string,
+      inventory_icon_1: :string,
+      inventory_icon_2: :string,
+      geoset_group_1: :uint32,
+      geoset_group_2: :uint32,
+      geoset_group_3: :uint32,
+      flags: :uint32,
+      spell_visual_id: :uint32,
+      group_sound_index: :uint32,
+      helmet_geoset_vis_id_1: :uint32,
+      helmet_geoset_vis_id_2: :uint32,
+      texture_1: :string,
+      texture_2: :string,
+      texture_3: :string,
+      texture_4: :string,
+      texture_5: :string,
+      texture_6: :string,
+      texture_7: :string,
+      texture_8: :string,
+      item_visual: :int32,
+      particle_color_id: :float
+    }
+  end
+end
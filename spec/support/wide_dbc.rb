@@ -0,0 +1,17 @@
+# frozen_string_literal: true
+
+require 'tmpdir'
+
+# An empty DBC whose header declares 2.5 million fields, as `wide_dbc`. Column
+# scratch sized by the field count does not fit on the C stack.
+RSpec.shared_context 'wide dbc' do
+  let(:wide_file) { File.join(Dir.tmpdir, "wow_dbc_wide_#{Process.pid}.dbc") }
+  let(:wide_dbc) do
+    File.binwrite(wide_file, ['WDBC', 0, 2_500_000, 10_000_000, 1].pack('a4V4') + "\0")
+    WowDBC::DBCFile.new(wide_file, { id: :uint32 }).tap(&:read)
+  end
+
+  after(:each) do
+    File.delete(wide_file) if File.exist?(wide_file)
+  end
+end
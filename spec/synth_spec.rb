@@ -0,0 +1,101 @@
+# frozen_string_literal: true
+
+require 'fileutils'
+require 'tmpdir'
+
+RSpec.describe WowDBC::Synth do
+  let(:schema) do
+    { id: :uint32, model_name: :string, texture: :string, flags: :uint32, visual: :int32, scale: :float }
+  end
+  let(:dir) { Dir.mktmpdir('wow_dbc_synth') }
+  let(:path) { File.join(dir, 'Synth.dbc') }
+
+  after(:each) do
+    FileUtils.rm_rf(dir)
+  end
+
+  def strings(dbc, field)
+    (0...dbc.header[:record_count]).map { |i| dbc.get_record(i)[field] }
+  end
+
+  describe '.generate' do
+    it 'writes a table DBCFile can read' do
+      header = described_class.generate(path, rows: 1000, schema: schema)
+      dbc = WowDBC::DBCFile.new(path, schema).tap(&:read)
+
+      expect(header).to eq(dbc.header)
+      expect(header[:record_count]).to eq(1000)
+      expect(header[:record_size]).to eq(24)
+      ids = strings(dbc, :id)
+      expect(ids).to eq(ids.sort)
+      expect(ids.uniq.size).to eq(1000)
+      expect(File.size(path)).to eq(20 + 1000 * 24 + header[:string_block_size])
+    end
+
+    it 'writes the same file for the same arguments' do
+      described_class.generate(path, rows: 500, schema: schema, seed: 7)
+      first = WowDBC.file_hash(path)
+      described_class.generate(path, rows: 500, schema: schema, seed: 7)
+      same = WowDBC.file_hash(path)
+      described_class.generate(path, rows: 500, schema: schema, seed: 8)
+
+      expect(same).to eq(first)
+      expect(WowDBC.file_hash(path)).not_to eq(first)
+    end
+
+    it 'follows the string and duplicate ratios' do
+      described_class.generate(path, rows: 2000, schema: schema, string_ratio: 0.0)
+      empty = WowDBC::DBCFile.new(path, schema).tap(&:read)
+      expect(strings(empty, :model_name).uniq).to eq([''])
+
+      described_class.generate(path, rows: 2000, schema: schema, string_ratio: 1.0, dup_ratio: 0.0)
+      unique = strings(WowDBC::DBCFile.new(path, schema).tap(&:read), :model_name)
+      expect(unique.uniq.size).to eq(2000)
+
+      described_class.generate(path, rows: 2000, schema: schema, string_ratio: 1.0, dup_ratio: 0.9)
+      repeated = strings(WowDBC::DBCFile.new(path, schema).tap(&:read), :model_name)
+      expect(repeated.uniq.size).to be < 1000
+    end
+
+    it 'stops and removes the partial file when the thread is killed' do
+      thread = Thread.new { described_class.generate(path, rows: 500_000_000, schema: schema) }
+      sleep 0.01 until File.exist?(path)
+      thread.kill
+
+      expect(thread.join(5)).to equal(thread)
+      expect(File.exist?(path)).to be false
+    end
+
+    it 'removes the partial file when a write fails' do
+      reader, writer = IO.pipe
+      pid = fork do
+        reader.close
+        Signal.trap('XFSZ', 'IGNORE')
+        Process.setrlimit(:FSIZE, 1 << 20)
+        error = begin
+          described_class.generate(path, rows: 1_000_000, schema: schema)
+          nil
+        rescue IOError => e
+          e.message
+        end
+        writer.write(Marshal.dump([error, File.exist?(path)]))
+        writer.close
+        exit!(0)
+      end
+      writer.close
+      error, exists = Marshal.load(reader.read)
+      Process.wait(pid)
+
+      expect(error).to start_with('Failed to write')
+      expect(exists).to be false
+    end
+
+    it 'validates its arguments' do
+      expect { described_class.generate(path, rows: 10) }.to raise_error(ArgumentError)
+      expect { described_class.generate(path, rows: -1, schema: schema) }.to raise_error(ArgumentError)
+      expect { described_class.generate(path, rows: 10, schema: schema, dup_ratio: 2) }.to raise_error(ArgumentError)
+      expect { described_class.generate(File.join(dir, 'missing', 'x.dbc'), rows: 1, schema: schema) }
+        .to raise_error(IOError)
+    end
+  end
+end
@@ -0,0 +1,154 @@
+# frozen_string_literal: true
+
+RSpec.describe WowDBC do
+  let(:test_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo.dbc') }
+  include_context 'item display info schema'
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+
+  let(:dbc_file) { WowDBC::DBCFile.new(test_file, field_definitions) }
+  let(:new_file) { File.join(File.dirname(__FILE__), 'resources', 'ItemDisplayInfo_transaction.dbc') }
+
+  before(:each) do
+    dbc_file.read
+  end
+
+  after(:each) do
+    File.delete(new_file) if File.exist?(new_file)
+  end
+
+  def edit(dbc)
+    dbc.update_record(0, :flags, 77)
+    dbc.update_record(1, :model_name_1, 'Changed')
+    dbc.update_record_multi(2, { geoset_group_1: 5, item_visual: -3 })
+    dbc.delete_record(3)
+    dbc.create_record_with_values(id: 9_999_999, model_name_1: 'New')
+    dbc.delete_record(10)
+    dbc.create_record
+  end
+
+  describe '#transaction' do
+    it 'keeps the changes and returns the block value when the block succeeds' do
+      result = dbc_file.transaction do |dbc|
+        edit(dbc)
+        :done
+      end
+
+      expect(result).to eq(:done)
+      expect(dbc_file.get_record(0)[:flags]).to eq(77)
+      expect(dbc_file.find_by(:id, 9_999_999).size).to eq(1)
+    end
+
+    it 'undoes updates, inserts, deletes and string appends when the block raises' do
+      header = dbc_file.header
+      hash = dbc_file.content_hash
+
+      expect do
+        dbc_file.transaction do |dbc|
+          edit(dbc)
+          raise 'failed halfway'
+        end
+      end.to raise_error(RuntimeError, 'failed halfway')
+
+      expect(dbc_file.header).to eq(header)
+      expect(dbc_file.content_hash).to eq(hash)
+    end
+
+    it 'rolls back a field update that fails partway' do
+      record = dbc_file.get_record(2)
+
+      expect do
+        dbc_file.transaction { |dbc| dbc.update_record_multi(2, { flags: 1, unknown: 2 }) }
+      end.to raise_error(ArgumentError)
+
+      expect(dbc_file.get_record(2)).to eq(record)
+    end
+
+    it 'rebuilds indexes built inside a rolled back transaction' do
+      dbc_file.build_index(:id)
+      id = dbc_file.get_record(5)[:id]
+
+      expect do
+        dbc_file.transaction do |dbc|
+          dbc.update_record(5, :id, 9_999_998)
+          expect(dbc.find_by(:id, 9_999_998).size).to eq(1)
+          raise ArgumentError
+        end
+      end.to raise_error(ArgumentError)
+
+      expect(dbc_file.find_by(:id, 9_999_998)).to be_empty
+      expect(dbc_file.find_by(:id, id).size).to eq(1)
+    end
+
+    it 'keeps indexes in step through a rollback rather than rebuilding them' do
+      dbc_file.build_index(:id, :direct)
+      dbc_file.build_index(:inventory_icon_1)
+      dbc_file.build_index(:group_sound_index, :sorted)
+      fresh = WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read).build_index(:group_sound_index, :sorted)
+      ids = [3, 5, 10, 399, 400, 401].map { |index| fresh.get_record(index)[:id] }
+      icon = fresh.get_record(0)[:inventory_icon_1]
+      group = fresh.get_record(10)[:group_sound_index]
+      lookups = lambda do |dbc|
+        [ids.map { |id| dbc.find_by(:id, id) }, dbc.find_by(:inventory_icon_1, icon),
+         dbc.find_range(:group_sound_index, group..group)]
+      end
+      expect do
+        dbc_file.transaction do |dbc|
+          dbc.update_record(3, :id, 9_999_998)
+          dbc.update_record(10, :group_sound_index, group + 1)
+          dbc.delete_record(5)
+          dbc.delete_record(399)
+          dbc.create_record_with_values(id: 9_999_997, inventory_icon_1: icon, group_sound_index: group)
+          dbc.update_record(0, :inventory_icon_1, 'Rolled back')
+          expect(dbc.find_by(:id, 9_999_997).size).to eq(1)
+          raise 'undo'
+        end
+      end.to raise_error(RuntimeError)
+
+      expect(dbc_file.find_by(:id, 9_999_997)).to be_empty
+      expect(dbc_file.find_by(:id, 9_999_998)).to be_empty
+      expect(lookups.call(dbc_file)).to eq(lookups.call(fresh))
+    end
+
+    it 'rolls back nested transactions on their own' do
+      dbc_file.transaction do |dbc|
+        dbc.update_record(0, :flags, 1)
+        begin
+          dbc.transaction do
+            dbc.update_record(0, :flags, 2)
+            dbc.delete_record(0)
+            raise 'inner'
+          end
+        rescue RuntimeError
+          nil
+        end
+        expect(dbc.get_record(0)[:flags]).to eq(1)
+      end
+
+      expect(dbc_file.get_record(0)[:flags]).to eq(1)
+    end
+
+    it 'undoes a patch applied inside the transaction' do
+      target = WowDBC::DBCFile.new(test_file, field_definitions).tap(&:read)
+      edit(target)
+      target.write_to(new_file)
+      patch = WowDBC.make_patch(test_file, new_file, fields: field_definitions)
+      hash = dbc_file.content_hash
+
+      expect do
+        dbc_file.transaction do |dbc|
+          dbc.apply_patch!(patch)
+          dbc.update_record(4, :flags, 2)
+          dbc.delete_record(6)
+          raise 'undo'
+        end
+      end.to raise_error(RuntimeError)
+
+      expect(dbc_file.content_hash).to eq(hash)
+    end
+
+    it 'does not allow read inside a transaction' do
+      expect { dbc_file.transaction(&:read) }.to raise_error(RuntimeError, /inside a transaction/)
+    end
+  end
+end